@@ -0,0 +1,444 @@
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "i265e.h"
+#include "h265bs_mem.h"
+#include "h265bs_ingest.h"
+#include "h265bs_nal.h"
+#include "h265bs_hash.h"
+#include "h265bs_tmodel.h"
+#include "h265bs_trace.h"
+#include "i265e_extern_bs.h"
+
+/* Benchmark harness, every result is one json object per line on stdout so
+ * runs of different versions can be diffed or loaded by a script */
+
+#define H265BS_BENCH_AU_CNT         3000
+#define H265BS_BENCH_SCAN_USEC      1000000
+
+typedef struct {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+} h265bs_bench_counter_t;
+
+static const h265bs_bench_counter_t h265bs_bench_counter[] = {
+    { "cycles",             PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions",       PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "branch_misses",      PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { "cache_misses",       PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { "dtlb_misses",        PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                                    | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    /* node misses are the loads served by another numa node */
+    { "node_loads",         PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_NODE | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                                    | (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16) },
+    { "node_load_misses",   PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_NODE | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                                    | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { "context_switches",   PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+    { "task_clock_ns",      PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+};
+
+#define H265BS_BENCH_COUNTER_NUM    ((int)(sizeof(h265bs_bench_counter) / sizeof(h265bs_bench_counter[0])))
+
+/* Counters of one bench stage, inherited by the threads it starts. A counter
+ * the kernel or the container does not give stays at fd -1 and is left out */
+typedef struct {
+    int fd[H265BS_BENCH_COUNTER_NUM];
+    uint64_t value[H265BS_BENCH_COUNTER_NUM];
+} h265bs_bench_perf_t;
+
+typedef struct {
+    char *tag;
+    char *bsname;
+    int auCnt;
+    int bScan;
+    int bReplay;
+    char *socName;          /* timing model of the replay, NULL for none */
+    char *traceName;        /* chrome trace json of the replay, NULL for none */
+    int bPerf;              /* perf_event_open counters per stage */
+    int remoteNode;         /* scan again with the buffer on this node, H265BS_MEM_NODE_ANY for none */
+} h265bs_bench_cfg_t;
+
+static int h265bs_bench_cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static long h265bs_bench_maxrss_kb(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+/* All counters reset and running, whatever can not be opened is skipped */
+static void h265bs_bench_perf_start(h265bs_bench_cfg_t *bench, h265bs_bench_perf_t *perf)
+{
+    struct perf_event_attr attr;
+    int i = 0;
+
+    for (i = 0; i < H265BS_BENCH_COUNTER_NUM; i++) {
+        perf->fd[i] = -1;
+        perf->value[i] = 0;
+        if (!bench->bPerf) {
+            continue;
+        }
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = h265bs_bench_counter[i].type;
+        attr.config = h265bs_bench_counter[i].config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        perf->fd[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (perf->fd[i] < 0 && (errno == EACCES || errno == EPERM)) {
+            /* perf_event_paranoid 2 still gives the user space part */
+            attr.exclude_kernel = attr.exclude_hv = 1;
+            perf->fd[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+    }
+    for (i = 0; i < H265BS_BENCH_COUNTER_NUM; i++) {
+        if (perf->fd[i] >= 0) {
+            ioctl(perf->fd[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(perf->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+/* Counts of a counter which shared the pmu with others are scaled up to the
+ * whole time it was enabled. Threads started meanwhile add theirs once joined */
+static void h265bs_bench_perf_stop(h265bs_bench_perf_t *perf)
+{
+    uint64_t buf[3];
+    int i = 0;
+
+    for (i = 0; i < H265BS_BENCH_COUNTER_NUM; i++) {
+        if (perf->fd[i] >= 0) {
+            ioctl(perf->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    for (i = 0; i < H265BS_BENCH_COUNTER_NUM; i++) {
+        if (perf->fd[i] < 0) {
+            continue;
+        }
+        if (read(perf->fd[i], buf, sizeof(buf)) != sizeof(buf) || buf[2] == 0) {
+            close(perf->fd[i]);
+            perf->fd[i] = -1;
+            continue;
+        }
+        perf->value[i] = buf[2] < buf[1] ? (uint64_t)((double)buf[0] * buf[1] / buf[2]) : buf[0];
+        close(perf->fd[i]);
+    }
+}
+
+/* ,"perf":{...} closing a result line, every counter in total, per MB and per
+ * unit, an access unit or a nal for the scan. null when no counter opened */
+static void h265bs_bench_perf_print(h265bs_bench_cfg_t *bench, h265bs_bench_perf_t *perf, int64_t bytes,
+        const char *unit, int64_t units)
+{
+    const char *sep = "";
+    int i = 0;
+
+    if (!bench->bPerf) {
+        return;
+    }
+    printf(",\"perf\":");
+    for (i = 0; i < H265BS_BENCH_COUNTER_NUM; i++) {
+        if (perf->fd[i] < 0) {
+            continue;
+        }
+        printf("%s\"%s\":{\"total\":%llu,\"per_mb\":%.3f,\"per_%s\":%.3f}", *sep ? sep : "{",
+                h265bs_bench_counter[i].name, (unsigned long long)perf->value[i],
+                bytes ? perf->value[i] * 1000000.0 / bytes : 0.0, unit, units ? (double)perf->value[i] / units : 0.0);
+        sep = ",";
+    }
+    printf("%s", *sep ? "}" : "null");
+}
+
+/* Start code scan over the whole file in memory on node, repeated for about
+ * a second */
+static int h265bs_bench_scan(h265bs_bench_cfg_t *bench, i265e_extern_bs_cfg_t *cfg, int node, double *gbps)
+{
+    struct stat stat_buf;
+    uint8_t *buf = NULL, *p = NULL, *end = NULL;
+    int64_t start = 0, elapsed = 0, bytes = 0, nalCnt = 0;
+    int fd = -1, loops = 0, n = 0, off = 0;
+    h265bs_bench_perf_t perf;
+
+    fd = open(bench->bsname, O_RDONLY);
+    if (fd < 0 || fstat(fd, &stat_buf) < 0 || stat_buf.st_size == 0) {
+        printf("h265bs_bench:open %s failed:%s\n", bench->bsname, strerror(errno));
+        goto err_open_bsname;
+    }
+
+    buf = h265bs_mem_alloc(stat_buf.st_size, C_VB_ALIGN, cfg->memFlags, node);
+    if (buf == NULL) {
+        goto err_alloc_buf;
+    }
+    while (off < stat_buf.st_size) {
+        n = read(fd, buf + off, stat_buf.st_size - off);
+        if (n <= 0) {
+            printf("h265bs_bench:read %s failed:%s\n", bench->bsname, strerror(errno));
+            goto err_read;
+        }
+        off += n;
+    }
+    end = buf + stat_buf.st_size;
+
+    h265bs_bench_perf_start(bench, &perf);
+    start = i265e_extern_bs_mdate();
+    do {
+        for (p = buf; (p = h265bs_nal_find_start_code(p, end)) != NULL; p += 3) {
+            nalCnt++;
+        }
+        bytes += stat_buf.st_size;
+        loops++;
+        elapsed = i265e_extern_bs_mdate() - start;
+    } while (elapsed < H265BS_BENCH_SCAN_USEC);
+    h265bs_bench_perf_stop(&perf);
+    *gbps = (double)bytes / elapsed / 1000.0;
+
+    printf("{\"bench\":\"scan\",\"tag\":\"%s\",\"bytes\":%lld,\"loops\":%d,\"nals\":%lld,\"usec\":%lld,\"gbps\":%.3f,\"hugepage\":%d,\"numa\":%d",
+            bench->tag, (long long)bytes, loops, (long long)(nalCnt / loops), (long long)elapsed,
+            *gbps, !!(cfg->memFlags & H265BS_MEM_F_HUGEPAGE), node);
+    h265bs_bench_perf_print(bench, &perf, bytes, "nal", nalCnt);
+    printf("}\n");
+
+    h265bs_mem_free(buf);
+    close(fd);
+    return 0;
+
+err_read:
+    h265bs_mem_free(buf);
+err_alloc_buf:
+err_open_bsname:
+    if (fd >= 0) close(fd);
+    return -1;
+}
+
+/* auCnt access units through the get_bitstream/release_bitstream cycle with
+ * a consumer which does nothing, so the engine is the bottleneck */
+static int h265bs_bench_replay(h265bs_bench_cfg_t *bench, i265e_param_t *param, i265e_extern_bs_cfg_t *cfg)
+{
+    i265e_extern_bs_t *h = NULL;
+    pthread_t tid;
+    i265e_nal_t *p_nal = NULL;
+    i265e_pic_t *pic_out = NULL;
+    void *bshandler = NULL;
+    int64_t *latency = NULL;
+    int64_t start = 0, elapsed = 0, bytes = 0;
+    int i_nal = 0, j = 0, auCnt = 0, errnum = 0;
+    h265bs_tmodel_stat_t tmStat;
+    h265bs_bench_perf_t perf;
+
+    latency = malloc(bench->auCnt * sizeof(int64_t));
+    if (latency == NULL) {
+        printf("h265bs_bench:malloc latency failed\n");
+        goto err_malloc_latency;
+    }
+
+    memset(&tmStat, 0, sizeof(tmStat));
+    if (bench->traceName && h265bs_trace_init(0) < 0) {
+        goto err_trace_init;
+    }
+    h265bs_trace_thread_name("consumer");
+    if (bench->socName) {
+        cfg->tmodel = h265bs_tmodel_init(h265bs_tmodel_soc_profile(param->socType), 1);
+        if (cfg->tmodel == NULL) {
+            goto err_tmodel_init;
+        }
+    }
+
+    h = i265e_extern_bs_init(param, cfg, bench->bsname, NULL);
+    if (h == NULL) {
+        goto err_i265e_extern_bs_init;
+    }
+
+    h265bs_bench_perf_start(bench, &perf);
+    start = i265e_extern_bs_mdate();
+    if ((errnum = pthread_create(&tid, NULL, i265e_extern_bs_enc_thread, h)) != 0) {
+        printf("h265bs_bench:pthread_create failed:%s\n", strerror(errnum));
+        goto err_pthread_create;
+    }
+
+    for (auCnt = 0; auCnt < bench->auCnt; auCnt++) {
+        if (i265e_extern_bs_get_bitstream(h, &p_nal, &i_nal, &pic_out, &bshandler) < 0) {
+            break;
+        }
+        latency[auCnt] = i265e_extern_bs_mdate() - ((i265e_extern_au_t *)bshandler)->readyTime;
+        for (j = 0; j < i_nal; j++) {
+            bytes += p_nal[j].i_payload;
+        }
+        i265e_extern_bs_release_bitstream(h, bshandler);
+    }
+    elapsed = i265e_extern_bs_mdate() - start;
+
+    i265e_extern_bs_stop(h);
+    pthread_join(tid, NULL);
+    i265e_extern_bs_deinit(h);
+    h265bs_bench_perf_stop(&perf);
+    if (cfg->tmodel) {
+        h265bs_tmodel_get_stat(cfg->tmodel, &tmStat);
+        h265bs_tmodel_deinit(cfg->tmodel);
+        cfg->tmodel = NULL;
+    }
+    if (bench->traceName) {
+        h265bs_trace_dump(bench->traceName);
+        h265bs_trace_deinit();
+    }
+
+    if (auCnt == 0 || elapsed == 0) {
+        printf("h265bs_bench:no access unit replayed\n");
+        goto err_no_au;
+    }
+    qsort(latency, auCnt, sizeof(int64_t), h265bs_bench_cmp_i64);
+
+    printf("{\"bench\":\"replay\",\"tag\":\"%s\",\"ingest\":\"%s\",\"hash\":\"%s\",\"tmodel\":\"%s\",\"cbr_kbps\":%d,\"wakeups\":%llu,\"trace\":%d,\"hugepage\":%d,\"numa\":%d,\"nalbufs\":%d,"
+            "\"aus\":%d,\"bytes\":%lld,\"usec\":%lld,\"fps\":%.1f,\"mbps\":%.1f,"
+            "\"lat_p50_us\":%lld,\"lat_p90_us\":%lld,\"lat_p99_us\":%lld,\"lat_max_us\":%lld,\"maxrss_kb\":%ld",
+            bench->tag, h265bs_ingest_mode_name(cfg->ingestMode), h265bs_hash_name(cfg->hashType),
+            bench->socName ? bench->socName : "none", param->rc.bitrate, (unsigned long long)tmStat.wakeupCnt, !!bench->traceName, !!(cfg->memFlags & H265BS_MEM_F_HUGEPAGE), cfg->numaNode,
+            cfg->nalBufNum, auCnt, (long long)bytes, (long long)elapsed,
+            auCnt * 1000000.0 / elapsed, (double)bytes / elapsed,
+            (long long)latency[auCnt * 50 / 100], (long long)latency[auCnt * 90 / 100],
+            (long long)latency[auCnt * 99 / 100], (long long)latency[auCnt - 1], h265bs_bench_maxrss_kb());
+    h265bs_bench_perf_print(bench, &perf, bytes, "au", auCnt);
+    printf("}\n");
+
+    free(latency);
+    return 0;
+
+err_pthread_create:
+    h265bs_bench_perf_stop(&perf);
+    i265e_extern_bs_deinit(h);
+err_i265e_extern_bs_init:
+    h265bs_tmodel_deinit(cfg->tmodel);
+    cfg->tmodel = NULL;
+err_tmodel_init:
+    h265bs_trace_deinit();
+err_trace_init:
+err_no_au:
+    free(latency);
+err_malloc_latency:
+    return -1;
+}
+
+static void usage(char *name)
+{
+    printf("Usage:%s [-t tag] [-a auCnt] [-S|-R] [-b bsBufSize] [-n nalBufNum] [-H] [-N node] [-I mode] [-q depth] [-r readSize] [-C hash] [-M soc] [-f fps] [-B kbps[,vbvKbits]] [-E trace.json] [-p] [-D node] bsname\n", name);
+    printf("\t-t tag       : free text copied into every result line\n");
+    printf("\t-a auCnt     : access units through get/release, default %d\n", H265BS_BENCH_AU_CNT);
+    printf("\t-S           : start code scan only\n");
+    printf("\t-R           : replay only\n");
+    printf("\t-p           : perf_event_open counters of each stage, per MB and per access unit\n");
+    printf("\t-D node      : with -N, scan again with the buffer on node and the thread still on -N, the delta goes to a numa line\n");
+    printf("\tthe other options are the ones of h265bs_parse_stream\n");
+}
+
+int main(int argc, char *argv[])
+{
+    h265bs_bench_cfg_t bench;
+    i265e_param_t param;
+    i265e_extern_bs_cfg_t cfg;
+    double localGbps = 0, remoteGbps = 0;
+    int opt = 0, ret = 0;
+
+    memset(&bench, 0, sizeof(bench));
+    memset(&param, 0, sizeof(param));
+    memset(&cfg, 0, sizeof(cfg));
+    bench.tag = "";
+    bench.auCnt = H265BS_BENCH_AU_CNT;
+    bench.bScan = bench.bReplay = 1;
+    bench.remoteNode = H265BS_MEM_NODE_ANY;
+    param.logLevel = C_LOG_WARNING;
+    cfg.bsBufSize = 4 * 1024 * 1024;
+    cfg.nalBufNum = I265E_EXT_NALBUF_NUM;
+    cfg.numaNode = H265BS_MEM_NODE_ANY;
+    cfg.ingestMode = H265BS_INGEST_SYNC;
+    cfg.ingestDepth = H265BS_INGEST_QUEUE_DEPTH;
+    cfg.ingestReadSize = H265BS_INGEST_READ_SIZE;
+    while ((opt = getopt(argc, argv, "t:a:SRb:n:HN:I:q:r:C:M:f:B:E:pD:")) != -1) {
+        switch (opt) {
+        case 't': bench.tag = optarg; break;
+        case 'a': bench.auCnt = atoi(optarg); break;
+        case 'S': bench.bReplay = 0; break;
+        case 'R': bench.bScan = 0; break;
+        case 'p': bench.bPerf = 1; break;
+        case 'D': bench.remoteNode = atoi(optarg); break;
+        case 'b': cfg.bsBufSize = atoi(optarg); break;
+        case 'n': cfg.nalBufNum = atoi(optarg); break;
+        case 'H': cfg.memFlags |= H265BS_MEM_F_HUGEPAGE; break;
+        case 'N': cfg.numaNode = atoi(optarg); break;
+        case 'I':
+            cfg.ingestMode = !strcmp(optarg, "uring") ? H265BS_INGEST_URING
+                : !strcmp(optarg, "thread") ? H265BS_INGEST_THREAD
+                : !strcmp(optarg, "mmap") ? H265BS_INGEST_MMAP : H265BS_INGEST_SYNC;
+            break;
+        case 'q': cfg.ingestDepth = atoi(optarg); break;
+        case 'r': cfg.ingestReadSize = atoi(optarg); break;
+        case 'C': cfg.hashType = C_MAX(h265bs_hash_type(optarg), 0); break;
+        case 'M':
+            bench.socName = optarg;
+            param.socType = h265bs_tmodel_soc_type(optarg);
+            if (param.socType == C_SOC_MAX) {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'E': bench.traceName = optarg; break;
+        case 'f': param.outFpsNum = atoi(optarg); param.outFpsDen = 1; break;
+        case 'B':
+            param.rc.rateControlMode = I265E_RC_CBR;
+            param.rc.bitrate = atoi(optarg);
+            param.rc.vbvBufferSize = strchr(optarg, ',') ? atoi(strchr(optarg, ',') + 1) : 0;
+            break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (argc - optind < 1 || bench.auCnt <= 0
+            || (bench.remoteNode != H265BS_MEM_NODE_ANY && (cfg.numaNode == H265BS_MEM_NODE_ANY || !bench.bScan))) {
+        usage(argv[0]);
+        return -1;
+    }
+    bench.bsname = argv[optind];
+
+    if (bench.remoteNode != H265BS_MEM_NODE_ANY && h265bs_mem_bind_thread(cfg.numaNode) < 0) {
+        return -1;
+    }
+    if (bench.bScan && h265bs_bench_scan(&bench, &cfg, cfg.numaNode, &localGbps) < 0) {
+        ret = -1;
+    }
+    /* same thread, same file, only the node of the buffer differs */
+    if (ret == 0 && bench.remoteNode != H265BS_MEM_NODE_ANY) {
+        if (h265bs_bench_scan(&bench, &cfg, bench.remoteNode, &remoteGbps) < 0) {
+            ret = -1;
+        } else {
+            printf("{\"bench\":\"numa\",\"tag\":\"%s\",\"local\":%d,\"remote\":%d,\"local_gbps\":%.3f,\"remote_gbps\":%.3f,\"delta_pct\":%.1f}\n",
+                    bench.tag, cfg.numaNode, bench.remoteNode, localGbps, remoteGbps,
+                    localGbps > 0 ? (remoteGbps - localGbps) * 100.0 / localGbps : 0.0);
+        }
+    }
+    if (bench.bReplay && h265bs_bench_replay(&bench, &param, &cfg) < 0) {
+        ret = -1;
+    }
+
+    return ret;
+}
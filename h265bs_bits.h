@@ -0,0 +1,77 @@
+#ifndef __H265BS_BITS_H__
+#define __H265BS_BITS_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bit reader over an rbsp, reads past the end give zero bits so a cut nal
+ * shows as pos beyond size * 8 instead of a fault */
+typedef struct {
+    uint8_t *p;
+    int size;           /* bytes */
+    int pos;            /* bits */
+} h265bs_bits_t;
+
+static inline uint32_t h265bs_bits_get(h265bs_bits_t *b, int n)
+{
+    uint32_t v = 0;
+
+    while (n-- > 0) {
+        if (b->pos < b->size * 8) {
+            v = (v << 1) | ((b->p[b->pos >> 3] >> (7 - (b->pos & 7))) & 0x01);
+        } else {
+            v <<= 1;
+        }
+        b->pos++;
+    }
+    return v;
+}
+
+/* At most 30 leading zeros, a longer prefix is corrupt data and reading it
+ * as such still gives a value that is positive as an int */
+static inline uint32_t h265bs_bits_get_ue(h265bs_bits_t *b)
+{
+    int zeros = 0;
+
+    while (h265bs_bits_get(b, 1) == 0 && zeros < 30 && b->pos < b->size * 8) {
+        zeros++;
+    }
+    return (1u << zeros) - 1 + h265bs_bits_get(b, zeros);
+}
+
+static inline int32_t h265bs_bits_get_se(h265bs_bits_t *b)
+{
+    uint32_t v = h265bs_bits_get_ue(b);
+
+    return (v & 0x01) ? (int32_t)((v + 1) >> 1) : -(int32_t)(v >> 1);
+}
+
+static inline int h265bs_bits_over(const h265bs_bits_t *b)
+{
+    return b->pos > b->size * 8;
+}
+
+/* drop the emulation prevention bytes of [src, src + size) */
+static inline int h265bs_bits_unescape(const uint8_t *src, int size, uint8_t *dst, int dstSize)
+{
+    int i = 0, n = 0, zeros = 0;
+
+    for (i = 0; i < size && n < dstSize; i++) {
+        if (zeros >= 2 && src[i] == 0x03) {
+            zeros = 0;
+            continue;
+        }
+        dst[n++] = src[i];
+        zeros = src[i] ? 0 : zeros + 1;
+    }
+    return n;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __H265BS_BITS_H__ */
@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "h265bs_cbr.h"
+
+struct h265bs_cbr {
+    /* levels in bits times fpsNum so a frame interval is a whole number */
+    int64_t fpsNum;
+    int64_t frameIn;                /* bits arriving in one frame interval */
+    int64_t bufSize;
+    int64_t fullness;               /* before the next removal */
+
+    /* one filler nal per slot, as long as a frame interval can ask for, its
+     * stop byte moves with the length it is cut to */
+    int fillerSize;
+    uint8_t **filler;
+    int *fillerStop;
+    int slotNum;
+
+    h265bs_cbr_stat_t stat;
+};
+
+/* 00 00 00 01, FD_NUT on layer 0, then 0xff up to the end */
+static void h265bs_cbr_build(uint8_t *buf, int size, int tidPlus1)
+{
+    buf[0] = buf[1] = buf[2] = 0;
+    buf[3] = 1;
+    buf[4] = I265E_NAL_FILLER_DATA << 1;
+    buf[5] = tidPlus1;
+    memset(buf + 6, 0xff, size - 6);
+}
+
+h265bs_cbr_t *h265bs_cbr_init(const i265e_param_t *param, int slotNum)
+{
+    int64_t bitrate = (int64_t)param->rc.bitrate * 1000;
+    int64_t bufBits = (int64_t)(param->rc.vbvBufferSize ? param->rc.vbvBufferSize : param->rc.bitrate) * 1000;
+    double init = param->rc.vbvBufferInit > 0 ? param->rc.vbvBufferInit : 0.9;
+    int i = 0;
+    h265bs_cbr_t *cbr = NULL;
+
+    if (param->rc.bitrate <= 0 || param->outFpsNum == 0 || param->outFpsDen == 0) {
+        printf("h265bs_cbr:needs rc.bitrate and outFpsNum/outFpsDen\n");
+        goto err_invalid_param;
+    }
+
+    cbr = calloc(1, sizeof(h265bs_cbr_t));
+    if (cbr == NULL) {
+        printf("h265bs_cbr:calloc h265bs_cbr_t failed\n");
+        goto err_calloc_cbr;
+    }
+    cbr->fpsNum = param->outFpsNum;
+    cbr->frameIn = bitrate * param->outFpsDen;
+    cbr->bufSize = bufBits * cbr->fpsNum;
+    if (cbr->bufSize < cbr->frameIn) {
+        printf("h265bs_cbr:vbvBufferSize=%d kbits holds less than one frame interval\n", param->rc.vbvBufferSize);
+        goto err_buf_size;
+    }
+    /* vbvBufferInit below 1 is a fraction of the buffer, kbits otherwise */
+    cbr->fullness = init < 1.0 ? (int64_t)(init * bufBits) * cbr->fpsNum : (int64_t)(init * 1000) * cbr->fpsNum;
+    cbr->fullness = C_MIN(cbr->fullness, cbr->bufSize);
+    cbr->stat.minFullness = INT64_MAX;
+
+    /* the level right after a removal is at most bufSize - frameIn, so the
+     * filler of one access unit never exceeds a frame interval */
+    cbr->fillerSize = C_MAX(H265BS_CBR_FILLER_SIZE_MIN, (int)(cbr->frameIn / cbr->fpsNum / 8) + H265BS_CBR_FILLER_MIN + 1);
+    cbr->slotNum = slotNum;
+    cbr->filler = calloc(slotNum, sizeof(uint8_t *));
+    cbr->fillerStop = calloc(slotNum, sizeof(int));
+    if (cbr->filler == NULL || cbr->fillerStop == NULL) {
+        printf("h265bs_cbr:calloc filler failed\n");
+        goto err_calloc_filler;
+    }
+    for (i = 0; i < slotNum; i++) {
+        cbr->filler[i] = malloc(cbr->fillerSize);
+        if (cbr->filler[i] == NULL) {
+            printf("h265bs_cbr:malloc filler failed\n");
+            goto err_malloc_filler;
+        }
+        h265bs_cbr_build(cbr->filler[i], cbr->fillerSize, 1);
+        cbr->fillerStop[i] = -1;
+    }
+
+    return cbr;
+
+err_malloc_filler:
+    for (i = 0; i < slotNum; i++) {
+        free(cbr->filler[i]);
+    }
+err_calloc_filler:
+    free(cbr->fillerStop);
+    free(cbr->filler);
+err_buf_size:
+    free(cbr);
+err_calloc_cbr:
+err_invalid_param:
+    return NULL;
+}
+
+void h265bs_cbr_deinit(h265bs_cbr_t *cbr)
+{
+    int i = 0;
+
+    if (cbr) {
+        for (i = 0; i < cbr->slotNum; i++) {
+            free(cbr->filler[i]);
+        }
+        free(cbr->fillerStop);
+        free(cbr->filler);
+        free(cbr);
+    }
+}
+
+int h265bs_cbr_pad(h265bs_cbr_t *cbr, int slot, int auBytes, int tidPlus1, i265e_nal_t *nal, int nalMax)
+{
+    int64_t unit = 8 * cbr->fpsNum, excess = 0;
+    int remain = 0, n = 0;
+    uint8_t *filler = cbr->filler[slot];
+
+    cbr->stat.auCnt++;
+    cbr->stat.streamBytes += auBytes;
+
+    /* the decoder waits for an access unit the rate did not bring in time */
+    cbr->fullness -= auBytes * unit;
+    if (cbr->fullness < 0) {
+        cbr->stat.underflowCnt++;
+        cbr->fullness = 0;
+    }
+
+    /* whatever would not fit at the next arrival goes out as filler now */
+    excess = cbr->fullness + cbr->frameIn - cbr->bufSize;
+    if (excess > 0) {
+        remain = C_MIN(C_MAX((excess + unit - 1) / unit, H265BS_CBR_FILLER_MIN), cbr->fillerSize);
+        cbr->stat.paddedCnt++;
+    }
+
+    if (remain > 0 && nalMax > 0) {
+        /* move the stop byte instead of rebuilding the filler */
+        if (cbr->fillerStop[slot] >= 0) {
+            filler[cbr->fillerStop[slot]] = 0xff;
+        }
+        filler[5] = tidPlus1;
+        filler[remain - 1] = 0x80;
+        cbr->fillerStop[slot] = remain - 1;
+        nal->i_type = I265E_NAL_FILLER_DATA;
+        nal->i_payload = remain;
+        nal->p_payload = filler;
+        n = 1;
+        cbr->fullness -= remain * unit;
+        cbr->stat.fillerBytes += remain;
+    } else if (remain > 0) {
+        cbr->stat.nalFullCnt++;
+    }
+    cbr->stat.fillerNalCnt += n;
+    cbr->stat.minFullness = C_MIN(cbr->stat.minFullness, cbr->fullness / cbr->fpsNum);
+    cbr->fullness = C_MIN(cbr->fullness + cbr->frameIn, cbr->bufSize);
+
+    return n;
+}
+
+void h265bs_cbr_get_stat(h265bs_cbr_t *cbr, h265bs_cbr_stat_t *stat)
+{
+    *stat = cbr->stat;
+}
+
+void h265bs_cbr_dump_stat(h265bs_cbr_t *cbr)
+{
+    h265bs_cbr_stat_t *stat = &cbr->stat;
+
+    printf("h265bs_cbr:auCnt=%llu, paddedCnt=%llu, fillerNalCnt=%llu, fillerBytes=%llu, streamBytes=%llu, "
+            "underflowCnt=%llu, nalFullCnt=%llu, minFullness=%lld bits\n",
+            (unsigned long long)stat->auCnt, (unsigned long long)stat->paddedCnt, (unsigned long long)stat->fillerNalCnt,
+            (unsigned long long)stat->fillerBytes, (unsigned long long)stat->streamBytes, (unsigned long long)stat->underflowCnt,
+            (unsigned long long)stat->nalFullCnt, (long long)(stat->auCnt ? stat->minFullness : 0));
+}
@@ -0,0 +1,47 @@
+#ifndef __H265BS_CBR_H__
+#define __H265BS_CBR_H__
+
+#include <stdint.h>
+
+#include "i265e.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* start code, nal header and the rbsp stop byte around the 0xff run */
+#define H265BS_CBR_FILLER_MIN       7
+#define H265BS_CBR_FILLER_SIZE_MIN  4096
+
+typedef struct {
+    uint64_t auCnt;
+    uint64_t paddedCnt;             /* access units which got filler */
+    uint64_t fillerNalCnt;
+    uint64_t fillerBytes;
+    uint64_t streamBytes;           /* source bytes, without the filler */
+    uint64_t underflowCnt;          /* access units the rate could not carry in time */
+    uint64_t nalFullCnt;            /* no room left in nal[] for the filler */
+    int64_t minFullness;            /* bits, lowest vbv level seen right after a removal */
+} h265bs_cbr_stat_t;
+
+typedef struct h265bs_cbr h265bs_cbr_t;
+
+/* Hypothetical decoder buffer of rc.vbvBufferSize kbits, rc.bitrate kbit/s in
+ * and one access unit out every outFpsDen/outFpsNum s. Every access unit is
+ * padded so the buffer never overflows, which makes the output exactly CBR.
+ * Filler nals point into buffers built here, slotNum is the count of access
+ * units in flight at the same time */
+extern h265bs_cbr_t *h265bs_cbr_init(const i265e_param_t *param, int slotNum);
+extern void h265bs_cbr_deinit(h265bs_cbr_t *cbr);
+/* Appends filler nals for an access unit of auBytes to nal[0, nalMax), returns
+ * how many. They carry tidPlus1 of the access unit and stay valid until the
+ * same slot is padded again */
+extern int h265bs_cbr_pad(h265bs_cbr_t *cbr, int slot, int auBytes, int tidPlus1, i265e_nal_t *nal, int nalMax);
+extern void h265bs_cbr_get_stat(h265bs_cbr_t *cbr, h265bs_cbr_stat_t *stat);
+extern void h265bs_cbr_dump_stat(h265bs_cbr_t *cbr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __H265BS_CBR_H__ */
@@ -0,0 +1,336 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "h265bs_nal.h"
+#include "h265bs_ps.h"
+#include "h265bs_mem.h"
+#include "h265bs_check.h"
+
+/* bytes handed to h265bs_check_buf at once by h265bs_check_file */
+#define H265BS_CHECK_CHUNK      (4 * 1024 * 1024)
+
+struct h265bs_check {
+    FILE *fp;
+    int maxReport;
+    h265bs_check_stat_t stat;
+
+    /* nal waiting for the start code which ends it */
+    const uint8_t *pendNal;
+    int64_t pendSize;
+    int64_t pendOff;
+
+    /* access unit in progress */
+    int nalInAu;
+    int vclCnt;
+    uint32_t vclType;
+    uint32_t lastType;
+    int bPicSeen;
+
+    /* parameter set ids seen so far */
+    uint8_t vps[H265BS_PS_VPS_MAX];
+    uint8_t sps[H265BS_PS_SPS_MAX];
+    uint8_t pps[H265BS_PS_PPS_MAX];
+    int psCnt[3];
+};
+
+static const char *h265bs_check_kind_str[H265BS_CHECK_KIND_NUM] = {
+    "forbidden_bit", "layer_id", "temporal_id", "reserved_type", "order", "mixed_vcl",
+    "first_slice", "missing_ps", "no_irap_start", "no_ps", "truncated", "id_range",
+};
+
+const char *h265bs_check_kind_name(h265bs_check_kind_t kind)
+{
+    return (kind >= 0 && kind < H265BS_CHECK_KIND_NUM) ? h265bs_check_kind_str[kind] : "unknown";
+}
+
+static void h265bs_check_report(h265bs_check_t *c, h265bs_check_kind_t kind, int64_t off, const char *fmt, ...)
+{
+    va_list ap;
+
+    c->stat.issueCnt++;
+    if (c->stat.kindCnt[kind]++ >= c->maxReport) {
+        return;
+    }
+    fprintf(c->fp, "h265bs_check:offset %lld: %s: ", (long long)off, h265bs_check_kind_str[kind]);
+    va_start(ap, fmt);
+    vfprintf(c->fp, fmt, ap);
+    va_end(ap);
+    fprintf(c->fp, "\n");
+}
+
+h265bs_check_t *h265bs_check_init(FILE *fp, int maxReport)
+{
+    h265bs_check_t *c = calloc(1, sizeof(h265bs_check_t));
+
+    if (c == NULL) {
+        printf("h265bs_check:calloc h265bs_check_t failed\n");
+        return NULL;
+    }
+    c->fp = fp;
+    c->maxReport = maxReport > 0 ? maxReport : H265BS_CHECK_REPORT_MAX;
+    return c;
+}
+
+void h265bs_check_deinit(h265bs_check_t *c)
+{
+    free(c);
+}
+
+/* nal_unit_type values H.265 table 7-1 leaves reserved */
+static int h265bs_check_reserved(uint32_t type)
+{
+    return (type >= 10 && type <= 15) || (type >= 22 && type <= 31) || (type >= 41 && type <= 47);
+}
+
+/* non-vcl nals which may not come before the first slice of an access unit */
+static int h265bs_check_after_vcl(uint32_t type)
+{
+    return type == I265E_NAL_EOS || type == I265E_NAL_EOB || type == I265E_NAL_FILLER_DATA
+        || type == I265E_NAL_SUFFIX_SEI || (type >= 45 && type <= 47) || type >= 56;
+}
+
+static void h265bs_check_ps(h265bs_check_t *c, const uint8_t *nal, int64_t size, int64_t off, int bLast)
+{
+    h265bs_ps_ids_t ids;
+    int bFirstSlice = 0, ret = 0;
+
+    ret = h265bs_ps_parse_ids(nal, (int)C_MIN(size, 0x7fffffff), &ids);
+    if (ret == -2) {
+        h265bs_check_report(c, H265BS_CHECK_ID_RANGE, off, "nal type %u with id %d referring to %d", ids.type, ids.id, ids.ref);
+        return;
+    } else if (ret < 0) {
+        h265bs_check_report(c, H265BS_CHECK_TRUNCATED, off, "%s", bLast ? "last nal cut before its ids"
+                : "nal too short for its ids");
+        return;
+    }
+
+    switch (ids.type) {
+    case I265E_NAL_VPS:
+        c->vps[ids.id] = 1;
+        c->psCnt[0]++;
+        break;
+    case I265E_NAL_SPS:
+        if (!c->vps[ids.ref]) {
+            h265bs_check_report(c, H265BS_CHECK_MISSING_PS, off, "sps %d refers to vps %d not seen before", ids.id, ids.ref);
+        }
+        c->sps[ids.id] = 1;
+        c->psCnt[1]++;
+        break;
+    case I265E_NAL_PPS:
+        if (!c->sps[ids.ref]) {
+            h265bs_check_report(c, H265BS_CHECK_MISSING_PS, off, "pps %d refers to sps %d not seen before", ids.id, ids.ref);
+        }
+        c->pps[ids.id] = 1;
+        c->psCnt[2]++;
+        break;
+    default:
+        bFirstSlice = H265BS_NAL_FIRST_SLICE(nal + ((nal[2] == 0x01) ? 3 : 4));
+        if (!c->pps[ids.ref] && bFirstSlice) {
+            h265bs_check_report(c, H265BS_CHECK_MISSING_PS, off, "slice refers to pps %d not seen before", ids.ref);
+        }
+        break;
+    }
+}
+
+/* One nal with its start code, bLast when nothing follows it in the stream */
+static void h265bs_check_nal(h265bs_check_t *c, const uint8_t *nal, int64_t size, int64_t off, int bLast)
+{
+    int scLen = (nal[2] == 0x01) ? 3 : 4;
+    const uint8_t *hdr = nal + scLen;
+    uint32_t type = 0, layerId = 0, tidPlus1 = 0;
+    int bFirstSlice = 0, bVcl = 0;
+
+    c->stat.nalCnt++;
+    if (size < scLen + 2) {
+        h265bs_check_report(c, H265BS_CHECK_TRUNCATED, off, "%s", bLast ? "stream ends inside a nal header" : "nal shorter than its header");
+        return;
+    }
+
+    type = H265BS_NAL_TYPE(hdr);
+    layerId = H265BS_NAL_LAYER_ID(hdr);
+    tidPlus1 = H265BS_NAL_TID_PLUS1(hdr);
+    bVcl = h265bs_nal_is_vcl(type);
+    bFirstSlice = (size > scLen + 2) ? H265BS_NAL_FIRST_SLICE(hdr) : 0;
+
+    if (hdr[0] & 0x80) {
+        h265bs_check_report(c, H265BS_CHECK_FORBIDDEN_BIT, off, "nal type %u", type);
+    }
+    if (layerId != 0) {
+        h265bs_check_report(c, H265BS_CHECK_LAYER_ID, off, "nuh_layer_id %u on nal type %u%s", layerId, type,
+                layerId == 63 ? ", a reserved value" : ", not a base layer nal");
+    }
+    if (tidPlus1 == 0) {
+        h265bs_check_report(c, H265BS_CHECK_TID, off, "nuh_temporal_id_plus1 0 on nal type %u", type);
+    } else if (tidPlus1 != 1 && (h265bs_nal_is_irap(type) || type == I265E_NAL_VPS || type == I265E_NAL_SPS
+                || type == I265E_NAL_EOS || type == I265E_NAL_EOB)) {
+        h265bs_check_report(c, H265BS_CHECK_TID, off, "TemporalId %u on nal type %u which needs 0", tidPlus1 - 1, type);
+    } else if (tidPlus1 == 1 && (type == I265E_NAL_CODED_SLICE_TSA_N || type == I265E_NAL_CODED_SLICE_TLA_R
+                || (layerId == 0 && (type == I265E_NAL_CODED_SLICE_STSA_N || type == I265E_NAL_CODED_SLICE_STSA_R)))) {
+        h265bs_check_report(c, H265BS_CHECK_TID, off, "TemporalId 0 on a TSA or STSA nal type %u", type);
+    }
+    if (h265bs_check_reserved(type)) {
+        h265bs_check_report(c, H265BS_CHECK_RESERVED_TYPE, off, "nal type %u", type);
+    }
+
+    /* the access unit split of the replay scanner and the index */
+    if (c->nalInAu == 0 || h265bs_nal_au_boundary(type, bFirstSlice, c->vclCnt > 0)) {
+        c->stat.auCnt++;
+        c->nalInAu = 0;
+        c->vclCnt = 0;
+    } else if (c->lastType == I265E_NAL_EOB || (c->lastType == I265E_NAL_EOS && type != I265E_NAL_EOB)) {
+        h265bs_check_report(c, H265BS_CHECK_ORDER, off, "nal type %u behind an end of %s nal", type,
+                c->lastType == I265E_NAL_EOS ? "sequence" : "bitstream");
+    }
+
+    if (type == I265E_NAL_ACCESS_UNIT_DELIMITER && c->nalInAu > 0) {
+        h265bs_check_report(c, H265BS_CHECK_ORDER, off, "access unit delimiter is not the first nal of its access unit");
+    }
+    if (c->vclCnt == 0 && h265bs_check_after_vcl(type)) {
+        h265bs_check_report(c, H265BS_CHECK_ORDER, off, "nal type %u before the first slice of its access unit", type);
+    }
+    if (bVcl) {
+        if (c->vclCnt == 0) {
+            if (!bFirstSlice) {
+                h265bs_check_report(c, H265BS_CHECK_FIRST_SLICE, off, "access unit starts with a dependent or later slice segment");
+            }
+            if (!c->bPicSeen && !h265bs_nal_is_irap(type)) {
+                h265bs_check_report(c, H265BS_CHECK_NO_IRAP_START, off, "first picture has nal type %u", type);
+            }
+            c->bPicSeen = 1;
+            c->vclType = type;
+        } else if (type != c->vclType) {
+            h265bs_check_report(c, H265BS_CHECK_MIXED_VCL, off, "slice of nal type %u in a picture of type %u", type, c->vclType);
+        }
+        c->vclCnt++;
+    }
+    if (bVcl || (type >= I265E_NAL_VPS && type <= I265E_NAL_PPS)) {
+        h265bs_check_ps(c, nal, size, off, bLast);
+    }
+
+    c->nalInAu++;
+    c->lastType = type;
+}
+
+void h265bs_check_buf(h265bs_check_t *c, const uint8_t *buf, int64_t size, int64_t off)
+{
+    const uint8_t *end = buf + size, *p = buf, *sc = NULL;
+
+    c->stat.bytes += size;
+    while ((sc = h265bs_nal_find_start_code((uint8_t *)p, (uint8_t *)end)) != NULL) {
+        if (sc > buf && sc[-1] == 0x00) {
+            sc--;
+        }
+        if (c->pendNal) {
+            h265bs_check_nal(c, c->pendNal, off + (sc - buf) - c->pendOff, c->pendOff, 0);
+        } else if (sc > buf && c->stat.nalCnt == 0) {
+            h265bs_check_report(c, H265BS_CHECK_TRUNCATED, off, "%lld bytes before the first start code", (long long)(sc - buf));
+        }
+        c->pendNal = sc;
+        c->pendOff = off + (sc - buf);
+        p = sc + ((sc[2] == 0x01) ? 3 : 4);
+    }
+    if (c->pendNal) {
+        c->pendSize = (off + size) - c->pendOff;
+    } else if (size > 0) {
+        h265bs_check_report(c, H265BS_CHECK_TRUNCATED, off, "%lld bytes without a start code", (long long)size);
+    }
+}
+
+uint64_t h265bs_check_end(h265bs_check_t *c)
+{
+    if (c->pendNal) {
+        h265bs_check_nal(c, c->pendNal, c->pendSize, c->pendOff, 1);
+        c->pendNal = NULL;
+    }
+    if (c->stat.nalCnt > 0 && (c->psCnt[0] == 0 || c->psCnt[1] == 0 || c->psCnt[2] == 0)) {
+        h265bs_check_report(c, H265BS_CHECK_NO_PS, c->stat.bytes, "stream without %s", c->psCnt[0] == 0 ? "VPS"
+                : c->psCnt[1] == 0 ? "SPS" : "PPS");
+    }
+    return c->stat.issueCnt;
+}
+
+void h265bs_check_get_stat(h265bs_check_t *c, h265bs_check_stat_t *stat)
+{
+    *stat = c->stat;
+}
+
+void h265bs_check_dump_stat(h265bs_check_t *c)
+{
+    int k = 0;
+
+    fprintf(c->fp, "h265bs_check:bytes=%llu, nalCnt=%llu, auCnt=%llu, issueCnt=%llu", (unsigned long long)c->stat.bytes,
+            (unsigned long long)c->stat.nalCnt, (unsigned long long)c->stat.auCnt, (unsigned long long)c->stat.issueCnt);
+    for (k = 0; k < H265BS_CHECK_KIND_NUM; k++) {
+        if (c->stat.kindCnt[k]) {
+            fprintf(c->fp, ", %s=%llu", h265bs_check_kind_str[k], (unsigned long long)c->stat.kindCnt[k]);
+        }
+    }
+    fprintf(c->fp, "\n");
+}
+
+int64_t h265bs_check_file(const char *name, FILE *fp, int maxReport, h265bs_check_stat_t *stat)
+{
+    struct stat stat_buf;
+    h265bs_mem_window_t window;
+    h265bs_check_t *c = NULL;
+    uint8_t *base = MAP_FAILED, *end = NULL, *cut = NULL;
+    int64_t pos = 0, next = 0, issueCnt = -1;
+    int fd = -1;
+
+    fd = open(name, O_RDONLY);
+    if (fd < 0 || fstat(fd, &stat_buf) < 0) {
+        fprintf(fp, "h265bs_check:open %s failed:%s\n", name, strerror(errno));
+        goto err_open;
+    }
+    c = h265bs_check_init(fp, maxReport);
+    if (c == NULL) {
+        goto err_check_init;
+    }
+    if (stat_buf.st_size > 0) {
+        base = mmap(NULL, stat_buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) {
+            fprintf(fp, "h265bs_check:mmap %s failed:%s\n", name, strerror(errno));
+            goto err_mmap;
+        }
+        madvise(base, stat_buf.st_size, MADV_SEQUENTIAL);
+    }
+
+    /* chunks cut at start codes, the pages behind the pending nal go back */
+    end = base + stat_buf.st_size;
+    h265bs_mem_window_init(&window, 2 * H265BS_CHECK_CHUNK, H265BS_CHECK_CHUNK, stat_buf.st_size);
+    for (pos = 0; pos < stat_buf.st_size; pos = next) {
+        next = stat_buf.st_size;
+        if (stat_buf.st_size - pos > H265BS_CHECK_CHUNK) {
+            cut = h265bs_nal_find_start_code(base + pos + H265BS_CHECK_CHUNK, end);
+            if (cut) {
+                next = cut - base - (cut[-1] == 0x00);
+            }
+        }
+        h265bs_mem_window_advise(&window, fd, base, 0, stat_buf.st_size, pos, c->pendNal ? c->pendOff : pos);
+        h265bs_check_buf(c, base + pos, next - pos, pos);
+    }
+    issueCnt = h265bs_check_end(c);
+    h265bs_check_dump_stat(c);
+    if (stat) {
+        h265bs_check_get_stat(c, stat);
+    }
+
+    if (base != MAP_FAILED) {
+        munmap(base, stat_buf.st_size);
+    }
+err_mmap:
+    h265bs_check_deinit(c);
+err_check_init:
+err_open:
+    if (fd >= 0) close(fd);
+    return issueCnt;
+}
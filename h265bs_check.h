@@ -0,0 +1,62 @@
+#ifndef __H265BS_CHECK_H__
+#define __H265BS_CHECK_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define H265BS_CHECK_REPORT_MAX     10      /* default messages per kind */
+
+/* What the nal level checker flags, every message carries the byte offset of
+ * the start code of the nal at fault */
+typedef enum {
+    H265BS_CHECK_FORBIDDEN_BIT  = 0,    /* forbidden_zero_bit set */
+    H265BS_CHECK_LAYER_ID       = 1,    /* nuh_layer_id of an enhancement layer or 63 */
+    H265BS_CHECK_TID            = 2,    /* nuh_temporal_id_plus1 0, or not 1 where TemporalId must be 0 */
+    H265BS_CHECK_RESERVED_TYPE  = 3,    /* reserved nal_unit_type */
+    H265BS_CHECK_ORDER          = 4,    /* nal order inside an access unit, H.265 7.4.2.4.4 */
+    H265BS_CHECK_MIXED_VCL      = 5,    /* slices of one picture with different types */
+    H265BS_CHECK_FIRST_SLICE    = 6,    /* picture not opened by first_slice_segment_in_pic_flag */
+    H265BS_CHECK_MISSING_PS     = 7,    /* reference to a parameter set not seen before */
+    H265BS_CHECK_NO_IRAP_START  = 8,    /* the first picture is not an IRAP */
+    H265BS_CHECK_NO_PS          = 9,    /* no VPS, SPS or PPS in the whole stream */
+    H265BS_CHECK_TRUNCATED      = 10,   /* nal cut in its header or its ids, or bytes without a start code */
+    H265BS_CHECK_ID_RANGE       = 11,   /* vps, sps or pps id beyond the range H.265 allows */
+    H265BS_CHECK_KIND_NUM,
+} h265bs_check_kind_t;
+
+typedef struct {
+    uint64_t bytes;
+    uint64_t nalCnt;
+    uint64_t auCnt;
+    uint64_t issueCnt;
+    uint64_t kindCnt[H265BS_CHECK_KIND_NUM];
+} h265bs_check_stat_t;
+
+typedef struct h265bs_check h265bs_check_t;
+
+/* Messages go to fp, at most maxReport of each kind, 0 for the default */
+extern h265bs_check_t *h265bs_check_init(FILE *fp, int maxReport);
+extern void h265bs_check_deinit(h265bs_check_t *c);
+/* Check the nals of [buf, buf + size), buf is at file offset off. Buffers
+ * hold whole nals and follow each other in the stream, the last nal is only
+ * checked by the next call or h265bs_check_end, so buf has to stay valid
+ * until then */
+extern void h265bs_check_buf(h265bs_check_t *c, const uint8_t *buf, int64_t size, int64_t off);
+/* The end of stream checks, returns the issue count */
+extern uint64_t h265bs_check_end(h265bs_check_t *c);
+extern void h265bs_check_get_stat(h265bs_check_t *c, h265bs_check_stat_t *stat);
+extern void h265bs_check_dump_stat(h265bs_check_t *c);
+extern const char *h265bs_check_kind_name(h265bs_check_kind_t kind);
+
+/* The whole file through a sliding mapping, -1 when it can not be read */
+extern int64_t h265bs_check_file(const char *name, FILE *fp, int maxReport, h265bs_check_stat_t *stat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __H265BS_CHECK_H__ */
@@ -0,0 +1,24 @@
+#ifndef __H265BS_CLOCK_H__
+#define __H265BS_CLOCK_H__
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Monotonic microseconds, the clock of every timing and stat */
+static inline int64_t h265bs_mdate(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __H265BS_CLOCK_H__ */
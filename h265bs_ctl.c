@@ -0,0 +1,370 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "h265bs_trace.h"
+#include "h265bs_ctl.h"
+
+typedef struct {
+    int fd;                 /* -1 for a free slot */
+    int chn;
+    char line[H265BS_CTL_LINE_MAX];
+    int len;
+    int bOverflow;          /* a line too long, the rest of it is dropped */
+} h265bs_ctl_client_t;
+
+struct h265bs_ctl {
+    char *path;
+    int listenFd;
+    int epollFd;
+    int stopFd;             /* eventfd, ends the event loop */
+    pthread_t tid;
+
+    pthread_mutex_t mutex;  /* chn and chnCnt, added while the loop runs */
+    i265e_extern_bs_t *chn[H265BS_CTL_CHN_MAX];
+    int chnCnt;
+
+    h265bs_ctl_client_t client[H265BS_CTL_CLIENT_MAX];
+};
+
+/* Replies are a few lines, a client which does not read them loses them
+ * instead of holding the loop */
+static void h265bs_ctl_reply(h265bs_ctl_client_t *c, const char *fmt, ...)
+{
+    char buf[H265BS_CTL_LINE_MAX];
+    va_list ap;
+    int n = 0;
+
+    va_start(ap, fmt);
+    n = vsnprintf(buf, sizeof(buf) - 1, fmt, ap);
+    va_end(ap);
+    n = C_MIN(n, (int)sizeof(buf) - 2);
+    buf[n++] = '\n';
+    send(c->fd, buf, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+static void h265bs_ctl_stats(h265bs_ctl_t *ctl, h265bs_ctl_client_t *c)
+{
+    i265e_extern_stat_t stat;
+    i265e_extern_bs_t *h = NULL;
+    int i = 0, chnCnt = 0;
+
+    pthread_mutex_lock(&ctl->mutex);
+    chnCnt = ctl->chnCnt;
+    pthread_mutex_unlock(&ctl->mutex);
+    for (i = 0; i < chnCnt; i++) {
+        h = ctl->chn[i];
+        if (i265e_extern_bs_get_param(h, I265E_EXT_RCFG_STAT_ID, &stat) < 0) {
+            continue;
+        }
+        h265bs_ctl_reply(c, "stat chn=%d frame=%lld pts=%lld aus=%llu ready=%d free=%d speed=%d paused=%d "
+                "idrReqs=%llu seeks=%llu swaps=%llu splices=%llu supers=%llu rendSwitches=%llu",
+                i, (long long)stat.frameNum, (long long)stat.lastPts, (unsigned long long)stat.auCnt, stat.readyCnt,
+                stat.freeCnt, stat.speed, stat.bPaused, (unsigned long long)stat.idrReqCnt,
+                (unsigned long long)stat.seekCnt, (unsigned long long)stat.swapCnt, (unsigned long long)stat.spliceCnt,
+                (unsigned long long)stat.superCnt, (unsigned long long)stat.rendSwitchCnt);
+    }
+    h265bs_ctl_reply(c, "ok");
+}
+
+/* The loop only posts requests, set_param stores them under the lock of
+ * the channel and its enc thread checks them against the index it plays */
+static void h265bs_ctl_cmd(h265bs_ctl_t *ctl, h265bs_ctl_client_t *c, char *line)
+{
+    i265e_extern_rcfg_trick_param_t trick;
+    i265e_extern_rcfg_source_param_t src;
+    i265e_extern_bs_t *h = NULL;
+    char cmd[32], *arg = NULL, *end = NULL;
+    int n = 0, v = 0, ret = 0, chnCnt = 0, bInt = 0;
+
+    if (sscanf(line, "%31s %n", cmd, &n) < 1) {
+        return;
+    }
+    arg = line + n;
+    v = strtol(arg, &end, 10);
+    bInt = end != arg && *end == '\0';
+
+    pthread_mutex_lock(&ctl->mutex);
+    chnCnt = ctl->chnCnt;
+    h = c->chn < chnCnt ? ctl->chn[c->chn] : NULL;
+    pthread_mutex_unlock(&ctl->mutex);
+
+    if (strcmp(cmd, "stats") == 0) {
+        h265bs_ctl_stats(ctl, c);
+        return;
+    } else if (strcmp(cmd, "chn") == 0) {
+        if (!bInt || v < 0 || v >= chnCnt) {
+            h265bs_ctl_reply(c, "error no channel %s, %d channels", arg, chnCnt);
+            return;
+        }
+        c->chn = v;
+        h265bs_ctl_reply(c, "ok");
+        return;
+    }
+
+    if (h == NULL) {
+        h265bs_ctl_reply(c, "error no channel %d", c->chn);
+        return;
+    }
+    if (strcmp(cmd, "pause") == 0 || strcmp(cmd, "resume") == 0) {
+        v = cmd[0] == 'p';
+        ret = i265e_extern_bs_set_param(h, I265E_EXT_RCFG_PAUSE_ID, &v);
+    } else if (strcmp(cmd, "idr") == 0) {
+        v = 1;
+        ret = i265e_extern_bs_set_param(h, I265E_RCFG_ENIDR_ID, &v);
+    } else if (strcmp(cmd, "seek") == 0 && bInt) {
+        if (v < 0) {
+            h265bs_ctl_reply(c, "error seek to frame %d", v);
+            return;
+        }
+        ret = i265e_extern_bs_set_param(h, I265E_EXT_RCFG_SEEK_ID, &v);
+    } else if (strcmp(cmd, "speed") == 0 && bInt) {
+        if (v == 0) {
+            h265bs_ctl_reply(c, "error speed 0, pause stops the channel");
+            return;
+        }
+        trick.speed = v;
+        ret = i265e_extern_bs_set_param(h, I265E_EXT_RCFG_TRICK_ID, &trick);
+    } else if (strcmp(cmd, "source") == 0 && *arg) {
+        snprintf(src.name, sizeof(src.name), "%s", arg);
+        ret = i265e_extern_bs_set_param(h, I265E_EXT_RCFG_SOURCE_ID, &src);
+    } else {
+        h265bs_ctl_reply(c, "error unknown command %s", line);
+        return;
+    }
+    if (ret < 0) {
+        h265bs_ctl_reply(c, "error %s refused by channel %d", cmd, c->chn);
+    } else {
+        h265bs_ctl_reply(c, "ok");
+    }
+}
+
+static void h265bs_ctl_close(h265bs_ctl_t *ctl, h265bs_ctl_client_t *c)
+{
+    epoll_ctl(ctl->epollFd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+}
+
+static void h265bs_ctl_accept(h265bs_ctl_t *ctl)
+{
+    struct epoll_event ev;
+    h265bs_ctl_client_t *c = NULL;
+    int i = 0, fd = -1;
+
+    fd = accept4(ctl->listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    for (i = 0; i < H265BS_CTL_CLIENT_MAX && ctl->client[i].fd >= 0; i++);
+    if (i == H265BS_CTL_CLIENT_MAX) {
+        printf("h265bs_ctl:%d connections already, one refused\n", H265BS_CTL_CLIENT_MAX);
+        close(fd);
+        return;
+    }
+    c = &ctl->client[i];
+    memset(c, 0, sizeof(*c));
+    c->fd = fd;
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+    if (epoll_ctl(ctl->epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        printf("h265bs_ctl:epoll_ctl failed:%s\n", strerror(errno));
+        close(fd);
+        c->fd = -1;
+    }
+}
+
+/* Everything read so far, complete lines are run and the rest kept */
+static void h265bs_ctl_read(h265bs_ctl_t *ctl, h265bs_ctl_client_t *c)
+{
+    char *p = NULL, *nl = NULL;
+    int n = 0;
+
+    n = read(c->fd, c->line + c->len, sizeof(c->line) - 1 - c->len);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+        return;
+    } else if (n <= 0) {
+        h265bs_ctl_close(ctl, c);
+        return;
+    }
+    c->len += n;
+    c->line[c->len] = '\0';
+
+    for (p = c->line; (nl = strchr(p, '\n')) != NULL; p = nl + 1) {
+        *nl = '\0';
+        if (nl > p && nl[-1] == '\r') {
+            nl[-1] = '\0';
+        }
+        if (c->bOverflow) {
+            c->bOverflow = 0;
+        } else {
+            h265bs_ctl_cmd(ctl, c, p);
+        }
+    }
+    c->len -= p - c->line;
+    memmove(c->line, p, c->len);
+    if (c->len == sizeof(c->line) - 1) {
+        if (!c->bOverflow) {
+            h265bs_ctl_reply(c, "error line over %d bytes", H265BS_CTL_LINE_MAX - 1);
+        }
+        c->bOverflow = 1;
+        c->len = 0;
+    }
+}
+
+static void *h265bs_ctl_thread(void *arg)
+{
+    h265bs_ctl_t *ctl = arg;
+    struct epoll_event ev[H265BS_CTL_CLIENT_MAX + 2];
+    int i = 0, n = 0, bStop = 0;
+
+    h265bs_trace_thread_name("ctl");
+    while (!bStop) {
+        n = epoll_wait(ctl->epollFd, ev, H265BS_CTL_CLIENT_MAX + 2, -1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0) {
+            printf("h265bs_ctl:epoll_wait failed:%s\n", strerror(errno));
+            break;
+        }
+        for (i = 0; i < n; i++) {
+            if (ev[i].data.ptr == &ctl->stopFd) {
+                bStop = 1;
+            } else if (ev[i].data.ptr == &ctl->listenFd) {
+                h265bs_ctl_accept(ctl);
+            } else {
+                h265bs_ctl_read(ctl, ev[i].data.ptr);
+            }
+        }
+    }
+    return NULL;
+}
+
+h265bs_ctl_t *h265bs_ctl_init(const char *path)
+{
+    h265bs_ctl_t *ctl = NULL;
+    struct sockaddr_un addr;
+    struct epoll_event ev;
+    int i = 0, errnum = 0;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        printf("h265bs_ctl:socket path %s too long\n", path);
+        goto err_path;
+    }
+    ctl = calloc(1, sizeof(h265bs_ctl_t));
+    if (ctl == NULL) {
+        printf("h265bs_ctl:calloc h265bs_ctl_t failed\n");
+        goto err_calloc_ctl;
+    }
+    for (i = 0; i < H265BS_CTL_CLIENT_MAX; i++) {
+        ctl->client[i].fd = -1;
+    }
+    ctl->path = strdup(path);
+    if (ctl->path == NULL) {
+        printf("h265bs_ctl:strdup path failed\n");
+        goto err_strdup_path;
+    }
+
+    /* a socket left by a process which died is taken over */
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    ctl->listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (ctl->listenFd < 0) {
+        printf("h265bs_ctl:socket failed:%s\n", strerror(errno));
+        goto err_socket;
+    }
+    if (bind(ctl->listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(ctl->listenFd, 4) < 0) {
+        printf("h265bs_ctl:listen on %s failed:%s\n", path, strerror(errno));
+        goto err_bind;
+    }
+
+    ctl->stopFd = eventfd(0, EFD_CLOEXEC);
+    ctl->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (ctl->stopFd < 0 || ctl->epollFd < 0) {
+        printf("h265bs_ctl:eventfd or epoll_create1 failed:%s\n", strerror(errno));
+        goto err_epoll_create;
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = &ctl->listenFd;
+    epoll_ctl(ctl->epollFd, EPOLL_CTL_ADD, ctl->listenFd, &ev);
+    ev.data.ptr = &ctl->stopFd;
+    epoll_ctl(ctl->epollFd, EPOLL_CTL_ADD, ctl->stopFd, &ev);
+
+    pthread_mutex_init(&ctl->mutex, NULL);
+    if ((errnum = pthread_create(&ctl->tid, NULL, h265bs_ctl_thread, ctl)) != 0) {
+        printf("h265bs_ctl:pthread_create failed:%s\n", strerror(errnum));
+        goto err_pthread_create;
+    }
+
+    return ctl;
+
+err_pthread_create:
+    pthread_mutex_destroy(&ctl->mutex);
+err_epoll_create:
+    if (ctl->epollFd >= 0) close(ctl->epollFd);
+    if (ctl->stopFd >= 0) close(ctl->stopFd);
+    unlink(path);
+err_bind:
+    close(ctl->listenFd);
+err_socket:
+    free(ctl->path);
+err_strdup_path:
+    free(ctl);
+err_calloc_ctl:
+err_path:
+    return NULL;
+}
+
+int h265bs_ctl_add(h265bs_ctl_t *ctl, i265e_extern_bs_t *h)
+{
+    int chn = -1;
+
+    pthread_mutex_lock(&ctl->mutex);
+    if (ctl->chnCnt < H265BS_CTL_CHN_MAX) {
+        chn = ctl->chnCnt;
+        ctl->chn[ctl->chnCnt++] = h;
+    }
+    pthread_mutex_unlock(&ctl->mutex);
+    if (chn < 0) {
+        printf("h265bs_ctl:%d channels already\n", H265BS_CTL_CHN_MAX);
+    }
+    return chn;
+}
+
+void h265bs_ctl_deinit(h265bs_ctl_t *ctl)
+{
+    uint64_t one = 1;
+    int i = 0;
+
+    if (ctl == NULL) {
+        return;
+    }
+    if (write(ctl->stopFd, &one, sizeof(one)) != sizeof(one)) {
+        printf("h265bs_ctl:stop failed:%s\n", strerror(errno));
+    }
+    pthread_join(ctl->tid, NULL);
+    for (i = 0; i < H265BS_CTL_CLIENT_MAX; i++) {
+        if (ctl->client[i].fd >= 0) {
+            close(ctl->client[i].fd);
+        }
+    }
+    close(ctl->epollFd);
+    close(ctl->stopFd);
+    close(ctl->listenFd);
+    unlink(ctl->path);
+    pthread_mutex_destroy(&ctl->mutex);
+    free(ctl->path);
+    free(ctl);
+}
@@ -0,0 +1,42 @@
+#ifndef __H265BS_CTL_H__
+#define __H265BS_CTL_H__
+
+#include "i265e_extern_bs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define H265BS_CTL_CHN_MAX      16
+#define H265BS_CTL_CLIENT_MAX   8
+#define H265BS_CTL_LINE_MAX     512
+
+/* Control socket of a replay process, one text command per line on a unix
+ * stream socket. Each maps onto a set_param or get_param id of the channel
+ * the connection addresses:
+ *   pause, resume      I265E_EXT_RCFG_PAUSE_ID
+ *   seek frame         I265E_EXT_RCFG_SEEK_ID
+ *   speed speed        I265E_EXT_RCFG_TRICK_ID
+ *   idr                I265E_RCFG_ENIDR_ID
+ *   source file        I265E_EXT_RCFG_SOURCE_ID
+ *   stats              I265E_EXT_RCFG_STAT_ID, a "stat" line per channel
+ *   chn n              channel of the commands which follow, 0 at connect
+ * and is answered by an "ok" or "error reason" line. ok means the channel
+ * took the request, it is applied by the enc thread at its next access
+ * unit, which drops a speed the index it plays has no keyframes for. stats
+ * shows what is in force. The event loop runs on a thread of its own, the
+ * replay only sees the set_param and get_param */
+typedef struct h265bs_ctl h265bs_ctl_t;
+
+extern h265bs_ctl_t *h265bs_ctl_init(const char *path);
+/* Channel number of h, -1 when all are taken */
+extern int h265bs_ctl_add(h265bs_ctl_t *ctl, i265e_extern_bs_t *h);
+/* Closes the connections and removes the socket, call it before the
+ * channels are stopped */
+extern void h265bs_ctl_deinit(h265bs_ctl_t *ctl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __H265BS_CTL_H__ */
@@ -0,0 +1,459 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "h265bs_clock.h"
+#include "h265bs_nal.h"
+#include "h265bs_hash.h"
+#include "h265bs_slice.h"
+#include "h265bs_mem.h"
+#include "h265bs_diff.h"
+
+/* smallest byte range given to a scan worker, and its read ahead */
+#define H265BS_DIFF_CHUNK_MIN   (4 * 1024 * 1024)
+#define H265BS_DIFF_AHEAD       (8 * 1024 * 1024)
+#define H265BS_DIFF_NAL_INIT    4096
+/* slice types plus one for pictures whose header could not be parsed */
+#define H265BS_DIFF_TYPE_NUM    4
+
+typedef struct {
+    int64_t off;            /* 00 00 01 of the nal */
+    int64_t size;           /* nal header and payload */
+    uint64_t hash;          /* xxh64 of the nal header and payload */
+    uint32_t type;
+    int bFirst;             /* first_slice_segment_in_pic_flag of a vcl nal */
+} h265bs_diff_nal_t;
+
+typedef struct {
+    int64_t nal;            /* first nal */
+    int nalCnt;
+    int64_t off;            /* leading zero of a 4 byte start code included */
+    int64_t size;           /* up to the next access unit */
+    uint64_t hash;          /* of the nal hashes */
+    int sliceType;          /* H265BS_SLICE_*, -1 when unknown */
+    int bIrap;
+} h265bs_diff_au_t;
+
+typedef struct {
+    const char *name;
+    int fd;
+    uint8_t *base;
+    int64_t size;
+    h265bs_diff_nal_t *nal;
+    int64_t nalCnt;
+    h265bs_diff_au_t *au;
+    int64_t auCnt;
+    int64_t typeCnt[H265BS_DIFF_TYPE_NUM];
+    int64_t typeBytes[H265BS_DIFF_TYPE_NUM];
+    int ret;
+    pthread_t tid;
+} h265bs_diff_file_t;
+
+/* The nals whose start code lies in [start, end) of one file, the last one
+ * is read on past end up to the next start code */
+typedef struct {
+    h265bs_diff_file_t *file;
+    int64_t start;
+    int64_t end;
+    h265bs_diff_nal_t *nal;
+    int64_t nalCnt;
+    int64_t nalMax;
+    int ret;
+} h265bs_diff_chunk_t;
+
+typedef struct {
+    h265bs_diff_file_t file[2];
+    h265bs_diff_chunk_t *chunk;
+    int chunkNum;
+    int chunkNext;          /* next chunk to scan, under mutex */
+    pthread_mutex_t mutex;
+} h265bs_diff_t;
+
+static const char *h265bs_diff_type_name[H265BS_DIFF_TYPE_NUM] = {"B", "P", "I", "?"};
+
+static int h265bs_diff_scan(h265bs_diff_chunk_t *c)
+{
+    h265bs_diff_file_t *f = c->file;
+    h265bs_mem_window_t window;
+    h265bs_diff_nal_t *nal = NULL;
+    h265bs_nal_iter_t it;
+    uint8_t *chunkEnd = f->base + c->end;
+
+    h265bs_mem_window_init(&window, H265BS_DIFF_AHEAD, H265BS_DIFF_AHEAD / 2, f->size);
+    h265bs_mem_window_reset(&window, c->start);
+    h265bs_nal_iter_init(&it, f->base + c->start, f->base + f->size);
+    while (h265bs_nal_iter_next(&it) && it.sc < chunkEnd) {
+        if (it.nalEnd - it.hdr < 2) {
+            continue;
+        }
+        /* the diff reads the headers again, nothing is dropped behind */
+        h265bs_mem_window_advise(&window, f->fd, f->base, 0, f->size, it.sc - f->base, c->start);
+
+        if (c->nalCnt == c->nalMax) {
+            c->nalMax = c->nalMax ? c->nalMax * 2 : H265BS_DIFF_NAL_INIT;
+            nal = realloc(c->nal, c->nalMax * sizeof(h265bs_diff_nal_t));
+            if (nal == NULL) {
+                return -1;
+            }
+            c->nal = nal;
+        }
+        nal = &c->nal[c->nalCnt++];
+        nal->off = it.sc - f->base;
+        nal->size = it.nalEnd - it.hdr;
+        nal->hash = h265bs_xxh64(it.hdr, nal->size, 0);
+        nal->type = H265BS_NAL_TYPE(it.hdr);
+        nal->bFirst = h265bs_nal_iter_first_slice(&it);
+    }
+    return 0;
+}
+
+static void *h265bs_diff_worker(void *arg)
+{
+    h265bs_diff_t *d = (h265bs_diff_t *)arg;
+    h265bs_diff_chunk_t *c = NULL;
+
+    while (1) {
+        pthread_mutex_lock(&d->mutex);
+        c = (d->chunkNext < d->chunkNum) ? &d->chunk[d->chunkNext++] : NULL;
+        pthread_mutex_unlock(&d->mutex);
+        if (c == NULL) {
+            break;
+        }
+        c->ret = h265bs_diff_scan(c);
+    }
+    return NULL;
+}
+
+/* Joins the chunks of f and splits the nals into access units the way the
+ * scanner does, the slice type comes from the first slice segment header */
+static void *h265bs_diff_split(void *arg)
+{
+    h265bs_diff_file_t *f = (h265bs_diff_file_t *)arg;
+    h265bs_slice_t *slice = NULL;
+    h265bs_slice_info_t info;
+    h265bs_diff_nal_t *nal = NULL;
+    h265bs_diff_au_t *au = NULL;
+    int64_t i = 0, off = 0;
+    int bAuVcl = 0, t = 0;
+
+    f->ret = -1;
+    slice = h265bs_slice_init();
+    if (slice == NULL) {
+        return NULL;
+    }
+    f->au = malloc(C_MAX(f->nalCnt, 1) * sizeof(h265bs_diff_au_t));
+    if (f->au == NULL) {
+        h265bs_slice_deinit(slice);
+        return NULL;
+    }
+    for (i = 0; i < f->nalCnt; i++) {
+        nal = &f->nal[i];
+        off = (nal->off > 0 && f->base[nal->off - 1] == 0) ? nal->off - 1 : nal->off;
+        if (au == NULL || h265bs_nal_au_boundary(nal->type, nal->bFirst, bAuVcl)) {
+            if (au) {
+                au->size = off - au->off;
+            }
+            au = &f->au[f->auCnt++];
+            memset(au, 0, sizeof(*au));
+            au->nal = i;
+            au->off = off;
+            au->sliceType = -1;
+            bAuVcl = 0;
+        }
+        au->nalCnt++;
+        au->hash = (au->hash ^ nal->hash) * 0x9e3779b97f4a7c15ULL + (uint64_t)nal->type;
+        if (h265bs_slice_nal(slice, f->base + nal->off, nal->size + 3, &info) == 1 && !bAuVcl) {
+            au->sliceType = info.sliceType;
+            au->bIrap = h265bs_nal_is_irap(info.nalType);
+        }
+        if (h265bs_nal_is_vcl(nal->type)) {
+            bAuVcl = 1;
+        }
+    }
+    if (au) {
+        au->size = f->size - au->off;
+    }
+    for (i = 0; i < f->auCnt; i++) {
+        t = f->au[i].sliceType < 0 ? H265BS_DIFF_TYPE_NUM - 1 : f->au[i].sliceType;
+        f->typeCnt[t]++;
+        f->typeBytes[t] += f->au[i].size;
+    }
+    h265bs_slice_deinit(slice);
+    f->ret = 0;
+    return NULL;
+}
+
+static int h265bs_diff_open(h265bs_diff_file_t *f, const char *name)
+{
+    struct stat stat_buf;
+
+    f->name = name;
+    f->base = MAP_FAILED;
+    f->fd = open(name, O_RDONLY);
+    if (f->fd < 0 || fstat(f->fd, &stat_buf) < 0) {
+        printf("h265bs_diff:open %s failed:%s\n", name, strerror(errno));
+        return -1;
+    }
+    f->size = stat_buf.st_size;
+    if (f->size == 0) {
+        printf("h265bs_diff:%s is empty\n", name);
+        return -1;
+    }
+    f->base = mmap(NULL, f->size, PROT_READ, MAP_SHARED, f->fd, 0);
+    if (f->base == MAP_FAILED) {
+        printf("h265bs_diff:mmap %s failed:%s\n", name, strerror(errno));
+        return -1;
+    }
+    madvise(f->base, f->size, MADV_SEQUENTIAL);
+    return 0;
+}
+
+static void h265bs_diff_close(h265bs_diff_file_t *f)
+{
+    if (f->base != MAP_FAILED) {
+        munmap(f->base, f->size);
+    }
+    if (f->fd >= 0) {
+        close(f->fd);
+    }
+    free(f->nal);
+    free(f->au);
+}
+
+/* Concatenates the nal lists of the chunks of f, they come in file order */
+static int h265bs_diff_join(h265bs_diff_t *d, h265bs_diff_file_t *f)
+{
+    int64_t cnt = 0;
+    int k = 0;
+
+    for (k = 0; k < d->chunkNum; k++) {
+        if (d->chunk[k].file == f) {
+            cnt += d->chunk[k].nalCnt;
+        }
+    }
+    f->nal = malloc(C_MAX(cnt, 1) * sizeof(h265bs_diff_nal_t));
+    if (f->nal == NULL) {
+        return -1;
+    }
+    for (k = 0; k < d->chunkNum; k++) {
+        if (d->chunk[k].file == f && d->chunk[k].nalCnt) {
+            memcpy(f->nal + f->nalCnt, d->chunk[k].nal, d->chunk[k].nalCnt * sizeof(h265bs_diff_nal_t));
+            f->nalCnt += d->chunk[k].nalCnt;
+        }
+    }
+    return 0;
+}
+
+/* Pairs the nals of access unit i of both files in order and tells where
+ * the first pair differs */
+static void h265bs_diff_first(h265bs_diff_t *d, int64_t i)
+{
+    h265bs_diff_file_t *a = &d->file[0], *b = &d->file[1];
+    h265bs_diff_au_t *auA = &a->au[i], *auB = &b->au[i];
+    h265bs_diff_nal_t *x = NULL, *y = NULL;
+    const uint8_t *p = NULL, *q = NULL;
+    int64_t n = 0, k = 0;
+    int j = 0;
+
+    for (j = 0; j < auA->nalCnt && j < auB->nalCnt; j++) {
+        x = &a->nal[auA->nal + j];
+        y = &b->nal[auB->nal + j];
+        if (x->type != y->type) {
+            printf("h265bs_diff:first divergence at frame %lld nal %d, type %u at byte %lld of a, type %u at byte %lld of b\n",
+                    (long long)i, j, x->type, (long long)x->off, y->type, (long long)y->off);
+            return;
+        }
+        if (x->hash == y->hash && x->size == y->size) {
+            continue;
+        }
+        p = a->base + x->off + 3;
+        q = b->base + y->off + 3;
+        n = C_MIN(x->size, y->size);
+        for (k = 0; k < n && p[k] == q[k]; k++);
+        printf("h265bs_diff:first divergence at frame %lld nal %d type %u, byte %lld of the nal, byte %lld of a, "
+                "byte %lld of b, nal sizes %lld and %lld\n",
+                (long long)i, j, x->type, (long long)k, (long long)(x->off + 3 + k), (long long)(y->off + 3 + k),
+                (long long)x->size, (long long)y->size);
+        return;
+    }
+    printf("h265bs_diff:first divergence at frame %lld, %d nals in a, %d in b\n", (long long)i, auA->nalCnt, auB->nalCnt);
+}
+
+static void h265bs_diff_report(h265bs_diff_t *d, const h265bs_diff_cfg_t *cfg, int64_t firstDiff, int64_t sameCnt)
+{
+    h265bs_diff_file_t *a = &d->file[0], *b = &d->file[1];
+    int64_t n = C_MIN(a->auCnt, b->auCnt), i = 0, s = 0, bytesA = 0, bytesB = 0;
+    double rateA = 0, rateB = 0, avgA = 0, avgB = 0;
+    int t = 0, gop = 0, bIrap = 0;
+
+    printf("h265bs_diff:a %s, %lld frames, %lld bytes\n", a->name, (long long)a->auCnt, (long long)a->size);
+    printf("h265bs_diff:b %s, %lld frames, %lld bytes\n", b->name, (long long)b->auCnt, (long long)b->size);
+    printf("h265bs_diff:%lld of %lld paired frames the same\n", (long long)sameCnt, (long long)n);
+    if (firstDiff >= n) {
+        printf("h265bs_diff:first divergence at frame %lld, %s ends there\n", (long long)firstDiff,
+                a->auCnt < b->auCnt ? "a" : "b");
+    } else if (firstDiff >= 0) {
+        h265bs_diff_first(d, firstDiff);
+    }
+
+    for (t = 0; t < H265BS_DIFF_TYPE_NUM; t++) {
+        if (a->typeCnt[t] == 0 && b->typeCnt[t] == 0) {
+            continue;
+        }
+        avgA = a->typeCnt[t] ? (double)a->typeBytes[t] / a->typeCnt[t] : 0;
+        avgB = b->typeCnt[t] ? (double)b->typeBytes[t] / b->typeCnt[t] : 0;
+        printf("h265bs_diff:%s frames, a %lld of %.1f bytes, b %lld of %.1f bytes, %+.2f%%\n",
+                h265bs_diff_type_name[t], (long long)a->typeCnt[t], avgA, (long long)b->typeCnt[t], avgB,
+                avgA > 0 ? (avgB - avgA) * 100 / avgA : 0);
+    }
+
+    /* gops of a, b is cut at the same frames */
+    for (s = 0; s < n; s = i) {
+        bytesA = bytesB = 0;
+        bIrap = b->au[s].bIrap;
+        for (i = s; i < n && (i == s || !a->au[i].bIrap); i++) {
+            bytesA += a->au[i].size;
+            bytesB += b->au[i].size;
+        }
+        if (cfg->fpsNum > 0 && cfg->fpsDen > 0) {
+            rateA = bytesA * 8.0 * cfg->fpsNum / cfg->fpsDen / (i - s) / 1000;
+            rateB = bytesB * 8.0 * cfg->fpsNum / cfg->fpsDen / (i - s) / 1000;
+        } else {
+            rateA = (double)bytesA / (i - s);
+            rateB = (double)bytesB / (i - s);
+        }
+        printf("h265bs_diff:gop %d frames %lld..%lld, a %.1f, b %.1f %s, %+.2f%%%s\n", gop++, (long long)s, (long long)i,
+                rateA, rateB, (cfg->fpsNum > 0 && cfg->fpsDen > 0) ? "kbps" : "bytes/frame",
+                bytesA ? (bytesB - bytesA) * 100.0 / bytesA : 0, bIrap ? "" : ", no IRAP in b");
+    }
+}
+
+int h265bs_diff(const char *nameA, const char *nameB, const h265bs_diff_cfg_t *cfg)
+{
+    h265bs_diff_t *d = NULL;
+    h265bs_diff_file_t *f = NULL;
+    pthread_t *tid = NULL;
+    int64_t i = 0, firstDiff = -1, sameCnt = 0, start = 0, scanUs = 0, n = 0, size = 0;
+    int k = 0, j = 0, cnt = 0, threadNum = C_MAX(cfg->threadNum, 1), errnum = 0, ret = -1;
+
+    d = calloc(1, sizeof(h265bs_diff_t));
+    if (d == NULL) {
+        printf("h265bs_diff:calloc failed\n");
+        goto err_calloc_diff;
+    }
+    d->file[0].fd = d->file[1].fd = -1;
+    d->file[0].base = d->file[1].base = MAP_FAILED;
+    if (h265bs_diff_open(&d->file[0], nameA) < 0 || h265bs_diff_open(&d->file[1], nameB) < 0) {
+        goto err_open;
+    }
+
+    /* up to threadNum chunks of a file, so both are scanned at once */
+    d->chunk = calloc(2 * threadNum, sizeof(h265bs_diff_chunk_t));
+    tid = calloc(threadNum, sizeof(pthread_t));
+    if (d->chunk == NULL || tid == NULL) {
+        printf("h265bs_diff:calloc chunks failed\n");
+        goto err_calloc_chunk;
+    }
+    for (j = 0; j < 2; j++) {
+        f = &d->file[j];
+        cnt = C_MAX(C_MIN(f->size / H265BS_DIFF_CHUNK_MIN, threadNum), 1);
+        size = f->size / cnt;
+        for (k = 0; k < cnt; k++) {
+            d->chunk[d->chunkNum].file = f;
+            d->chunk[d->chunkNum].start = k * size;
+            d->chunk[d->chunkNum].end = (k == cnt - 1) ? f->size : (k + 1) * size;
+            d->chunkNum++;
+        }
+    }
+    pthread_mutex_init(&d->mutex, NULL);
+
+    start = h265bs_mdate();
+    cnt = C_MIN(threadNum, d->chunkNum);
+    for (k = 0; k < cnt; k++) {
+        if ((errnum = pthread_create(&tid[k], NULL, h265bs_diff_worker, d)) != 0) {
+            printf("h265bs_diff:pthread_create failed:%s\n", strerror(errnum));
+            break;
+        }
+    }
+    if (k == 0) {
+        goto err_create_worker;
+    }
+    cnt = k;
+    for (k = 0; k < cnt; k++) {
+        pthread_join(tid[k], NULL);
+    }
+    for (k = 0; k < d->chunkNum; k++) {
+        if (d->chunk[k].ret < 0) {
+            printf("h265bs_diff:out of memory for the nals of %s\n", d->chunk[k].file->name);
+            goto err_scan;
+        }
+    }
+    if (h265bs_diff_join(d, &d->file[0]) < 0 || h265bs_diff_join(d, &d->file[1]) < 0) {
+        printf("h265bs_diff:malloc nals failed\n");
+        goto err_scan;
+    }
+    for (k = 0; k < d->chunkNum; k++) {
+        free(d->chunk[k].nal);
+        d->chunk[k].nal = NULL;
+    }
+
+    /* the access units of a file depend on all its nals, one thread a file */
+    for (j = 0; j < 2; j++) {
+        if ((errnum = pthread_create(&d->file[j].tid, NULL, h265bs_diff_split, &d->file[j])) != 0) {
+            printf("h265bs_diff:pthread_create failed:%s\n", strerror(errnum));
+            break;
+        }
+    }
+    for (k = 0; k < j; k++) {
+        pthread_join(d->file[k].tid, NULL);
+    }
+    if (j < 2) {
+        goto err_scan;
+    }
+    if (d->file[0].ret < 0 || d->file[1].ret < 0) {
+        printf("h265bs_diff:access unit split failed\n");
+        goto err_scan;
+    }
+    scanUs = h265bs_mdate() - start;
+
+    n = C_MIN(d->file[0].auCnt, d->file[1].auCnt);
+    for (i = 0; i < n; i++) {
+        if (d->file[0].au[i].hash == d->file[1].au[i].hash && d->file[0].au[i].nalCnt == d->file[1].au[i].nalCnt) {
+            sameCnt++;
+        } else if (firstDiff < 0) {
+            firstDiff = i;
+        }
+    }
+    if (firstDiff < 0 && d->file[0].auCnt != d->file[1].auCnt) {
+        firstDiff = n;
+    }
+    h265bs_diff_report(d, cfg, firstDiff, sameCnt);
+    printf("h265bs_diff:%lld nals and %lld nals scanned in %lld us on %d threads, %.1f MB/s\n",
+            (long long)d->file[0].nalCnt, (long long)d->file[1].nalCnt, (long long)scanUs, cnt,
+            scanUs ? (d->file[0].size + d->file[1].size) / (double)scanUs : 0);
+    ret = firstDiff < 0 ? 0 : 1;
+
+err_scan:
+err_create_worker:
+    pthread_mutex_destroy(&d->mutex);
+err_calloc_chunk:
+    for (k = 0; k < d->chunkNum; k++) {
+        free(d->chunk[k].nal);
+    }
+    free(d->chunk);
+    free(tid);
+err_open:
+    h265bs_diff_close(&d->file[0]);
+    h265bs_diff_close(&d->file[1]);
+    free(d);
+err_calloc_diff:
+    return ret;
+}
@@ -0,0 +1,28 @@
+#ifndef __H265BS_DIFF_H__
+#define __H265BS_DIFF_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    int threadNum;          /* scan workers shared by both files */
+    int fpsNum;             /* frame rate of the gop bitrates, 0 reports bytes per frame */
+    int fpsDen;
+} h265bs_diff_cfg_t;
+
+/* Compares stream b against the reference a. Both are split into nals and
+ * hashed on threadNum workers, then paired access unit by access unit and,
+ * inside the first access unit which differs, nal by nal, only that nal is
+ * compared byte by byte. The report gives the first divergence, frame sizes
+ * per slice type and the bitrate of every gop of a. 0 when the streams are
+ * the same, 1 when they differ, -1 on error */
+extern int h265bs_diff(const char *nameA, const char *nameB, const h265bs_diff_cfg_t *cfg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __H265BS_DIFF_H__ */
@@ -0,0 +1,526 @@
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "i265e.h"
+
+/* Synthetic Annex-B generator for the benchmarks and make check. Start
+ * codes, nal headers, VPS/SPS/PPS and slice segment headers are real
+ * syntax, a Main profile 64x64 CTB stream of one short term reference. The
+ * slice data behind the headers is random bytes run through emulation
+ * prevention. IDR pictures are I slices, the TRAIL_R ones in between P and
+ * B in turn with POC counting from the IDR and the slice QP going round
+ * qp-3..qp+3. With wavefronts every slice starts a CTB row and carries the
+ * entry points of its rows */
+
+#define H265BS_GEN_CTB          64
+#define H265BS_GEN_HDR_MAX      8192
+#define H265BS_GEN_ROWS_MAX     256
+
+typedef struct {
+    int frames;
+    int gopSize;
+    int slices;             /* slices per picture */
+    int iFrameSize;         /* bytes of an I picture, split over the slices */
+    int pFrameSize;
+    int sizeJitter;         /* +- percent of the frame size */
+    int longScPercent;      /* percent of nals with a 4 byte start code */
+    int epPerKB;            /* 00 00 pairs per KB which need an emulation byte */
+    uint64_t seed;
+    int width;
+    int height;
+    int qp;                 /* init_qp of the pps */
+    int psId;               /* id of the vps, sps and pps */
+    int bWavefront;         /* entropy_coding_sync_enabled_flag */
+    /* derived */
+    int ctbCols;
+    int ctbRows;
+    int addrBits;           /* bits of slice_segment_address */
+} h265bs_gen_cfg_t;
+
+typedef struct {
+    uint8_t *buf;
+    int size;
+    int occupy;
+} h265bs_gen_buf_t;
+
+/* rbsp bits of a parameter set or slice segment header */
+typedef struct {
+    uint8_t buf[H265BS_GEN_HDR_MAX];
+    int bits;
+} h265bs_gen_bits_t;
+
+static uint64_t h265bs_gen_rand(uint64_t *state)
+{
+    /* xorshift64*, the output only depends on the seed */
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+static void h265bs_gen_put(h265bs_gen_buf_t *b, uint8_t byte)
+{
+    b->buf[b->occupy++] = byte;
+}
+
+/* One rbsp byte, an emulation byte goes in front of it when needed */
+static void h265bs_gen_escape(h265bs_gen_buf_t *b, uint8_t byte, int *zeros)
+{
+    if (*zeros >= 2 && byte <= 0x03) {
+        h265bs_gen_put(b, 0x03);
+        *zeros = 0;
+    }
+    h265bs_gen_put(b, byte);
+    *zeros = byte ? 0 : *zeros + 1;
+}
+
+static void h265bs_gen_u(h265bs_gen_bits_t *w, uint32_t val, int n)
+{
+    int i = 0;
+
+    for (i = n - 1; i >= 0; i--, w->bits++) {
+        if ((val >> i) & 1) {
+            w->buf[w->bits >> 3] |= 0x80 >> (w->bits & 7);
+        }
+    }
+}
+
+static void h265bs_gen_ue(h265bs_gen_bits_t *w, uint32_t val)
+{
+    int len = 0;
+
+    val++;
+    for (len = 0; (val >> len) > 1; len++);
+    h265bs_gen_u(w, 0, len);
+    h265bs_gen_u(w, val, len + 1);
+}
+
+static void h265bs_gen_se(h265bs_gen_bits_t *w, int val)
+{
+    h265bs_gen_ue(w, val > 0 ? 2 * val - 1 : -2 * val);
+}
+
+/* rbsp_trailing_bits and byte_alignment alike, a one and zeros */
+static void h265bs_gen_align(h265bs_gen_bits_t *w)
+{
+    h265bs_gen_u(w, 1, 1);
+    while (w->bits & 7) {
+        h265bs_gen_u(w, 0, 1);
+    }
+}
+
+static int h265bs_gen_bit_len(uint32_t val)
+{
+    int len = 0;
+
+    for (len = 0; val >> len; len++);
+    return len;
+}
+
+/* Start code and nal header, nuh_layer_id 0 and TemporalId 0 */
+static void h265bs_gen_nal_head(h265bs_gen_buf_t *b, h265bs_gen_cfg_t *cfg, uint64_t *rs, int type)
+{
+    if ((int)(h265bs_gen_rand(rs) % 100) < cfg->longScPercent) {
+        h265bs_gen_put(b, 0x00);
+    }
+    h265bs_gen_put(b, 0x00);
+    h265bs_gen_put(b, 0x00);
+    h265bs_gen_put(b, 0x01);
+    h265bs_gen_put(b, type << 1);
+    h265bs_gen_put(b, 0x01);
+}
+
+/* The aligned header bits behind the nal header */
+static void h265bs_gen_put_bits(h265bs_gen_buf_t *b, h265bs_gen_bits_t *w)
+{
+    int i = 0, zeros = 0;
+
+    for (i = 0; i < w->bits / 8; i++) {
+        h265bs_gen_escape(b, w->buf[i], &zeros);
+    }
+}
+
+/* profile_tier_level(1, 0) of Main at level 4.1 */
+static void h265bs_gen_ptl(h265bs_gen_bits_t *w)
+{
+    h265bs_gen_u(w, 0, 2);              /* general_profile_space */
+    h265bs_gen_u(w, 0, 1);              /* general_tier_flag */
+    h265bs_gen_u(w, 1, 5);              /* general_profile_idc */
+    h265bs_gen_u(w, 0x60000000, 32);    /* compatible with Main and Main 10 */
+    h265bs_gen_u(w, 0x9, 4);            /* progressive, frame only */
+    h265bs_gen_u(w, 0, 22);             /* reserved zero 43 bits and inbld */
+    h265bs_gen_u(w, 0, 22);
+    h265bs_gen_u(w, 123, 8);            /* general_level_idc */
+}
+
+static void h265bs_gen_vps(h265bs_gen_buf_t *b, h265bs_gen_cfg_t *cfg, uint64_t *rs)
+{
+    h265bs_gen_bits_t w;
+
+    memset(&w, 0, sizeof(w));
+    h265bs_gen_u(&w, cfg->psId, 4);     /* vps_video_parameter_set_id */
+    h265bs_gen_u(&w, 3, 2);             /* base layer internal and available */
+    h265bs_gen_u(&w, 0, 6);             /* vps_max_layers_minus1 */
+    h265bs_gen_u(&w, 0, 3);             /* vps_max_sub_layers_minus1 */
+    h265bs_gen_u(&w, 1, 1);             /* vps_temporal_id_nesting_flag */
+    h265bs_gen_u(&w, 0xffff, 16);
+    h265bs_gen_ptl(&w);
+    h265bs_gen_u(&w, 1, 1);             /* vps_sub_layer_ordering_info_present_flag */
+    h265bs_gen_ue(&w, 1);               /* vps_max_dec_pic_buffering_minus1 */
+    h265bs_gen_ue(&w, 0);               /* vps_max_num_reorder_pics */
+    h265bs_gen_ue(&w, 0);               /* vps_max_latency_increase_plus1 */
+    h265bs_gen_u(&w, 0, 6);             /* vps_max_layer_id */
+    h265bs_gen_ue(&w, 0);               /* vps_num_layer_sets_minus1 */
+    h265bs_gen_u(&w, 0, 1);             /* vps_timing_info_present_flag */
+    h265bs_gen_u(&w, 0, 1);             /* vps_extension_flag */
+    h265bs_gen_align(&w);
+    h265bs_gen_nal_head(b, cfg, rs, I265E_NAL_VPS);
+    h265bs_gen_put_bits(b, &w);
+}
+
+static void h265bs_gen_sps(h265bs_gen_buf_t *b, h265bs_gen_cfg_t *cfg, uint64_t *rs)
+{
+    h265bs_gen_bits_t w;
+
+    memset(&w, 0, sizeof(w));
+    h265bs_gen_u(&w, cfg->psId, 4);     /* sps_video_parameter_set_id */
+    h265bs_gen_u(&w, 0, 3);             /* sps_max_sub_layers_minus1 */
+    h265bs_gen_u(&w, 1, 1);             /* sps_temporal_id_nesting_flag */
+    h265bs_gen_ptl(&w);
+    h265bs_gen_ue(&w, cfg->psId);       /* sps_seq_parameter_set_id */
+    h265bs_gen_ue(&w, 1);               /* chroma_format_idc 4:2:0 */
+    h265bs_gen_ue(&w, cfg->width);
+    h265bs_gen_ue(&w, cfg->height);
+    h265bs_gen_u(&w, 0, 1);             /* conformance_window_flag */
+    h265bs_gen_ue(&w, 0);               /* bit_depth_luma_minus8 */
+    h265bs_gen_ue(&w, 0);               /* bit_depth_chroma_minus8 */
+    h265bs_gen_ue(&w, 4);               /* log2_max_pic_order_cnt_lsb_minus4, 8 bits */
+    h265bs_gen_u(&w, 1, 1);             /* sps_sub_layer_ordering_info_present_flag */
+    h265bs_gen_ue(&w, 1);
+    h265bs_gen_ue(&w, 0);
+    h265bs_gen_ue(&w, 0);
+    h265bs_gen_ue(&w, 0);               /* 8x8 min coding block */
+    h265bs_gen_ue(&w, 3);               /* 64x64 CTB */
+    h265bs_gen_ue(&w, 0);               /* 4x4 min transform block */
+    h265bs_gen_ue(&w, 3);               /* 32x32 max transform block */
+    h265bs_gen_ue(&w, 1);               /* max_transform_hierarchy_depth_inter */
+    h265bs_gen_ue(&w, 1);               /* max_transform_hierarchy_depth_intra */
+    h265bs_gen_u(&w, 0, 1);             /* scaling_list_enabled_flag */
+    h265bs_gen_u(&w, 1, 1);             /* amp_enabled_flag */
+    h265bs_gen_u(&w, 1, 1);             /* sample_adaptive_offset_enabled_flag */
+    h265bs_gen_u(&w, 0, 1);             /* pcm_enabled_flag */
+    h265bs_gen_ue(&w, 1);               /* num_short_term_ref_pic_sets */
+    h265bs_gen_ue(&w, 1);               /* the picture in front, used */
+    h265bs_gen_ue(&w, 0);
+    h265bs_gen_ue(&w, 0);
+    h265bs_gen_u(&w, 1, 1);
+    h265bs_gen_u(&w, 0, 1);             /* long_term_ref_pics_present_flag */
+    h265bs_gen_u(&w, 1, 1);             /* sps_temporal_mvp_enabled_flag */
+    h265bs_gen_u(&w, 1, 1);             /* strong_intra_smoothing_enabled_flag */
+    h265bs_gen_u(&w, 0, 1);             /* vui_parameters_present_flag */
+    h265bs_gen_u(&w, 0, 1);             /* sps_extension_present_flag */
+    h265bs_gen_align(&w);
+    h265bs_gen_nal_head(b, cfg, rs, I265E_NAL_SPS);
+    h265bs_gen_put_bits(b, &w);
+}
+
+static void h265bs_gen_pps(h265bs_gen_buf_t *b, h265bs_gen_cfg_t *cfg, uint64_t *rs)
+{
+    h265bs_gen_bits_t w;
+
+    memset(&w, 0, sizeof(w));
+    h265bs_gen_ue(&w, cfg->psId);       /* pps_pic_parameter_set_id */
+    h265bs_gen_ue(&w, cfg->psId);       /* pps_seq_parameter_set_id */
+    h265bs_gen_u(&w, 0, 1);             /* dependent_slice_segments_enabled_flag */
+    h265bs_gen_u(&w, 0, 1);             /* output_flag_present_flag */
+    h265bs_gen_u(&w, 0, 3);             /* num_extra_slice_header_bits */
+    h265bs_gen_u(&w, 0, 1);             /* sign_data_hiding_enabled_flag */
+    h265bs_gen_u(&w, 1, 1);             /* cabac_init_present_flag */
+    h265bs_gen_ue(&w, 0);               /* num_ref_idx_l0_default_active_minus1 */
+    h265bs_gen_ue(&w, 0);               /* num_ref_idx_l1_default_active_minus1 */
+    h265bs_gen_se(&w, cfg->qp - 26);    /* init_qp_minus26 */
+    h265bs_gen_u(&w, 0, 1);             /* constrained_intra_pred_flag */
+    h265bs_gen_u(&w, 0, 1);             /* transform_skip_enabled_flag */
+    h265bs_gen_u(&w, 1, 1);             /* cu_qp_delta_enabled_flag */
+    h265bs_gen_ue(&w, 1);               /* diff_cu_qp_delta_depth */
+    h265bs_gen_se(&w, 0);               /* pps_cb_qp_offset */
+    h265bs_gen_se(&w, 0);               /* pps_cr_qp_offset */
+    h265bs_gen_u(&w, 0, 1);             /* pps_slice_chroma_qp_offsets_present_flag */
+    h265bs_gen_u(&w, 0, 1);             /* weighted_pred_flag */
+    h265bs_gen_u(&w, 0, 1);             /* weighted_bipred_flag */
+    h265bs_gen_u(&w, 0, 1);             /* transquant_bypass_enabled_flag */
+    h265bs_gen_u(&w, 0, 1);             /* tiles_enabled_flag */
+    h265bs_gen_u(&w, cfg->bWavefront, 1);
+    h265bs_gen_u(&w, 1, 1);             /* pps_loop_filter_across_slices_enabled_flag */
+    h265bs_gen_u(&w, 0, 1);             /* deblocking_filter_control_present_flag */
+    h265bs_gen_u(&w, 0, 1);             /* pps_scaling_list_data_present_flag */
+    h265bs_gen_u(&w, 0, 1);             /* lists_modification_present_flag */
+    h265bs_gen_ue(&w, 0);               /* log2_parallel_merge_level_minus2 */
+    h265bs_gen_u(&w, 0, 1);             /* slice_segment_header_extension_present_flag */
+    h265bs_gen_u(&w, 0, 1);             /* pps_extension_present_flag */
+    h265bs_gen_align(&w);
+    h265bs_gen_nal_head(b, cfg, rs, I265E_NAL_PPS);
+    h265bs_gen_put_bits(b, &w);
+}
+
+/* size random slice data bytes of one substream, escaped into b. The last
+ * substream ends with the rbsp stop bit, the others with a non zero byte so
+ * the emulation bytes of one do not depend on the one in front */
+static void h265bs_gen_data(h265bs_gen_buf_t *b, h265bs_gen_cfg_t *cfg, uint64_t *rs, int size, int bLast)
+{
+    int i = 0, zeros = 0, forced = 0;
+    uint8_t byte = 0;
+    uint64_t r = 0;
+
+    for (i = 0; i < size; i++) {
+        r = h265bs_gen_rand(rs);
+        if (i == size - 1) {
+            byte = bLast ? 0x80 : (r >> 56) | 0x01;
+        } else if (forced > 0) {
+            /* 00 00 0x, the last one makes the emulation byte necessary */
+            byte = (forced-- > 1) ? 0x00 : (r & 0x03);
+        } else if ((cfg->epPerKB > 0) && ((int)(r % 1024) < cfg->epPerKB) && (i + 3 < size)) {
+            byte = 0x00;
+            forced = 2;
+        } else {
+            byte = r >> 56;
+        }
+        h265bs_gen_escape(b, byte, &zeros);
+    }
+}
+
+/* One slice segment of picture frame starting at CTB addr over rows CTB
+ * rows, dataSize slice data bytes before emulation prevention. The data
+ * goes to scratch first, the entry points count its escaped bytes */
+static void h265bs_gen_slice(h265bs_gen_buf_t *b, h265bs_gen_buf_t *scratch, h265bs_gen_cfg_t *cfg, uint64_t *rs,
+        int frame, int addr, int rows, int dataSize)
+{
+    h265bs_gen_bits_t w;
+    int gopPos = frame % cfg->gopSize, sliceType = 0, type = 0, i = 0, size = 0, maxSize = 0;
+    int subOff[H265BS_GEN_ROWS_MAX + 1];
+
+    if (gopPos == 0) {
+        type = I265E_NAL_CODED_SLICE_IDR_W_RADL;
+        sliceType = 2;
+    } else {
+        type = I265E_NAL_CODED_SLICE_TRAIL_R;
+        sliceType = gopPos & 1;     /* P then B */
+    }
+
+    scratch->occupy = 0;
+    for (i = 0; i < rows; i++) {
+        subOff[i] = scratch->occupy;
+        size = (i == rows - 1) ? dataSize - (rows - 1) * (dataSize / rows) : dataSize / rows;
+        h265bs_gen_data(scratch, cfg, rs, size, i == rows - 1);
+        if (i < rows - 1) {
+            maxSize = C_MAX(maxSize, scratch->occupy - subOff[i]);
+        }
+    }
+    subOff[rows] = scratch->occupy;
+
+    memset(&w, 0, sizeof(w));
+    h265bs_gen_u(&w, addr == 0, 1);                 /* first_slice_segment_in_pic_flag */
+    if (gopPos == 0) {
+        h265bs_gen_u(&w, 0, 1);                     /* no_output_of_prior_pics_flag */
+    }
+    h265bs_gen_ue(&w, cfg->psId);                   /* slice_pic_parameter_set_id */
+    if (addr) {
+        h265bs_gen_u(&w, addr, cfg->addrBits);
+    }
+    h265bs_gen_ue(&w, sliceType);
+    if (gopPos) {
+        h265bs_gen_u(&w, gopPos & 0xff, 8);         /* slice_pic_order_cnt_lsb */
+        h265bs_gen_u(&w, 1, 1);                     /* short_term_ref_pic_set_sps_flag */
+        h265bs_gen_u(&w, 1, 1);                     /* slice_temporal_mvp_enabled_flag */
+    }
+    h265bs_gen_u(&w, 1, 1);                         /* slice_sao_luma_flag */
+    h265bs_gen_u(&w, 1, 1);                         /* slice_sao_chroma_flag */
+    if (sliceType != 2) {
+        h265bs_gen_u(&w, 0, 1);                     /* num_ref_idx_active_override_flag */
+        if (sliceType == 0) {
+            h265bs_gen_u(&w, 0, 1);                 /* mvd_l1_zero_flag */
+        }
+        h265bs_gen_u(&w, 1, 1);                     /* cabac_init_flag */
+        if (sliceType == 0) {
+            h265bs_gen_u(&w, 1, 1);                 /* collocated_from_l0_flag */
+        }
+        h265bs_gen_ue(&w, 0);                       /* five_minus_max_num_merge_cand */
+    }
+    h265bs_gen_se(&w, gopPos ? gopPos % 7 - 3 : 0); /* slice_qp_delta */
+    h265bs_gen_u(&w, 1, 1);                         /* slice_loop_filter_across_slices_enabled_flag */
+    if (cfg->bWavefront) {
+        h265bs_gen_ue(&w, rows - 1);                /* num_entry_point_offsets */
+        if (rows > 1) {
+            size = C_MAX(h265bs_gen_bit_len(maxSize - 1), 1);
+            h265bs_gen_ue(&w, size - 1);            /* offset_len_minus1 */
+            for (i = 0; i < rows - 1; i++) {
+                h265bs_gen_u(&w, subOff[i + 1] - subOff[i] - 1, size);
+            }
+        }
+    }
+    h265bs_gen_align(&w);
+
+    h265bs_gen_nal_head(b, cfg, rs, type);
+    h265bs_gen_put_bits(b, &w);
+    memcpy(b->buf + b->occupy, scratch->buf, scratch->occupy);
+    b->occupy += scratch->occupy;
+}
+
+static int h265bs_gen_frame_size(h265bs_gen_cfg_t *cfg, uint64_t *rs, int bIntra)
+{
+    int size = bIntra ? cfg->iFrameSize : cfg->pFrameSize;
+    int jitter = size * cfg->sizeJitter / 100;
+
+    if (jitter > 0) {
+        size += (int)(h265bs_gen_rand(rs) % (2 * jitter + 1)) - jitter;
+    }
+    return C_MAX(size, (cfg->slices + cfg->ctbRows) * 8);
+}
+
+static void usage(char *name)
+{
+    printf("Usage:%s [-n frames] [-g gop] [-s slices] [-i ibytes] [-p pbytes] [-j jitter%%] [-l long%%] [-e epPerKB] [-S seed]\n"
+            "       [-r WxH] [-q qp] [-d id] [-w] outname\n", name);
+    printf("\t-n frames  : pictures to generate, default 300\n");
+    printf("\t-g gop     : IDR interval, default 30\n");
+    printf("\t-s slices  : slices per picture, default 1\n");
+    printf("\t-i ibytes  : bytes of an IDR picture, default 60000\n");
+    printf("\t-p pbytes  : bytes of a TRAIL_R picture, default 8000\n");
+    printf("\t-j jitter  : +- percent of picture size, default 20\n");
+    printf("\t-l long    : percent of 4 byte start codes, default 50\n");
+    printf("\t-e epPerKB : emulation prevention bytes per KB, default 1\n");
+    printf("\t-S seed    : random seed, default 1\n");
+    printf("\t-r WxH     : picture size, multiples of 8, default 1920x1080\n");
+    printf("\t-q qp      : init_qp of the pps, the slices go round qp-3..qp+3, default 26\n");
+    printf("\t-d id      : vps, sps and pps id, default 0\n");
+    printf("\t-w         : wavefronts, every slice starts a CTB row and carries entry points\n");
+}
+
+int main(int argc, char *argv[])
+{
+    h265bs_gen_cfg_t cfg;
+    h265bs_gen_buf_t b;
+    h265bs_gen_buf_t scratch;
+    uint64_t rs = 0;
+    int opt = 0, i = 0, s = 0, bIntra = 0, frameSize = 0, sliceSize = 0, ctbCnt = 0, addr = 0, next = 0, rows = 0;
+    int out_fd = -1;
+    char *outname = NULL;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.frames = 300;
+    cfg.gopSize = 30;
+    cfg.slices = 1;
+    cfg.iFrameSize = 60000;
+    cfg.pFrameSize = 8000;
+    cfg.sizeJitter = 20;
+    cfg.longScPercent = 50;
+    cfg.epPerKB = 1;
+    cfg.seed = 1;
+    cfg.width = 1920;
+    cfg.height = 1080;
+    cfg.qp = 26;
+    while ((opt = getopt(argc, argv, "n:g:s:i:p:j:l:e:S:r:q:d:w")) != -1) {
+        switch (opt) {
+        case 'n': cfg.frames = atoi(optarg); break;
+        case 'g': cfg.gopSize = atoi(optarg); break;
+        case 's': cfg.slices = atoi(optarg); break;
+        case 'i': cfg.iFrameSize = atoi(optarg); break;
+        case 'p': cfg.pFrameSize = atoi(optarg); break;
+        case 'j': cfg.sizeJitter = atoi(optarg); break;
+        case 'l': cfg.longScPercent = atoi(optarg); break;
+        case 'e': cfg.epPerKB = atoi(optarg); break;
+        case 'S': cfg.seed = strtoull(optarg, NULL, 0); break;
+        case 'r': sscanf(optarg, "%dx%d", &cfg.width, &cfg.height); break;
+        case 'q': cfg.qp = atoi(optarg); break;
+        case 'd': cfg.psId = atoi(optarg); break;
+        case 'w': cfg.bWavefront = 1; break;
+        default:
+            usage(argv[0]);
+            goto err_invalid_cmdline;
+        }
+    }
+    cfg.ctbCols = (cfg.width + H265BS_GEN_CTB - 1) / H265BS_GEN_CTB;
+    cfg.ctbRows = (cfg.height + H265BS_GEN_CTB - 1) / H265BS_GEN_CTB;
+    ctbCnt = cfg.ctbCols * cfg.ctbRows;
+    if (argc - optind < 1 || cfg.frames <= 0 || cfg.gopSize <= 0 || cfg.slices <= 0
+            || cfg.width <= 0 || cfg.height <= 0 || cfg.width % 8 || cfg.height % 8 || cfg.ctbRows > H265BS_GEN_ROWS_MAX
+            || cfg.qp < 0 || cfg.qp > 51 || cfg.psId < 0 || cfg.psId >= 16
+            || cfg.slices > (cfg.bWavefront ? cfg.ctbRows : ctbCnt)) {
+        usage(argv[0]);
+        goto err_invalid_cmdline;
+    }
+    outname = argv[optind];
+    rs = cfg.seed ? cfg.seed : 1;
+    cfg.addrBits = h265bs_gen_bit_len(ctbCnt - 1);
+
+    /* worst case: jitter, one emulation byte per two payload bytes, headers */
+    b.size = C_MAX(cfg.iFrameSize, cfg.pFrameSize) * 2 + (cfg.slices + cfg.ctbRows) * 16;
+    b.size += b.size / 2;
+    scratch.size = b.size;
+    b.size += cfg.slices * H265BS_GEN_HDR_MAX;
+    b.buf = malloc(b.size);
+    if (b.buf == NULL) {
+        printf("malloc %d bytes failed\n", b.size);
+        goto err_malloc_buf;
+    }
+    scratch.buf = malloc(scratch.size);
+    if (scratch.buf == NULL) {
+        printf("malloc %d bytes failed\n", scratch.size);
+        goto err_malloc_scratch;
+    }
+
+    out_fd = open(outname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (out_fd < 0) {
+        printf("open %s failed:%s\n", outname, strerror(errno));
+        goto err_open_outname;
+    }
+
+    for (i = 0; i < cfg.frames; i++) {
+        b.occupy = 0;
+        bIntra = (i % cfg.gopSize) == 0;
+        if (bIntra) {
+            h265bs_gen_vps(&b, &cfg, &rs);
+            h265bs_gen_sps(&b, &cfg, &rs);
+            h265bs_gen_pps(&b, &cfg, &rs);
+        }
+        frameSize = h265bs_gen_frame_size(&cfg, &rs, bIntra);
+        sliceSize = frameSize / cfg.slices;
+        for (s = 0; s < cfg.slices; s++) {
+            if (cfg.bWavefront) {
+                addr = s * cfg.ctbRows / cfg.slices * cfg.ctbCols;
+                next = (s + 1) * cfg.ctbRows / cfg.slices * cfg.ctbCols;
+                rows = (next - addr) / cfg.ctbCols;
+            } else {
+                addr = (int)((int64_t)s * ctbCnt / cfg.slices);
+                rows = 1;
+            }
+            h265bs_gen_slice(&b, &scratch, &cfg, &rs, i, addr, rows, sliceSize);
+        }
+        if (write(out_fd, b.buf, b.occupy) != b.occupy) {
+            printf("write %s failed:%s\n", outname, strerror(errno));
+            goto err_write;
+        }
+    }
+
+    close(out_fd);
+    free(scratch.buf);
+    free(b.buf);
+    return 0;
+
+err_write:
+    close(out_fd);
+err_open_outname:
+    free(scratch.buf);
+err_malloc_scratch:
+    free(b.buf);
+err_malloc_buf:
+err_invalid_cmdline:
+    return -1;
+}
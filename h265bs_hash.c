@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "h265bs_hash.h"
+
+/****************************************************************************
+ * crc32c, Castagnoli polynomial, reflected
+ ****************************************************************************/
+#define H265BS_CRC32C_POLY      0x82f63b78u
+
+static uint32_t h265bs_crc32c_table[8][256];
+static int h265bs_crc32c_hw = 0;
+static pthread_once_t h265bs_crc32c_once = PTHREAD_ONCE_INIT;
+
+static void h265bs_crc32c_init(void)
+{
+    uint32_t crc = 0;
+    int i = 0, j = 0;
+
+#if defined(__x86_64__)
+    h265bs_crc32c_hw = __builtin_cpu_supports("sse4.2");
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+    h265bs_crc32c_hw = 1;
+#endif
+    if (h265bs_crc32c_hw) {
+        return;
+    }
+
+    for (i = 0; i < 256; i++) {
+        crc = i;
+        for (j = 0; j < 8; j++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? H265BS_CRC32C_POLY : 0);
+        }
+        h265bs_crc32c_table[0][i] = crc;
+    }
+    for (i = 0; i < 256; i++) {
+        for (j = 1; j < 8; j++) {
+            crc = h265bs_crc32c_table[j - 1][i];
+            h265bs_crc32c_table[j][i] = (crc >> 8) ^ h265bs_crc32c_table[0][crc & 0xff];
+        }
+    }
+}
+
+/* slicing by 8 for cpus without crc instructions */
+static uint32_t h265bs_crc32c_sw(uint32_t crc, const uint8_t *p, size_t len)
+{
+    uint64_t v = 0;
+
+    while (len >= 8) {
+        memcpy(&v, p, 8);
+        v ^= crc;
+        crc = h265bs_crc32c_table[7][v & 0xff] ^ h265bs_crc32c_table[6][(v >> 8) & 0xff]
+            ^ h265bs_crc32c_table[5][(v >> 16) & 0xff] ^ h265bs_crc32c_table[4][(v >> 24) & 0xff]
+            ^ h265bs_crc32c_table[3][(v >> 32) & 0xff] ^ h265bs_crc32c_table[2][(v >> 40) & 0xff]
+            ^ h265bs_crc32c_table[1][(v >> 48) & 0xff] ^ h265bs_crc32c_table[0][v >> 56];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = (crc >> 8) ^ h265bs_crc32c_table[0][(crc ^ *p++) & 0xff];
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t h265bs_crc32c_hw_run(uint32_t crc, const uint8_t *p, size_t len)
+{
+    uint64_t c = crc, v = 0;
+
+    while (len >= 8) {
+        memcpy(&v, p, 8);
+        c = __builtin_ia32_crc32di(c, v);
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        c = __builtin_ia32_crc32qi(c, *p++);
+    }
+    return c;
+}
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+static uint32_t h265bs_crc32c_hw_run(uint32_t crc, const uint8_t *p, size_t len)
+{
+    uint64_t v = 0;
+
+    while (len >= 8) {
+        memcpy(&v, p, 8);
+        crc = __crc32cd(crc, v);
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = __crc32cb(crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+uint32_t h265bs_crc32c(uint32_t crc, const void *buf, size_t len)
+{
+    pthread_once(&h265bs_crc32c_once, h265bs_crc32c_init);
+
+    crc = ~crc;
+#if defined(__x86_64__) || (defined(__aarch64__) && defined(__ARM_FEATURE_CRC32))
+    if (h265bs_crc32c_hw) {
+        return ~h265bs_crc32c_hw_run(crc, buf, len);
+    }
+#endif
+    return ~h265bs_crc32c_sw(crc, buf, len);
+}
+
+/****************************************************************************
+ * xxh64
+ ****************************************************************************/
+#define H265BS_XXH_P1   0x9E3779B185EBCA87ULL
+#define H265BS_XXH_P2   0xC2B2AE3D27D4EB4FULL
+#define H265BS_XXH_P3   0x165667B19E3779F9ULL
+#define H265BS_XXH_P4   0x85EBCA77C2B2AE63ULL
+#define H265BS_XXH_P5   0x27D4EB2F165667C5ULL
+
+#define H265BS_ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static inline uint64_t h265bs_xxh64_round(uint64_t acc, uint64_t v)
+{
+    acc += v * H265BS_XXH_P2;
+    acc = H265BS_ROTL64(acc, 31);
+    return acc * H265BS_XXH_P1;
+}
+
+static inline uint64_t h265bs_xxh64_merge(uint64_t acc, uint64_t v)
+{
+    acc ^= h265bs_xxh64_round(0, v);
+    return acc * H265BS_XXH_P1 + H265BS_XXH_P4;
+}
+
+uint64_t h265bs_xxh64(const void *buf, size_t len, uint64_t seed)
+{
+    const uint8_t *p = buf, *end = p + len;
+    uint64_t v1 = 0, v2 = 0, v3 = 0, v4 = 0, h = 0, k = 0;
+    uint32_t k32 = 0;
+
+    if (len >= 32) {
+        v1 = seed + H265BS_XXH_P1 + H265BS_XXH_P2;
+        v2 = seed + H265BS_XXH_P2;
+        v3 = seed;
+        v4 = seed - H265BS_XXH_P1;
+        do {
+            memcpy(&k, p, 8);      v1 = h265bs_xxh64_round(v1, k);
+            memcpy(&k, p + 8, 8);  v2 = h265bs_xxh64_round(v2, k);
+            memcpy(&k, p + 16, 8); v3 = h265bs_xxh64_round(v3, k);
+            memcpy(&k, p + 24, 8); v4 = h265bs_xxh64_round(v4, k);
+            p += 32;
+        } while (p + 32 <= end);
+        h = H265BS_ROTL64(v1, 1) + H265BS_ROTL64(v2, 7) + H265BS_ROTL64(v3, 12) + H265BS_ROTL64(v4, 18);
+        h = h265bs_xxh64_merge(h, v1);
+        h = h265bs_xxh64_merge(h, v2);
+        h = h265bs_xxh64_merge(h, v3);
+        h = h265bs_xxh64_merge(h, v4);
+    } else {
+        h = seed + H265BS_XXH_P5;
+    }
+    h += len;
+
+    while (p + 8 <= end) {
+        memcpy(&k, p, 8);
+        h ^= h265bs_xxh64_round(0, k);
+        h = H265BS_ROTL64(h, 27) * H265BS_XXH_P1 + H265BS_XXH_P4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        memcpy(&k32, p, 4);
+        h ^= (uint64_t)k32 * H265BS_XXH_P1;
+        h = H265BS_ROTL64(h, 23) * H265BS_XXH_P2 + H265BS_XXH_P3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p++) * H265BS_XXH_P5;
+        h = H265BS_ROTL64(h, 11) * H265BS_XXH_P1;
+    }
+
+    h ^= h >> 33;
+    h *= H265BS_XXH_P2;
+    h ^= h >> 29;
+    h *= H265BS_XXH_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t h265bs_hash(h265bs_hash_type_t type, const void *buf, size_t len)
+{
+    switch (type) {
+    case H265BS_HASH_CRC32C:
+        return h265bs_crc32c(0, buf, len);
+    case H265BS_HASH_XXH64:
+        return h265bs_xxh64(buf, len, 0);
+    default:
+        return 0;
+    }
+}
+
+const char *h265bs_hash_name(h265bs_hash_type_t type)
+{
+    switch (type) {
+    case H265BS_HASH_CRC32C:
+        return "crc32c";
+    case H265BS_HASH_XXH64:
+        return "xxh64";
+    default:
+        return "none";
+    }
+}
+
+int h265bs_hash_type(const char *name)
+{
+    if (!strcmp(name, "crc32c")) {
+        return H265BS_HASH_CRC32C;
+    } else if (!strcmp(name, "xxh64")) {
+        return H265BS_HASH_XXH64;
+    } else if (!strcmp(name, "none")) {
+        return H265BS_HASH_NONE;
+    }
+    return -1;
+}
@@ -0,0 +1,30 @@
+#ifndef __H265BS_HASH_H__
+#define __H265BS_HASH_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    H265BS_HASH_NONE    = 0,
+    H265BS_HASH_CRC32C  = 1,    /* sse4.2/armv8 crc instructions when the cpu has them */
+    H265BS_HASH_XXH64   = 2,
+} h265bs_hash_type_t;
+
+/* crc is the value of the bytes before, 0 to start */
+extern uint32_t h265bs_crc32c(uint32_t crc, const void *buf, size_t len);
+extern uint64_t h265bs_xxh64(const void *buf, size_t len, uint64_t seed);
+/* checksum of one access unit, 0 for H265BS_HASH_NONE */
+extern uint64_t h265bs_hash(h265bs_hash_type_t type, const void *buf, size_t len);
+extern const char *h265bs_hash_name(h265bs_hash_type_t type);
+/* "crc32c", "xxh64" or "none", -1 for anything else */
+extern int h265bs_hash_type(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __H265BS_HASH_H__ */
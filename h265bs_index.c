@@ -0,0 +1,494 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "h265bs_nal.h"
+#include "h265bs_hash.h"
+#include "h265bs_mem.h"
+#include "h265bs_slice.h"
+#include "h265bs_index.h"
+
+#define H265BS_INDEX_AU_CAP     1024
+/* resident part of the file while it is scanned */
+#define H265BS_INDEX_AHEAD      (8 * 1024 * 1024)
+#define H265BS_INDEX_STEP       (1024 * 1024)
+#define H265BS_INDEX_MAGIC      "H265IDX"
+#define H265BS_INDEX_VERSION    1
+
+/* head of a saved index, au[] and key[] follow */
+typedef struct {
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    auSize;         /* sizeof(h265bs_index_au_t) of the build which saved it */
+    int64_t     fileSize;
+    int64_t     mtimeNs;
+    int32_t     hashType;
+    int32_t     auCnt;
+    int32_t     keyCnt;
+    int32_t     maxKeySize;
+    int32_t     maxAuSize;
+} h265bs_index_file_t;
+
+static h265bs_index_au_t *h265bs_index_new_au(h265bs_index_t *idx)
+{
+    h265bs_index_au_t *au = NULL;
+
+    if (idx->auCnt == idx->auCap) {
+        au = realloc(idx->au, idx->auCap * 2 * sizeof(h265bs_index_au_t));
+        if (au == NULL) {
+            return NULL;
+        }
+        idx->au = au;
+        idx->auCap *= 2;
+    }
+    au = &idx->au[idx->auCnt++];
+    memset(au, 0, sizeof(*au));
+    return au;
+}
+
+static int h265bs_index_add_key(h265bs_index_t *idx, int auIdx)
+{
+    int *key = NULL;
+
+    if (idx->keyCnt == idx->keyCap) {
+        key = realloc(idx->key, idx->keyCap * 2 * sizeof(int));
+        if (key == NULL) {
+            return -1;
+        }
+        idx->key = key;
+        idx->keyCap *= 2;
+    }
+    idx->key[idx->keyCnt++] = auIdx;
+    return 0;
+}
+
+/* Close the access unit at auEnd, -1 when it is over maxAuSize */
+static int h265bs_index_au_end(h265bs_index_t *idx, h265bs_index_au_t *au, uint8_t *base, int64_t auEnd, int maxAuSize)
+{
+    if (maxAuSize > 0 && auEnd - au->off > maxAuSize) {
+        printf("h265bs_index:access unit %d of %lld bytes at %lld is over %d\n",
+                idx->auCnt - 1, (long long)(auEnd - au->off), (long long)au->off, maxAuSize);
+        return -1;
+    }
+    au->size = auEnd - au->off;
+    au->checksum = h265bs_hash(idx->hashType, base + au->off, au->size);
+    idx->maxAuSize = C_MAX(idx->maxAuSize, au->size);
+    return 0;
+}
+
+/* Split [base, end) into access units with the rules of the replay scanner,
+ * everything in front of the open access unit is given back as it goes */
+static int h265bs_index_scan(h265bs_index_t *idx, int fd, uint8_t *base, uint8_t *end, int maxAuSize)
+{
+    h265bs_mem_window_t window;
+    uint8_t *sc = NULL, *p = base;
+    h265bs_index_au_t *au = NULL;
+    uint32_t type = 0;
+    int scLen = 0, vclCnt = 0, bFirstSlice = 0;
+
+    h265bs_mem_window_init(&window, H265BS_INDEX_AHEAD, H265BS_INDEX_STEP, end - base);
+    while ((sc = h265bs_nal_find_start_code(p, end)) != NULL) {
+        h265bs_mem_window_advise(&window, fd, base, 0, end - base, sc - base, au ? au->off : 0);
+        if ((sc > p) && (sc[-1] == 0x00)) {
+            sc--;
+        }
+        scLen = (sc[2] == 0x01) ? 3 : 4;
+        if (end - sc < scLen + 2) {
+            break;
+        }
+        type = H265BS_NAL_TYPE(sc + scLen);
+        bFirstSlice = (end - sc > scLen + 2) ? H265BS_NAL_FIRST_SLICE(sc + scLen) : 1;
+
+        if ((au == NULL) || h265bs_nal_au_boundary(type, bFirstSlice, vclCnt > 0)) {
+            if (au && h265bs_index_au_end(idx, au, base, sc - base, maxAuSize) < 0) {
+                return -1;
+            }
+            au = h265bs_index_new_au(idx);
+            if (au == NULL) {
+                printf("h265bs_index:realloc au table failed\n");
+                return -1;
+            }
+            au->off = sc - base;
+            vclCnt = 0;
+        }
+
+        au->nalCnt++;
+        if (h265bs_nal_is_vcl(type)) {
+            if (vclCnt++ == 0) {
+                au->type = type;
+                if (h265bs_nal_is_irap(type)) {
+                    au->flags |= H265BS_AU_F_IRAP;
+                    if (h265bs_index_add_key(idx, idx->auCnt - 1) < 0) {
+                        printf("h265bs_index:realloc key table failed\n");
+                        return -1;
+                    }
+                }
+                if (h265bs_nal_is_idr(type)) {
+                    au->flags |= H265BS_AU_F_IDR;
+                }
+            }
+        } else if (type >= I265E_NAL_VPS && type <= I265E_NAL_PPS) {
+            au->flags |= H265BS_AU_F_PARAM;
+        }
+        p = sc + scLen + 2;
+    }
+    if (au && h265bs_index_au_end(idx, au, base, end - base, maxAuSize) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+h265bs_index_t *h265bs_index_build(int fd, int hashType, int maxAuSize)
+{
+    struct stat stat_buf;
+    uint8_t *base = MAP_FAILED;
+    h265bs_index_t *idx = NULL;
+    int i = 0;
+
+    if (fstat(fd, &stat_buf) < 0 || !S_ISREG(stat_buf.st_mode) || stat_buf.st_size == 0) {
+        printf("h265bs_index:input is not a non-empty regular file\n");
+        goto err_fstat;
+    }
+
+    idx = calloc(1, sizeof(h265bs_index_t));
+    if (idx == NULL) {
+        printf("h265bs_index:calloc h265bs_index_t failed\n");
+        goto err_calloc_idx;
+    }
+    idx->fileSize = stat_buf.st_size;
+    idx->hashType = hashType;
+    idx->auCap = idx->keyCap = H265BS_INDEX_AU_CAP;
+    idx->au = malloc(idx->auCap * sizeof(h265bs_index_au_t));
+    idx->key = malloc(idx->keyCap * sizeof(int));
+    if (idx->au == NULL || idx->key == NULL) {
+        printf("h265bs_index:malloc tables failed\n");
+        goto err_malloc_table;
+    }
+
+    base = mmap(NULL, idx->fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) {
+        printf("h265bs_index:mmap failed:%s\n", strerror(errno));
+        goto err_mmap;
+    }
+    madvise(base, idx->fileSize, MADV_SEQUENTIAL);
+
+    if (h265bs_index_scan(idx, fd, base, base + idx->fileSize, maxAuSize) < 0) {
+        goto err_scan;
+    }
+    munmap(base, idx->fileSize);
+    for (i = 0; i < idx->keyCnt; i++) {
+        idx->maxKeySize = C_MAX(idx->maxKeySize, idx->au[idx->key[i]].size);
+    }
+
+    return idx;
+
+err_scan:
+    munmap(base, idx->fileSize);
+err_mmap:
+err_malloc_table:
+    h265bs_index_free(idx);
+err_calloc_idx:
+err_fstat:
+    return NULL;
+}
+
+void h265bs_index_free(h265bs_index_t *idx)
+{
+    if (idx) {
+        h265bs_slice_deinit(idx->slice);
+        free(idx->sliceBuf);
+        free(idx->key);
+        free(idx->au);
+        free(idx);
+    }
+}
+
+static int h265bs_index_file_head(h265bs_index_file_t *head, int srcFd)
+{
+    struct stat stat_buf;
+
+    if (fstat(srcFd, &stat_buf) < 0) {
+        printf("h265bs_index:fstat input failed:%s\n", strerror(errno));
+        return -1;
+    }
+    memset(head, 0, sizeof(*head));
+    memcpy(head->magic, H265BS_INDEX_MAGIC, sizeof(H265BS_INDEX_MAGIC));
+    head->version = H265BS_INDEX_VERSION;
+    head->auSize = sizeof(h265bs_index_au_t);
+    head->fileSize = stat_buf.st_size;
+    head->mtimeNs = stat_buf.st_mtim.tv_sec * 1000000000LL + stat_buf.st_mtim.tv_nsec;
+    return 0;
+}
+
+static int h265bs_index_io(int fd, void *buf, int64_t size, int bWrite)
+{
+    uint8_t *p = buf;
+    ssize_t n = 0;
+
+    while (size > 0) {
+        n = bWrite ? write(fd, p, size) : read(fd, p, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+int h265bs_index_save(h265bs_index_t *idx, int srcFd, const char *name)
+{
+    h265bs_index_file_t head;
+    int fd = -1;
+
+    if (h265bs_index_file_head(&head, srcFd) < 0) {
+        goto err_head;
+    }
+    if (head.fileSize != idx->fileSize) {
+        printf("h265bs_index:index of %lld bytes, the input has %lld\n", (long long)idx->fileSize, (long long)head.fileSize);
+        goto err_head;
+    }
+    head.hashType = idx->hashType;
+    head.auCnt = idx->auCnt;
+    head.keyCnt = idx->keyCnt;
+    head.maxKeySize = idx->maxKeySize;
+    head.maxAuSize = idx->maxAuSize;
+
+    fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        printf("h265bs_index:open %s failed:%s\n", name, strerror(errno));
+        goto err_open;
+    }
+    if (h265bs_index_io(fd, &head, sizeof(head), 1) < 0
+            || h265bs_index_io(fd, idx->au, (int64_t)idx->auCnt * sizeof(h265bs_index_au_t), 1) < 0
+            || h265bs_index_io(fd, idx->key, (int64_t)idx->keyCnt * sizeof(int), 1) < 0) {
+        printf("h265bs_index:write %s failed:%s\n", name, strerror(errno));
+        goto err_write;
+    }
+    close(fd);
+    return 0;
+
+err_write:
+    close(fd);
+    unlink(name);
+err_open:
+err_head:
+    return -1;
+}
+
+h265bs_index_t *h265bs_index_load(const char *name, int srcFd)
+{
+    h265bs_index_file_t head, src;
+    h265bs_index_t *idx = NULL;
+    int fd = -1, i = 0;
+
+    if (h265bs_index_file_head(&src, srcFd) < 0) {
+        goto err_head;
+    }
+    fd = open(name, O_RDONLY);
+    if (fd < 0) {
+        goto err_open;
+    }
+    if (h265bs_index_io(fd, &head, sizeof(head), 0) < 0 || memcmp(head.magic, src.magic, sizeof(head.magic))
+            || head.version != src.version || head.auSize != src.auSize) {
+        printf("h265bs_index:%s is not an index of this build\n", name);
+        goto err_head_read;
+    }
+    if (head.fileSize != src.fileSize || head.mtimeNs != src.mtimeNs) {
+        printf("h265bs_index:%s is stale, the input changed\n", name);
+        goto err_head_read;
+    }
+    if (head.auCnt <= 0 || head.keyCnt < 0 || head.keyCnt > head.auCnt) {
+        printf("h265bs_index:%s has %d access units and %d keyframes\n", name, head.auCnt, head.keyCnt);
+        goto err_head_read;
+    }
+
+    idx = calloc(1, sizeof(h265bs_index_t));
+    if (idx == NULL) {
+        printf("h265bs_index:calloc h265bs_index_t failed\n");
+        goto err_calloc_idx;
+    }
+    idx->fileSize = head.fileSize;
+    idx->hashType = head.hashType;
+    idx->auCnt = idx->auCap = head.auCnt;
+    idx->keyCnt = head.keyCnt;
+    idx->keyCap = C_MAX(head.keyCnt, 1);
+    idx->maxKeySize = head.maxKeySize;
+    idx->maxAuSize = head.maxAuSize;
+    idx->au = malloc(idx->auCap * sizeof(h265bs_index_au_t));
+    idx->key = malloc(idx->keyCap * sizeof(int));
+    if (idx->au == NULL || idx->key == NULL) {
+        printf("h265bs_index:malloc tables failed\n");
+        goto err_malloc_table;
+    }
+    if (h265bs_index_io(fd, idx->au, (int64_t)idx->auCnt * sizeof(h265bs_index_au_t), 0) < 0
+            || h265bs_index_io(fd, idx->key, (int64_t)idx->keyCnt * sizeof(int), 0) < 0) {
+        printf("h265bs_index:%s is cut short\n", name);
+        goto err_read;
+    }
+    for (i = 0; i < idx->keyCnt; i++) {
+        if (idx->key[i] < 0 || idx->key[i] >= idx->auCnt) {
+            printf("h265bs_index:%s keyframe %d is out of its %d access units\n", name, idx->key[i], idx->auCnt);
+            goto err_read;
+        }
+    }
+    close(fd);
+    return idx;
+
+err_read:
+err_malloc_table:
+    h265bs_index_free(idx);
+err_calloc_idx:
+err_head_read:
+    close(fd);
+err_open:
+err_head:
+    return NULL;
+}
+
+int h265bs_index_key_before(h265bs_index_t *idx, int auIdx)
+{
+    int lo = 0, hi = idx->keyCnt - 1, mid = 0, ret = -1;
+
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if (idx->key[mid] <= auIdx) {
+            ret = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return ret;
+}
+
+static const uint8_t *h265bs_index_read(h265bs_index_t *idx, int fd, h265bs_index_au_t *au)
+{
+    uint8_t *buf = NULL;
+    int n = 0, off = 0;
+
+    if (au->size > idx->sliceBufSize) {
+        buf = realloc(idx->sliceBuf, au->size);
+        if (buf == NULL) {
+            printf("h265bs_index:realloc slice buffer failed\n");
+            return NULL;
+        }
+        idx->sliceBuf = buf;
+        idx->sliceBufSize = au->size;
+    }
+    while (off < au->size) {
+        n = pread(fd, idx->sliceBuf + off, au->size - off, au->off + off);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            printf("h265bs_index:pread au at %lld failed:%s\n", (long long)au->off, n < 0 ? strerror(errno) : "end of file");
+            return NULL;
+        }
+        off += n;
+    }
+    return idx->sliceBuf;
+}
+
+/* The nals of one access unit through the slice parser, the entry takes
+ * what the first slice segment tells. bParamOnly only updates the
+ * parameter sets */
+static void h265bs_index_slice_au(h265bs_index_t *idx, h265bs_index_au_t *au, const uint8_t *buf, int size, int bParamOnly)
+{
+    const uint8_t *end = buf + size, *p = NULL, *sc = NULL;
+    h265bs_slice_info_t info;
+    uint32_t type = 0;
+    int scLen = 0, bFound = 0;
+
+    for (p = buf; end - p > 4; p = sc) {
+        scLen = (p[2] == 0x01) ? 3 : 4;
+        sc = h265bs_nal_find_start_code((uint8_t *)p + scLen, (uint8_t *)end);
+        if (sc == NULL) {
+            sc = end;
+        } else if (sc[-1] == 0x00) {
+            sc--;
+        }
+        type = H265BS_NAL_TYPE(p + scLen);
+        if (bParamOnly && (type < I265E_NAL_VPS || type > I265E_NAL_PPS)) {
+            continue;
+        }
+        if (h265bs_slice_nal(idx->slice, p, sc - p, &info) == 1 && !bFound) {
+            au->poc = info.poc;
+            au->sliceType = info.sliceType;
+            au->qp = info.qp;
+            au->tid = info.tid;
+            bFound = 1;
+        }
+    }
+    if (!bParamOnly) {
+        if (!bFound) {
+            au->sliceType = -1;
+        }
+        au->flags |= H265BS_AU_F_SLICE;
+    }
+}
+
+int h265bs_index_slice(h265bs_index_t *idx, int fd, int auIdx, const uint8_t *buf, int size)
+{
+    h265bs_index_au_t *au = idx->au;
+    const uint8_t *data = NULL;
+    int s = auIdx, k = 0;
+
+    if (au[auIdx].flags & H265BS_AU_F_SLICE) {
+        return 0;
+    }
+    if (idx->slice == NULL) {
+        idx->slice = h265bs_slice_init();
+        if (idx->slice == NULL) {
+            return -1;
+        }
+    }
+
+    /* back to where the POC is known, filled entries reach back to one */
+    while (s > 0 && !(au[s - 1].flags & H265BS_AU_F_SLICE)
+            && !((au[s].flags & H265BS_AU_F_IRAP) && au[s].type < I265E_NAL_CODED_SLICE_CRA)) {
+        s--;
+    }
+    if (s == 0) {
+        h265bs_slice_restart(idx->slice);
+    } else if (au[s - 1].flags & H265BS_AU_F_SLICE) {
+        for (k = s - 1; k > 0 && !h265bs_slice_is_tid0_ref(au[k].type, au[k].tid); k--);
+        h265bs_slice_set_prev_poc(idx->slice, au[k].poc);
+    }
+    /* a jump, the parameter sets in force may be further back */
+    if (s != idx->sliceNext) {
+        for (k = s - 1; k >= 0 && !(au[k].flags & H265BS_AU_F_PARAM); k--);
+        if (k >= 0 && (data = h265bs_index_read(idx, fd, &au[k])) != NULL) {
+            h265bs_index_slice_au(idx, &au[k], data, au[k].size, 1);
+        }
+    }
+
+    for (k = s; k <= auIdx; k++) {
+        data = (k == auIdx && buf) ? buf : h265bs_index_read(idx, fd, &au[k]);
+        if (data == NULL) {
+            idx->sliceNext = -1;
+            return -1;
+        }
+        h265bs_index_slice_au(idx, &au[k], data, k == auIdx && buf ? size : au[k].size, 0);
+    }
+    idx->sliceNext = auIdx + 1;
+
+    return 0;
+}
+
+void h265bs_index_dump(h265bs_index_t *idx)
+{
+    if (idx) {
+        printf("h265bs_index:fileSize=%lld, auCnt=%d, keyCnt=%d, maxKeySize=%d, maxAuSize=%d, hash=%s\n",
+                (long long)idx->fileSize, idx->auCnt, idx->keyCnt, idx->maxKeySize, idx->maxAuSize, h265bs_hash_name(idx->hashType));
+    }
+}
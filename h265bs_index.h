@@ -0,0 +1,76 @@
+#ifndef __H265BS_INDEX_H__
+#define __H265BS_INDEX_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define H265BS_AU_F_IRAP        (1 << 0)
+#define H265BS_AU_F_IDR         (1 << 1)
+#define H265BS_AU_F_PARAM       (1 << 2)    /* carries VPS/SPS/PPS */
+#define H265BS_AU_F_SLICE       (1 << 3)    /* poc, sliceType, qp and tid are filled */
+
+/* One access unit of the file, AU boundaries follow the replay scanner so
+ * au[n] is the n-th frame the replay engine emits. Both split at the nals
+ * which start an access unit only, whatever its nal count */
+typedef struct {
+    int64_t     off;            /* first start code of the access unit */
+    int32_t     size;
+    uint8_t     type;           /* nal type of the first slice */
+    uint8_t     flags;          /* H265BS_AU_F_* */
+    uint16_t    nalCnt;
+    uint64_t    checksum;       /* h265bs_hash() of the access unit bytes */
+    /* first slice segment header, filled by h265bs_index_slice */
+    int32_t     poc;
+    int8_t      sliceType;      /* H265BS_SLICE_*, -1 when it could not be parsed */
+    int8_t      qp;
+    uint8_t     tid;
+} h265bs_index_au_t;
+
+typedef struct {
+    int64_t             fileSize;
+    int                 hashType;   /* h265bs_hash_type_t of au[].checksum */
+    h265bs_index_au_t   *au;
+    int                 auCnt;
+    int                 auCap;
+    int                 *key;       /* au indexes of the IRAP access units */
+    int                 keyCnt;
+    int                 keyCap;
+    int32_t             maxKeySize;
+    int32_t             maxAuSize;
+
+    /* slice header parsing of h265bs_index_slice, sliceNext is the access
+     * unit the parser state is right for */
+    struct h265bs_slice *slice;
+    int                 sliceNext;
+    uint8_t             *sliceBuf;
+    int                 sliceBufSize;
+} h265bs_index_t;
+
+/* Scan the whole file once, fd must be a regular file. An access unit over
+ * maxAuSize bytes fails the scan, the replay engine can not carry it
+ * whole and would drop it, 0 for no limit */
+extern h265bs_index_t *h265bs_index_build(int fd, int hashType, int maxAuSize);
+extern void h265bs_index_free(h265bs_index_t *idx);
+/* Keep the index of the file behind srcFd in name, raw tables in host
+ * byte order with the size and mtime of the file. Load gives NULL when
+ * name is missing, from another build or the file changed since */
+extern int h265bs_index_save(h265bs_index_t *idx, int srcFd, const char *name);
+extern h265bs_index_t *h265bs_index_load(const char *name, int srcFd);
+/* Position in key[] of the last keyframe at or before auIdx, -1 if none */
+extern int h265bs_index_key_before(h265bs_index_t *idx, int auIdx);
+/* Fill the slice header fields of au[auIdx] unless they are already. The
+ * access units in front are parsed first up to one whose POC is known, an
+ * IDR, BLA or filled one, read from fd. buf(size bytes) is au[auIdx] when
+ * the caller has it in memory, NULL to read it too. 0 when the entry is
+ * filled, even if with sliceType -1, -1 when the file can not be read */
+extern int h265bs_index_slice(h265bs_index_t *idx, int fd, int auIdx, const uint8_t *buf, int size);
+extern void h265bs_index_dump(h265bs_index_t *idx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __H265BS_INDEX_H__ */
@@ -0,0 +1,774 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>
+
+#include "icommon.h"
+#include "h265bs_mem.h"
+#include "h265bs_ingest.h"
+
+typedef enum {
+    H265BS_SLOT_FREE        = 0,
+    H265BS_SLOT_INFLIGHT    = 1,
+    H265BS_SLOT_READY       = 2,
+} h265bs_slot_state_t;
+
+/* Read buffers rotate in submission order: head is consumed next, tail is
+ * filled next, count slots between them are in flight or ready */
+typedef struct {
+    uint8_t *buf;
+    h265bs_slot_state_t state;
+    int64_t off;
+    int len;            /* bytes read, 0 end of file, <0 -errno */
+    int pos;            /* bytes already handed to the caller */
+    struct iovec iov;
+} h265bs_ingest_slot_t;
+
+struct h265bs_ingest {
+    int fd;
+    h265bs_ingest_cfg_t cfg;
+    h265bs_ingest_mode_t mode;
+    int bSeekable;
+
+    uint8_t *bufBase;
+    h265bs_ingest_slot_t *slot;
+    int head;
+    int tail;
+    int count;
+    int64_t nextOff;
+    int bFillEof;       /* the fill side saw end of file, stop reading ahead */
+
+    h265bs_ingest_stat_t stat;
+
+    /* io_uring context */
+    int ringFd;
+    void *sqRing;
+    size_t sqRingSize;
+    void *cqRing;
+    size_t cqRingSize;
+    struct io_uring_sqe *sqes;
+    size_t sqesSize;
+    unsigned *sqTail;
+    unsigned *sqMask;
+    unsigned *sqArray;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqMask;
+    struct io_uring_cqe *cqes;
+    int inflight;
+
+    /* read-ahead thread context */
+    pthread_t tid;
+    pthread_mutex_t mutex;
+    pthread_cond_t fillCond;
+    pthread_cond_t readyCond;
+    int gen;
+    int64_t seekOff;    /* where the thread reads from once gen changed */
+    int bBusy;          /* the thread is in read() with the fd it took */
+    int stopFd;         /* eventfd deinit wakes a read() on an idle pipe with */
+    int bStop;
+    int bThread;
+
+    /* mmap window context, queueDepth * readSize is kept resident ahead */
+    uint8_t *map;
+    int64_t mapOff;
+    int64_t mapLen;
+    int64_t fileSize;
+    int64_t pos;
+    h265bs_mem_window_t window;
+};
+
+/****************************************************************************
+ * io_uring backend, raw syscalls so there is no liburing dependency
+ ****************************************************************************/
+static int h265bs_uring_setup(h265bs_ingest_t *ing)
+{
+    struct io_uring_params p;
+    uint8_t *sq = NULL, *cq = NULL;
+
+    memset(&p, 0, sizeof(p));
+    ing->ringFd = syscall(__NR_io_uring_setup, ing->cfg.queueDepth, &p);
+    if (ing->ringFd < 0) {
+        printf("h265bs_ingest:io_uring_setup failed:%s\n", strerror(errno));
+        return -1;
+    }
+
+    ing->sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ing->cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ing->sqRingSize = ing->cqRingSize = C_MAX(ing->sqRingSize, ing->cqRingSize);
+    }
+
+    sq = mmap(NULL, ing->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ing->ringFd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) {
+        printf("h265bs_ingest:mmap sq ring failed:%s\n", strerror(errno));
+        goto err_mmap_sq;
+    }
+    ing->sqRing = sq;
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        cq = sq;
+    } else {
+        cq = mmap(NULL, ing->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ing->ringFd, IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED) {
+            printf("h265bs_ingest:mmap cq ring failed:%s\n", strerror(errno));
+            goto err_mmap_cq;
+        }
+    }
+    ing->cqRing = cq;
+
+    ing->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+    ing->sqes = mmap(NULL, ing->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ing->ringFd, IORING_OFF_SQES);
+    if (ing->sqes == MAP_FAILED) {
+        printf("h265bs_ingest:mmap sqes failed:%s\n", strerror(errno));
+        goto err_mmap_sqes;
+    }
+
+    ing->sqTail = (unsigned *)(sq + p.sq_off.tail);
+    ing->sqMask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ing->sqArray = (unsigned *)(sq + p.sq_off.array);
+    ing->cqHead = (unsigned *)(cq + p.cq_off.head);
+    ing->cqTail = (unsigned *)(cq + p.cq_off.tail);
+    ing->cqMask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ing->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    return 0;
+
+err_mmap_sqes:
+    if (ing->cqRing != ing->sqRing) munmap(ing->cqRing, ing->cqRingSize);
+err_mmap_cq:
+    munmap(ing->sqRing, ing->sqRingSize);
+err_mmap_sq:
+    close(ing->ringFd);
+    ing->ringFd = -1;
+    return -1;
+}
+
+static void h265bs_uring_teardown(h265bs_ingest_t *ing)
+{
+    if (ing->ringFd >= 0) {
+        munmap(ing->sqes, ing->sqesSize);
+        if (ing->cqRing != ing->sqRing) munmap(ing->cqRing, ing->cqRingSize);
+        munmap(ing->sqRing, ing->sqRingSize);
+        close(ing->ringFd);
+        ing->ringFd = -1;
+    }
+}
+
+static int h265bs_uring_submit(h265bs_ingest_t *ing, int idx)
+{
+    h265bs_ingest_slot_t *slot = &ing->slot[idx];
+    unsigned tail = *ing->sqTail;
+    unsigned sqIdx = tail & *ing->sqMask;
+    struct io_uring_sqe *sqe = &ing->sqes[sqIdx];
+    int ret = 0;
+
+    /* READV instead of READ keeps 5.1 kernels working */
+    slot->iov.iov_base = slot->buf;
+    slot->iov.iov_len = ing->cfg.readSize;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = ing->fd;
+    sqe->off = slot->off;
+    sqe->addr = (uintptr_t)&slot->iov;
+    sqe->len = 1;
+    sqe->user_data = idx;
+    ing->sqArray[sqIdx] = sqIdx;
+    __atomic_store_n(ing->sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    do {
+        ret = syscall(__NR_io_uring_enter, ing->ringFd, 1, 0, 0, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        printf("h265bs_ingest:io_uring_enter submit failed:%s\n", strerror(errno));
+        return -1;
+    }
+
+    slot->state = H265BS_SLOT_INFLIGHT;
+    ing->inflight++;
+    return 0;
+}
+
+static int h265bs_uring_reap(h265bs_ingest_t *ing, int bWait)
+{
+    unsigned head = 0;
+    struct io_uring_cqe *cqe = NULL;
+    h265bs_ingest_slot_t *slot = NULL;
+    int ret = 0, reaped = 0;
+
+    if (bWait) {
+        do {
+            ret = syscall(__NR_io_uring_enter, ing->ringFd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        } while (ret < 0 && errno == EINTR);
+        if (ret < 0) {
+            printf("h265bs_ingest:io_uring_enter wait failed:%s\n", strerror(errno));
+            return -1;
+        }
+    }
+
+    head = *ing->cqHead;
+    while (head != __atomic_load_n(ing->cqTail, __ATOMIC_ACQUIRE)) {
+        cqe = &ing->cqes[head & *ing->cqMask];
+        slot = &ing->slot[cqe->user_data];
+        slot->len = cqe->res;
+        slot->pos = 0;
+        slot->state = H265BS_SLOT_READY;
+        if (cqe->res <= 0) {
+            ing->bFillEof = 1;
+        } else {
+            ing->stat.readBytes += cqe->res;
+            ing->stat.readCnt++;
+        }
+        ing->inflight--;
+        head++;
+        reaped++;
+    }
+    __atomic_store_n(ing->cqHead, head, __ATOMIC_RELEASE);
+
+    return reaped;
+}
+
+static void h265bs_uring_fill(h265bs_ingest_t *ing)
+{
+    h265bs_ingest_slot_t *slot = NULL;
+
+    /* a pipe has no offsets, more than one read in flight could reorder it */
+    while (!ing->bFillEof && ing->count < ing->cfg.queueDepth
+            && (ing->bSeekable || ing->inflight == 0)) {
+        slot = &ing->slot[ing->tail];
+        slot->off = ing->bSeekable ? ing->nextOff : -1;
+        if (h265bs_uring_submit(ing, ing->tail) < 0) {
+            break;
+        }
+        ing->nextOff += ing->cfg.readSize;
+        ing->tail = (ing->tail + 1) % ing->cfg.queueDepth;
+        ing->count++;
+    }
+}
+
+static void h265bs_uring_drain(h265bs_ingest_t *ing)
+{
+    while (ing->inflight > 0) {
+        if (h265bs_uring_reap(ing, 1) < 0) {
+            break;
+        }
+    }
+}
+
+static void h265bs_uring_reset(h265bs_ingest_t *ing, int64_t off)
+{
+    int i = 0;
+
+    h265bs_uring_drain(ing);
+    for (i = 0; i < ing->cfg.queueDepth; i++) {
+        ing->slot[i].state = H265BS_SLOT_FREE;
+    }
+    ing->head = ing->tail = ing->count = 0;
+    ing->nextOff = off;
+    ing->bFillEof = 0;
+}
+
+static int h265bs_uring_read(h265bs_ingest_t *ing, uint8_t *dst, int size)
+{
+    h265bs_ingest_slot_t *slot = NULL;
+    int n = 0;
+
+    while (1) {
+        h265bs_uring_fill(ing);
+        if (ing->count == 0) {
+            return 0;
+        }
+        slot = &ing->slot[ing->head];
+        if (slot->state == H265BS_SLOT_INFLIGHT) {
+            /* reap whatever already landed before going to sleep */
+            if (h265bs_uring_reap(ing, 0) == 0) {
+                ing->stat.waitCnt++;
+                if (h265bs_uring_reap(ing, 1) < 0) {
+                    return -1;
+                }
+            }
+            continue;
+        }
+        if (slot->len <= 0) {
+            return slot->len;
+        }
+
+        n = C_MIN(size, slot->len - slot->pos);
+        memcpy(dst, slot->buf + slot->pos, n);
+        slot->pos += n;
+        if (slot->pos == slot->len) {
+            slot->state = H265BS_SLOT_FREE;
+            ing->head = (ing->head + 1) % ing->cfg.queueDepth;
+            ing->count--;
+            /* a short file read leaves the later offsets wrong, read again from here */
+            if (ing->bSeekable && slot->len < ing->cfg.readSize) {
+                h265bs_uring_reset(ing, slot->off + slot->len);
+            }
+        }
+        return n;
+    }
+}
+
+/****************************************************************************
+ * read-ahead thread backend
+ ****************************************************************************/
+/* Wait until fd has data or stopFd is written, 0 when read() will not block
+ * for long, -1 to stop. A regular file is always readable */
+static int h265bs_ingest_wait(h265bs_ingest_t *ing, int fd)
+{
+    struct pollfd pfd[2];
+
+    pfd[0].fd = fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = ing->stopFd;
+    pfd[1].events = POLLIN;
+    while (poll(pfd, 2, -1) < 0) {
+        if (errno != EINTR) {
+            return 0;   /* let read() report it */
+        }
+    }
+    return (pfd[1].revents & POLLIN) ? -1 : 0;
+}
+
+static void *h265bs_ingest_thread(void *arg)
+{
+    h265bs_ingest_t *ing = arg;
+    h265bs_ingest_slot_t *slot = NULL;
+    int gen = 0, seekGen = 0, n = 0, fd = -1;
+    int64_t seekOff = 0;
+
+    /* next to its read buffers, like the enc thread */
+    if (ing->cfg.numaNode != H265BS_MEM_NODE_ANY) {
+        h265bs_mem_bind_thread(ing->cfg.numaNode);
+    }
+    pthread_mutex_lock(&ing->mutex);
+    seekGen = ing->gen;
+    while (!ing->bStop) {
+        if (ing->bFillEof || ing->count == ing->cfg.queueDepth) {
+            pthread_cond_wait(&ing->fillCond, &ing->mutex);
+            continue;
+        }
+
+        slot = &ing->slot[ing->tail];
+        gen = ing->gen;
+        seekOff = ing->seekOff;
+        fd = ing->fd;
+        ing->bBusy = 1;
+        pthread_mutex_unlock(&ing->mutex);
+
+        /* the seek is done here so it never races with our own read() */
+        if (seekGen != gen) {
+            lseek(fd, seekOff, SEEK_SET);
+            seekGen = gen;
+        }
+        if (h265bs_ingest_wait(ing, fd) < 0) {
+            pthread_mutex_lock(&ing->mutex);
+            ing->bBusy = 0;
+            pthread_cond_broadcast(&ing->readyCond);
+            break;
+        }
+        do {
+            n = read(fd, slot->buf, ing->cfg.readSize);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) {
+            n = -errno;
+        }
+
+        pthread_mutex_lock(&ing->mutex);
+        ing->bBusy = 0;
+        if (gen != ing->gen) {
+            pthread_cond_broadcast(&ing->readyCond);
+            continue;   /* rewound while reading, drop it */
+        }
+        slot->len = n;
+        slot->pos = 0;
+        slot->state = H265BS_SLOT_READY;
+        ing->tail = (ing->tail + 1) % ing->cfg.queueDepth;
+        ing->count++;
+        if (n <= 0) {
+            ing->bFillEof = 1;
+        } else {
+            ing->stat.readBytes += n;
+            ing->stat.readCnt++;
+        }
+        pthread_cond_signal(&ing->readyCond);
+    }
+    pthread_mutex_unlock(&ing->mutex);
+
+    return NULL;
+}
+
+static int h265bs_thread_read(h265bs_ingest_t *ing, uint8_t *dst, int size)
+{
+    h265bs_ingest_slot_t *slot = NULL;
+    int n = 0;
+
+    pthread_mutex_lock(&ing->mutex);
+    if (ing->count == 0) {
+        ing->stat.waitCnt++;
+        while (ing->count == 0) {
+            pthread_cond_wait(&ing->readyCond, &ing->mutex);
+        }
+    }
+    slot = &ing->slot[ing->head];
+    pthread_mutex_unlock(&ing->mutex);
+
+    if (slot->len <= 0) {
+        return slot->len;
+    }
+
+    /* a ready slot is never touched by the thread, copy without the lock */
+    n = C_MIN(size, slot->len - slot->pos);
+    memcpy(dst, slot->buf + slot->pos, n);
+    slot->pos += n;
+
+    if (slot->pos == slot->len) {
+        pthread_mutex_lock(&ing->mutex);
+        slot->state = H265BS_SLOT_FREE;
+        ing->head = (ing->head + 1) % ing->cfg.queueDepth;
+        ing->count--;
+        pthread_cond_signal(&ing->fillCond);
+        pthread_mutex_unlock(&ing->mutex);
+    }
+
+    return n;
+}
+
+static int h265bs_thread_seek(h265bs_ingest_t *ing, int64_t off)
+{
+    int i = 0;
+
+    pthread_mutex_lock(&ing->mutex);
+    ing->gen++;
+    ing->seekOff = off;
+    for (i = 0; i < ing->cfg.queueDepth; i++) {
+        ing->slot[i].state = H265BS_SLOT_FREE;
+    }
+    ing->head = ing->tail = ing->count = 0;
+    ing->bFillEof = 0;
+    pthread_cond_signal(&ing->fillCond);
+    pthread_mutex_unlock(&ing->mutex);
+
+    return 0;
+}
+
+/****************************************************************************
+ * sliding mmap window backend
+ ****************************************************************************/
+static void h265bs_mmap_unmap(h265bs_ingest_t *ing)
+{
+    if (ing->map) {
+        munmap(ing->map, ing->mapLen);
+        ing->map = NULL;
+        ing->mapLen = 0;
+    }
+}
+
+/* Map windowSize bytes from the page holding pos, the file may have grown */
+static int h265bs_mmap_remap(h265bs_ingest_t *ing)
+{
+    struct stat stat_buf;
+    int64_t off = ing->pos & ~(int64_t)4095;
+
+    h265bs_mmap_unmap(ing);
+    if (fstat(ing->fd, &stat_buf) < 0) {
+        return -1;
+    }
+    ing->fileSize = stat_buf.st_size;
+    if (ing->pos >= ing->fileSize) {
+        return 0;
+    }
+
+    ing->mapOff = off;
+    ing->mapLen = C_MIN(ing->cfg.windowSize, ing->fileSize - off);
+    ing->map = mmap(NULL, ing->mapLen, PROT_READ, MAP_SHARED, ing->fd, off);
+    if (ing->map == MAP_FAILED) {
+        printf("h265bs_ingest:mmap %lld bytes at %lld failed:%s\n", (long long)ing->mapLen, (long long)off, strerror(errno));
+        ing->map = NULL;
+        ing->mapLen = 0;
+        return -1;
+    }
+    return 0;
+}
+
+static int h265bs_mmap_read(h265bs_ingest_t *ing, uint8_t *dst, int size)
+{
+    int n = 0;
+
+    if (ing->map == NULL || ing->pos >= ing->mapOff + ing->mapLen) {
+        if (h265bs_mmap_remap(ing) < 0) {
+            return -errno;
+        }
+        if (ing->map == NULL) {
+            return 0;
+        }
+    }
+
+    n = C_MIN(size, ing->mapOff + ing->mapLen - ing->pos);
+    h265bs_mem_window_advise(&ing->window, ing->fd, ing->map, ing->mapOff, ing->mapLen, ing->pos, ing->pos);
+    memcpy(dst, ing->map + (ing->pos - ing->mapOff), n);
+    ing->pos += n;
+    ing->stat.readBytes += n;
+    ing->stat.readCnt++;
+
+    return n;
+}
+
+static void h265bs_mmap_seek(h265bs_ingest_t *ing, int64_t off)
+{
+    ing->pos = off;
+    h265bs_mem_window_reset(&ing->window, off);
+    if (ing->map && (off < ing->mapOff || off >= ing->mapOff + ing->mapLen)) {
+        h265bs_mmap_unmap(ing);
+    }
+}
+
+/****************************************************************************
+ * public interface
+ ****************************************************************************/
+h265bs_ingest_t *h265bs_ingest_init(int fd, h265bs_ingest_cfg_t *cfg)
+{
+    int i = 0, errnum = 0;
+    struct stat stat_buf;
+    h265bs_ingest_t *ing = calloc(1, sizeof(h265bs_ingest_t));
+    if (ing == NULL) {
+        printf("h265bs_ingest:calloc h265bs_ingest_t failed\n");
+        goto err_calloc_ingest;
+    }
+
+    ing->fd = fd;
+    ing->cfg = *cfg;
+    ing->mode = cfg->mode;
+    ing->ringFd = -1;
+    ing->stopFd = -1;
+    if (ing->cfg.queueDepth <= 0) ing->cfg.queueDepth = H265BS_INGEST_QUEUE_DEPTH;
+    if (ing->cfg.readSize <= 0) ing->cfg.readSize = H265BS_INGEST_READ_SIZE;
+    if (ing->cfg.windowSize <= 0) ing->cfg.windowSize = H265BS_INGEST_WINDOW_SIZE;
+    ing->bSeekable = (fstat(fd, &stat_buf) == 0) && S_ISREG(stat_buf.st_mode);
+
+    if (ing->mode == H265BS_INGEST_MMAP && !ing->bSeekable) {
+        printf("h265bs_ingest:input can not be mapped, use read()\n");
+        ing->mode = H265BS_INGEST_SYNC;
+    }
+    if (ing->mode == H265BS_INGEST_MMAP) {
+        /* whole windows of pages, the read-ahead of the other modes stays resident */
+        ing->cfg.windowSize = C_MAX((ing->cfg.windowSize + 4095) & ~(int64_t)4095, 2 * (int64_t)ing->cfg.readSize);
+        h265bs_mem_window_init(&ing->window, (int64_t)ing->cfg.queueDepth * ing->cfg.readSize, ing->cfg.readSize,
+                stat_buf.st_size);
+    }
+    if (ing->mode == H265BS_INGEST_SYNC || ing->mode == H265BS_INGEST_MMAP) {
+        return ing;
+    }
+
+    ing->bufBase = h265bs_mem_alloc((size_t)ing->cfg.queueDepth * ing->cfg.readSize, 4096, ing->cfg.memFlags, ing->cfg.numaNode);
+    ing->slot = calloc(ing->cfg.queueDepth, sizeof(h265bs_ingest_slot_t));
+    if (ing->bufBase == NULL || ing->slot == NULL) {
+        printf("h265bs_ingest:alloc %d x %d read buffers failed\n", ing->cfg.queueDepth, ing->cfg.readSize);
+        goto err_alloc_slot;
+    }
+    for (i = 0; i < ing->cfg.queueDepth; i++) {
+        ing->slot[i].buf = ing->bufBase + (size_t)i * ing->cfg.readSize;
+    }
+
+    if (ing->mode == H265BS_INGEST_URING && h265bs_uring_setup(ing) < 0) {
+        printf("h265bs_ingest:io_uring unavailable, use read-ahead thread\n");
+        ing->mode = H265BS_INGEST_THREAD;
+    }
+
+    if (ing->mode == H265BS_INGEST_URING) {
+        h265bs_uring_fill(ing);
+    } else {
+        ing->stopFd = eventfd(0, EFD_CLOEXEC);
+        if (ing->stopFd < 0) {
+            printf("h265bs_ingest:eventfd failed:%s\n", strerror(errno));
+            goto err_eventfd;
+        }
+        pthread_mutex_init(&ing->mutex, NULL);
+        pthread_cond_init(&ing->fillCond, NULL);
+        pthread_cond_init(&ing->readyCond, NULL);
+        if ((errnum = pthread_create(&ing->tid, NULL, h265bs_ingest_thread, ing)) != 0) {
+            printf("h265bs_ingest:pthread_create failed:%s\n", strerror(errnum));
+            goto err_pthread_create;
+        }
+        ing->bThread = 1;
+    }
+
+    return ing;
+
+err_pthread_create:
+    pthread_cond_destroy(&ing->readyCond);
+    pthread_cond_destroy(&ing->fillCond);
+    pthread_mutex_destroy(&ing->mutex);
+    close(ing->stopFd);
+err_eventfd:
+err_alloc_slot:
+    free(ing->slot);
+    if (ing->bufBase) h265bs_mem_free(ing->bufBase);
+    free(ing);
+err_calloc_ingest:
+    return NULL;
+}
+
+void h265bs_ingest_deinit(h265bs_ingest_t *ing)
+{
+    if (ing) {
+        if (ing->mode == H265BS_INGEST_URING) {
+            h265bs_uring_drain(ing);
+            h265bs_uring_teardown(ing);
+        } else if (ing->bThread) {
+            pthread_mutex_lock(&ing->mutex);
+            ing->bStop = 1;
+            pthread_cond_signal(&ing->fillCond);
+            pthread_mutex_unlock(&ing->mutex);
+            /* the thread may wait for data on an idle pipe */
+            if (eventfd_write(ing->stopFd, 1) < 0) {
+                printf("h265bs_ingest:wake reader failed:%s\n", strerror(errno));
+            }
+            pthread_join(ing->tid, NULL);
+            close(ing->stopFd);
+            pthread_cond_destroy(&ing->readyCond);
+            pthread_cond_destroy(&ing->fillCond);
+            pthread_mutex_destroy(&ing->mutex);
+        }
+        h265bs_mmap_unmap(ing);
+        free(ing->slot);
+        if (ing->bufBase) h265bs_mem_free(ing->bufBase);
+        free(ing);
+    }
+}
+
+int h265bs_ingest_read(h265bs_ingest_t *ing, uint8_t *dst, int size)
+{
+    int n = 0;
+
+    if (size <= 0) {
+        return 0;
+    }
+
+    switch (ing->mode) {
+    case H265BS_INGEST_URING:
+        return h265bs_uring_read(ing, dst, size);
+    case H265BS_INGEST_THREAD:
+        return h265bs_thread_read(ing, dst, size);
+    case H265BS_INGEST_MMAP:
+        return h265bs_mmap_read(ing, dst, size);
+    default:
+        n = read(ing->fd, dst, size);
+        if (n > 0) {
+            ing->stat.readBytes += n;
+            ing->stat.readCnt++;
+        }
+        return n;
+    }
+}
+
+int h265bs_ingest_seek(h265bs_ingest_t *ing, int64_t off)
+{
+    if (!ing->bSeekable && ing->mode != H265BS_INGEST_SYNC) {
+        errno = ESPIPE;
+        return -1;
+    }
+
+    switch (ing->mode) {
+    case H265BS_INGEST_URING:
+        h265bs_uring_reset(ing, off);
+        return 0;
+    case H265BS_INGEST_THREAD:
+        return h265bs_thread_seek(ing, off);
+    case H265BS_INGEST_MMAP:
+        h265bs_mmap_seek(ing, off);
+        return 0;
+    default:
+        return lseek(ing->fd, off, SEEK_SET) < 0 ? -1 : 0;
+    }
+}
+
+int h265bs_ingest_rewind(h265bs_ingest_t *ing)
+{
+    return h265bs_ingest_seek(ing, 0);
+}
+
+int h265bs_ingest_set_fd(h265bs_ingest_t *ing, int fd)
+{
+    struct stat stat_buf;
+    int bSeekable = (fstat(fd, &stat_buf) == 0) && S_ISREG(stat_buf.st_mode);
+
+    switch (ing->mode) {
+    case H265BS_INGEST_URING:
+        h265bs_uring_reset(ing, 0);
+        ing->fd = fd;
+        ing->bSeekable = bSeekable;
+        return 0;
+    case H265BS_INGEST_THREAD:
+        /* the old fd may be closed right after we return, wait for its read() */
+        pthread_mutex_lock(&ing->mutex);
+        while (ing->bBusy) {
+            pthread_cond_wait(&ing->readyCond, &ing->mutex);
+        }
+        ing->fd = fd;
+        ing->bSeekable = bSeekable;
+        pthread_mutex_unlock(&ing->mutex);
+        return h265bs_thread_seek(ing, 0);
+    case H265BS_INGEST_MMAP:
+        h265bs_mmap_unmap(ing);
+        ing->fd = fd;
+        ing->bSeekable = bSeekable;
+        h265bs_mem_window_init(&ing->window, (int64_t)ing->cfg.queueDepth * ing->cfg.readSize, ing->cfg.readSize,
+                bSeekable ? stat_buf.st_size : 0);
+        h265bs_mmap_seek(ing, 0);
+        if (!bSeekable) {
+            ing->mode = H265BS_INGEST_SYNC;
+        }
+        return 0;
+    default:
+        ing->fd = fd;
+        ing->bSeekable = bSeekable;
+        return 0;
+    }
+}
+
+const char *h265bs_ingest_mode_name(h265bs_ingest_mode_t mode)
+{
+    switch (mode) {
+    case H265BS_INGEST_URING:
+        return "uring";
+    case H265BS_INGEST_THREAD:
+        return "thread";
+    case H265BS_INGEST_MMAP:
+        return "mmap";
+    default:
+        return "sync";
+    }
+}
+
+void h265bs_ingest_get_stat(h265bs_ingest_t *ing, h265bs_ingest_stat_t *stat)
+{
+    if (ing->bThread) pthread_mutex_lock(&ing->mutex);
+    *stat = ing->stat;
+    stat->mode = ing->mode;
+    if (ing->bThread) pthread_mutex_unlock(&ing->mutex);
+}
+
+void h265bs_ingest_dump_stat(h265bs_ingest_t *ing)
+{
+    h265bs_ingest_stat_t stat;
+
+    if (ing) {
+        h265bs_ingest_get_stat(ing, &stat);
+        printf("h265bs_ingest:mode=%s, queueDepth=%d, readSize=%d, readBytes=%llu, readCnt=%llu, waitCnt=%llu\n",
+                h265bs_ingest_mode_name(stat.mode), ing->cfg.queueDepth, ing->cfg.readSize,
+                (unsigned long long)stat.readBytes, (unsigned long long)stat.readCnt, (unsigned long long)stat.waitCnt);
+    }
+}
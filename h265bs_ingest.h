@@ -0,0 +1,56 @@
+#ifndef __H265BS_INGEST_H__
+#define __H265BS_INGEST_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define H265BS_INGEST_QUEUE_DEPTH   4
+#define H265BS_INGEST_READ_SIZE     (1024 * 1024)
+#define H265BS_INGEST_WINDOW_SIZE   (64 * 1024 * 1024)
+
+typedef enum {
+    H265BS_INGEST_SYNC      = 0,    /* plain read() in the caller */
+    H265BS_INGEST_URING     = 1,    /* io_uring read-ahead, falls back to THREAD */
+    H265BS_INGEST_THREAD    = 2,    /* read-ahead thread */
+    H265BS_INGEST_MMAP      = 3,    /* sliding mapping window, falls back to SYNC on a pipe */
+} h265bs_ingest_mode_t;
+
+typedef struct {
+    h265bs_ingest_mode_t    mode;
+    int                     queueDepth; /* reads kept in flight */
+    int                     readSize;   /* bytes of one read */
+    int                     memFlags;   /* H265BS_MEM_F_* of the read buffers */
+    int                     numaNode;   /* node of the read buffers and the read-ahead thread */
+    int64_t                 windowSize; /* MMAP: bytes mapped at once, 0 for the default */
+} h265bs_ingest_cfg_t;
+
+typedef struct {
+    h265bs_ingest_mode_t    mode;       /* backend really in use */
+    uint64_t                readBytes;
+    uint64_t                readCnt;    /* completed reads */
+    uint64_t                waitCnt;    /* consumer found no data ready */
+} h265bs_ingest_stat_t;
+
+typedef struct h265bs_ingest h265bs_ingest_t;
+
+extern h265bs_ingest_t *h265bs_ingest_init(int fd, h265bs_ingest_cfg_t *cfg);
+extern void h265bs_ingest_deinit(h265bs_ingest_t *ing);
+/* read() semantics: bytes copied, 0 at end of file, <0 on error */
+extern int h265bs_ingest_read(h265bs_ingest_t *ing, uint8_t *dst, int size);
+/* lseek(fd, off, SEEK_SET), drops everything read ahead */
+extern int h265bs_ingest_seek(h265bs_ingest_t *ing, int64_t off);
+extern int h265bs_ingest_rewind(h265bs_ingest_t *ing);
+/* go on reading fd from its start, the old fd is no longer touched */
+extern int h265bs_ingest_set_fd(h265bs_ingest_t *ing, int fd);
+extern const char *h265bs_ingest_mode_name(h265bs_ingest_mode_t mode);
+extern void h265bs_ingest_get_stat(h265bs_ingest_t *ing, h265bs_ingest_stat_t *stat);
+extern void h265bs_ingest_dump_stat(h265bs_ingest_t *ing);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __H265BS_INGEST_H__ */
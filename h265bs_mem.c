@@ -0,0 +1,234 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "icommon.h"
+#include "h265bs_mem.h"
+
+#define H265BS_MEM_PAGE_SIZE        4096
+#define H265BS_MEM_MAX_NODE         256
+
+/* lives right in front of every pointer handed out */
+typedef struct {
+    void                *base;
+    size_t              mapSize;
+    h265bs_mem_page_t   pageType;
+    int                 node;
+} h265bs_mem_hdr_t;
+
+static int h265bs_mem_mbind(void *addr, size_t len, int node)
+{
+    unsigned long nodemask[H265BS_MEM_MAX_NODE / (8 * sizeof(unsigned long))];
+
+    if (node < 0 || node >= H265BS_MEM_MAX_NODE) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(nodemask, 0, sizeof(nodemask));
+    nodemask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+
+    return syscall(SYS_mbind, addr, len, MPOL_BIND, nodemask, H265BS_MEM_MAX_NODE + 1, MPOL_MF_MOVE);
+}
+
+static int h265bs_mem_query_node(void *addr)
+{
+    void *page = (void *)((uintptr_t)addr & ~(uintptr_t)(H265BS_MEM_PAGE_SIZE - 1));
+    int status = -1;
+
+    if (syscall(SYS_move_pages, 0, 1, &page, NULL, &status, 0) < 0) {
+        return -1;
+    }
+    return status < 0 ? -1 : status;
+}
+
+void *h265bs_mem_alloc(size_t size, int align, int flags, int node)
+{
+    size_t hdrSize = 0, mapSize = 0;
+    uint8_t *base = MAP_FAILED;
+    h265bs_mem_hdr_t *hdr = NULL;
+    h265bs_mem_page_t pageType = H265BS_MEM_PAGE_NORMAL;
+
+    if (align < (int)sizeof(h265bs_mem_hdr_t)) {
+        align = C_NATIVE_ALIGN;
+    }
+    if (align > H265BS_MEM_PAGE_SIZE || (align & (align - 1))) {
+        printf("h265bs_mem:unsupported align=%d\n", align);
+        return NULL;
+    }
+    hdrSize = C_ALIGN(sizeof(h265bs_mem_hdr_t), align);
+
+    if (flags & H265BS_MEM_F_HUGEPAGE) {
+        mapSize = C_ALIGN(size + hdrSize, H265BS_MEM_HUGEPAGE_SIZE);
+        base = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (base != MAP_FAILED) {
+            pageType = H265BS_MEM_PAGE_HUGETLB;
+        } else {
+            /* no hugetlbfs reservation, let khugepaged back it if it can */
+            base = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (base != MAP_FAILED && madvise(base, mapSize, MADV_HUGEPAGE) == 0) {
+                pageType = H265BS_MEM_PAGE_THP;
+            }
+        }
+    } else {
+        mapSize = C_ALIGN(size + hdrSize, H265BS_MEM_PAGE_SIZE);
+        base = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (base == MAP_FAILED) {
+        printf("h265bs_mem:mmap %zu bytes failed:%s\n", mapSize, strerror(errno));
+        return NULL;
+    }
+
+    if (node != H265BS_MEM_NODE_ANY && h265bs_mem_mbind(base, mapSize, node) < 0) {
+        printf("h265bs_mem:mbind to node %d failed:%s, keep default policy\n", node, strerror(errno));
+    }
+
+    /* fault everything in now so the placement is settled before use */
+    memset(base, 0, mapSize);
+
+    hdr = (h265bs_mem_hdr_t *)(base + hdrSize) - 1;
+    hdr->base = base;
+    hdr->mapSize = mapSize;
+    hdr->pageType = pageType;
+    hdr->node = h265bs_mem_query_node(base);
+
+    return base + hdrSize;
+}
+
+void h265bs_mem_free(void *ptr)
+{
+    h265bs_mem_hdr_t *hdr = NULL;
+
+    if (ptr) {
+        hdr = (h265bs_mem_hdr_t *)ptr - 1;
+        munmap(hdr->base, hdr->mapSize);
+    }
+}
+
+void h265bs_mem_get_info(void *ptr, h265bs_mem_info_t *info)
+{
+    h265bs_mem_hdr_t *hdr = (h265bs_mem_hdr_t *)ptr - 1;
+
+    info->pageType = hdr->pageType;
+    info->node = hdr->node;
+    info->mapSize = hdr->mapSize;
+}
+
+const char *h265bs_mem_page_name(h265bs_mem_page_t pageType)
+{
+    switch (pageType) {
+    case H265BS_MEM_PAGE_HUGETLB:
+        return "hugetlb";
+    case H265BS_MEM_PAGE_THP:
+        return "thp";
+    default:
+        return "normal";
+    }
+}
+
+int h265bs_mem_bind_thread(int node)
+{
+    char path[64];
+    char cpulist[1024];
+    char *p = NULL;
+    FILE *fp = NULL;
+    cpu_set_t cpuset;
+    int first = 0, last = 0, cpu = 0, errnum = 0;
+
+    sprintf(path, "/sys/devices/system/node/node%d/cpulist", node);
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        printf("h265bs_mem:open %s failed:%s\n", path, strerror(errno));
+        return -1;
+    }
+    if (fgets(cpulist, sizeof(cpulist), fp) == NULL) {
+        fclose(fp);
+        printf("h265bs_mem:read %s failed\n", path);
+        return -1;
+    }
+    fclose(fp);
+
+    /* cpulist looks like "0-7,16-23" */
+    CPU_ZERO(&cpuset);
+    p = cpulist;
+    while (*p && *p != '\n') {
+        first = strtol(p, &p, 10);
+        last = first;
+        if (*p == '-') {
+            last = strtol(p + 1, &p, 10);
+        }
+        for (cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, &cpuset);
+        }
+        if (*p == ',') {
+            p++;
+        } else {
+            break;
+        }
+    }
+    if (CPU_COUNT(&cpuset) == 0) {
+        printf("h265bs_mem:node %d has no cpu\n", node);
+        return -1;
+    }
+
+    if ((errnum = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset)) != 0) {
+        printf("h265bs_mem:bind thread to node %d failed:%s\n", node, strerror(errnum));
+        return -1;
+    }
+
+    return 0;
+}
+
+void h265bs_mem_window_init(h265bs_mem_window_t *w, int64_t ahead, int64_t step, int64_t fileSize)
+{
+    long pages = sysconf(_SC_PHYS_PAGES);
+
+    w->ahead = ahead;
+    w->step = step;
+    w->bDropCache = pages > 0 && fileSize > (int64_t)pages * H265BS_MEM_PAGE_SIZE / 2;
+    h265bs_mem_window_reset(w, 0);
+}
+
+void h265bs_mem_window_reset(h265bs_mem_window_t *w, int64_t pos)
+{
+    w->advised = w->released = pos & ~(int64_t)(H265BS_MEM_PAGE_SIZE - 1);
+}
+
+void h265bs_mem_window_advise(h265bs_mem_window_t *w, int fd, uint8_t *map, int64_t mapOff, int64_t mapLen,
+        int64_t pos, int64_t keep)
+{
+    int64_t from = 0, to = 0, mapEnd = mapOff + mapLen;
+
+    if (pos + w->ahead - w->step > w->advised) {
+        from = C_MAX(w->advised, pos) & ~(int64_t)(H265BS_MEM_PAGE_SIZE - 1);
+        to = pos + w->ahead;
+        if (C_MIN(to, mapEnd) > from) {
+            madvise(map + (from - mapOff), C_MIN(to, mapEnd) - from, MADV_WILLNEED);
+        }
+        if (to > C_MAX(from, mapEnd)) {
+            posix_fadvise(fd, C_MAX(from, mapEnd), to - C_MAX(from, mapEnd), POSIX_FADV_WILLNEED);
+        }
+        w->advised = to;
+    }
+
+    keep &= ~(int64_t)(H265BS_MEM_PAGE_SIZE - 1);
+    if (keep - w->released >= w->step) {
+        from = C_MAX(w->released, mapOff);
+        if (keep > from) {
+            madvise(map + (from - mapOff), keep - from, MADV_DONTNEED);
+        }
+        if (w->bDropCache) {
+            posix_fadvise(fd, w->released, keep - w->released, POSIX_FADV_DONTNEED);
+        }
+        w->released = keep;
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef __H265BS_MEM_H__
+#define __H265BS_MEM_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define H265BS_MEM_HUGEPAGE_SIZE    (2 * 1024 * 1024)
+#define H265BS_MEM_NODE_ANY         (-1)
+
+/* placement request flags */
+#define H265BS_MEM_F_HUGEPAGE       (1 << 0)
+
+/* what the kernel actually gave us */
+typedef enum {
+    H265BS_MEM_PAGE_NORMAL  = 0,
+    H265BS_MEM_PAGE_THP     = 1,    /* madvise(MADV_HUGEPAGE) fallback */
+    H265BS_MEM_PAGE_HUGETLB = 2,    /* MAP_HUGETLB, explicit 2MB pages */
+} h265bs_mem_page_t;
+
+typedef struct {
+    h265bs_mem_page_t   pageType;
+    int                 node;       /* node of the first page, -1 unknown */
+    size_t              mapSize;
+} h265bs_mem_info_t;
+
+/* Anonymous mapping aligned to align(<= 4096), backed by 2MB pages when
+ * H265BS_MEM_F_HUGEPAGE is set and bound to node unless it is
+ * H265BS_MEM_NODE_ANY. Falls back to THP and then to normal pages */
+extern void *h265bs_mem_alloc(size_t size, int align, int flags, int node);
+extern void h265bs_mem_free(void *ptr);
+extern void h265bs_mem_get_info(void *ptr, h265bs_mem_info_t *info);
+extern const char *h265bs_mem_page_name(h265bs_mem_page_t pageType);
+
+/* Pin the calling thread to the cpus of node */
+extern int h265bs_mem_bind_thread(int node);
+
+/* Residency of a file mapping read front to back. Every step bytes the next
+ * ahead bytes are asked in with MADV_WILLNEED, posix_fadvise past the end of
+ * the mapping, and what lies before keep is dropped with MADV_DONTNEED, so
+ * about ahead bytes stay resident whatever the file size. Offsets are file
+ * offsets */
+typedef struct {
+    int64_t     ahead;
+    int64_t     step;
+    int         bDropCache;     /* also out of the page cache, the file would not fit it anyway */
+    int64_t     advised;        /* asked in up to */
+    int64_t     released;       /* dropped up to */
+} h265bs_mem_window_t;
+
+/* bDropCache is set for a file over half of the memory */
+extern void h265bs_mem_window_init(h265bs_mem_window_t *w, int64_t ahead, int64_t step, int64_t fileSize);
+extern void h265bs_mem_window_reset(h265bs_mem_window_t *w, int64_t pos);
+/* map covers [mapOff, mapOff + mapLen) of fd, mapOff page aligned */
+extern void h265bs_mem_window_advise(h265bs_mem_window_t *w, int fd, uint8_t *map, int64_t mapOff, int64_t mapLen,
+        int64_t pos, int64_t keep);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __H265BS_MEM_H__ */
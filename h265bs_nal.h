@@ -0,0 +1,114 @@
+#ifndef __H265BS_NAL_H__
+#define __H265BS_NAL_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "i265e.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* nal unit header, hdr points right behind the start code */
+#define H265BS_NAL_TYPE(hdr)        (((hdr)[0] >> 1) & 0x3f)
+#define H265BS_NAL_LAYER_ID(hdr)    ((((hdr)[0] & 0x01) << 5) | (((hdr)[1] >> 3) & 0x1f))
+#define H265BS_NAL_TID_PLUS1(hdr)   ((hdr)[1] & 0x07)
+/* first_slice_segment_in_pic_flag, the first payload bit of a vcl nal */
+#define H265BS_NAL_FIRST_SLICE(hdr) (((hdr)[2] >> 7) & 0x01)
+
+static inline int h265bs_nal_is_vcl(uint32_t type)
+{
+    return type < I265E_NAL_VPS;
+}
+
+static inline int h265bs_nal_is_irap(uint32_t type)
+{
+    return (type >= I265E_NAL_CODED_SLICE_BLA_W_LP) && (type <= 23);
+}
+
+static inline int h265bs_nal_is_idr(uint32_t type)
+{
+    return (type == I265E_NAL_CODED_SLICE_IDR_W_RADL) || (type == I265E_NAL_CODED_SLICE_IDR_N_LP);
+}
+
+/* non-vcl nal types which may only open an access unit, H.265 7.4.2.4.4 */
+static inline int h265bs_nal_starts_au(uint32_t type)
+{
+    return ((type >= I265E_NAL_VPS) && (type <= I265E_NAL_ACCESS_UNIT_DELIMITER))
+        || (type == I265E_NAL_PREFIX_SEI)
+        || ((type >= 41) && (type <= 44))
+        || ((type >= 48) && (type <= 55));
+}
+
+/* The nal opens the next access unit. bAuVcl tells if the one being built
+ * already has a vcl nal, bFirstSlice is first_slice_segment_in_pic_flag of
+ * a vcl nal. The split of the replay scanner, which the index follows */
+static inline int h265bs_nal_au_boundary(uint32_t type, int bFirstSlice, int bAuVcl)
+{
+    return bAuVcl && (h265bs_nal_starts_au(type) || (h265bs_nal_is_vcl(type) && bFirstSlice));
+}
+
+/* First 00 00 01 in [p, end), NULL when there is none. Looks at the third
+ * byte first, so most of the payload is stepped over three bytes at a time */
+static inline uint8_t *h265bs_nal_find_start_code(uint8_t *p, uint8_t *end)
+{
+    for (p += 2; p < end; ) {
+        if (p[0] > 1) {
+            p += 3;
+        } else if (p[-1]) {
+            p += 2;
+        } else if (p[-2] | (p[0] - 1)) {
+            p++;
+        } else {
+            return p - 2;
+        }
+    }
+    return NULL;
+}
+
+/* Walks the nals of a mapped or buffered stream start code to start code */
+typedef struct {
+    uint8_t *begin;
+    uint8_t *end;
+    uint8_t *sc;        /* 00 00 01 of the nal */
+    uint8_t *start;     /* the nal with its start code, the zero in front of a 4 byte one included */
+    uint8_t *hdr;       /* nal header, right behind the start code */
+    uint8_t *nalEnd;    /* the zero of a 4 byte start code behind is left out */
+    uint8_t *next;      /* 00 00 01 of the nal behind, NULL after the last */
+} h265bs_nal_iter_t;
+
+static inline void h265bs_nal_iter_init(h265bs_nal_iter_t *it, uint8_t *begin, uint8_t *end)
+{
+    it->begin = begin;
+    it->end = end;
+    it->next = h265bs_nal_find_start_code(begin, end);
+}
+
+/* 1 with the next nal in it, 0 after the last. At the end of a cut stream
+ * the header may be short, nalEnd - hdr below 2 */
+static inline int h265bs_nal_iter_next(h265bs_nal_iter_t *it)
+{
+    if (it->next == NULL || it->next + 3 >= it->end) {
+        return 0;
+    }
+    it->sc = it->next;
+    it->start = (it->sc > it->begin && it->sc[-1] == 0) ? it->sc - 1 : it->sc;
+    it->hdr = it->sc + 3;
+    it->next = h265bs_nal_find_start_code(it->hdr, it->end);
+    it->nalEnd = (it->next == NULL) ? it->end : (it->next[-1] == 0) ? it->next - 1 : it->next;
+    return 1;
+}
+
+/* first_slice_segment_in_pic_flag of the nal, 1 when the stream ends before
+ * it like the scanner takes it */
+static inline int h265bs_nal_iter_first_slice(const h265bs_nal_iter_t *it)
+{
+    return (it->end - it->hdr > 2) ? H265BS_NAL_FIRST_SLICE(it->hdr) : 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __H265BS_NAL_H__ */
@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "h265bs_nal.h"
+#include "h265bs_slice.h"
+#include "h265bs_mem.h"
+#include "h265bs_par.h"
+
+/* read ahead of the scan */
+#define H265BS_PAR_CHUNK        (4 * 1024 * 1024)
+
+/* substreams of the picture in progress, by their index in the picture */
+typedef struct {
+    int64_t idx;                /* -1 before the first picture */
+    uint32_t nalType;
+    int sliceCnt;
+    int failCnt;                /* slice segments whose header did not parse */
+    int64_t *unitSize;
+    int unitNum;
+    int unitMax;
+} h265bs_par_pic_t;
+
+typedef struct {
+    const h265bs_par_cfg_t *cfg;
+    h265bs_slice_t *slice;
+    h265bs_slice_entry_t entry;
+    h265bs_par_pic_t pic;
+    int64_t *sorted;
+    int sortedMax;
+
+    int64_t picCnt;
+    int64_t failPicCnt;
+    int64_t substreamCnt;
+    int64_t bytes;
+    double imbalanceSum;
+    double boundSum;
+    double worstImbalance;
+    int64_t worstPic;
+    int64_t span[H265BS_PAR_CORES_MAX];     /* bytes on the most loaded core, summed */
+
+    /* layout of the last picture, printed when it changes */
+    int ctbCols;
+    int ctbRows;
+    int tileCols;
+    int tileRows;
+    int bWavefront;
+} h265bs_par_t;
+
+int h265bs_par_parse_cores(const char *str, h265bs_par_cfg_t *cfg)
+{
+    char *end = NULL;
+    long v = 0;
+
+    cfg->coreCnt = 0;
+    while (*str) {
+        v = strtol(str, &end, 10);
+        if (end == str || v <= 0 || v > 1024 || cfg->coreCnt == H265BS_PAR_CORES_MAX || (*end && *end != ',')) {
+            return -1;
+        }
+        cfg->coreNum[cfg->coreCnt++] = (int)v;
+        str = *end ? end + 1 : end;
+    }
+    return cfg->coreCnt > 0 ? 0 : -1;
+}
+
+static int h265bs_par_cmp_size(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+    return (x < y) - (x > y);
+}
+
+static int h265bs_par_reserve(h265bs_par_t *h, int num)
+{
+    h265bs_par_pic_t *pic = &h->pic;
+    int64_t *size = NULL;
+    int max = pic->unitMax ? pic->unitMax : 64;
+
+    if (num <= pic->unitMax) {
+        return 0;
+    }
+    while (max < num) {
+        max *= 2;
+    }
+    size = realloc(pic->unitSize, max * sizeof(int64_t));
+    if (size == NULL) {
+        return -1;
+    }
+    memset(size + pic->unitMax, 0, (max - pic->unitMax) * sizeof(int64_t));
+    pic->unitSize = size;
+    pic->unitMax = max;
+    return 0;
+}
+
+/* Biggest substream first onto the least loaded of coreNum cores, the
+ * bytes of the most loaded one */
+static int64_t h265bs_par_span(const int64_t *sorted, int num, int coreNum)
+{
+    int64_t load[1024];
+    int64_t span = 0;
+    int i = 0, k = 0, min = 0;
+
+    memset(load, 0, coreNum * sizeof(int64_t));
+    for (i = 0; i < num; i++) {
+        for (k = 1, min = 0; k < coreNum; k++) {
+            min = load[k] < load[min] ? k : min;
+        }
+        load[min] += sorted[i];
+        span = C_MAX(span, load[min]);
+    }
+    return span;
+}
+
+static void h265bs_par_finish(h265bs_par_t *h)
+{
+    h265bs_par_pic_t *pic = &h->pic;
+    int64_t total = 0, span = 0;
+    double avg = 0, imbalance = 0, bound = 0;
+    char cores[H265BS_PAR_CORES_MAX * 24];
+    int num = 0, i = 0, len = 0;
+
+    if (pic->idx < 0) {
+        return;
+    }
+    h->picCnt++;
+    for (i = 0; i < pic->unitNum; i++) {
+        if (pic->unitSize[i] > 0) {
+            h->sorted[num++] = pic->unitSize[i];
+            total += pic->unitSize[i];
+        }
+    }
+    if (num == 0) {
+        h->failPicCnt++;
+        printf("h265bs_par:pic %lld type %u, %d slices, %s\n", (long long)pic->idx, pic->nalType, pic->sliceCnt,
+                pic->failCnt == pic->sliceCnt ? "no slice header parsed" : "no slice data");
+        return;
+    }
+    qsort(h->sorted, num, sizeof(int64_t), h265bs_par_cmp_size);
+    avg = (double)total / num;
+    imbalance = h->sorted[0] / avg;
+    bound = (double)total / h->sorted[0];
+    for (i = 0; i < h->cfg->coreCnt; i++) {
+        span = h265bs_par_span(h->sorted, num, h->cfg->coreNum[i]);
+        h->span[i] += span;
+        len += snprintf(cores + len, sizeof(cores) - len, ", %d cores %.2f", h->cfg->coreNum[i], (double)total / span);
+    }
+    cores[len] = '\0';
+    printf("h265bs_par:pic %lld type %u, %d slices, %d substreams, %lld bytes, min %lld avg %.1f max %lld, "
+            "imbalance %.2f, bound %.2f%s%s\n", (long long)pic->idx, pic->nalType, pic->sliceCnt, num, (long long)total,
+            (long long)h->sorted[num - 1], avg, (long long)h->sorted[0], imbalance, bound, cores,
+            pic->failCnt ? ", some slice headers not parsed" : "");
+
+    h->substreamCnt += num;
+    h->bytes += total;
+    h->imbalanceSum += imbalance;
+    h->boundSum += bound;
+    if (imbalance > h->worstImbalance) {
+        h->worstImbalance = imbalance;
+        h->worstPic = pic->idx;
+    }
+}
+
+static void h265bs_par_start(h265bs_par_t *h, uint32_t nalType)
+{
+    h265bs_par_finish(h);
+    h->pic.idx++;
+    h->pic.nalType = nalType;
+    h->pic.sliceCnt = 0;
+    h->pic.failCnt = 0;
+    if (h->pic.unitMax) {
+        memset(h->pic.unitSize, 0, h->pic.unitMax * sizeof(int64_t));
+    }
+    h->pic.unitNum = 0;
+}
+
+static int h265bs_par_add(h265bs_par_t *h, const h265bs_slice_entry_t *e)
+{
+    h265bs_par_pic_t *pic = &h->pic;
+    int bSliceUnits = e->tileCols * e->tileRows == 1 && !e->bWavefront;
+    int unit = e->unit, i = 0;
+
+    if (e->ctbCols != h->ctbCols || e->ctbRows != h->ctbRows || e->tileCols != h->tileCols
+            || e->tileRows != h->tileRows || e->bWavefront != h->bWavefront) {
+        printf("h265bs_par:pic %lld on, %dx%d CTBs, %dx%d tiles, wavefronts %s\n", (long long)pic->idx,
+                e->ctbCols, e->ctbRows, e->tileCols, e->tileRows, e->bWavefront ? "on" : "off");
+        h->ctbCols = e->ctbCols;
+        h->ctbRows = e->ctbRows;
+        h->tileCols = e->tileCols;
+        h->tileRows = e->tileRows;
+        h->bWavefront = e->bWavefront;
+    }
+    if (bSliceUnits) {
+        /* a slice is the unit, its dependent slice segments carry on with it */
+        unit = (e->bDependent && pic->unitNum > 0) ? pic->unitNum - 1 : pic->unitNum;
+    } else if (unit < 0 || unit + e->substreamNum > e->unitNum) {
+        pic->failCnt++;
+        return 0;
+    }
+    if (h265bs_par_reserve(h, unit + e->substreamNum) < 0) {
+        return -1;
+    }
+    for (i = 0; i < e->substreamNum; i++) {
+        pic->unitSize[unit + i] += e->substreamSize[i];
+    }
+    pic->unitNum = C_MAX(pic->unitNum, unit + e->substreamNum);
+    if (pic->unitNum > h->sortedMax) {
+        free(h->sorted);
+        h->sortedMax = pic->unitMax;
+        h->sorted = malloc(h->sortedMax * sizeof(int64_t));
+        if (h->sorted == NULL) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int h265bs_par(const char *name, const h265bs_par_cfg_t *cfg)
+{
+    struct stat stat_buf;
+    h265bs_mem_window_t window;
+    h265bs_slice_info_t info;
+    h265bs_nal_iter_t it;
+    h265bs_par_t *h = NULL;
+    uint8_t *base = MAP_FAILED, *end = NULL, *nalStart = NULL, *nalEnd = NULL;
+    uint32_t type = 0;
+    int fd = -1, i = 0, ret = -1;
+
+    h = calloc(1, sizeof(h265bs_par_t));
+    if (h == NULL) {
+        printf("h265bs_par:calloc failed\n");
+        goto err_calloc;
+    }
+    h->cfg = cfg;
+    h->pic.idx = -1;
+    h->ctbCols = -1;
+    h->slice = h265bs_slice_init();
+    if (h->slice == NULL) {
+        printf("h265bs_par:slice parser init failed\n");
+        goto err_slice_init;
+    }
+    fd = open(name, O_RDONLY);
+    if (fd < 0 || fstat(fd, &stat_buf) < 0) {
+        printf("h265bs_par:open %s failed:%s\n", name, strerror(errno));
+        goto err_open;
+    }
+    if (stat_buf.st_size == 0) {
+        printf("h265bs_par:%s is empty\n", name);
+        goto err_mmap;
+    }
+    base = mmap(NULL, stat_buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        printf("h265bs_par:mmap %s failed:%s\n", name, strerror(errno));
+        goto err_mmap;
+    }
+    madvise(base, stat_buf.st_size, MADV_SEQUENTIAL);
+    end = base + stat_buf.st_size;
+
+    h265bs_mem_window_init(&window, 2 * H265BS_PAR_CHUNK, H265BS_PAR_CHUNK, stat_buf.st_size);
+    h265bs_nal_iter_init(&it, base, end);
+    while (h265bs_nal_iter_next(&it) && it.hdr + 2 < end) {
+        nalStart = it.start;
+        nalEnd = it.nalEnd;
+        h265bs_mem_window_advise(&window, fd, base, 0, stat_buf.st_size, nalStart - base, nalStart - base);
+
+        type = H265BS_NAL_TYPE(it.hdr);
+        h265bs_slice_nal(h->slice, nalStart, nalEnd - nalStart, &info);
+        if (!h265bs_nal_is_vcl(type) || nalEnd - it.hdr < 3) {
+            continue;
+        }
+        if (H265BS_NAL_FIRST_SLICE(it.hdr)) {
+            h265bs_par_start(h, type);
+        } else if (h->pic.idx < 0) {
+            continue;
+        }
+        h->pic.sliceCnt++;
+        if (h265bs_slice_entry(h->slice, nalStart, nalEnd - nalStart, &h->entry) < 0) {
+            h->pic.failCnt++;
+        } else if (h265bs_par_add(h, &h->entry) < 0) {
+            printf("h265bs_par:out of memory for the substreams\n");
+            goto err_add;
+        }
+    }
+    h265bs_par_finish(h);
+
+    if (h->picCnt > h->failPicCnt) {
+        printf("h265bs_par:%lld pictures, %.1f substreams and %.1f bytes a picture, imbalance avg %.2f worst %.2f at pic %lld, "
+                "bound avg %.2f\n", (long long)h->picCnt, (double)h->substreamCnt / (h->picCnt - h->failPicCnt),
+                (double)h->bytes / (h->picCnt - h->failPicCnt), h->imbalanceSum / (h->picCnt - h->failPicCnt),
+                h->worstImbalance, (long long)h->worstPic, h->boundSum / (h->picCnt - h->failPicCnt));
+        for (i = 0; i < cfg->coreCnt; i++) {
+            printf("h265bs_par:%d cores, speedup %.2f over the stream\n", cfg->coreNum[i],
+                    h->span[i] ? (double)h->bytes / h->span[i] : 0);
+        }
+    }
+    if (h->failPicCnt) {
+        printf("h265bs_par:%lld of %lld pictures without substreams\n", (long long)h->failPicCnt,
+                (long long)h->picCnt);
+    }
+    ret = 0;
+
+err_add:
+    munmap(base, stat_buf.st_size);
+err_mmap:
+err_open:
+    if (fd >= 0) close(fd);
+    h265bs_slice_deinit(h->slice);
+err_slice_init:
+    free(h->pic.unitSize);
+    free(h->sorted);
+    free(h);
+err_calloc:
+    return ret;
+}
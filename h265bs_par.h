@@ -0,0 +1,33 @@
+#ifndef __H265BS_PAR_H__
+#define __H265BS_PAR_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define H265BS_PAR_CORES_MAX    8
+
+typedef struct {
+    int coreNum[H265BS_PAR_CORES_MAX];  /* decoder core counts to estimate the speedup for */
+    int coreCnt;
+} h265bs_par_cfg_t;
+
+/* "2,4,8" into cfg, 0 when it is understood */
+extern int h265bs_par_parse_cores(const char *str, h265bs_par_cfg_t *cfg);
+
+/* Decoder parallelism of a stream from its slice segment headers. The entry
+ * points cut every picture into substreams, one per CTB row with wavefronts,
+ * per tile with tiles, per CTB row of a tile with both and per slice with
+ * neither. A line per picture gives their count and sizes, the imbalance
+ * max / avg, the speedup bound total / max and the speedup at each core
+ * count when the substreams go to the least loaded core biggest first. The
+ * two CTB lag between wavefront rows is left out. 0 on success */
+extern int h265bs_par(const char *name, const h265bs_par_cfg_t *cfg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __H265BS_PAR_H__ */
@@ -4,10 +4,525 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <pthread.h>
+
+#include "h265bs_clock.h"
+#include "h265bs_nal.h"
+#include "h265bs_check.h"
+#include "h265bs_seg.h"
+#include "h265bs_hash.h"
+#include "h265bs_trim.h"
+#include "h265bs_diff.h"
+#include "h265bs_par.h"
 
 #define BUFSIZE		8192
+#define H265BS_PARSE_FILE_PATH_MAX  4096
 
-int main(int argc, char *argv[])
+/* Batch mode: every input file, or every file under an input directory, is
+ * scanned on a pool of workers. Files go to the workers biggest first, each to
+ * the one with the fewest bytes queued, and a worker which runs dry steals the
+ * smallest file left in the fullest queue. The nal files of a file only depend
+ * on the file and the report is printed in input order once all are done, so
+ * the output is the same whatever the thread count */
+
+typedef struct {
+    char *name;
+    int64_t size;
+
+    /* written by the worker which ran the file */
+    int64_t nalCnt;
+    int64_t picCnt;
+    int64_t irapCnt;
+    const char *errStep;            /* NULL when the file went through */
+    int errnum;
+    int64_t issueCnt;
+    int64_t segCnt;
+    char *checkMsg;                 /* checker messages, printed with the report */
+    size_t checkLen;
+} h265bs_parse_file_job_t;
+
+typedef struct h265bs_parse_file_batch h265bs_parse_file_batch_t;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    int *job;                       /* job indexes, biggest file first */
+    int head;                       /* the owner takes from the head */
+    int tail;                       /* thieves take from the tail */
+    int64_t bytes;                  /* bytes of job[head, tail) */
+    int stealCnt;
+    pthread_t tid;
+    h265bs_parse_file_batch_t *batch;
+} h265bs_parse_file_worker_t;
+
+struct h265bs_parse_file_batch {
+    h265bs_parse_file_job_t *job;
+    int jobNum;
+    int jobMax;
+    h265bs_parse_file_worker_t *worker;
+    int workerNum;
+    char *outdir;
+    int bCountOnly;                 /* no nal files, counts only */
+    int bCheck;                     /* nal conformance check of every file */
+    char *segTarget;                /* access units to segments instead of nal files */
+    h265bs_seg_cfg_t segCfg;
+};
+
+static int h265bs_parse_file_add(h265bs_parse_file_batch_t *batch, const char *name, int64_t size)
+{
+    h265bs_parse_file_job_t *job = NULL;
+
+    if (batch->jobNum == batch->jobMax) {
+        job = realloc(batch->job, C_MAX(64, batch->jobMax * 2) * sizeof(h265bs_parse_file_job_t));
+        if (job == NULL) {
+            printf("h265bs_parse_file:realloc job failed\n");
+            return -1;
+        }
+        batch->job = job;
+        batch->jobMax = C_MAX(64, batch->jobMax * 2);
+    }
+    job = &batch->job[batch->jobNum];
+    memset(job, 0, sizeof(h265bs_parse_file_job_t));
+    job->name = strdup(name);
+    if (job->name == NULL) {
+        printf("h265bs_parse_file:strdup %s failed\n", name);
+        return -1;
+    }
+    job->size = size;
+    batch->jobNum++;
+
+    return 0;
+}
+
+/* Regular files are taken as they are, directories walked in name order */
+static int h265bs_parse_file_collect(h265bs_parse_file_batch_t *batch, const char *name)
+{
+    struct stat stat_buf;
+    struct dirent **entry = NULL;
+    char path[H265BS_PARSE_FILE_PATH_MAX];
+    int n = 0, i = 0, ret = 0;
+
+    if (stat(name, &stat_buf) < 0) {
+        printf("h265bs_parse_file:stat %s failed:%s\n", name, strerror(errno));
+        return -1;
+    }
+    if (S_ISREG(stat_buf.st_mode)) {
+        return h265bs_parse_file_add(batch, name, stat_buf.st_size);
+    }
+    if (!S_ISDIR(stat_buf.st_mode)) {
+        printf("h265bs_parse_file:%s is neither a file nor a directory, skipped\n", name);
+        return 0;
+    }
+
+    n = scandir(name, &entry, NULL, alphasort);
+    if (n < 0) {
+        printf("h265bs_parse_file:scandir %s failed:%s\n", name, strerror(errno));
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        if (ret == 0 && strcmp(entry[i]->d_name, ".") && strcmp(entry[i]->d_name, "..")) {
+            if (snprintf(path, sizeof(path), "%s/%s", name, entry[i]->d_name) >= sizeof(path)) {
+                printf("h265bs_parse_file:%s/%s too long\n", name, entry[i]->d_name);
+                ret = -1;
+            } else {
+                ret = h265bs_parse_file_collect(batch, path);
+            }
+        }
+        free(entry[i]);
+    }
+    free(entry);
+
+    return ret;
+}
+
+/* mkdir -p, a parent made by another worker meanwhile is fine */
+static int h265bs_parse_file_mkdir(char *path)
+{
+    char *p = path;
+
+    while ((p = strchr(p + 1, '/')) != NULL) {
+        *p = 0;
+        if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+            *p = '/';
+            return -1;
+        }
+        *p = '/';
+    }
+    if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int h265bs_parse_file_write(const char *name, const uint8_t *buf, int64_t size)
+{
+    int64_t n = 0;
+    int fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0) {
+        return -1;
+    }
+    while (size > 0) {
+        n = write(fd, buf, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            close(fd);
+            return -1;
+        }
+        buf += n;
+        size -= n;
+    }
+
+    return close(fd);
+}
+
+/* The same nal files as the single file mode: a nal runs from its start code,
+ * with the leading zero of a four byte one, up to the next start code. They
+ * go to outdir/<input name>.nal/, or with a segment target the access units
+ * go to outdir/<input name>.seg/ cut at IDRs */
+static void h265bs_parse_file_run(h265bs_parse_file_batch_t *batch, h265bs_parse_file_job_t *job)
+{
+    char dir[H265BS_PARSE_FILE_PATH_MAX], name[H265BS_PARSE_FILE_PATH_MAX + 64];
+    const char *rel = job->name;
+    h265bs_nal_iter_t it;
+    uint8_t *buf = NULL, *end = NULL, *nalStart = NULL, *nalEnd = NULL;
+    uint32_t type = 0;
+    int fd = -1;
+    FILE *fp = NULL;
+    h265bs_check_t *check = NULL;
+    h265bs_seg_cfg_t segCfg = batch->segCfg;
+    h265bs_seg_t *seg = NULL;
+    h265bs_seg_stat_t segStat;
+    i265e_nal_t au;
+    int bAuVcl = 0, bFirst = 0;
+
+    if (job->size == 0) {
+        return;
+    }
+
+    while (rel[0] == '/' || (rel[0] == '.' && rel[1] == '/')) {
+        rel += rel[0] == '/' ? 1 : 2;
+    }
+    if (!batch->bCountOnly) {
+        if (snprintf(dir, sizeof(dir), "%s/%s.%s", batch->outdir, rel, batch->segTarget ? "seg" : "nal") >= sizeof(dir)) {
+            job->errStep = "output name";
+            job->errnum = ENAMETOOLONG;
+            return;
+        }
+        if (h265bs_parse_file_mkdir(dir) < 0) {
+            job->errStep = "mkdir";
+            goto err_mkdir;
+        }
+    }
+    if (!batch->bCountOnly && batch->segTarget) {
+        snprintf(name, sizeof(name), "%s/seg", dir);
+        segCfg.prefix = name;
+        seg = h265bs_seg_init(&segCfg);
+        if (seg == NULL) {
+            job->errStep = "segment";
+            goto err_seg_init;
+        }
+    }
+
+    fd = open(job->name, O_RDONLY);
+    if (fd < 0) {
+        job->errStep = "open";
+        goto err_open;
+    }
+    buf = mmap(NULL, job->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (buf == MAP_FAILED) {
+        job->errStep = "mmap";
+        goto err_mmap;
+    }
+    madvise(buf, job->size, MADV_SEQUENTIAL);
+    end = buf + job->size;
+    memset(&au, 0, sizeof(au));
+
+    h265bs_nal_iter_init(&it, buf, end);
+    while (h265bs_nal_iter_next(&it)) {
+        nalStart = it.start;
+        nalEnd = it.nalEnd;
+
+        type = H265BS_NAL_TYPE(it.hdr);
+        bFirst = h265bs_nal_iter_first_slice(&it);
+        job->nalCnt++;
+        /* the access unit split of the scanner, the one before is complete */
+        if (seg && h265bs_nal_au_boundary(type, bFirst, bAuVcl)) {
+            au.i_payload = nalStart - au.p_payload;
+            if (h265bs_seg_write(seg, &au, 1, h265bs_nal_is_idr(au.i_type), job->picCnt - 1) < 0) {
+                job->errStep = "write";
+                goto err_write;
+            }
+            memset(&au, 0, sizeof(au));
+            bAuVcl = 0;
+        }
+        if (au.p_payload == NULL) {
+            au.p_payload = nalStart;
+        }
+        if (h265bs_nal_is_vcl(type)) {
+            bAuVcl = 1;
+            au.i_type = au.i_type ? au.i_type : type;
+        }
+        if (h265bs_nal_is_vcl(type) && bFirst) {
+            job->picCnt++;
+            job->irapCnt += h265bs_nal_is_irap(type);
+        }
+
+        if (!batch->bCountOnly && seg == NULL) {
+            snprintf(name, sizeof(name), "%s/nal%04lld_type%u.h265", dir, (long long)job->nalCnt, type);
+            if (h265bs_parse_file_write(name, nalStart, nalEnd - nalStart) < 0) {
+                job->errStep = "write";
+                goto err_write;
+            }
+        }
+    }
+
+    if (seg) {
+        au.i_payload = au.p_payload ? end - au.p_payload : 0;
+        if (au.i_payload && h265bs_seg_write(seg, &au, 1, h265bs_nal_is_idr(au.i_type), job->picCnt - 1) < 0) {
+            job->errStep = "write";
+            goto err_write;
+        }
+        h265bs_seg_get_stat(seg, &segStat);
+        h265bs_seg_deinit(seg);
+        seg = NULL;
+        job->segCnt = segStat.segCnt;
+        if (segStat.errCnt) {
+            job->errStep = "segment";
+            errno = EIO;
+            goto err_seg_write;
+        }
+    }
+
+    /* the pages were just read, the checker goes over them while they are hot */
+    if (batch->bCheck) {
+        fp = open_memstream(&job->checkMsg, &job->checkLen);
+        if (fp == NULL) {
+            job->errStep = "open_memstream";
+            goto err_open_memstream;
+        }
+        check = h265bs_check_init(fp, 0);
+        if (check) {
+            h265bs_check_buf(check, buf, job->size, 0);
+            job->issueCnt = h265bs_check_end(check);
+            h265bs_check_deinit(check);
+        }
+        fclose(fp);
+        if (check == NULL) {
+            job->errStep = "check";
+            errno = ENOMEM;
+            goto err_check_init;
+        }
+    }
+
+    munmap(buf, job->size);
+    close(fd);
+    return;
+
+err_check_init:
+err_open_memstream:
+err_seg_write:
+err_write:
+    munmap(buf, job->size);
+err_mmap:
+    close(fd);
+err_open:
+    h265bs_seg_deinit(seg);
+err_seg_init:
+err_mkdir:
+    job->errnum = errno;
+}
+
+static int h265bs_parse_file_take(h265bs_parse_file_worker_t *w, int bTail)
+{
+    int i = -1;
+
+    pthread_mutex_lock(&w->mutex);
+    if (w->head < w->tail) {
+        i = bTail ? w->job[--w->tail] : w->job[w->head++];
+        w->bytes -= w->batch->job[i].size;
+    }
+    pthread_mutex_unlock(&w->mutex);
+
+    return i;
+}
+
+/* Smallest job of the worker with the most bytes left, -1 once all are empty */
+static int h265bs_parse_file_steal(h265bs_parse_file_worker_t *self)
+{
+    h265bs_parse_file_batch_t *batch = self->batch;
+    h265bs_parse_file_worker_t *victim = NULL;
+    int64_t bytes = 0, most = -1;
+    int i = 0, n = 0;
+
+    do {
+        victim = NULL;
+        most = -1;
+        for (i = 0; i < batch->workerNum; i++) {
+            pthread_mutex_lock(&batch->worker[i].mutex);
+            n = batch->worker[i].tail - batch->worker[i].head;
+            bytes = batch->worker[i].bytes;
+            pthread_mutex_unlock(&batch->worker[i].mutex);
+            if (&batch->worker[i] != self && n > 0 && bytes > most) {
+                victim = &batch->worker[i];
+                most = bytes;
+            }
+        }
+        /* another thief may have emptied it meanwhile, look again */
+        if (victim && (i = h265bs_parse_file_take(victim, 1)) >= 0) {
+            self->stealCnt++;
+            return i;
+        }
+    } while (victim);
+
+    return -1;
+}
+
+static void *h265bs_parse_file_worker(void *arg)
+{
+    h265bs_parse_file_worker_t *w = (h265bs_parse_file_worker_t *)arg;
+    int i = 0;
+
+    while ((i = h265bs_parse_file_take(w, 0)) >= 0 || (i = h265bs_parse_file_steal(w)) >= 0) {
+        h265bs_parse_file_run(w->batch, &w->batch->job[i]);
+    }
+
+    return NULL;
+}
+
+static h265bs_parse_file_batch_t *h265bs_parse_file_sort_batch;
+
+/* biggest first, input order between equal sizes */
+static int h265bs_parse_file_cmp_size(const void *a, const void *b)
+{
+    const h265bs_parse_file_job_t *job = h265bs_parse_file_sort_batch->job;
+    int x = *(const int *)a, y = *(const int *)b;
+
+    if (job[x].size != job[y].size) {
+        return job[x].size < job[y].size ? 1 : -1;
+    }
+    return x - y;
+}
+
+static int h265bs_parse_file_batch(h265bs_parse_file_batch_t *batch)
+{
+    h265bs_parse_file_worker_t *w = NULL;
+    h265bs_parse_file_job_t *job = NULL;
+    int *order = NULL;
+    int64_t start = 0, elapsed = 0, bytes = 0, nalCnt = 0, issueCnt = 0;
+    int i = 0, k = 0, started = 0, failCnt = 0, stealCnt = 0, errnum = 0, ret = -1;
+
+    batch->workerNum = C_MAX(1, C_MIN(batch->workerNum, batch->jobNum));
+    order = malloc(batch->jobNum * sizeof(int));
+    batch->worker = calloc(batch->workerNum, sizeof(h265bs_parse_file_worker_t));
+    if (order == NULL || batch->worker == NULL) {
+        printf("h265bs_parse_file:calloc workers failed\n");
+        free(batch->worker);
+        batch->worker = NULL;
+        goto err_calloc_worker;
+    }
+    for (k = 0; k < batch->workerNum; k++) {
+        batch->worker[k].batch = batch;
+        pthread_mutex_init(&batch->worker[k].mutex, NULL);
+    }
+    for (k = 0; k < batch->workerNum; k++) {
+        w = &batch->worker[k];
+        w->job = malloc(batch->jobNum * sizeof(int));
+        if (w->job == NULL) {
+            printf("h265bs_parse_file:malloc worker queue failed\n");
+            goto err_malloc_queue;
+        }
+    }
+
+    /* longest processing time first: each file to the lightest queue */
+    for (i = 0; i < batch->jobNum; i++) {
+        order[i] = i;
+    }
+    h265bs_parse_file_sort_batch = batch;
+    qsort(order, batch->jobNum, sizeof(int), h265bs_parse_file_cmp_size);
+    for (i = 0; i < batch->jobNum; i++) {
+        w = &batch->worker[0];
+        for (k = 1; k < batch->workerNum; k++) {
+            if (batch->worker[k].bytes < w->bytes) {
+                w = &batch->worker[k];
+            }
+        }
+        w->job[w->tail++] = order[i];
+        w->bytes += batch->job[order[i]].size;
+    }
+
+    start = h265bs_mdate();
+    for (started = 0; started < batch->workerNum; started++) {
+        w = &batch->worker[started];
+        if ((errnum = pthread_create(&w->tid, NULL, h265bs_parse_file_worker, w)) != 0) {
+            printf("h265bs_parse_file:pthread_create failed:%s\n", strerror(errnum));
+            break;
+        }
+    }
+    /* the started workers steal whatever the missing ones had */
+    if (started == 0) {
+        h265bs_parse_file_worker(&batch->worker[0]);
+    }
+    for (k = 0; k < started; k++) {
+        pthread_join(batch->worker[k].tid, NULL);
+        stealCnt += batch->worker[k].stealCnt;
+    }
+    elapsed = C_MAX(h265bs_mdate() - start, 1);
+
+    for (i = 0; i < batch->jobNum; i++) {
+        job = &batch->job[i];
+        if (job->errStep) {
+            printf("%s: %s failed:%s\n", job->name, job->errStep, strerror(job->errnum));
+            failCnt++;
+            continue;
+        }
+        if (job->checkLen) {
+            fwrite(job->checkMsg, 1, job->checkLen, stdout);
+        }
+        printf("%s: bytes=%lld, nals=%lld, pictures=%lld, iraps=%lld", job->name,
+                (long long)job->size, (long long)job->nalCnt, (long long)job->picCnt, (long long)job->irapCnt);
+        if (batch->bCheck) {
+            printf(", issues=%lld", (long long)job->issueCnt);
+            issueCnt += job->issueCnt;
+        }
+        if (batch->segTarget) {
+            printf(", segments=%lld", (long long)job->segCnt);
+        }
+        printf("\n");
+        bytes += job->size;
+        nalCnt += job->nalCnt;
+    }
+    printf("h265bs_parse_file:files=%d, failed=%d, bytes=%lld, nals=%lld, threads=%d, steals=%d, usec=%lld, %.1f MB/s, %.1f files/s",
+            batch->jobNum, failCnt, (long long)bytes, (long long)nalCnt, C_MAX(started, 1), stealCnt,
+            (long long)elapsed, (double)bytes / elapsed, batch->jobNum * 1000000.0 / elapsed);
+    if (batch->bCheck) {
+        printf(", issues=%lld", (long long)issueCnt);
+    }
+    printf("\n");
+    /* a stream with issues fails the run like an unreadable file */
+    ret = (failCnt || issueCnt) ? -1 : 0;
+
+err_malloc_queue:
+    for (k = 0; k < batch->workerNum; k++) {
+        pthread_mutex_destroy(&batch->worker[k].mutex);
+        free(batch->worker[k].job);
+    }
+err_calloc_worker:
+    free(batch->worker);
+    free(order);
+    return ret;
+}
+
+/* One input, nal files go to the current directory */
+static int h265bs_parse_file_one(char *bsname)
 {
 	int bsfd = -1;
 	int nalfd = -1;
@@ -20,20 +535,18 @@ int main(int argc, char *argv[])
 	char *endptr = NULL, *startptr = NULL;
 	int naltype = 0;
 
-	if (argc < 2) {
-		printf("Usage:%s h265bsfile", argv[0]);
-		return -1;
-	}
-
-	bsfd = open(argv[1], O_RDONLY);
+	bsfd = strcmp(bsname, "-") ? open(bsname, O_RDONLY) : dup(STDIN_FILENO);
 	if (bsfd < 0) {
-		printf("open %s failed\n", argv[1]);
+		printf("open %s failed\n", bsname);
 		goto err_open_bsfile;
 	}
 
     startptr = endptr = bsbuf;
 	while (1) {
 		readcnt = read(bsfd, bsbuf + leftcnt, BUFSIZE - leftcnt);
+		if (readcnt < 0 && errno == EINTR) {
+			continue;
+		}
 		if (readcnt <= 0) {
 			printf("readcnt = %d\n", readcnt);
 			break;
@@ -109,3 +622,205 @@ err_open_nalname:
 err_open_bsfile:
 	return -1;
 }
+
+static void usage(char *name)
+{
+    printf("Usage:%s h265bsfile, - reads stdin\n", name);
+    printf("      %s [-j threads] [-o outdir] [-c] [-v] [-g target] [-f fps] input...\n", name);
+    printf("\t-j threads   : batch mode workers, default the online cpu count\n");
+    printf("\t-o outdir    : nal files of input go to outdir/input.nal/, default .\n");
+    printf("\t-c           : count nals and pictures only, no nal files\n");
+    printf("\t-v           : nal conformance check of every input, messages carry byte offsets\n");
+    printf("\t-g target    : access units go to outdir/input.seg/ in segments cut at IDRs after N frames, Nk/Nm bytes or Ns seconds at -f\n");
+    printf("\tseveral inputs, a directory or any of the options above run the batch mode\n");
+    printf("      %s -t start:end [-i index] [-f fps] input output\n", name);
+    printf("\t-t start:end : copy frames [start, end) from the IRAP at or before start, no end for the end of file,\n");
+    printf("\t               N is a frame and Ns a time in seconds. The input is split from offset 0 up to end\n");
+    printf("\t-i index     : jump to the IRAP with the keyframe index kept in this file, it is built and saved\n");
+    printf("\t               when missing or older than the input\n");
+    printf("\t-f fps       : frame rate of the times and of -g, num or num/den\n");
+    printf("      %s -d [-j threads] [-f fps] a b\n", name);
+    printf("\t-d           : compare b against a by access unit, first divergence, sizes per slice type and gop bitrates\n");
+    printf("\t               in kbps with -f, exits 0 when the streams are the same and 1 when they differ\n");
+    printf("      %s -p [-k cores] input\n", name);
+    printf("\t-p           : substreams of every picture from the entry points, their sizes and imbalance\n");
+    printf("\t-k cores     : decoder core counts to estimate the speedup for, up to 8 as 2,4,8\n");
+}
+
+/* The keyframe index saved in idxName, built from inName and saved there
+ * when it is missing or stale */
+static h265bs_index_t *h265bs_parse_file_index(const char *inName, const char *idxName)
+{
+    h265bs_index_t *idx = NULL;
+    int64_t start = h265bs_mdate();
+    int fd = -1;
+
+    fd = open(inName, O_RDONLY);
+    if (fd < 0) {
+        printf("h265bs_parse_file:open %s failed:%s\n", inName, strerror(errno));
+        return NULL;
+    }
+    idx = h265bs_index_load(idxName, fd);
+    if (idx) {
+        printf("h265bs_parse_file:index %s loaded in %lld us\n", idxName, (long long)(h265bs_mdate() - start));
+    } else if ((idx = h265bs_index_build(fd, H265BS_HASH_NONE, 0)) != NULL) {
+        if (h265bs_index_save(idx, fd, idxName) == 0) {
+            printf("h265bs_parse_file:index %s built in %lld us\n", idxName, (long long)(h265bs_mdate() - start));
+        }
+    }
+    close(fd);
+    return idx;
+}
+
+static int h265bs_parse_file_trim(const char *range, const char *fps, const char *idxName, const char *inName, const char *outName)
+{
+    h265bs_trim_cfg_t cfg;
+    h265bs_trim_stat_t stat;
+    char buf[64];
+    char *sep = NULL;
+    int fpsNum = 0, fpsDen = 1, ret = 0;
+
+    if (fps && sscanf(fps, "%d/%d", &fpsNum, &fpsDen) < 1) {
+        printf("h265bs_parse_file:bad frame rate %s\n", fps);
+        return -1;
+    }
+    snprintf(buf, sizeof(buf), "%s", range);
+    sep = strchr(buf, ':');
+    if (sep == NULL) {
+        printf("h265bs_parse_file:range %s is not start:end\n", range);
+        return -1;
+    }
+    *sep++ = '\0';
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.endFrame = -1;
+    if (h265bs_trim_parse_frame(buf, fpsNum, fpsDen, &cfg.startFrame) < 0
+            || (*sep && h265bs_trim_parse_frame(sep, fpsNum, fpsDen, &cfg.endFrame) < 0)) {
+        printf("h265bs_parse_file:bad range %s\n", range);
+        return -1;
+    }
+    if (idxName && (cfg.index = h265bs_parse_file_index(inName, idxName)) == NULL) {
+        return -1;
+    }
+    ret = h265bs_trim(inName, outName, &cfg, &stat);
+    h265bs_index_free(cfg.index);
+    if (ret < 0) {
+        return -1;
+    }
+    if (stat.frameCnt < 0) {
+        snprintf(buf, sizeof(buf), "to the end");
+    } else {
+        snprintf(buf, sizeof(buf), "%lld frames", (long long)stat.frameCnt);
+    }
+    printf("h265bs_trim:frames %lld..%lld from IRAP %lld, %s, %lld bytes at %lld + %d parameter set bytes, "
+            "scanned %lld bytes in %lld us, %s in %lld us\n",
+            (long long)cfg.startFrame, (long long)cfg.endFrame, (long long)stat.keyFrame, buf,
+            (long long)stat.srcSize, (long long)stat.srcOff, stat.psSize,
+            (long long)stat.scanBytes, (long long)stat.scanUs, stat.copyName, (long long)stat.copyUs);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    h265bs_parse_file_batch_t batch;
+    struct stat stat_buf;
+    h265bs_diff_cfg_t diffCfg;
+    h265bs_par_cfg_t parCfg;
+    const char *trimRange = NULL, *fpsStr = NULL, *idxName = NULL;
+    int opt = 0, i = 0, bBatch = 0, bDiff = 0, bPar = 0, ret = 0, fpsNum = 0, fpsDen = 1;
+
+    memset(&batch, 0, sizeof(batch));
+    batch.outdir = ".";
+    batch.workerNum = sysconf(_SC_NPROCESSORS_ONLN);
+    memset(&parCfg, 0, sizeof(parCfg));
+    while ((opt = getopt(argc, argv, "j:o:cvg:t:i:f:dpk:")) != -1) {
+        switch (opt) {
+        case 'j': batch.workerNum = atoi(optarg); bBatch = 1; break;
+        case 'o': batch.outdir = optarg; bBatch = 1; break;
+        case 'c': batch.bCountOnly = 1; bBatch = 1; break;
+        case 'v': batch.bCheck = 1; bBatch = 1; break;
+        case 'g': batch.segTarget = optarg; bBatch = 1; break;
+        case 't': trimRange = optarg; break;
+        case 'i': idxName = optarg; break;
+        case 'f': fpsStr = optarg; break;
+        case 'd': bDiff = 1; break;
+        case 'p': bPar = 1; break;
+        case 'k':
+            if (h265bs_par_parse_cores(optarg, &parCfg) < 0) {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    /* -f may come behind -g */
+    if (batch.segTarget) {
+        if (fpsStr && sscanf(fpsStr, "%d/%d", &fpsNum, &fpsDen) < 1) {
+            printf("h265bs_parse_file:bad frame rate %s\n", fpsStr);
+            return -1;
+        }
+        if (h265bs_seg_parse_target(batch.segTarget, fpsNum, fpsDen, &batch.segCfg) < 0) {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (bPar) {
+        if (bDiff || trimRange || bBatch || argc - optind != 1) {
+            usage(argv[0]);
+            return -1;
+        }
+        return h265bs_par(argv[optind], &parCfg);
+    }
+    if (bDiff) {
+        if (trimRange || strcmp(batch.outdir, ".") || batch.bCountOnly || batch.bCheck || batch.segTarget || argc - optind != 2) {
+            usage(argv[0]);
+            return -1;
+        }
+        memset(&diffCfg, 0, sizeof(diffCfg));
+        diffCfg.threadNum = batch.workerNum;
+        diffCfg.fpsDen = 1;
+        if (fpsStr && sscanf(fpsStr, "%d/%d", &diffCfg.fpsNum, &diffCfg.fpsDen) < 1) {
+            printf("h265bs_parse_file:bad frame rate %s\n", fpsStr);
+            return -1;
+        }
+        return h265bs_diff(argv[optind], argv[optind + 1], &diffCfg);
+    }
+    if (trimRange) {
+        if (bBatch || argc - optind != 2) {
+            usage(argv[0]);
+            return -1;
+        }
+        return h265bs_parse_file_trim(trimRange, fpsStr, idxName, argv[optind], argv[optind + 1]);
+    }
+    if (argc - optind < 1) {
+        usage(argv[0]);
+        return -1;
+    }
+    if (argc - optind > 1 || (strcmp(argv[optind], "-") && stat(argv[optind], &stat_buf) == 0 && S_ISDIR(stat_buf.st_mode))) {
+        bBatch = 1;
+    }
+    if (!bBatch) {
+        return h265bs_parse_file_one(argv[optind]);
+    }
+
+    for (i = optind; i < argc && ret == 0; i++) {
+        ret = h265bs_parse_file_collect(&batch, argv[i]);
+    }
+    if (ret == 0 && batch.jobNum == 0) {
+        printf("h265bs_parse_file:no input file\n");
+        ret = -1;
+    }
+    if (ret == 0) {
+        ret = h265bs_parse_file_batch(&batch);
+    }
+
+    for (i = 0; i < batch.jobNum; i++) {
+        free(batch.job[i].name);
+        free(batch.job[i].checkMsg);
+    }
+    free(batch.job);
+
+    return ret;
+}
@@ -8,334 +8,626 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <pthread.h>
-#include <assert.h>
+#include <poll.h>
+#include <sys/inotify.h>
 
 #include "i265e.h"
-
-#define I265E_EXT_MAX_NAL_CNT       5
-
-static int startProcess = 0;
-
-typedef struct i265e_extern_bs {
-    int bsBufSize;
-    uint8_t *bsBuf;
-    int bsFd;
-    int bsFileSize;
-    uint8_t *startPtr;
-    uint8_t *endPtr;
-    int bsBufOccupy;
-
-    uint8_t *nalBuf;
-    unsigned int nalBufOccupy;
-    i265e_nal_t *nal;
-    int nalCnt;
-
-    /* sync context */
-    pthread_cond_t enc_start_cond;
-    pthread_mutex_t enc_start_mutex;
-    pthread_cond_t enc_end_cond;
-    pthread_mutex_t enc_end_mutex;
-    int tiggerEncStartFlag;
-    int tiggerEncEndFlag;
-} i265e_extern_bs_t;
-
-i265e_extern_bs_t *i265e_extern_bs_init(int bsBufSize, char *bsname)
+#include "h265bs_mem.h"
+#include "h265bs_ingest.h"
+#include "h265bs_hash.h"
+#include "h265bs_tmodel.h"
+#include "h265bs_nal.h"
+#include "h265bs_trace.h"
+#include "h265bs_check.h"
+#include "h265bs_seg.h"
+#include "h265bs_ctl.h"
+#include "i265e_extern_bs.h"
+
+/* One file name per line, empty lines and lines starting with # skipped */
+static char **load_playlist(char *listname, int *cnt)
 {
-    struct stat stat_buf;
-    i265e_extern_bs_t *h = calloc(1, sizeof(i265e_extern_bs_t));
-    if (h == NULL) {
-        printf("i265ext:calloc i265e_extern_bs_t failed\n");
-        goto err_calloc_i265e_extern_bs_t;
+    FILE *fp = NULL;
+    char line[4096];
+    char **list = NULL, **tmp = NULL;
+    int len = 0;
+
+    *cnt = 0;
+    fp = fopen(listname, "r");
+    if (fp == NULL) {
+        printf("open playlist %s failed:%s\n", listname, strerror(errno));
+        return NULL;
     }
-
-    h->bsBufSize = bsBufSize;
-    h->bsBuf = malloc(h->bsBufSize);
-    if (h->bsBuf == NULL) {
-        printf("i265ext:malloc bsBuf failed\n");
-        goto err_malloc_bsBuf;
-    }
-
-    h->bsFd = open(bsname, O_RDONLY);
-    if (h->bsFd < 0) {
-        printf("i265ext:open %s failed:%s\n", bsname, strerror(errno));
-        goto err_open_bsname;
-    }
-
-    if (fstat(h->bsFd, &stat_buf) < 0) {
-        printf("i265ext:fstat %s failed:%s\n", bsname, strerror(errno));
-        goto err_fstat_bsFd;
-    }
-
-    h->bsFileSize = stat_buf.st_size;
-    h->startPtr = NULL;
-    h->endPtr = h->bsBuf;
-    h->bsBufOccupy = 0;
-
-    h->nalBuf = NULL;
-    h->nalBufOccupy = 0;
-
-    h->nal = calloc(I265E_EXT_MAX_NAL_CNT, sizeof(i265e_nal_t));;
-    if (h->nal == NULL) {
-        printf("i265ext:calloc h->nal failed:%s\n", strerror(errno));
-        goto err_calloc_nal;
+    while (fgets(line, sizeof(line), fp)) {
+        len = strcspn(line, "\r\n");
+        line[len] = '\0';
+        if (len == 0 || line[0] == '#') {
+            continue;
+        }
+        tmp = realloc(list, (*cnt + 1) * sizeof(char *));
+        if (tmp == NULL || (tmp[*cnt] = strdup(line)) == NULL) {
+            printf("alloc playlist entry failed\n");
+            list = tmp ? tmp : list;
+            break;
+        }
+        list = tmp;
+        (*cnt)++;
     }
-    h->nalCnt = 0;
-
-    /* sync context */
-    h->tiggerEncStartFlag = 1;
-    h->tiggerEncEndFlag = 0;
-    pthread_mutex_init(&h->enc_start_mutex, NULL);
-    pthread_cond_init(&h->enc_start_cond, NULL);
-    pthread_mutex_init(&h->enc_end_mutex, NULL);
-    pthread_cond_init(&h->enc_end_cond, NULL);
-
-    return h;
-
-err_calloc_nal:
-err_fstat_bsFd:
-    close(h->bsFd);
-err_open_bsname:
-    free(h->bsBuf);
-err_malloc_bsBuf:
-    free(h);
-err_calloc_i265e_extern_bs_t:
-    return NULL;
+    fclose(fp);
+    return list;
 }
 
-void i265e_extern_bs_deinit(i265e_extern_bs_t *h)
+/* A playlist whose lines are "kbps file", the names are moved to the front */
+static int *load_ladder(char **list, int cnt)
 {
-    if (h) {
-        pthread_mutex_destroy(&h->enc_start_mutex);
-        pthread_cond_destroy(&h->enc_start_cond);
-        pthread_mutex_destroy(&h->enc_end_mutex);
-        pthread_cond_destroy(&h->enc_end_cond);
-        if (h->nal) free(h->nal);
-        if (h->bsFd >= 0) close(h->bsFd);
-        if (h->bsBuf) free(h->bsBuf);
-        free(h);
+    int *kbps = calloc(cnt, sizeof(int));
+    int i = 0, n = 0;
+
+    if (kbps == NULL) {
+        printf("calloc ladder failed\n");
+        return NULL;
     }
+    for (i = 0; i < cnt; i++) {
+        if (sscanf(list[i], "%d %n", &kbps[i], &n) != 1 || list[i][n] == '\0') {
+            printf("ladder entry \"%s\" is not \"kbps file\"\n", list[i]);
+            free(kbps);
+            return NULL;
+        }
+        memmove(list[i], list[i] + n, strlen(list[i] + n) + 1);
+    }
+    return kbps;
 }
 
-void i265e_extern_dump_nal(i265e_extern_bs_t *h)
-{
-	if (h) {
-		int i = 0;
-
-		printf("-----------%s(%d) start, h->nalCnt=%d --------\n", __func__, __LINE__, h->nalCnt);
-		for (i = 0; i < h->nalCnt; i++) {
-			printf("[%d], i_type=%d, p_payload=%p, i_payload=%d\n", i, h->nal[i].i_type, h->nal[i].p_payload, h->nal[i].i_payload);
-		}
-		printf("-----------%s(%d) end,  h->nalCnt=%d --------\n", __func__, __LINE__, h->nalCnt);
-	}
-}
+/* -W: a file closed after writing or moved in at path is swapped in */
+typedef struct {
+    i265e_extern_bs_t *h;
+    char *path;
+    int inFd;
+    int stopPipe[2];
+    pthread_t tid;
+} source_watch_t;
 
-int i265e_extern_bs_slice_write(i265e_extern_bs_t *h, uint8_t *nal_buf)
+static void *source_watch_thread(void *arg)
 {
-    int readCnt = 0;
-    h->nalBuf = nal_buf;
-    h->nalBufOccupy = 0;
-    h->nalCnt = 0;
-    memset(h->nal, 0, sizeof(i265e_nal_t));
-
-	while (1) {
-        /*fill the h->bsBufSize */
-        if ((h->bsBufOccupy <= 5)) {
-            readCnt = read(h->bsFd, h->endPtr + h->bsBufOccupy, h->bsBufSize - (h->endPtr + h->bsBufOccupy - h->bsBuf));
-            if (readCnt < 0 && errno != EINTR) {
-                printf("readCnt=%d, errno=%d:%s\n", readCnt, errno, strerror(errno));
-                abort();
-            }
-            if (readCnt < 0 && errno == EINTR) {
-                continue;
-            } else if (readCnt == 0) {	//To the EndOfFile
-                lseek(h->bsFd, 0, SEEK_SET);
+    source_watch_t *w = arg;
+    union {
+        struct inotify_event ev;
+        char buf[4096];
+    } u;
+    const struct inotify_event *ev = NULL;
+    const char *base = strrchr(w->path, '/') ? strrchr(w->path, '/') + 1 : w->path;
+    struct pollfd pfd[2];
+    i265e_extern_rcfg_source_param_t src;
+    ssize_t n = 0;
+    char *p = NULL;
+
+    pfd[0].fd = w->inFd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = w->stopPipe[0];
+    pfd[1].events = POLLIN;
+    while (1) {
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR) {
                 continue;
-            } else { /* readCnt > 0*/
-                h->bsBufOccupy += readCnt;
             }
+            break;
         }
-
-
-		while (h->bsBufOccupy >= 5) {
-			if ((h->endPtr[0] == 0x00) && (h->endPtr[1] == 0x00) && ((h->endPtr[2] == 0x01)
-						|| ((h->endPtr[2] == 0x00) && (h->endPtr[3] == 0x01)))) {
-                if (h->startPtr == NULL) { // start nal
-                    h->startPtr = h->endPtr;
-                    if ((h->endPtr[0] == 0x00) && (h->endPtr[1] == 0x00) && (h->endPtr[2] == 0x01)) {
-                        /* Init nal info */
-                        h->nal[h->nalCnt].i_type = (h->endPtr[3] >> 1) & 0x3f;
-                        h->endPtr += 4;
-                        h->bsBufOccupy -= 4;
-                    } else {
-                        h->nal[h->nalCnt].i_type = (h->endPtr[4] >> 1) & 0x3f;
-                        h->endPtr += 5;
-                        h->bsBufOccupy -= 5;
-                    }
-
-                    /* Init nal info */
-                    h->nal[h->nalCnt].i_payload = 0;
-                    h->nal[h->nalCnt].p_payload = h->nalBuf + h->nalBufOccupy;
-                } else { /* end nal */
-                    memcpy(h->nalBuf + h->nalBufOccupy, h->startPtr, h->endPtr - h->startPtr);
-                    h->nalBufOccupy += h->endPtr - h->startPtr;
-
-                    h->nal[h->nalCnt].i_payload = h->nalBuf + h->nalBufOccupy - h->nal[h->nalCnt].p_payload;
-                    h->nalCnt++;
-                    h->startPtr = NULL;
-
-                    if ((h->nal[h->nalCnt - 1].i_type == I265E_NAL_CODED_SLICE_IDR_W_RADL)
-							|| (h->nal[h->nalCnt - 1].i_type == I265E_NAL_CODED_SLICE_TRAIL_R)) {
-                        if (h->bsBufOccupy > 0) {
-                            memmove(h->bsBuf, h->endPtr, h->bsBufOccupy);
-							h->endPtr = h->bsBuf;
-                        }
-						i265e_extern_dump_nal(h);
-                        return 0;
-                    }
-                }
-            } else {
-                h->endPtr++;
-                h->bsBufOccupy--;
+        if (pfd[1].revents) {
+            break;
+        }
+        n = read(w->inFd, u.buf, sizeof(u.buf));
+        for (p = u.buf; n > 0 && p < u.buf + n; p += sizeof(struct inotify_event) + ev->len) {
+            ev = (const struct inotify_event *)p;
+            if (ev->len && strcmp(ev->name, base) == 0) {
+                printf("%s changed, swapping it in\n", w->path);
+                snprintf(src.name, sizeof(src.name), "%s", w->path);
+                i265e_extern_bs_set_param(w->h, I265E_EXT_RCFG_SOURCE_ID, &src);
             }
         }
-	}
-
-    return -1;
-}
-
-int i265e_extern_bs_enc(i265e_extern_bs_t *h, uint8_t *nal_buf)
-{
-    pthread_mutex_lock(&h->enc_start_mutex);
-    if (h->tiggerEncStartFlag == 0) {
-        pthread_cond_wait(&h->enc_start_cond, &h->enc_start_mutex);
     }
-    h->tiggerEncStartFlag = 0;
-    pthread_mutex_unlock(&h->enc_start_mutex);
-
-    /* to do */
-    i265e_extern_bs_slice_write(h, nal_buf);
-
-    pthread_mutex_lock(&h->enc_end_mutex);
-    h->tiggerEncEndFlag = 1;
-    pthread_cond_signal(&h->enc_end_cond);
-    pthread_mutex_unlock(&h->enc_end_mutex);
-    return 0;
+    return NULL;
 }
 
-int i265e_extern_bs_get_bitstream(i265e_extern_bs_t *h, i265e_nal_t **pp_nal, int *pi_nal, uint8_t **nal_buf)
+/* The directory is watched, a file renamed over path shows up too */
+static int source_watch_start(source_watch_t *w, i265e_extern_bs_t *h, char *path)
 {
-    pthread_mutex_lock(&h->enc_end_mutex);
-    if (h->tiggerEncEndFlag == 0) {
-        pthread_cond_wait(&h->enc_end_cond, &h->enc_end_mutex);
-    }
-    h->tiggerEncEndFlag = 0;
-    pthread_mutex_unlock(&h->enc_end_mutex);
-
-    *pp_nal = h->nal;
-    *pi_nal = h->nalCnt;
-    *nal_buf = h->nalBuf;
+    char dir[I265E_EXT_NAME_MAX];
+    char *slash = strrchr(path, '/');
+    int errnum = 0;
 
+    w->h = h;
+    w->path = path;
+    snprintf(dir, sizeof(dir), "%.*s", slash ? (int)(slash - path) + 1 : 1, slash ? path : ".");
+    w->inFd = inotify_init1(IN_CLOEXEC);
+    if (w->inFd < 0) {
+        printf("inotify_init1 failed:%s\n", strerror(errno));
+        goto err_inotify_init;
+    }
+    if (inotify_add_watch(w->inFd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        printf("inotify_add_watch %s failed:%s\n", dir, strerror(errno));
+        goto err_add_watch;
+    }
+    if (pipe(w->stopPipe) < 0) {
+        printf("pipe failed:%s\n", strerror(errno));
+        goto err_pipe;
+    }
+    if ((errnum = pthread_create(&w->tid, NULL, source_watch_thread, w)) != 0) {
+        printf("pthread_create source_watch_thread failed:%s\n", strerror(errnum));
+        goto err_pthread_create;
+    }
     return 0;
-}
 
-int i265e_extern_bs_release_bitstream(i265e_extern_bs_t *h)
-{
-    pthread_mutex_lock(&h->enc_start_mutex);
-    h->tiggerEncStartFlag = 1;
-    pthread_cond_signal(&h->enc_start_cond);
-    pthread_mutex_unlock(&h->enc_start_mutex);
-
-    return 0;
+err_pthread_create:
+    close(w->stopPipe[0]);
+    close(w->stopPipe[1]);
+err_pipe:
+err_add_watch:
+    close(w->inFd);
+err_inotify_init:
+    return -1;
 }
 
-void *i265e_extern_bs_enc_thread(void *arg)
+static void source_watch_stop(source_watch_t *w)
 {
-    void **thread_arg = arg;
-    i265e_extern_bs_t *h = thread_arg[0];
-    uint8_t *nal_buf = thread_arg[1];
-
-    while (startProcess) {
-        i265e_extern_bs_enc(h, nal_buf);
+    if (write(w->stopPipe[1], "", 1) != 1) {
+        printf("stop source_watch_thread failed:%s\n", strerror(errno));
     }
-    return NULL;
+    pthread_join(w->tid, NULL);
+    close(w->stopPipe[0]);
+    close(w->stopPipe[1]);
+    close(w->inFd);
 }
 
+static void usage(char *name)
+{
+    printf("Usage:%s [-n nalBufNum] [-u] [-H] [-N node] [-I mode] [-q depth] [-r readSize] [-x] [-T speed[@frame]] [-P] [-C hash] [-M soc] [-f fps] [-B kbps[,vbvKbits]] [-s mode,iBits,pBits[,bBits[,prio]]] [-L ladder] [-K kbps[@frame]] [-D frame] [-A intra] [-E trace.json] [-V] [-G target] [-S file[@frame]] [-W file] [-c socket] [-l logLevel] bsBufSize savecnt bsname savename\n", name);
+    printf("\tsavecnt <= 0 saves until the input ends, bsname - reads stdin\n");
+    printf("\t-n nalBufNum : count of pooled nal buffers, default %d\n", I265E_EXT_NALBUF_NUM);
+    printf("\t-u           : use one caller nal buffer instead of the pool(bUserNalbuf)\n");
+    printf("\t-H           : back bsBuf and the nal pool with 2MB huge pages\n");
+    printf("\t-N node      : bind buffers, the enc and the read-ahead thread to numa node\n");
+    printf("\t-I mode      : input backend sync|uring|thread|mmap, default sync\n");
+    printf("\t-q depth     : read-ahead queue depth, default %d\n", H265BS_INGEST_QUEUE_DEPTH);
+    printf("\t-r readSize  : bytes of one read-ahead, default %d\n", H265BS_INGEST_READ_SIZE);
+    printf("\t-x           : index the file at start, needed by -T\n");
+    printf("\t-T speed     : trick play from frame on, keyframes only, <0 reverse, 1 back to normal\n");
+    printf("\t-P           : bsname is a playlist, one file per line, spliced at IRAPs\n");
+    printf("\t-C hash      : crc32c|xxh64 per access unit, every saved one is checked against it\n");
+    printf("\t-M soc       : deliver with the latency and throughput of m200|t10|t20|t30\n");
+    printf("\t-f fps       : with -M, access units are captured at this frame rate instead of back to back\n");
+    printf("\t-B kbps      : with -f, pad every access unit with filler data to a CBR of kbps, vbv of 1s by default\n");
+    printf("\t-s mode,...  : super frames over iBits/pBits/bBits are 1 dropped, 2 replaced by the last smaller one, 3 flagged,\n");
+    printf("\t               IRAPs are never dropped, prio 1 lets one through while the stream stays under -B kbps at -f\n");
+    printf("\t-L ladder    : bsname is a list of \"kbps file\" lines, aligned renditions of one content\n");
+    printf("\t-K kbps      : with -L, switch to the closest rendition from frame on, at the next IDR\n");
+    printf("\t-D frame     : with -x, force an IDR at frame, the frames it takes to show up are printed\n");
+    printf("\t-A intra     : all intra encode of bsname, forced IDRs are taken from it\n");
+    printf("\t-E trace     : record where every access unit spent its time, chrome trace json at the end\n");
+    printf("\t-V           : nal conformance check of every input file before the replay, issues go with byte offsets\n");
+    printf("\t-G target    : savename is a prefix of segments cut at IDRs after N frames, Nk/Nm bytes or Ns seconds at -f\n");
+    printf("\t-S file      : swap file in from frame on, at the next IRAP of bsname\n");
+    printf("\t-W file      : swap file in every time it is written or moved in\n");
+    printf("\t-c socket    : control socket, pause|resume|seek frame|speed n|idr|source file|stats per line\n");
+    printf("\t-l logLevel  : %d prints every access unit(default), %d only the stats\n", C_LOG_DEBUG, C_LOG_INFO);
+}
 
 int main(int argc, char *argv[])
 {
-    int bsBufSize = 0, savecnt = 0;
+    int savecnt = 0;
     char *bsname = NULL;
     char *savename = NULL;
+    i265e_param_t param;
+    i265e_extern_bs_cfg_t cfg;
     i265e_extern_bs_t *h = NULL;
     pthread_t tid;
     int errnum = 0;
-    int i = 0, j = 0;
+    int i = 0, j = 0, opt = 0;
     i265e_nal_t *p_nal = NULL;
     int i_nal = 0;
+    i265e_pic_t *pic_out = NULL;
+    void *bshandler = NULL;
     uint8_t *nal_buf = NULL;
-    uint8_t *bs_buf = NULL;
     int save_fd = -1;
-    void *thread_arg[2];
+    i265e_extern_rcfg_trick_param_t trick;
+    int trickFrame = -1;
+    char *at = NULL;
+    int bPlaylist = 0;
+    i265e_extern_au_t *au = NULL;
+    uint64_t sum = 0, expect = 0;
+    int verifyCnt = 0, mismatchCnt = 0, superCnt = 0;
+    char *socName = NULL;
+    int bLadder = 0, rcFrame = -1;
+    int idrFrame = -1, idrOn = 1;
+    i265e_rcfg_rc_param_t rc;
+    char *traceName = NULL;
+    int traceChn = 0;
+    int bCheck = 0;
+    int typeCnt[I265E_TYPE_B + 1] = {0};
+    int64_t qpSum[I265E_TYPE_B + 1] = {0};
+    static const char *typeName[I265E_TYPE_B + 1] = {"unknown", "IDR", "I", "P", "Bref", "B"};
+    char **checkName = NULL;
+    int checkCnt = 0;
+    char *segTarget = NULL;
+    h265bs_seg_cfg_t segCfg;
+    h265bs_seg_t *seg = NULL;
+    i265e_extern_rcfg_source_param_t src;
+    int swapFrame = -1, swapCnt = 0;
+    char *watchName = NULL;
+    source_watch_t watch;
+    char *ctlName = NULL;
+    h265bs_ctl_t *ctl = NULL;
+
+    memset(&param, 0, sizeof(param));
+    memset(&cfg, 0, sizeof(cfg));
+    param.logLevel = C_LOG_DEBUG;
+    cfg.nalBufNum = I265E_EXT_NALBUF_NUM;
+    cfg.numaNode = H265BS_MEM_NODE_ANY;
+    cfg.ingestMode = H265BS_INGEST_SYNC;
+    cfg.ingestDepth = H265BS_INGEST_QUEUE_DEPTH;
+    cfg.ingestReadSize = H265BS_INGEST_READ_SIZE;
+    trick.speed = 1;
+    memset(&rc, 0, sizeof(rc));
+    memset(&segCfg, 0, sizeof(segCfg));
+    while ((opt = getopt(argc, argv, "n:uHN:I:q:r:xT:PC:M:f:B:s:LK:D:A:E:VG:S:W:c:l:")) != -1) {
+        switch (opt) {
+        case 'n':
+            cfg.nalBufNum = atoi(optarg);
+            break;
+        case 'u':
+            param.bUserNalbuf = true;
+            break;
+        case 'H':
+            cfg.memFlags |= H265BS_MEM_F_HUGEPAGE;
+            break;
+        case 'N':
+            cfg.numaNode = atoi(optarg);
+            break;
+        case 'I':
+            if (!strcmp(optarg, "uring")) {
+                cfg.ingestMode = H265BS_INGEST_URING;
+            } else if (!strcmp(optarg, "thread")) {
+                cfg.ingestMode = H265BS_INGEST_THREAD;
+            } else if (!strcmp(optarg, "mmap")) {
+                cfg.ingestMode = H265BS_INGEST_MMAP;
+            } else if (!strcmp(optarg, "sync")) {
+                cfg.ingestMode = H265BS_INGEST_SYNC;
+            } else {
+                usage(argv[0]);
+                goto err_invalid_cmdline;
+            }
+            break;
+        case 'q':
+            cfg.ingestDepth = atoi(optarg);
+            break;
+        case 'r':
+            cfg.ingestReadSize = atoi(optarg);
+            break;
+        case 'x':
+            cfg.bIndex = 1;
+            break;
+        case 'T':
+            trick.speed = atoi(optarg);
+            at = strchr(optarg, '@');
+            trickFrame = at ? atoi(at + 1) : 0;
+            break;
+        case 'P':
+            bPlaylist = 1;
+            break;
+        case 'C':
+            cfg.hashType = h265bs_hash_type(optarg);
+            if (cfg.hashType < 0) {
+                usage(argv[0]);
+                goto err_invalid_cmdline;
+            }
+            break;
+        case 'M':
+            socName = optarg;
+            param.socType = h265bs_tmodel_soc_type(optarg);
+            if (param.socType == C_SOC_MAX) {
+                usage(argv[0]);
+                goto err_invalid_cmdline;
+            }
+            break;
+        case 'f':
+            param.outFpsNum = atoi(optarg);
+            param.outFpsDen = 1;
+            break;
+        case 'B':
+            param.rc.rateControlMode = I265E_RC_CBR;
+            param.rc.bitrate = atoi(optarg);
+            at = strchr(optarg, ',');
+            param.rc.vbvBufferSize = at ? atoi(at + 1) : 0;
+            break;
+        case 's':
+            param.superFrm.bframe_bits_thresd = -1;
+            if (sscanf(optarg, "%d,%d,%d,%d,%d", &param.superFrm.mode, &param.superFrm.iframe_bits_thresd,
+                        &param.superFrm.pframe_bits_thresd, &param.superFrm.bframe_bits_thresd,
+                        &param.superFrm.priority) < 3) {
+                usage(argv[0]);
+                goto err_invalid_cmdline;
+            }
+            /* B pictures go by the P threshold unless they have their own */
+            if (param.superFrm.bframe_bits_thresd < 0) {
+                param.superFrm.bframe_bits_thresd = param.superFrm.pframe_bits_thresd;
+            }
+            break;
+        case 'L':
+            bLadder = 1;
+            break;
+        case 'K':
+            rc.bitrate = atoi(optarg);
+            at = strchr(optarg, '@');
+            rcFrame = at ? atoi(at + 1) : 0;
+            break;
+        case 'D':
+            idrFrame = atoi(optarg);
+            break;
+        case 'A':
+            cfg.intraName = optarg;
+            break;
+        case 'E':
+            traceName = optarg;
+            break;
+        case 'V':
+            bCheck = 1;
+            break;
+        case 'G':
+            segTarget = optarg;
+            break;
+        case 'S':
+            at = strrchr(optarg, '@');
+            swapFrame = at ? atoi(at + 1) : 0;
+            snprintf(src.name, sizeof(src.name), "%.*s", at ? (int)(at - optarg) : (int)strlen(optarg), optarg);
+            break;
+        case 'W':
+            watchName = optarg;
+            break;
+        case 'c':
+            ctlName = optarg;
+            break;
+        case 'l':
+            param.logLevel = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            goto err_invalid_cmdline;
+        }
+    }
+
+    if (argc - optind < 4 || cfg.nalBufNum <= 0) {
+        usage(argv[0]);
+        goto err_invalid_cmdline;
+    }
 
-    if (argc < 5) {
-        printf("Usage:%s bsBufSize savecnt bsname savename\n", argv[0]);
+	cfg.bsBufSize = atoi(argv[optind]);
+    savecnt = atoi(argv[optind + 1]);
+    bsname = argv[optind + 2];
+    savename = argv[optind + 3];
+    segCfg.prefix = savename;
+    if (segTarget && h265bs_seg_parse_target(segTarget, param.outFpsNum, param.outFpsDen, &segCfg) < 0) {
+        usage(argv[0]);
         goto err_invalid_cmdline;
     }
+    printf("bsBufSize=%d,savecnt=%d,bsname=%s,savename=%s,nalBufNum=%d,bUserNalbuf=%d,memFlags=%d,numaNode=%d\n",
+            cfg.bsBufSize, savecnt, bsname, savename, cfg.nalBufNum, param.bUserNalbuf, cfg.memFlags, cfg.numaNode);
+
+    if (bPlaylist) {
+        cfg.playlist = load_playlist(bsname, &cfg.playlistCnt);
+        if (cfg.playlistCnt == 0) {
+            printf("playlist %s has no entry\n", bsname);
+            goto err_load_playlist;
+        }
+    } else if (bLadder) {
+        /* the ladder is read like a playlist, the lines then lose their bitrate */
+        cfg.rendition = load_playlist(bsname, &cfg.renditionCnt);
+        cfg.renditionKbps = cfg.renditionCnt ? load_ladder(cfg.rendition, cfg.renditionCnt) : NULL;
+        if (cfg.renditionKbps == NULL) {
+            printf("ladder %s has no usable entry\n", bsname);
+            goto err_load_playlist;
+        }
+    }
 
-	bsBufSize = atoi(argv[1]);
-    savecnt = atoi(argv[2]);
-    bsname = argv[3];
-    savename = argv[4];
-    printf("bsBufSize=%d,savecnt=%d,bsname=%s,savename=%s\n", bsBufSize, savecnt, bsname, savename);
+    /* a stream with issues still goes on, the replay shows what they do */
+    if (bCheck) {
+        checkName = bPlaylist ? cfg.playlist : bLadder ? cfg.rendition : &bsname;
+        checkCnt = bPlaylist ? cfg.playlistCnt : bLadder ? cfg.renditionCnt : strcmp(bsname, "-") != 0;
+        for (i = 0; i < checkCnt; i++) {
+            printf("h265bs_check:%s\n", checkName[i]);
+            h265bs_check_file(checkName[i], stdout, 0, NULL);
+        }
+    }
 
-    nal_buf = malloc(bsBufSize);
-    if (nal_buf == NULL) {
-        printf("malloc nal_buf failed\n");
-        goto err_malloc_nal_buf;
+    if (param.bUserNalbuf) {
+        nal_buf = malloc(cfg.bsBufSize);
+        if (nal_buf == NULL) {
+            printf("malloc nal_buf failed\n");
+            goto err_malloc_nal_buf;
+        }
     }
 
-    save_fd = open(savename, O_RDWR | O_CREAT | O_TRUNC, 0644);
-    if (save_fd < 0) {
-        printf("open %s failed:%s\n", savename, strerror(errno));
-        goto err_open_savename;
+    if (socName) {
+        cfg.tmodel = h265bs_tmodel_init(h265bs_tmodel_soc_profile(param.socType), getpid());
+        if (cfg.tmodel == NULL) {
+            printf("h265bs_tmodel_init %s failed\n", socName);
+            goto err_tmodel_init;
+        }
     }
 
-    h = i265e_extern_bs_init(bsBufSize, bsname);
+    if (segTarget) {
+        seg = h265bs_seg_init(&segCfg);
+        if (seg == NULL) {
+            printf("h265bs_seg_init %s failed\n", savename);
+            goto err_open_savename;
+        }
+    } else {
+        save_fd = open(savename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (save_fd < 0) {
+            printf("open %s failed:%s\n", savename, strerror(errno));
+            goto err_open_savename;
+        }
+    }
+
+    if (traceName && h265bs_trace_init(0) < 0) {
+        goto err_trace_init;
+    }
+    h265bs_trace_thread_name("consumer");
+
+    h = i265e_extern_bs_init(&param, &cfg, bsname, nal_buf);
     if (h == NULL) {
         printf("i265e_extern_bs_init failed\n");
         goto err_i265e_extern_bs_init;
     }
+    traceChn = i265e_extern_bs_channel(h);
 
-    thread_arg[0] = h;
-    thread_arg[1] = nal_buf;
-    startProcess = 1;
-    if ((errnum = pthread_create(&tid, NULL, i265e_extern_bs_enc_thread, (void *)thread_arg)) != 0) {
+    if (watchName && source_watch_start(&watch, h, watchName) < 0) {
+        goto err_source_watch_start;
+    }
+    if (ctlName) {
+        ctl = h265bs_ctl_init(ctlName);
+        if (ctl == NULL) {
+            goto err_ctl_init;
+        }
+        h265bs_ctl_add(ctl, h);
+    }
+
+    if ((errnum = pthread_create(&tid, NULL, i265e_extern_bs_enc_thread, (void *)h)) != 0) {
         printf("pthread_create i265e_extern_bs_enc_thread failed:%s\n", strerror(errnum));
         goto err_pthread_create_i265e_extern_bs_enc_thread;
     }
 
-    for (i = 0; i < savecnt; i++) {
-        i265e_extern_bs_get_bitstream(h, &p_nal, &i_nal, &bs_buf);
-        for (j = 0; j < i_nal; j++) {
-            write(save_fd, p_nal[j].p_payload, p_nal[j].i_payload);
+    for (i = 0; (savecnt <= 0) || (i < savecnt); i++) {
+        if (i == trickFrame && i265e_extern_bs_set_param(h, I265E_EXT_RCFG_TRICK_ID, &trick) < 0) {
+            printf("set trick speed %d failed\n", trick.speed);
+        }
+        if (i == rcFrame && i265e_extern_bs_set_param(h, I265E_RCFG_RC_ID, &rc) < 0) {
+            printf("set bitrate %d failed\n", rc.bitrate);
+        }
+        if (i == idrFrame && i265e_extern_bs_set_param(h, I265E_RCFG_ENIDR_ID, &idrOn) < 0) {
+            printf("force IDR failed\n");
+            idrFrame = -1;
+        }
+        if (i == swapFrame && i265e_extern_bs_set_param(h, I265E_EXT_RCFG_SOURCE_ID, &src) < 0) {
+            printf("swap to %s failed\n", src.name);
+        }
+        if (i265e_extern_bs_get_bitstream(h, &p_nal, &i_nal, &pic_out, &bshandler) < 0) {
+            break;
+        }
+        H265BS_TRACE_BEGIN("write", traceChn, pic_out->pts);
+        if (seg) {
+            for (j = 0; j < i_nal && !h265bs_nal_is_idr(p_nal[j].i_type); j++);
+            if (h265bs_seg_write(seg, p_nal, i_nal, j < i_nal, pic_out->pts) < 0) {
+                printf("segment write failed\n");
+            }
+        } else {
+            for (j = 0; j < i_nal; j++) {
+                write(save_fd, p_nal[j].p_payload, p_nal[j].i_payload);
+            }
+        }
+        H265BS_TRACE_END("write", traceChn, pic_out->pts);
+        au = bshandler;
+        if (param.logLevel >= C_LOG_DEBUG) {
+            printf("pts=%lld, sliceType=%s, qp=%d, poc=%d\n", (long long)pic_out->pts, typeName[au->sliceType],
+                    pic_out->qp, au->poc);
+        }
+        typeCnt[au->sliceType]++;
+        qpSum[au->sliceType] += pic_out->qp;
+        if (idrFrame >= 0 && i >= idrFrame) {
+            for (j = 0; j < i_nal && !h265bs_nal_is_idr(p_nal[j].i_type); j++);
+            if (j < i_nal) {
+                printf("forced IDR at frame %d delivered at frame %d, pts %lld\n", idrFrame, i, (long long)pic_out->pts);
+                idrFrame = -1;
+            }
+        }
+        superCnt += !!(au->flags & I265E_EXT_AU_F_SUPERFRM);
+        if (au->flags & I265E_EXT_AU_F_SWAP) {
+            printf("source swapped in at frame %d, pts %lld\n", i, (long long)pic_out->pts);
+            swapCnt++;
+        }
+        /* what was written against the scan time table, or the engine's own
+         * sum for a payload which is not the one of pts */
+        if (cfg.hashType != H265BS_HASH_NONE) {
+            expect = (au->indexAu && !(au->flags & (I265E_EXT_AU_F_SUBST | I265E_EXT_AU_F_SWAP)))
+                ? au->indexAu->checksum : au->checksum;
+            sum = h265bs_hash(cfg.hashType, p_nal[0].p_payload, au->nalBufOccupy);
+            mismatchCnt += (sum != expect);
+            verifyCnt++;
         }
 
-        i265e_extern_bs_release_bitstream(h);
+        i265e_extern_bs_release_bitstream(h, bshandler);
     }
 
-    startProcess = 0;
+    h265bs_ctl_deinit(ctl);
+    if (watchName) {
+        source_watch_stop(&watch);
+    }
+    i265e_extern_bs_stop(h);
     pthread_join(tid, NULL);
+    i265e_extern_bs_dump_stat(h);
     i265e_extern_bs_deinit(h);
+    h265bs_tmodel_deinit(cfg.tmodel);
+    if (traceName) {
+        h265bs_trace_dump(traceName);
+        h265bs_trace_deinit();
+    }
+    for (i = I265E_TYPE_AUTO; i <= I265E_TYPE_B; i++) {
+        if (typeCnt[i]) {
+            printf("%s pictures %d, mean qp %.2f\n", typeName[i], typeCnt[i], i ? (double)qpSum[i] / typeCnt[i] : 0.0);
+        }
+    }
+    if (param.superFrm.mode != I265E_EXT_SUPERFRM_NONE) {
+        printf("%d super frames delivered\n", superCnt);
+    }
+    if (swapFrame >= 0 || watchName) {
+        printf("%d source swaps delivered\n", swapCnt);
+    }
+    if (cfg.hashType != H265BS_HASH_NONE) {
+        printf("%s verified %d access units, %d mismatch\n", h265bs_hash_name(cfg.hashType), verifyCnt, mismatchCnt);
+    }
+    if (seg) {
+        h265bs_seg_dump_stat(seg);
+    }
+    h265bs_seg_deinit(seg);
+    close(save_fd);
+    free(nal_buf);
+    for (i = 0; i < cfg.playlistCnt; i++) {
+        free(cfg.playlist[i]);
+    }
+    free(cfg.playlist);
+    for (i = 0; i < cfg.renditionCnt; i++) {
+        free(cfg.rendition[i]);
+    }
+    free(cfg.rendition);
+    free(cfg.renditionKbps);
 
     return 0;
 
 err_pthread_create_i265e_extern_bs_enc_thread:
+    h265bs_ctl_deinit(ctl);
+err_ctl_init:
+    if (watchName) {
+        source_watch_stop(&watch);
+    }
+err_source_watch_start:
     i265e_extern_bs_deinit(h);
 err_i265e_extern_bs_init:
+    h265bs_trace_deinit();
+err_trace_init:
+    h265bs_seg_deinit(seg);
     close(save_fd);
 err_open_savename:
+    h265bs_tmodel_deinit(cfg.tmodel);
+err_tmodel_init:
     free(nal_buf);
 err_malloc_nal_buf:
+err_load_playlist:
+    for (i = 0; i < cfg.playlistCnt; i++) {
+        free(cfg.playlist[i]);
+    }
+    free(cfg.playlist);
+    for (i = 0; i < cfg.renditionCnt; i++) {
+        free(cfg.rendition[i]);
+    }
+    free(cfg.rendition);
+    free(cfg.renditionKbps);
 err_invalid_cmdline:
     return -1;
 }
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "h265bs_mem.h"
+#include "h265bs_pool.h"
+
+struct h265bs_pool {
+    int blkSize;
+    int blkNum;
+    uint8_t *slab;
+    void (*ckFree)(void *ptr);
+
+    /* free block stack, holds block indexes */
+    int *freeIdx;
+    int freeCnt;
+
+    h265bs_pool_stat_t stat;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+h265bs_pool_t *h265bs_pool_init(int blkSize, int blkNum, void *(*ckMalloc)(int size, int align), void (*ckFree)(void *ptr),
+        int memFlags, int numaNode)
+{
+    int i = 0;
+    h265bs_pool_t *pool = NULL;
+
+    if ((blkSize <= 0) || (blkNum <= 0)) {
+        printf("h265bs_pool:invalid blkSize=%d or blkNum=%d\n", blkSize, blkNum);
+        goto err_invalid_param;
+    }
+
+    pool = calloc(1, sizeof(h265bs_pool_t));
+    if (pool == NULL) {
+        printf("h265bs_pool:calloc h265bs_pool_t failed\n");
+        goto err_calloc_pool;
+    }
+
+    pool->blkSize = C_ALIGN(blkSize, C_VB_ALIGN);
+    pool->blkNum = blkNum;
+    pool->ckFree = (ckMalloc && ckFree) ? ckFree : h265bs_mem_free;
+
+    if ((int64_t)pool->blkSize * pool->blkNum > INT32_MAX) {
+        printf("h265bs_pool:slab of %d x %d bytes is too large\n", pool->blkNum, pool->blkSize);
+        goto err_slab_size;
+    }
+
+    pool->slab = (ckMalloc && ckFree) ? ckMalloc(pool->blkSize * pool->blkNum, C_VB_ALIGN)
+        : h265bs_mem_alloc(pool->blkSize * pool->blkNum, C_VB_ALIGN, memFlags, numaNode);
+    if (pool->slab == NULL) {
+        printf("h265bs_pool:ckMalloc slab(%d x %d) failed\n", pool->blkNum, pool->blkSize);
+        goto err_malloc_slab;
+    }
+
+    pool->freeIdx = calloc(pool->blkNum, sizeof(int));
+    if (pool->freeIdx == NULL) {
+        printf("h265bs_pool:calloc freeIdx failed\n");
+        goto err_calloc_freeIdx;
+    }
+    for (i = 0; i < pool->blkNum; i++) {
+        pool->freeIdx[i] = pool->blkNum - 1 - i;
+    }
+    pool->freeCnt = pool->blkNum;
+
+    pool->stat.blkSize = pool->blkSize;
+    pool->stat.blkNum = pool->blkNum;
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    return pool;
+
+err_calloc_freeIdx:
+    pool->ckFree(pool->slab);
+err_malloc_slab:
+err_slab_size:
+    free(pool);
+err_calloc_pool:
+err_invalid_param:
+    return NULL;
+}
+
+void h265bs_pool_deinit(h265bs_pool_t *pool)
+{
+    if (pool) {
+        if (pool->freeCnt != pool->blkNum) {
+            printf("h265bs_pool:deinit with %d blocks still in use\n", pool->blkNum - pool->freeCnt);
+        }
+        pthread_mutex_destroy(&pool->mutex);
+        pthread_cond_destroy(&pool->cond);
+        free(pool->freeIdx);
+        pool->ckFree(pool->slab);
+        free(pool);
+    }
+}
+
+uint8_t *h265bs_pool_get(h265bs_pool_t *pool, int bWait)
+{
+    uint8_t *blk = NULL;
+
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->freeCnt == 0) {
+        pool->stat.waitCnt++;
+        if (!bWait) {
+            pthread_mutex_unlock(&pool->mutex);
+            return NULL;
+        }
+        while (pool->freeCnt == 0) {
+            pthread_cond_wait(&pool->cond, &pool->mutex);
+        }
+    }
+    blk = pool->slab + pool->freeIdx[--pool->freeCnt] * pool->blkSize;
+    pool->stat.getCnt++;
+    pool->stat.inUse++;
+    if (pool->stat.inUse > pool->stat.peakInUse) {
+        pool->stat.peakInUse = pool->stat.inUse;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return blk;
+}
+
+void h265bs_pool_put(h265bs_pool_t *pool, uint8_t *blk)
+{
+    int idx = 0;
+
+    if (blk == NULL) {
+        return;
+    }
+
+    idx = (blk - pool->slab) / pool->blkSize;
+    assert(idx >= 0 && idx < pool->blkNum && blk == pool->slab + idx * pool->blkSize);
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->freeIdx[pool->freeCnt++] = idx;
+    pool->stat.putCnt++;
+    pool->stat.inUse--;
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+int h265bs_pool_release(void *privData, void *releaseData)
+{
+    h265bs_pool_put(privData, releaseData);
+    return 0;
+}
+
+void h265bs_pool_get_stat(h265bs_pool_t *pool, h265bs_pool_stat_t *stat)
+{
+    pthread_mutex_lock(&pool->mutex);
+    *stat = pool->stat;
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void h265bs_pool_dump_stat(h265bs_pool_t *pool)
+{
+    h265bs_pool_stat_t stat;
+
+    if (pool) {
+        h265bs_pool_get_stat(pool, &stat);
+        printf("h265bs_pool:blkSize=%d, blkNum=%d, inUse=%d, peakInUse=%d, getCnt=%llu, putCnt=%llu, waitCnt=%llu\n",
+                stat.blkSize, stat.blkNum, stat.inUse, stat.peakInUse,
+                (unsigned long long)stat.getCnt, (unsigned long long)stat.putCnt, (unsigned long long)stat.waitCnt);
+    }
+}
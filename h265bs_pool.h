@@ -0,0 +1,44 @@
+#ifndef __H265BS_POOL_H__
+#define __H265BS_POOL_H__
+
+#include <stdint.h>
+
+#include "icommon.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct h265bs_pool h265bs_pool_t;
+
+typedef struct {
+    int         blkSize;        /* payload bytes of one block, C_VB_ALIGN aligned */
+    int         blkNum;         /* blocks carved out of the slab */
+    int         inUse;          /* blocks handed out and not yet released */
+    int         peakInUse;      /* high water mark of inUse */
+    uint64_t    getCnt;
+    uint64_t    putCnt;
+    uint64_t    waitCnt;        /* get calls which found the pool empty */
+} h265bs_pool_stat_t;
+
+/* All the memory of the pool is taken by one ckMalloc call at init time, the
+ * get/put path never touches the allocator. ckMalloc/ckFree follow the
+ * i265e_param_t memory hooks, NULL means h265bs_mem_alloc with memFlags
+ * (H265BS_MEM_F_*) on numaNode */
+extern h265bs_pool_t *h265bs_pool_init(int blkSize, int blkNum, void *(*ckMalloc)(int size, int align), void (*ckFree)(void *ptr),
+        int memFlags, int numaNode);
+extern void h265bs_pool_deinit(h265bs_pool_t *pool);
+/* bWait = 0 returns NULL at once when the pool is empty */
+extern uint8_t *h265bs_pool_get(h265bs_pool_t *pool, int bWait);
+extern void h265bs_pool_put(h265bs_pool_t *pool, uint8_t *blk);
+/* same prototype as i265e_pic_t.releaseFunc, privData is the pool and
+ * releaseData the block */
+extern int h265bs_pool_release(void *privData, void *releaseData);
+extern void h265bs_pool_get_stat(h265bs_pool_t *pool, h265bs_pool_stat_t *stat);
+extern void h265bs_pool_dump_stat(h265bs_pool_t *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __H265BS_POOL_H__ */
@@ -0,0 +1,491 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "h265bs_nal.h"
+#include "h265bs_bits.h"
+#include "h265bs_ps.h"
+
+/* rbsp bytes looked at to find the ids, a sps with 7 sub layers needs 100 */
+#define H265BS_PS_PARSE_WINDOW  160
+
+enum {
+    H265BS_PS_KIND_VPS = 0,
+    H265BS_PS_KIND_SPS,
+    H265BS_PS_KIND_PPS,
+    H265BS_PS_KIND_NUM,
+};
+
+typedef struct {
+    uint8_t *data;      /* nal as sent, from the nal header on */
+    int size;
+    int cap;
+    int gen;            /* source which sent it last, 0 while empty */
+} h265bs_ps_slot_t;
+
+struct h265bs_ps {
+    int maxNalSize;
+    uint8_t *rbsp;
+    uint8_t *rbsp2;
+    h265bs_ps_slot_t slot[H265BS_PS_KIND_NUM][H265BS_PS_PPS_MAX];
+    int map[H265BS_PS_KIND_NUM][H265BS_PS_PPS_MAX];    /* id of the source -> id sent, -1 unseen */
+    int gen;
+    int bPpsRemap;      /* slices of this source need their pps id rewritten */
+    h265bs_ps_stat_t stat;
+};
+
+static const int h265bs_ps_id_max[H265BS_PS_KIND_NUM] = {
+    H265BS_PS_VPS_MAX, H265BS_PS_SPS_MAX, H265BS_PS_PPS_MAX,
+};
+
+/****************************************************************************
+ * bit access on the rbsp
+ ****************************************************************************/
+static int h265bs_ps_put_bits(h265bs_bits_t *b, uint32_t v, int n)
+{
+    uint8_t *byte = NULL;
+
+    while (n-- > 0) {
+        if (b->pos >= b->size * 8) {
+            return -1;
+        }
+        byte = &b->p[b->pos >> 3];
+        if ((v >> n) & 0x01) {
+            *byte |= 0x80 >> (b->pos & 7);
+        } else {
+            *byte &= ~(0x80 >> (b->pos & 7));
+        }
+        b->pos++;
+    }
+    return 0;
+}
+
+static int h265bs_ps_ue_len(uint32_t v)
+{
+    int n = 0;
+
+    for (v++; v > 1; v >>= 1) {
+        n++;
+    }
+    return 2 * n + 1;
+}
+
+static int h265bs_ps_put_ue(h265bs_bits_t *b, uint32_t v)
+{
+    int n = h265bs_ps_ue_len(v) / 2;
+
+    if (h265bs_ps_put_bits(b, 0, n) < 0) {
+        return -1;
+    }
+    return h265bs_ps_put_bits(b, v + 1, n + 1);
+}
+
+static int h265bs_ps_escape(const uint8_t *src, int size, uint8_t *dst, int dstSize)
+{
+    int i = 0, n = 0, zeros = 0;
+
+    for (i = 0; i < size; i++) {
+        if (n + 2 > dstSize) {
+            return -1;
+        }
+        if (zeros >= 2 && src[i] <= 0x03) {
+            dst[n++] = 0x03;
+            zeros = 0;
+        }
+        dst[n++] = src[i];
+        zeros = src[i] ? 0 : zeros + 1;
+    }
+    /* a nal may not end with a zero byte, cabac_zero_words get their 03 */
+    if (zeros > 0) {
+        if (n == dstSize) {
+            return -1;
+        }
+        dst[n++] = 0x03;
+    }
+    return n;
+}
+
+/****************************************************************************
+ * id parsing and rewriting
+ ****************************************************************************/
+int h265bs_ps_parse_ids(const uint8_t *nal, int size, h265bs_ps_ids_t *ids)
+{
+    uint8_t rbsp[H265BS_PS_PARSE_WINDOW];
+    h265bs_bits_t b;
+    int scLen = 0, maxSubLayersMinus1 = 0, i = 0;
+    int profilePresent[8], levelPresent[8];
+
+    scLen = (nal[2] == 0x01) ? 3 : 4;
+    if (size < scLen + 3) {
+        return -1;
+    }
+    b.p = rbsp;
+    b.size = h265bs_bits_unescape(nal + scLen + 2, C_MIN(size - scLen - 2, H265BS_PS_PARSE_WINDOW), rbsp, sizeof(rbsp));
+    b.pos = 0;
+
+    ids->type = H265BS_NAL_TYPE(nal + scLen);
+    ids->id = ids->ref = -1;
+    ids->idPos = ids->idLen = ids->refPos = ids->refLen = 0;
+    switch (ids->type) {
+    case I265E_NAL_VPS:
+        ids->id = h265bs_bits_get(&b, 4);
+        ids->idLen = 4;
+        break;
+    case I265E_NAL_SPS:
+        ids->ref = h265bs_bits_get(&b, 4);
+        ids->refLen = 4;
+        maxSubLayersMinus1 = h265bs_bits_get(&b, 3);
+        h265bs_bits_get(&b, 1);          /* sps_temporal_id_nesting_flag */
+        b.pos += 96;                        /* general profile, tier and level */
+        for (i = 0; i < maxSubLayersMinus1; i++) {
+            profilePresent[i] = h265bs_bits_get(&b, 1);
+            levelPresent[i] = h265bs_bits_get(&b, 1);
+        }
+        if (maxSubLayersMinus1 > 0) {
+            b.pos += (8 - maxSubLayersMinus1) * 2;
+        }
+        for (i = 0; i < maxSubLayersMinus1; i++) {
+            b.pos += (profilePresent[i] ? 88 : 0) + (levelPresent[i] ? 8 : 0);
+        }
+        ids->idPos = b.pos;
+        ids->id = h265bs_bits_get_ue(&b);
+        ids->idLen = b.pos - ids->idPos;
+        break;
+    case I265E_NAL_PPS:
+        ids->id = h265bs_bits_get_ue(&b);
+        ids->idLen = b.pos;
+        ids->refPos = b.pos;
+        ids->ref = h265bs_bits_get_ue(&b);
+        ids->refLen = b.pos - ids->refPos;
+        break;
+    default:
+        if (!h265bs_nal_is_vcl(ids->type)) {
+            return -1;
+        }
+        h265bs_bits_get(&b, 1);          /* first_slice_segment_in_pic_flag */
+        if (h265bs_nal_is_irap(ids->type)) {
+            h265bs_bits_get(&b, 1);      /* no_output_of_prior_pics_flag */
+        }
+        ids->refPos = b.pos;
+        ids->ref = h265bs_bits_get_ue(&b);
+        ids->refLen = b.pos - ids->refPos;
+        break;
+    }
+
+    if (b.pos > b.size * 8) {
+        return -1;
+    }
+    if ((ids->type == I265E_NAL_VPS && ids->id >= H265BS_PS_VPS_MAX)
+            || (ids->type == I265E_NAL_SPS && (ids->id >= H265BS_PS_SPS_MAX || ids->ref >= H265BS_PS_VPS_MAX))
+            || (ids->type == I265E_NAL_PPS && (ids->id >= H265BS_PS_PPS_MAX || ids->ref >= H265BS_PS_SPS_MAX))
+            || (h265bs_nal_is_vcl(ids->type) && ids->ref >= H265BS_PS_PPS_MAX)) {
+        return -2;
+    }
+    return 0;
+}
+
+/* Copy nal to dst with id and ref coded anew. Ids of the same length are
+ * overwritten in place, otherwise the rbsp is shifted up to its stop bit,
+ * which only parameter sets allow: a slice header ends byte aligned */
+static int h265bs_ps_rewrite(h265bs_ps_t *ps, const uint8_t *nal, int size, h265bs_ps_ids_t *ids,
+        int id, int ref, uint8_t *dst, int dstSize)
+{
+    h265bs_bits_t src, out;
+    int scLen = (nal[2] == 0x01) ? 3 : 4;
+    int pos[2], oldLen[2], val[2], bUe[2];
+    int fieldCnt = 0, delta = 0, i = 0, n = 0, last = 0, stopPos = 0;
+
+    /* the ids in bit order, only the vps id and the vps of a sps are u(4) */
+    if (ids->id >= 0) {
+        pos[fieldCnt] = ids->idPos; oldLen[fieldCnt] = ids->idLen; val[fieldCnt] = id;
+        bUe[fieldCnt++] = (ids->type != I265E_NAL_VPS);
+    }
+    if (ids->ref >= 0) {
+        pos[fieldCnt] = ids->refPos; oldLen[fieldCnt] = ids->refLen; val[fieldCnt] = ref;
+        bUe[fieldCnt++] = (ids->type != I265E_NAL_SPS);
+    }
+    if (fieldCnt == 2 && pos[1] < pos[0]) {
+        n = pos[0]; pos[0] = pos[1]; pos[1] = n;
+        n = oldLen[0]; oldLen[0] = oldLen[1]; oldLen[1] = n;
+        n = val[0]; val[0] = val[1]; val[1] = n;
+        n = bUe[0]; bUe[0] = bUe[1]; bUe[1] = n;
+    }
+    for (i = 0; i < fieldCnt; i++) {
+        delta += (bUe[i] ? h265bs_ps_ue_len(val[i]) : oldLen[i]) - oldLen[i];
+    }
+    if (delta != 0 && h265bs_nal_is_vcl(ids->type)) {
+        return -1;
+    }
+
+    src.p = ps->rbsp;
+    src.size = h265bs_bits_unescape(nal + scLen + 2, size - scLen - 2, ps->rbsp, ps->maxNalSize);
+    src.pos = 0;
+    if (delta == 0) {
+        for (i = 0; i < fieldCnt; i++) {
+            src.pos = pos[i];
+            if (bUe[i]) {
+                h265bs_ps_put_ue(&src, val[i]);
+            } else {
+                h265bs_ps_put_bits(&src, val[i], oldLen[i]);
+            }
+        }
+        out = src;
+        out.pos = src.size * 8;
+    } else {
+        for (last = src.size - 1; last >= 0 && src.p[last] == 0; last--);
+        if (last < 0) {
+            return -1;
+        }
+        for (stopPos = last * 8 + 7; !((src.p[last] >> (7 - (stopPos & 7))) & 0x01); stopPos--);
+
+        out.p = ps->rbsp2;
+        out.size = ps->maxNalSize;
+        out.pos = 0;
+        for (i = 0; i < fieldCnt; i++) {
+            while (src.pos < pos[i]) {
+                h265bs_ps_put_bits(&out, h265bs_bits_get(&src, 1), 1);
+            }
+            if ((bUe[i] ? h265bs_ps_put_ue(&out, val[i]) : h265bs_ps_put_bits(&out, val[i], oldLen[i])) < 0) {
+                return -1;
+            }
+            src.pos += oldLen[i];
+        }
+        while (src.pos < stopPos) {
+            h265bs_ps_put_bits(&out, h265bs_bits_get(&src, 1), 1);
+        }
+        if (h265bs_ps_put_bits(&out, 1, 1) < 0 || h265bs_ps_put_bits(&out, 0, (8 - (out.pos & 7)) & 7) < 0) {
+            return -1;
+        }
+    }
+
+    if (dstSize < scLen + 2) {
+        return -1;
+    }
+    memcpy(dst, nal, scLen + 2);
+    n = h265bs_ps_escape(out.p, out.pos / 8, dst + scLen + 2, dstSize - scLen - 2);
+    if (n < 0) {
+        return -1;
+    }
+    ps->stat.rewriteCnt++;
+    return scLen + 2 + n;
+}
+
+/****************************************************************************
+ * splice book keeping
+ ****************************************************************************/
+h265bs_ps_t *h265bs_ps_init(int maxNalSize)
+{
+    int k = 0, i = 0;
+    h265bs_ps_t *ps = calloc(1, sizeof(h265bs_ps_t));
+    if (ps == NULL) {
+        printf("h265bs_ps:calloc h265bs_ps_t failed\n");
+        goto err_calloc_ps;
+    }
+
+    ps->maxNalSize = maxNalSize;
+    ps->rbsp = malloc(maxNalSize);
+    ps->rbsp2 = malloc(maxNalSize);
+    if (ps->rbsp == NULL || ps->rbsp2 == NULL) {
+        printf("h265bs_ps:malloc rbsp of %d bytes failed\n", maxNalSize);
+        goto err_malloc_rbsp;
+    }
+    for (k = 0; k < H265BS_PS_KIND_NUM; k++) {
+        for (i = 0; i < H265BS_PS_PPS_MAX; i++) {
+            ps->map[k][i] = -1;
+        }
+    }
+    ps->gen = 1;
+
+    return ps;
+
+err_malloc_rbsp:
+    free(ps->rbsp2);
+    free(ps->rbsp);
+    free(ps);
+err_calloc_ps:
+    return NULL;
+}
+
+void h265bs_ps_deinit(h265bs_ps_t *ps)
+{
+    int k = 0, i = 0;
+
+    if (ps) {
+        for (k = 0; k < H265BS_PS_KIND_NUM; k++) {
+            for (i = 0; i < H265BS_PS_PPS_MAX; i++) {
+                free(ps->slot[k][i].data);
+            }
+        }
+        free(ps->rbsp2);
+        free(ps->rbsp);
+        free(ps);
+    }
+}
+
+void h265bs_ps_new_source(h265bs_ps_t *ps)
+{
+    int k = 0, i = 0;
+
+    for (k = 0; k < H265BS_PS_KIND_NUM; k++) {
+        for (i = 0; i < H265BS_PS_PPS_MAX; i++) {
+            ps->map[k][i] = -1;
+        }
+    }
+    ps->gen++;
+    ps->bPpsRemap = 0;
+}
+
+static int h265bs_ps_slot_equal(h265bs_ps_slot_t *slot, const uint8_t *nal, int size)
+{
+    int scLen = (nal[2] == 0x01) ? 3 : 4;
+
+    return (slot->gen != 0) && (slot->size == size - scLen) && !memcmp(slot->data, nal + scLen, size - scLen);
+}
+
+static int h265bs_ps_slot_store(h265bs_ps_t *ps, h265bs_ps_slot_t *slot, const uint8_t *nal, int size)
+{
+    int scLen = (nal[2] == 0x01) ? 3 : 4;
+    uint8_t *data = NULL;
+
+    if (slot->cap < size - scLen) {
+        data = realloc(slot->data, size - scLen);
+        if (data == NULL) {
+            printf("h265bs_ps:realloc slot of %d bytes failed\n", size - scLen);
+            return -1;
+        }
+        slot->data = data;
+        slot->cap = size - scLen;
+    }
+    memcpy(slot->data, nal + scLen, size - scLen);
+    slot->size = size - scLen;
+    slot->gen = ps->gen;
+    return 0;
+}
+
+/* A free id for parameter set kind k of the current source: an empty slot
+ * first, then one an earlier source left behind. Slices carry the pps id
+ * in a header which has to stay the same length, so a pps keeps its length */
+static int h265bs_ps_pick_id(h265bs_ps_t *ps, int k, int id)
+{
+    int pass = 0, i = 0, j = 0, bTaken = 0;
+
+    for (pass = 0; pass < 2; pass++) {
+        for (i = 0; i < h265bs_ps_id_max[k]; i++) {
+            if ((k == H265BS_PS_KIND_PPS) && (h265bs_ps_ue_len(i) != h265bs_ps_ue_len(id))) {
+                continue;
+            }
+            if ((pass == 0) ? (ps->slot[k][i].gen != 0) : (ps->slot[k][i].gen == ps->gen)) {
+                continue;
+            }
+            for (j = 0, bTaken = 0; j < h265bs_ps_id_max[k]; j++) {
+                bTaken |= (ps->map[k][j] == i);
+            }
+            if (!bTaken) {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+int h265bs_ps_filter(h265bs_ps_t *ps, const uint8_t *nal, int size, int bSplice, uint8_t *dst, int dstSize, int *dstLen)
+{
+    h265bs_ps_ids_t ids;
+    h265bs_ps_slot_t *slot = NULL;
+    int scLen = (nal[2] == 0x01) ? 3 : 4;
+    uint32_t type = H265BS_NAL_TYPE(nal + scLen);
+    int k = 0, id = 0, ref = 0, n = 0, bChanged = 0;
+    const uint8_t *out = nal;
+
+    if (h265bs_nal_is_vcl(type)) {
+        if (!ps->bPpsRemap || h265bs_ps_parse_ids(nal, size, &ids) < 0) {
+            return 1;
+        }
+        ref = ps->map[H265BS_PS_KIND_PPS][ids.ref];
+        if (ref < 0 || ref == ids.ref) {
+            return 1;
+        }
+        *dstLen = h265bs_ps_rewrite(ps, nal, size, &ids, -1, ref, dst, dstSize);
+        return *dstLen < 0 ? -1 : 2;
+    }
+    if (type < I265E_NAL_VPS || type > I265E_NAL_PPS || h265bs_ps_parse_ids(nal, size, &ids) < 0) {
+        return 1;
+    }
+
+    k = type - I265E_NAL_VPS;
+    ref = ids.ref;
+    if (k > H265BS_PS_KIND_VPS && ps->map[k - 1][ids.ref] >= 0) {
+        ref = ps->map[k - 1][ids.ref];
+    }
+    id = ps->map[k][ids.id];
+
+    if (id < 0 || id != ids.id || ref != ids.ref) {
+        /* what this source would send with its own id */
+        if (ref != ids.ref) {
+            n = h265bs_ps_rewrite(ps, nal, size, &ids, ids.id, ref, dst, dstSize);
+            if (n < 0) {
+                return -1;
+            }
+            out = dst;
+        } else {
+            n = size;
+        }
+        if (id < 0) {
+            id = ids.id;
+            slot = &ps->slot[k][id];
+            /* the id is held by another parameter set, of an earlier source
+             * or of this one after a renumber */
+            if (slot->gen != 0 && (slot->gen == ps->gen || !h265bs_ps_slot_equal(slot, out, n))) {
+                id = h265bs_ps_pick_id(ps, k, ids.id);
+                if (id < 0) {
+                    id = ids.id;
+                    ps->stat.replaceCnt++;
+                } else {
+                    ps->stat.renumCnt++;
+                }
+            }
+            ps->map[k][ids.id] = id;
+            if (k == H265BS_PS_KIND_PPS && id != ids.id) {
+                ps->bPpsRemap = 1;
+            }
+        }
+        if (id != ids.id) {
+            n = h265bs_ps_rewrite(ps, nal, size, &ids, id, ref, dst, dstSize);
+            if (n < 0) {
+                return -1;
+            }
+            out = dst;
+        }
+        bChanged = (out == dst);
+    } else {
+        n = size;
+    }
+
+    slot = &ps->slot[k][id];
+    if (bSplice && h265bs_ps_slot_equal(slot, out, n)) {
+        slot->gen = ps->gen;
+        ps->stat.dupCnt++;
+        return 0;
+    }
+    if (h265bs_ps_slot_store(ps, slot, out, n) < 0) {
+        return -1;
+    }
+    if (bChanged) {
+        *dstLen = n;
+        return 2;
+    }
+    return 1;
+}
+
+void h265bs_ps_get_stat(h265bs_ps_t *ps, h265bs_ps_stat_t *stat)
+{
+    *stat = ps->stat;
+}
+
+void h265bs_ps_dump_stat(h265bs_ps_t *ps)
+{
+    printf("h265bs_ps:dupCnt=%llu, renumCnt=%llu, replaceCnt=%llu, rewriteCnt=%llu\n",
+            (unsigned long long)ps->stat.dupCnt, (unsigned long long)ps->stat.renumCnt,
+            (unsigned long long)ps->stat.replaceCnt, (unsigned long long)ps->stat.rewriteCnt);
+}
@@ -0,0 +1,55 @@
+#ifndef __H265BS_PS_H__
+#define __H265BS_PS_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define H265BS_PS_VPS_MAX       16
+#define H265BS_PS_SPS_MAX       16
+#define H265BS_PS_PPS_MAX       64
+
+/* Where the ids sit in a parameter set or slice, bit offsets count from the
+ * first rbsp byte behind the nal header */
+typedef struct {
+    uint32_t type;
+    int id;             /* vps/sps/pps id, -1 for a slice */
+    int idPos;
+    int idLen;
+    int ref;            /* vps of a sps, sps of a pps, pps of a slice, -1 for a vps */
+    int refPos;
+    int refLen;
+} h265bs_ps_ids_t;
+
+typedef struct {
+    uint64_t dupCnt;        /* parameter sets dropped at a splice */
+    uint64_t renumCnt;      /* parameter sets given another id */
+    uint64_t replaceCnt;    /* conflicting pps kept its id, no free id of the same length */
+    uint64_t rewriteCnt;    /* nals written with new ids */
+} h265bs_ps_stat_t;
+
+typedef struct h265bs_ps h265bs_ps_t;
+
+/* nal starts with its start code, 0 when the ids were found, -1 when the
+ * nal ends before them and -2 when an id is out of range */
+extern int h265bs_ps_parse_ids(const uint8_t *nal, int size, h265bs_ps_ids_t *ids);
+
+/* Parameter set book keeping of a spliced output, maxNalSize bounds one nal */
+extern h265bs_ps_t *h265bs_ps_init(int maxNalSize);
+extern void h265bs_ps_deinit(h265bs_ps_t *ps);
+/* the following nals come from the next source */
+extern void h265bs_ps_new_source(h265bs_ps_t *ps);
+/* Pass one nal of the current source: 1 keeps it as it is, 0 drops it, 2
+ * wrote it with new ids to dst(*dstLen bytes), -1 on error. bSplice drops
+ * parameter sets equal to the ones already sent */
+extern int h265bs_ps_filter(h265bs_ps_t *ps, const uint8_t *nal, int size, int bSplice, uint8_t *dst, int dstSize, int *dstLen);
+extern void h265bs_ps_get_stat(h265bs_ps_t *ps, h265bs_ps_stat_t *stat);
+extern void h265bs_ps_dump_stat(h265bs_ps_t *ps);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __H265BS_PS_H__ */
@@ -0,0 +1,420 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <limits.h>
+#include <time.h>
+
+#include "h265bs_clock.h"
+#include "h265bs_seg.h"
+
+typedef enum {
+    H265BS_SEG_JOB_OPEN     = 0,    /* the spare file for the next rotation */
+    H265BS_SEG_JOB_CLOSE    = 1,    /* a finished segment, synced, closed and indexed */
+} h265bs_seg_job_kind_t;
+
+typedef struct {
+    h265bs_seg_job_kind_t kind;
+    int fd;
+    int segIdx;
+    int64_t size;                   /* bytes written, or to preallocate for an open */
+    int64_t firstPts;
+    int frames;
+} h265bs_seg_job_t;
+
+struct h265bs_seg {
+    h265bs_seg_cfg_t cfg;
+    char *prefix;
+
+    /* producer side */
+    int fd;
+    int segIdx;
+    int64_t segBytes;
+    int segFrames;
+    int64_t segFirstPts;
+    int64_t preallocNext;
+
+    /* io thread, jobs in order, the spare is the next segment file */
+    pthread_t tid;
+    pthread_mutex_t mutex;
+    pthread_cond_t jobCond;
+    pthread_cond_t spareCond;
+    h265bs_seg_job_t job[H265BS_SEG_JOB_MAX];
+    int jobHead;
+    int jobCnt;
+    int bStop;
+    int spareFd;
+    int spareErr;
+    int idxFd;
+
+    h265bs_seg_stat_t stat;
+};
+
+int h265bs_seg_parse_target(const char *str, int fpsNum, int fpsDen, h265bs_seg_cfg_t *cfg)
+{
+    char *end = NULL;
+    double v = strtod(str, &end);
+
+    if (end == str || v <= 0) {
+        return -1;
+    }
+    cfg->targetFrames = 0;
+    cfg->targetBytes = 0;
+    switch (*end) {
+    case '\0':
+        cfg->targetFrames = (int)v;
+        break;
+    case 'k':
+    case 'K':
+        cfg->targetBytes = (int64_t)(v * 1024);
+        break;
+    case 'm':
+    case 'M':
+        cfg->targetBytes = (int64_t)(v * 1024 * 1024);
+        break;
+    case 's':
+        if (fpsNum <= 0 || fpsDen <= 0) {
+            printf("h265bs_seg:a duration in seconds needs the frame rate\n");
+            return -1;
+        }
+        cfg->targetFrames = (int)(v * fpsNum / fpsDen + 0.5);
+        break;
+    default:
+        return -1;
+    }
+    return (cfg->targetFrames > 0 || cfg->targetBytes > 0) ? 0 : -1;
+}
+
+static void h265bs_seg_push(h265bs_seg_t *seg, h265bs_seg_job_t *job)
+{
+    pthread_mutex_lock(&seg->mutex);
+    while (seg->jobCnt == H265BS_SEG_JOB_MAX) {
+        pthread_cond_wait(&seg->spareCond, &seg->mutex);
+    }
+    seg->job[(seg->jobHead + seg->jobCnt) % H265BS_SEG_JOB_MAX] = *job;
+    seg->jobCnt++;
+    pthread_cond_signal(&seg->jobCond);
+    pthread_mutex_unlock(&seg->mutex);
+}
+
+static int h265bs_seg_name(h265bs_seg_t *seg, int segIdx, char *name, int size)
+{
+    return snprintf(name, size, "%s%05d.h265", seg->prefix, segIdx) < size ? 0 : -1;
+}
+
+static void h265bs_seg_open(h265bs_seg_t *seg, h265bs_seg_job_t *job)
+{
+    char name[PATH_MAX];
+    int fd = -1, errnum = 0;
+
+    if (h265bs_seg_name(seg, job->segIdx, name, sizeof(name)) < 0) {
+        errnum = ENAMETOOLONG;
+    } else if ((fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        errnum = errno;
+        printf("h265bs_seg:open %s failed:%s\n", name, strerror(errnum));
+    } else if (job->size > 0 && fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, job->size) < 0) {
+        /* not every file system has it, the segment is written anyway */
+        pthread_mutex_lock(&seg->mutex);
+        seg->stat.fallocFailCnt++;
+        pthread_mutex_unlock(&seg->mutex);
+    }
+
+    pthread_mutex_lock(&seg->mutex);
+    seg->spareFd = fd;
+    seg->spareErr = errnum;
+    seg->stat.errCnt += (fd < 0);
+    pthread_cond_broadcast(&seg->spareCond);
+    pthread_mutex_unlock(&seg->mutex);
+}
+
+static void h265bs_seg_close(h265bs_seg_t *seg, h265bs_seg_job_t *job)
+{
+    char name[PATH_MAX], line[PATH_MAX + 128];
+    const char *base = NULL;
+    int n = 0, errCnt = 0;
+
+    /* blocks fallocate put past the end go back */
+    errCnt += ftruncate(job->fd, job->size) < 0;
+    errCnt += fsync(job->fd) < 0;
+    errCnt += close(job->fd) < 0;
+
+    h265bs_seg_name(seg, job->segIdx, name, sizeof(name));
+    base = strrchr(name, '/') ? strrchr(name, '/') + 1 : name;
+    n = snprintf(line, sizeof(line), "%s %lld %d %lld\n", base, (long long)job->firstPts, job->frames, (long long)job->size);
+    if (seg->idxFd >= 0 && write(seg->idxFd, line, n) != n) {
+        errCnt++;
+    }
+    if (errCnt) {
+        printf("h265bs_seg:finishing %s failed:%s\n", name, strerror(errno));
+        pthread_mutex_lock(&seg->mutex);
+        seg->stat.errCnt += errCnt;
+        pthread_mutex_unlock(&seg->mutex);
+    }
+}
+
+static void *h265bs_seg_thread(void *arg)
+{
+    h265bs_seg_t *seg = arg;
+    h265bs_seg_job_t job;
+
+    pthread_mutex_lock(&seg->mutex);
+    while (1) {
+        while (seg->jobCnt == 0 && !seg->bStop) {
+            pthread_cond_wait(&seg->jobCond, &seg->mutex);
+        }
+        if (seg->jobCnt == 0) {
+            break;
+        }
+        job = seg->job[seg->jobHead];
+        seg->jobHead = (seg->jobHead + 1) % H265BS_SEG_JOB_MAX;
+        seg->jobCnt--;
+        pthread_cond_broadcast(&seg->spareCond);
+        pthread_mutex_unlock(&seg->mutex);
+
+        if (job.kind == H265BS_SEG_JOB_OPEN) {
+            h265bs_seg_open(seg, &job);
+        } else {
+            h265bs_seg_close(seg, &job);
+        }
+
+        pthread_mutex_lock(&seg->mutex);
+    }
+    pthread_mutex_unlock(&seg->mutex);
+
+    return NULL;
+}
+
+h265bs_seg_t *h265bs_seg_init(const h265bs_seg_cfg_t *cfg)
+{
+    h265bs_seg_t *seg = NULL;
+    h265bs_seg_job_t job;
+    char name[PATH_MAX];
+    int errnum = 0;
+
+    seg = calloc(1, sizeof(h265bs_seg_t));
+    if (seg == NULL) {
+        printf("h265bs_seg:calloc h265bs_seg_t failed\n");
+        goto err_calloc_seg;
+    }
+    seg->cfg = *cfg;
+    seg->prefix = strdup(cfg->prefix);
+    if (seg->prefix == NULL) {
+        printf("h265bs_seg:strdup prefix failed\n");
+        goto err_strdup_prefix;
+    }
+    seg->fd = seg->spareFd = -1;
+    seg->preallocNext = cfg->preallocSize > 0 ? cfg->preallocSize : cfg->targetBytes + cfg->targetBytes / 4;
+
+    if (snprintf(name, sizeof(name), "%s.idx", seg->prefix) >= sizeof(name)) {
+        printf("h265bs_seg:prefix %s too long\n", seg->prefix);
+        goto err_open_idx;
+    }
+    seg->idxFd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (seg->idxFd < 0) {
+        printf("h265bs_seg:open %s failed:%s\n", name, strerror(errno));
+        goto err_open_idx;
+    }
+    dprintf(seg->idxFd, "# segment first_pts frames bytes\n");
+
+    pthread_mutex_init(&seg->mutex, NULL);
+    pthread_cond_init(&seg->jobCond, NULL);
+    pthread_cond_init(&seg->spareCond, NULL);
+    if ((errnum = pthread_create(&seg->tid, NULL, h265bs_seg_thread, seg)) != 0) {
+        printf("h265bs_seg:pthread_create failed:%s\n", strerror(errnum));
+        goto err_pthread_create;
+    }
+
+    /* the first segment is opened right away, it is ready by the first write */
+    memset(&job, 0, sizeof(job));
+    job.kind = H265BS_SEG_JOB_OPEN;
+    job.size = seg->preallocNext;
+    h265bs_seg_push(seg, &job);
+
+    return seg;
+
+err_pthread_create:
+    pthread_cond_destroy(&seg->spareCond);
+    pthread_cond_destroy(&seg->jobCond);
+    pthread_mutex_destroy(&seg->mutex);
+    close(seg->idxFd);
+err_open_idx:
+    free(seg->prefix);
+err_strdup_prefix:
+    free(seg);
+err_calloc_seg:
+    return NULL;
+}
+
+/* Swap to the spare file and hand the finished segment to the io thread */
+static int h265bs_seg_rotate(h265bs_seg_t *seg, int64_t pts)
+{
+    h265bs_seg_job_t job;
+    int64_t start = 0;
+    int fd = -1, errnum = 0;
+
+    pthread_mutex_lock(&seg->mutex);
+    if (seg->spareFd < 0 && seg->spareErr == 0) {
+        seg->stat.stallCnt++;
+        start = h265bs_mdate();
+        while (seg->spareFd < 0 && seg->spareErr == 0) {
+            pthread_cond_wait(&seg->spareCond, &seg->mutex);
+        }
+        seg->stat.stallUs += h265bs_mdate() - start;
+    }
+    fd = seg->spareFd;
+    errnum = seg->spareErr;
+    seg->spareFd = -1;
+    seg->spareErr = 0;
+    pthread_mutex_unlock(&seg->mutex);
+    if (fd < 0) {
+        /* tried again at the next IDR */
+        memset(&job, 0, sizeof(job));
+        job.kind = H265BS_SEG_JOB_OPEN;
+        job.segIdx = seg->segIdx + (seg->fd >= 0);
+        job.size = seg->preallocNext;
+        h265bs_seg_push(seg, &job);
+        errno = errnum;
+        return -1;
+    }
+
+    memset(&job, 0, sizeof(job));
+    if (seg->fd >= 0) {
+        job.kind = H265BS_SEG_JOB_CLOSE;
+        job.fd = seg->fd;
+        job.segIdx = seg->segIdx;
+        job.size = seg->segBytes;
+        job.firstPts = seg->segFirstPts;
+        job.frames = seg->segFrames;
+        h265bs_seg_push(seg, &job);
+        seg->segIdx++;
+        /* without a size target the segment before is the best guess */
+        if (seg->cfg.preallocSize <= 0 && seg->cfg.targetBytes <= 0) {
+            seg->preallocNext = seg->segBytes + seg->segBytes / 4;
+        }
+    }
+    seg->fd = fd;
+    seg->segBytes = 0;
+    seg->segFrames = 0;
+    seg->segFirstPts = pts;
+    seg->stat.segCnt++;
+
+    memset(&job, 0, sizeof(job));
+    job.kind = H265BS_SEG_JOB_OPEN;
+    job.segIdx = seg->segIdx + 1;
+    job.size = seg->preallocNext;
+    h265bs_seg_push(seg, &job);
+
+    return 0;
+}
+
+static int h265bs_seg_write_all(int fd, const uint8_t *buf, int64_t size)
+{
+    int64_t off = 0;
+    ssize_t n = 0;
+
+    while (off < size) {
+        n = write(fd, buf + off, size - off);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            return -1;
+        }
+        off += n;
+    }
+    return 0;
+}
+
+int h265bs_seg_write(h265bs_seg_t *seg, const i265e_nal_t *nal, int nalCnt, int bIdr, int64_t pts)
+{
+    int i = 0;
+
+    if (seg->fd < 0 || (bIdr && ((seg->cfg.targetFrames > 0 && seg->segFrames >= seg->cfg.targetFrames)
+                    || (seg->cfg.targetBytes > 0 && seg->segBytes >= seg->cfg.targetBytes)))) {
+        if (h265bs_seg_rotate(seg, pts) < 0) {
+            printf("h265bs_seg:no file for segment %d:%s\n", seg->segIdx + (seg->fd >= 0), strerror(errno));
+            seg->stat.errCnt++;
+            /* the open segment keeps the IDR and what follows it, the
+             * rotation is tried again at the next IDR */
+            if (seg->fd < 0) {
+                return -1;
+            }
+        }
+    }
+
+    for (i = 0; i < nalCnt; i++) {
+        if (h265bs_seg_write_all(seg->fd, nal[i].p_payload, nal[i].i_payload) < 0) {
+            printf("h265bs_seg:write segment %d failed:%s\n", seg->segIdx, strerror(errno));
+            seg->stat.errCnt++;
+            return -1;
+        }
+        seg->segBytes += nal[i].i_payload;
+        seg->stat.bytes += nal[i].i_payload;
+    }
+    seg->segFrames++;
+    seg->stat.auCnt++;
+
+    return 0;
+}
+
+void h265bs_seg_deinit(h265bs_seg_t *seg)
+{
+    h265bs_seg_job_t job;
+    char name[PATH_MAX];
+
+    if (seg == NULL) {
+        return;
+    }
+    if (seg->fd >= 0) {
+        memset(&job, 0, sizeof(job));
+        job.kind = H265BS_SEG_JOB_CLOSE;
+        job.fd = seg->fd;
+        job.segIdx = seg->segIdx;
+        job.size = seg->segBytes;
+        job.firstPts = seg->segFirstPts;
+        job.frames = seg->segFrames;
+        h265bs_seg_push(seg, &job);
+    }
+
+    pthread_mutex_lock(&seg->mutex);
+    seg->bStop = 1;
+    pthread_cond_signal(&seg->jobCond);
+    pthread_mutex_unlock(&seg->mutex);
+    pthread_join(seg->tid, NULL);
+
+    /* the spare opened for a segment which never came */
+    if (seg->spareFd >= 0) {
+        close(seg->spareFd);
+        if (h265bs_seg_name(seg, seg->segIdx + (seg->fd >= 0), name, sizeof(name)) == 0) {
+            unlink(name);
+        }
+    }
+    close(seg->idxFd);
+    pthread_cond_destroy(&seg->spareCond);
+    pthread_cond_destroy(&seg->jobCond);
+    pthread_mutex_destroy(&seg->mutex);
+    free(seg->prefix);
+    free(seg);
+}
+
+void h265bs_seg_get_stat(h265bs_seg_t *seg, h265bs_seg_stat_t *stat)
+{
+    pthread_mutex_lock(&seg->mutex);
+    *stat = seg->stat;
+    pthread_mutex_unlock(&seg->mutex);
+}
+
+void h265bs_seg_dump_stat(h265bs_seg_t *seg)
+{
+    h265bs_seg_stat_t stat;
+
+    h265bs_seg_get_stat(seg, &stat);
+    printf("h265bs_seg:prefix=%s, segCnt=%llu, auCnt=%llu, bytes=%llu, stallCnt=%llu, stallUs=%lld, fallocFailCnt=%llu, errCnt=%llu\n",
+            seg->prefix, (unsigned long long)stat.segCnt, (unsigned long long)stat.auCnt, (unsigned long long)stat.bytes,
+            (unsigned long long)stat.stallCnt, (long long)stat.stallUs, (unsigned long long)stat.fallocFailCnt,
+            (unsigned long long)stat.errCnt);
+}
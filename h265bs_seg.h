@@ -0,0 +1,55 @@
+#ifndef __H265BS_SEG_H__
+#define __H265BS_SEG_H__
+
+#include <stdint.h>
+
+#include "i265e.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define H265BS_SEG_JOB_MAX      8
+
+/* Output cut into segment files at IDR access units once a segment has
+ * reached targetFrames or targetBytes, whichever is set. Segments are
+ * prefix%05d.h265, prefix.idx lists them */
+typedef struct {
+    const char  *prefix;
+    int         targetFrames;
+    int64_t     targetBytes;
+    int64_t     preallocSize;   /* fallocate of a new segment, 0 for the target or the last segment size */
+} h265bs_seg_cfg_t;
+
+typedef struct {
+    uint64_t segCnt;
+    uint64_t auCnt;
+    uint64_t bytes;
+    uint64_t stallCnt;          /* rotations which waited for the next file */
+    int64_t stallUs;
+    uint64_t fallocFailCnt;
+    uint64_t errCnt;            /* open, write, fsync or close failures */
+} h265bs_seg_stat_t;
+
+typedef struct h265bs_seg h265bs_seg_t;
+
+/* "N" frames, "Nk" or "Nm" bytes, "Ns" seconds at fpsNum/fpsDen, 0 when
+ * the target is understood */
+extern int h265bs_seg_parse_target(const char *str, int fpsNum, int fpsDen, h265bs_seg_cfg_t *cfg);
+extern h265bs_seg_t *h265bs_seg_init(const h265bs_seg_cfg_t *cfg);
+/* One access unit. The next file is opened ahead and the finished one is
+ * synced and closed on the io thread, a rotation only swaps the fd. When
+ * the next file could not be opened the access unit goes to the open
+ * segment and the rotation waits for the next IDR. -1 when there is no
+ * segment to write to or the write fails */
+extern int h265bs_seg_write(h265bs_seg_t *seg, const i265e_nal_t *nal, int nalCnt, int bIdr, int64_t pts);
+/* Closes the last segment and waits for the io thread */
+extern void h265bs_seg_deinit(h265bs_seg_t *seg);
+extern void h265bs_seg_get_stat(h265bs_seg_t *seg, h265bs_seg_stat_t *stat);
+extern void h265bs_seg_dump_stat(h265bs_seg_t *seg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __H265BS_SEG_H__ */
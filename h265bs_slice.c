@@ -0,0 +1,785 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "h265bs_nal.h"
+#include "h265bs_bits.h"
+#include "h265bs_ps.h"
+#include "h265bs_slice.h"
+
+/* rbsp bytes looked at, a sps with scaling lists and 64 reference picture
+ * sets or a slice header with weight tables stays well within */
+#define H265BS_SLICE_PARSE_WINDOW   1024
+/* the entry points of a 8K picture in 16x16 CTBs with both tiles and
+ * wavefronts still fit */
+#define H265BS_SLICE_ENTRY_WINDOW   4096
+
+#define H265BS_SLICE_RPS_MAX        64      /* num_short_term_ref_pic_sets */
+#define H265BS_SLICE_LT_SPS_MAX     32      /* num_long_term_ref_pics_sps */
+#define H265BS_SLICE_DELTA_MAX      16      /* num_negative_pics, num_positive_pics */
+#define H265BS_SLICE_REF_MAX        15      /* num_ref_idx_lx_active_minus1 */
+#define H265BS_SLICE_TILE_MAX       32      /* tile columns or rows, level 6.2 allows 20 and 22 */
+
+/* a short_term_ref_pic_set as far as the slice header needs it */
+typedef struct {
+    int numDelta;       /* NumDeltaPocs */
+    int numUsed;        /* pictures used by the current one */
+} h265bs_slice_rps_t;
+
+typedef struct {
+    int bValid;
+    int bSeparatePlanes;
+    int chromaArrayType;
+    int log2MaxPocLsb;
+    int numRps;
+    h265bs_slice_rps_t rps[H265BS_SLICE_RPS_MAX + 1];   /* the last one for the slice header */
+    int bLtPresent;
+    int numLtSps;
+    uint32_t ltUsedSps;     /* used_by_curr_pic_lt_sps_flag bits */
+    int bTemporalMvp;
+    int bSao;
+    int ctbCols;            /* PicWidthInCtbsY */
+    int ctbRows;            /* PicHeightInCtbsY */
+} h265bs_slice_sps_t;
+
+typedef struct {
+    int bValid;
+    int spsId;
+    int bOutputFlag;
+    int numExtraBits;
+    int bCabacInit;
+    int numRefIdx[2];       /* num_ref_idx_lx_default_active_minus1 + 1 */
+    int initQp;             /* 26 + init_qp_minus26 */
+    int bWeightedPred;
+    int bWeightedBipred;
+    int bListsModification;
+    /* what the slice segment header needs behind slice_qp_delta */
+    int bDependentSlices;
+    int bChromaQpOffsets;   /* pps_slice_chroma_qp_offsets_present_flag */
+    int bTiles;
+    int bWavefront;         /* entropy_coding_sync_enabled_flag */
+    int tileCols;
+    int tileRows;
+    int bUniformTiles;
+    int colWidth[H265BS_SLICE_TILE_MAX];    /* CTBs, without uniform spacing */
+    int rowHeight[H265BS_SLICE_TILE_MAX];
+    int bLoopFilterAcross;  /* pps_loop_filter_across_slices_enabled_flag */
+    int bDeblockOverride;
+    int bDeblockDisabled;
+    int bHeaderExt;         /* slice_segment_header_extension_present_flag */
+    int bChromaQpOffsetList;
+    int bValidExt;          /* parsed up to the pps extensions */
+} h265bs_slice_pps_t;
+
+/* Where a slice segment header left off at slice_qp_delta, or at
+ * slice_segment_address for a dependent slice segment */
+typedef struct {
+    h265bs_slice_pps_t *pps;
+    h265bs_slice_sps_t *sps;
+    int bFirst;
+    int bDependent;
+    int address;
+    int bSao;               /* slice_sao_luma_flag or slice_sao_chroma_flag */
+} h265bs_slice_seg_t;
+
+struct h265bs_slice {
+    h265bs_slice_sps_t sps[H265BS_PS_SPS_MAX];
+    h265bs_slice_pps_t pps[H265BS_PS_PPS_MAX];
+    int32_t prevTid0Poc;
+    int bFirst;             /* NoRaslOutputFlag of the next IRAP */
+    uint8_t rbsp[H265BS_SLICE_ENTRY_WINDOW];
+};
+
+h265bs_slice_t *h265bs_slice_init(void)
+{
+    h265bs_slice_t *s = calloc(1, sizeof(h265bs_slice_t));
+
+    if (s == NULL) {
+        printf("h265bs_slice:calloc h265bs_slice_t failed\n");
+        return NULL;
+    }
+    s->bFirst = 1;
+    return s;
+}
+
+void h265bs_slice_deinit(h265bs_slice_t *s)
+{
+    free(s);
+}
+
+void h265bs_slice_restart(h265bs_slice_t *s)
+{
+    s->bFirst = 1;
+    s->prevTid0Poc = 0;
+}
+
+void h265bs_slice_set_prev_poc(h265bs_slice_t *s, int32_t poc)
+{
+    s->bFirst = 0;
+    s->prevTid0Poc = poc;
+}
+
+int h265bs_slice_is_tid0_ref(uint32_t nalType, int tid)
+{
+    /* RADL, RASL and sub-layer non-reference pictures do not count */
+    return tid == 0 && (nalType < I265E_NAL_CODED_SLICE_RADL_N || nalType > I265E_NAL_CODED_SLICE_RASL_R)
+        && !(nalType <= 14 && (nalType & 0x01) == 0);
+}
+
+static int h265bs_slice_ceil_log2(int v)
+{
+    int n = 0;
+
+    while ((1 << n) < v) {
+        n++;
+    }
+    return n;
+}
+
+/****************************************************************************
+ * parameter sets
+ ****************************************************************************/
+static void h265bs_slice_skip_ptl(h265bs_bits_t *b, int maxSubLayersMinus1)
+{
+    int profilePresent[8], levelPresent[8];
+    int i = 0;
+
+    b->pos += 96;                           /* general profile, tier and level */
+    for (i = 0; i < maxSubLayersMinus1; i++) {
+        profilePresent[i] = h265bs_bits_get(b, 1);
+        levelPresent[i] = h265bs_bits_get(b, 1);
+    }
+    if (maxSubLayersMinus1 > 0) {
+        b->pos += (8 - maxSubLayersMinus1) * 2;
+    }
+    for (i = 0; i < maxSubLayersMinus1; i++) {
+        b->pos += (profilePresent[i] ? 88 : 0) + (levelPresent[i] ? 8 : 0);
+    }
+}
+
+static void h265bs_slice_skip_scaling_list(h265bs_bits_t *b)
+{
+    int sizeId = 0, matrixId = 0, i = 0, coefNum = 0;
+
+    for (sizeId = 0; sizeId < 4; sizeId++) {
+        for (matrixId = 0; matrixId < 6; matrixId += (sizeId == 3) ? 3 : 1) {
+            if (!h265bs_bits_get(b, 1)) {   /* scaling_list_pred_mode_flag */
+                h265bs_bits_get_ue(b);      /* scaling_list_pred_matrix_id_delta */
+                continue;
+            }
+            coefNum = C_MIN(64, 1 << (4 + (sizeId << 1)));
+            if (sizeId > 1) {
+                h265bs_bits_get_se(b);      /* scaling_list_dc_coef_minus8 */
+            }
+            for (i = 0; i < coefNum && !h265bs_bits_over(b); i++) {
+                h265bs_bits_get_se(b);      /* scaling_list_delta_coef */
+            }
+        }
+    }
+}
+
+/* st_ref_pic_set(idx) of H.265 7.3.7, rps[0, idx) are known */
+static int h265bs_slice_rps(h265bs_bits_t *b, h265bs_slice_rps_t *rps, int idx, int numRps)
+{
+    h265bs_slice_rps_t *ref = NULL;
+    int i = 0, numNeg = 0, numPos = 0, deltaIdx = 1, bUsed = 0;
+
+    rps[idx].numDelta = rps[idx].numUsed = 0;
+    if (idx != 0 && h265bs_bits_get(b, 1)) {    /* inter_ref_pic_set_prediction_flag */
+        if (idx == numRps) {
+            deltaIdx = h265bs_bits_get_ue(b) + 1;
+        }
+        if (deltaIdx > idx) {
+            return -1;
+        }
+        h265bs_bits_get(b, 1);                  /* delta_rps_sign */
+        h265bs_bits_get_ue(b);                  /* abs_delta_rps_minus1 */
+        ref = &rps[idx - deltaIdx];
+        for (i = 0; i <= ref->numDelta; i++) {
+            bUsed = h265bs_bits_get(b, 1);
+            if (bUsed || h265bs_bits_get(b, 1)) {   /* use_delta_flag */
+                rps[idx].numDelta++;
+                rps[idx].numUsed += bUsed;
+            }
+        }
+        return rps[idx].numDelta > 2 * H265BS_SLICE_DELTA_MAX ? -1 : 0;
+    }
+
+    numNeg = h265bs_bits_get_ue(b);
+    numPos = h265bs_bits_get_ue(b);
+    if (numNeg > H265BS_SLICE_DELTA_MAX || numPos > H265BS_SLICE_DELTA_MAX) {
+        return -1;
+    }
+    for (i = 0; i < numNeg + numPos; i++) {
+        h265bs_bits_get_ue(b);                  /* delta_poc_sx_minus1 */
+        rps[idx].numUsed += h265bs_bits_get(b, 1);
+    }
+    rps[idx].numDelta = numNeg + numPos;
+    return 0;
+}
+
+static int h265bs_slice_parse_sps(h265bs_slice_t *s, h265bs_bits_t *b)
+{
+    h265bs_slice_sps_t sps;
+    int maxSubLayersMinus1 = 0, id = 0, chromaFormat = 0, width = 0, height = 0, log2Ctb = 0, i = 0;
+
+    memset(&sps, 0, sizeof(sps));
+    h265bs_bits_get(b, 4);                      /* sps_video_parameter_set_id */
+    maxSubLayersMinus1 = h265bs_bits_get(b, 3);
+    h265bs_bits_get(b, 1);                      /* sps_temporal_id_nesting_flag */
+    h265bs_slice_skip_ptl(b, maxSubLayersMinus1);
+    id = h265bs_bits_get_ue(b);
+    if (id >= H265BS_PS_SPS_MAX) {
+        return -1;
+    }
+    chromaFormat = h265bs_bits_get_ue(b);
+    if (chromaFormat == 3) {
+        sps.bSeparatePlanes = h265bs_bits_get(b, 1);
+    }
+    sps.chromaArrayType = sps.bSeparatePlanes ? 0 : chromaFormat;
+    width = h265bs_bits_get_ue(b);              /* pic_width_in_luma_samples */
+    height = h265bs_bits_get_ue(b);             /* pic_height_in_luma_samples */
+    if (h265bs_bits_get(b, 1)) {                /* conformance_window_flag */
+        for (i = 0; i < 4; i++) {
+            h265bs_bits_get_ue(b);
+        }
+    }
+    h265bs_bits_get_ue(b);                      /* bit_depth_luma_minus8 */
+    h265bs_bits_get_ue(b);                      /* bit_depth_chroma_minus8 */
+    sps.log2MaxPocLsb = h265bs_bits_get_ue(b) + 4;
+    if (sps.log2MaxPocLsb > 16) {
+        return -1;
+    }
+    i = h265bs_bits_get(b, 1) ? 0 : maxSubLayersMinus1;    /* sps_sub_layer_ordering_info_present_flag */
+    for (; i <= maxSubLayersMinus1; i++) {
+        h265bs_bits_get_ue(b);                  /* sps_max_dec_pic_buffering_minus1 */
+        h265bs_bits_get_ue(b);                  /* sps_max_num_reorder_pics */
+        h265bs_bits_get_ue(b);                  /* sps_max_latency_increase_plus1 */
+    }
+    log2Ctb = h265bs_bits_get_ue(b) + 3;        /* log2_min_luma_coding_block_size_minus3 */
+    log2Ctb += h265bs_bits_get_ue(b);           /* log2_diff_max_min_luma_coding_block_size */
+    if (log2Ctb > 6 || width == 0 || height == 0) {
+        return -1;
+    }
+    sps.ctbCols = (width + (1 << log2Ctb) - 1) >> log2Ctb;
+    sps.ctbRows = (height + (1 << log2Ctb) - 1) >> log2Ctb;
+    for (i = 0; i < 4; i++) {
+        h265bs_bits_get_ue(b);                  /* transform block and hierarchy sizes */
+    }
+    if (h265bs_bits_get(b, 1) && h265bs_bits_get(b, 1)) {  /* scaling_list_enabled_flag, sps_scaling_list_data_present_flag */
+        h265bs_slice_skip_scaling_list(b);
+    }
+    h265bs_bits_get(b, 1);                      /* amp_enabled_flag */
+    sps.bSao = h265bs_bits_get(b, 1);
+    if (h265bs_bits_get(b, 1)) {                /* pcm_enabled_flag */
+        h265bs_bits_get(b, 8);                  /* pcm sample bit depths */
+        h265bs_bits_get_ue(b);
+        h265bs_bits_get_ue(b);
+        h265bs_bits_get(b, 1);                  /* pcm_loop_filter_disabled_flag */
+    }
+    sps.numRps = h265bs_bits_get_ue(b);
+    if (sps.numRps > H265BS_SLICE_RPS_MAX) {
+        return -1;
+    }
+    for (i = 0; i < sps.numRps; i++) {
+        if (h265bs_slice_rps(b, sps.rps, i, sps.numRps) < 0) {
+            return -1;
+        }
+    }
+    sps.bLtPresent = h265bs_bits_get(b, 1);
+    if (sps.bLtPresent) {
+        sps.numLtSps = h265bs_bits_get_ue(b);
+        if (sps.numLtSps > H265BS_SLICE_LT_SPS_MAX) {
+            return -1;
+        }
+        for (i = 0; i < sps.numLtSps; i++) {
+            h265bs_bits_get(b, sps.log2MaxPocLsb);  /* lt_ref_pic_poc_lsb_sps */
+            sps.ltUsedSps |= h265bs_bits_get(b, 1) << i;
+        }
+    }
+    sps.bTemporalMvp = h265bs_bits_get(b, 1);
+    if (h265bs_bits_over(b)) {
+        return -1;
+    }
+
+    sps.bValid = 1;
+    s->sps[id] = sps;
+    return 0;
+}
+
+static int h265bs_slice_parse_pps(h265bs_slice_t *s, h265bs_bits_t *b)
+{
+    h265bs_slice_pps_t pps;
+    int id = 0, bTransformSkip = 0, bRangeExt = 0, i = 0;
+
+    memset(&pps, 0, sizeof(pps));
+    id = h265bs_bits_get_ue(b);
+    pps.spsId = h265bs_bits_get_ue(b);
+    if (id >= H265BS_PS_PPS_MAX || pps.spsId >= H265BS_PS_SPS_MAX) {
+        return -1;
+    }
+    pps.bDependentSlices = h265bs_bits_get(b, 1);
+    pps.bOutputFlag = h265bs_bits_get(b, 1);
+    pps.numExtraBits = h265bs_bits_get(b, 3);
+    h265bs_bits_get(b, 1);                      /* sign_data_hiding_enabled_flag */
+    pps.bCabacInit = h265bs_bits_get(b, 1);
+    pps.numRefIdx[0] = h265bs_bits_get_ue(b) + 1;
+    pps.numRefIdx[1] = h265bs_bits_get_ue(b) + 1;
+    pps.initQp = 26 + h265bs_bits_get_se(b);
+    h265bs_bits_get(b, 1);                      /* constrained_intra_pred_flag */
+    bTransformSkip = h265bs_bits_get(b, 1);
+    if (h265bs_bits_get(b, 1)) {                /* cu_qp_delta_enabled_flag */
+        h265bs_bits_get_ue(b);                  /* diff_cu_qp_delta_depth */
+    }
+    h265bs_bits_get_se(b);                      /* pps_cb_qp_offset */
+    h265bs_bits_get_se(b);                      /* pps_cr_qp_offset */
+    pps.bChromaQpOffsets = h265bs_bits_get(b, 1);
+    pps.bWeightedPred = h265bs_bits_get(b, 1);
+    pps.bWeightedBipred = h265bs_bits_get(b, 1);
+    h265bs_bits_get(b, 1);                      /* transquant_bypass_enabled_flag */
+    pps.bTiles = h265bs_bits_get(b, 1);
+    pps.bWavefront = h265bs_bits_get(b, 1);
+    pps.tileCols = pps.tileRows = 1;
+    if (pps.bTiles) {
+        pps.tileCols = h265bs_bits_get_ue(b) + 1;
+        pps.tileRows = h265bs_bits_get_ue(b) + 1;
+        pps.bUniformTiles = h265bs_bits_get(b, 1);
+        if (!pps.bUniformTiles) {
+            for (i = 0; i < pps.tileCols - 1 + pps.tileRows - 1 && !h265bs_bits_over(b); i++) {
+                if (i < pps.tileCols - 1 && i < H265BS_SLICE_TILE_MAX) {
+                    pps.colWidth[i] = h265bs_bits_get_ue(b) + 1;
+                } else if (i >= pps.tileCols - 1 && i - (pps.tileCols - 1) < H265BS_SLICE_TILE_MAX) {
+                    pps.rowHeight[i - (pps.tileCols - 1)] = h265bs_bits_get_ue(b) + 1;
+                } else {
+                    h265bs_bits_get_ue(b);
+                }
+            }
+        }
+        h265bs_bits_get(b, 1);                  /* loop_filter_across_tiles_enabled_flag */
+    }
+    pps.bLoopFilterAcross = h265bs_bits_get(b, 1);
+    if (h265bs_bits_get(b, 1)) {                /* deblocking_filter_control_present_flag */
+        pps.bDeblockOverride = h265bs_bits_get(b, 1);
+        pps.bDeblockDisabled = h265bs_bits_get(b, 1);
+        if (!pps.bDeblockDisabled) {
+            h265bs_bits_get_se(b);              /* pps_beta_offset_div2 */
+            h265bs_bits_get_se(b);              /* pps_tc_offset_div2 */
+        }
+    }
+    if (h265bs_bits_get(b, 1)) {                /* pps_scaling_list_data_present_flag */
+        h265bs_slice_skip_scaling_list(b);
+    }
+    pps.bListsModification = h265bs_bits_get(b, 1);
+    if (h265bs_bits_over(b) || pps.numRefIdx[0] > H265BS_SLICE_REF_MAX + 1 || pps.numRefIdx[1] > H265BS_SLICE_REF_MAX + 1) {
+        return -1;
+    }
+
+    /* the entry point analysis also needs the range extension, other
+     * extensions leave the slice segment header alone or are not known */
+    h265bs_bits_get_ue(b);                      /* log2_parallel_merge_level_minus2 */
+    pps.bHeaderExt = h265bs_bits_get(b, 1);
+    pps.bValidExt = 1;
+    if (h265bs_bits_get(b, 1)) {                /* pps_extension_present_flag */
+        bRangeExt = h265bs_bits_get(b, 1);
+        if (h265bs_bits_get(b, 3)) {            /* multilayer, 3d and screen content extensions */
+            pps.bValidExt = 0;
+        }
+        h265bs_bits_get(b, 4);                  /* pps_extension_4bits */
+        if (bRangeExt) {
+            if (bTransformSkip) {
+                h265bs_bits_get_ue(b);          /* log2_max_transform_skip_block_size_minus2 */
+            }
+            h265bs_bits_get(b, 1);              /* cross_component_prediction_enabled_flag */
+            pps.bChromaQpOffsetList = h265bs_bits_get(b, 1);
+        }
+    }
+    if (h265bs_bits_over(b) || pps.tileCols > H265BS_SLICE_TILE_MAX || pps.tileRows > H265BS_SLICE_TILE_MAX) {
+        pps.bValidExt = 0;
+    }
+
+    pps.bValid = 1;
+    s->pps[id] = pps;
+    return 0;
+}
+
+/****************************************************************************
+ * slice segment header
+ ****************************************************************************/
+static int h265bs_slice_skip_weights(h265bs_bits_t *b, int chromaArrayType, const int *numRefIdx, int listNum)
+{
+    uint32_t lumaFlags = 0, chromaFlags = 0;
+    int l = 0, i = 0;
+
+    h265bs_bits_get_ue(b);                      /* luma_log2_weight_denom */
+    if (chromaArrayType != 0) {
+        h265bs_bits_get_se(b);                  /* delta_chroma_log2_weight_denom */
+    }
+    for (l = 0; l < listNum; l++) {
+        lumaFlags = h265bs_bits_get(b, numRefIdx[l]);
+        chromaFlags = chromaArrayType != 0 ? h265bs_bits_get(b, numRefIdx[l]) : 0;
+        for (i = numRefIdx[l] - 1; i >= 0; i--) {
+            if ((lumaFlags >> i) & 0x01) {
+                h265bs_bits_get_se(b);          /* delta_luma_weight */
+                h265bs_bits_get_se(b);          /* luma_offset */
+            }
+            if ((chromaFlags >> i) & 0x01) {
+                h265bs_bits_get_se(b);          /* delta_chroma_weight, delta_chroma_offset of cb and cr */
+                h265bs_bits_get_se(b);
+                h265bs_bits_get_se(b);
+                h265bs_bits_get_se(b);
+            }
+        }
+    }
+    return h265bs_bits_over(b) ? -1 : 0;
+}
+
+/* Up to slice_qp_delta, H.265 7.3.6.1. A dependent slice segment stops
+ * behind slice_segment_address with sliceType left at -1 */
+static int h265bs_slice_parse_header(h265bs_slice_t *s, h265bs_bits_t *b, h265bs_slice_info_t *info, h265bs_slice_seg_t *seg)
+{
+    h265bs_slice_pps_t *pps = NULL;
+    h265bs_slice_sps_t *sps = NULL;
+    int ppsId = 0, pocLsb = 0, numPicTotalCurr = 0, numLtSps = 0, numLt = 0, i = 0, l = 0;
+    int bTemporalMvp = 0, bColFromL0 = 1, listNum = 0;
+    int numRefIdx[2];
+    int32_t maxPocLsb = 0, prevLsb = 0, prevMsb = 0, msb = 0;
+
+    memset(seg, 0, sizeof(*seg));
+    seg->bFirst = h265bs_bits_get(b, 1);
+    if (h265bs_nal_is_irap(info->nalType)) {
+        h265bs_bits_get(b, 1);                  /* no_output_of_prior_pics_flag */
+    }
+    ppsId = h265bs_bits_get_ue(b);
+    if (ppsId >= H265BS_PS_PPS_MAX || !s->pps[ppsId].bValid || !s->sps[s->pps[ppsId].spsId].bValid) {
+        return -1;
+    }
+    pps = &s->pps[ppsId];
+    sps = &s->sps[pps->spsId];
+    seg->pps = pps;
+    seg->sps = sps;
+    if (!seg->bFirst) {
+        if (pps->bDependentSlices) {
+            seg->bDependent = h265bs_bits_get(b, 1);
+        }
+        seg->address = h265bs_bits_get(b, h265bs_slice_ceil_log2(sps->ctbCols * sps->ctbRows));
+        if (seg->bDependent) {
+            return h265bs_bits_over(b) ? -1 : 0;
+        }
+    }
+
+    h265bs_bits_get(b, pps->numExtraBits);      /* slice_reserved_flag */
+    info->sliceType = h265bs_bits_get_ue(b);
+    if (info->sliceType > H265BS_SLICE_I) {
+        return -1;
+    }
+    if (pps->bOutputFlag) {
+        h265bs_bits_get(b, 1);                  /* pic_output_flag */
+    }
+    if (sps->bSeparatePlanes) {
+        h265bs_bits_get(b, 2);                  /* colour_plane_id */
+    }
+    if (!h265bs_nal_is_idr(info->nalType)) {
+        pocLsb = h265bs_bits_get(b, sps->log2MaxPocLsb);
+        if (!h265bs_bits_get(b, 1)) {           /* short_term_ref_pic_set_sps_flag */
+            if (h265bs_slice_rps(b, sps->rps, sps->numRps, sps->numRps) < 0) {
+                return -1;
+            }
+            numPicTotalCurr = sps->rps[sps->numRps].numUsed;
+        } else if (sps->numRps > 0) {
+            i = sps->numRps > 1 ? h265bs_bits_get(b, h265bs_slice_ceil_log2(sps->numRps)) : 0;
+            if (i >= sps->numRps) {
+                return -1;
+            }
+            numPicTotalCurr = sps->rps[i].numUsed;
+        }
+        if (sps->bLtPresent) {
+            numLtSps = sps->numLtSps > 0 ? h265bs_bits_get_ue(b) : 0;
+            numLt = h265bs_bits_get_ue(b);
+            if (numLtSps > sps->numLtSps || numLtSps + numLt > H265BS_SLICE_LT_SPS_MAX) {
+                return -1;
+            }
+            for (i = 0; i < numLtSps + numLt; i++) {
+                if (i < numLtSps) {
+                    l = sps->numLtSps > 1 ? h265bs_bits_get(b, h265bs_slice_ceil_log2(sps->numLtSps)) : 0;
+                    numPicTotalCurr += (sps->ltUsedSps >> l) & 0x01;
+                } else {
+                    h265bs_bits_get(b, sps->log2MaxPocLsb);     /* poc_lsb_lt */
+                    numPicTotalCurr += h265bs_bits_get(b, 1);   /* used_by_curr_pic_lt_flag */
+                }
+                if (h265bs_bits_get(b, 1)) {    /* delta_poc_msb_present_flag */
+                    h265bs_bits_get_ue(b);      /* delta_poc_msb_cycle_lt */
+                }
+            }
+        }
+        if (sps->bTemporalMvp) {
+            bTemporalMvp = h265bs_bits_get(b, 1);
+        }
+    }
+    if (sps->bSao) {
+        seg->bSao = h265bs_bits_get(b, 1);      /* slice_sao_luma_flag */
+        if (sps->chromaArrayType != 0) {
+            seg->bSao |= h265bs_bits_get(b, 1); /* slice_sao_chroma_flag */
+        }
+    }
+
+    if (info->sliceType != H265BS_SLICE_I) {
+        listNum = info->sliceType == H265BS_SLICE_B ? 2 : 1;
+        numRefIdx[0] = pps->numRefIdx[0];
+        numRefIdx[1] = listNum == 2 ? pps->numRefIdx[1] : 0;
+        if (h265bs_bits_get(b, 1)) {            /* num_ref_idx_active_override_flag */
+            for (l = 0; l < listNum; l++) {
+                numRefIdx[l] = h265bs_bits_get_ue(b) + 1;
+                if (numRefIdx[l] > H265BS_SLICE_REF_MAX + 1) {
+                    return -1;
+                }
+            }
+        }
+        if (pps->bListsModification && numPicTotalCurr > 1) {
+            for (l = 0; l < listNum; l++) {
+                if (h265bs_bits_get(b, 1)) {    /* ref_pic_list_modification_flag_lx */
+                    b->pos += numRefIdx[l] * h265bs_slice_ceil_log2(numPicTotalCurr);
+                }
+            }
+        }
+        if (info->sliceType == H265BS_SLICE_B) {
+            h265bs_bits_get(b, 1);              /* mvd_l1_zero_flag */
+        }
+        if (pps->bCabacInit) {
+            h265bs_bits_get(b, 1);              /* cabac_init_flag */
+        }
+        if (bTemporalMvp) {
+            if (info->sliceType == H265BS_SLICE_B) {
+                bColFromL0 = h265bs_bits_get(b, 1);
+            }
+            if (numRefIdx[bColFromL0 ? 0 : 1] > 1) {
+                h265bs_bits_get_ue(b);          /* collocated_ref_idx */
+            }
+        }
+        if ((pps->bWeightedPred && info->sliceType == H265BS_SLICE_P)
+                || (pps->bWeightedBipred && info->sliceType == H265BS_SLICE_B)) {
+            if (h265bs_slice_skip_weights(b, sps->chromaArrayType, numRefIdx, listNum) < 0) {
+                return -1;
+            }
+        }
+        h265bs_bits_get_ue(b);                  /* five_minus_max_num_merge_cand */
+    }
+    info->qp = pps->initQp + h265bs_bits_get_se(b);
+    if (h265bs_bits_over(b)) {
+        return -1;
+    }
+
+    /* PicOrderCntVal, H.265 8.3.1 */
+    maxPocLsb = 1 << sps->log2MaxPocLsb;
+    if (h265bs_nal_is_irap(info->nalType) && (s->bFirst || info->nalType < I265E_NAL_CODED_SLICE_CRA)) {
+        msb = 0;
+    } else {
+        prevLsb = s->prevTid0Poc & (maxPocLsb - 1);
+        prevMsb = s->prevTid0Poc - prevLsb;
+        if (pocLsb < prevLsb && prevLsb - pocLsb >= maxPocLsb / 2) {
+            msb = prevMsb + maxPocLsb;
+        } else if (pocLsb > prevLsb && pocLsb - prevLsb > maxPocLsb / 2) {
+            msb = prevMsb - maxPocLsb;
+        } else {
+            msb = prevMsb;
+        }
+    }
+    info->poc = msb + pocLsb;
+    return 0;
+}
+
+/* Behind slice_qp_delta up to the slice segment data, H.265 7.3.6.1 */
+static int h265bs_slice_parse_entry(h265bs_bits_t *b, h265bs_slice_seg_t *seg, h265bs_slice_entry_t *entry)
+{
+    h265bs_slice_pps_t *pps = seg->pps;
+    int bDeblockDisabled = pps->bDeblockDisabled, num = 0, offsetLen = 0, i = 0;
+
+    if (!seg->bDependent) {
+        if (pps->bChromaQpOffsets) {
+            h265bs_bits_get_se(b);              /* slice_cb_qp_offset */
+            h265bs_bits_get_se(b);              /* slice_cr_qp_offset */
+        }
+        if (pps->bChromaQpOffsetList) {
+            h265bs_bits_get(b, 1);              /* cu_chroma_qp_offset_enabled_flag */
+        }
+        if (pps->bDeblockOverride && h265bs_bits_get(b, 1)) {  /* deblocking_filter_override_flag */
+            bDeblockDisabled = h265bs_bits_get(b, 1);
+            if (!bDeblockDisabled) {
+                h265bs_bits_get_se(b);          /* slice_beta_offset_div2 */
+                h265bs_bits_get_se(b);          /* slice_tc_offset_div2 */
+            }
+        }
+        if (pps->bLoopFilterAcross && (seg->bSao || !bDeblockDisabled)) {
+            h265bs_bits_get(b, 1);              /* slice_loop_filter_across_slices_enabled_flag */
+        }
+    }
+    entry->substreamNum = 1;
+    if (pps->bTiles || pps->bWavefront) {
+        num = h265bs_bits_get_ue(b);            /* num_entry_point_offsets */
+        if (num >= H265BS_SLICE_SUBSTREAM_MAX) {
+            return -1;
+        }
+        if (num > 0) {
+            offsetLen = h265bs_bits_get_ue(b) + 1;
+            if (offsetLen > 31) {
+                return -1;
+            }
+            for (i = 0; i < num; i++) {
+                entry->substreamSize[i] = h265bs_bits_get(b, offsetLen) + 1;
+            }
+        }
+        entry->substreamNum = num + 1;
+    }
+    if (pps->bHeaderExt) {
+        b->pos += 8 * h265bs_bits_get_ue(b);    /* slice_segment_header_extension_length */
+    }
+    b->pos = (b->pos + 8) & ~7;                 /* byte_alignment() */
+    return h265bs_bits_over(b) ? -1 : 0;
+}
+
+/* Tile column or row boundaries in CTBs, H.265 6.5.1 */
+static void h265bs_slice_tile_bd(int num, int ctbNum, int bUniform, const int *size, int *bd)
+{
+    int i = 0;
+
+    bd[0] = 0;
+    for (i = 0; i < num; i++) {
+        if (bUniform) {
+            bd[i + 1] = (i + 1) * ctbNum / num;
+        } else {
+            bd[i + 1] = (i == num - 1) ? ctbNum : bd[i] + size[i];
+        }
+    }
+}
+
+/* Substream index in the picture of the one starting at CTB address, they
+ * go CTB row by CTB row of each tile in tile scan */
+static void h265bs_slice_unit(h265bs_slice_seg_t *seg, h265bs_slice_entry_t *entry)
+{
+    h265bs_slice_pps_t *pps = seg->pps;
+    h265bs_slice_sps_t *sps = seg->sps;
+    int colBd[H265BS_SLICE_TILE_MAX + 1], rowBd[H265BS_SLICE_TILE_MAX + 1];
+    int x = seg->address % sps->ctbCols, y = seg->address / sps->ctbCols, tc = 0, tr = 0;
+
+    h265bs_slice_tile_bd(pps->tileCols, sps->ctbCols, !pps->bTiles || pps->bUniformTiles, pps->colWidth, colBd);
+    h265bs_slice_tile_bd(pps->tileRows, sps->ctbRows, !pps->bTiles || pps->bUniformTiles, pps->rowHeight, rowBd);
+    while (tc < pps->tileCols - 1 && x >= colBd[tc + 1]) {
+        tc++;
+    }
+    while (tr < pps->tileRows - 1 && y >= rowBd[tr + 1]) {
+        tr++;
+    }
+    if (pps->bWavefront) {
+        entry->unit = pps->tileCols * rowBd[tr] + tc * (rowBd[tr + 1] - rowBd[tr]) + y - rowBd[tr];
+        entry->unitNum = pps->tileCols * sps->ctbRows;
+    } else {
+        entry->unit = tr * pps->tileCols + tc;
+        entry->unitNum = pps->tileCols * pps->tileRows;
+    }
+}
+
+int h265bs_slice_entry(h265bs_slice_t *s, const uint8_t *nal, int size, h265bs_slice_entry_t *entry)
+{
+    h265bs_slice_info_t info;
+    h265bs_slice_seg_t seg;
+    h265bs_bits_t b;
+    int scLen = 0, headerSize = 0, raw = 0, n = 0, zeros = 0, sum = 0, i = 0;
+
+    scLen = (nal[2] == 0x01) ? 3 : 4;
+    if (size < scLen + 3 || !h265bs_nal_is_vcl(H265BS_NAL_TYPE(nal + scLen))) {
+        return -1;
+    }
+    memset(&info, 0, sizeof(info));
+    info.nalType = H265BS_NAL_TYPE(nal + scLen);
+    info.sliceType = -1;
+    b.p = s->rbsp;
+    b.size = h265bs_bits_unescape(nal + scLen + 2, C_MIN(size - scLen - 2, H265BS_SLICE_ENTRY_WINDOW), s->rbsp, sizeof(s->rbsp));
+    b.pos = 0;
+    if (h265bs_slice_parse_header(s, &b, &info, &seg) < 0 || !seg.pps->bValidExt
+            || h265bs_slice_parse_entry(&b, &seg, entry) < 0) {
+        return -1;
+    }
+
+    /* the header in nal bytes, emulation prevention bytes counted back in */
+    headerSize = b.pos / 8;
+    for (raw = scLen + 2; n < headerSize && raw < size; raw++) {
+        if (zeros >= 2 && nal[raw] == 0x03) {
+            zeros = 0;
+            continue;
+        }
+        n++;
+        zeros = nal[raw] ? 0 : zeros + 1;
+    }
+    for (i = 0; i < entry->substreamNum - 1; i++) {
+        sum += entry->substreamSize[i];
+        if (sum >= size - raw) {
+            return -1;
+        }
+    }
+    entry->substreamSize[entry->substreamNum - 1] = size - raw - sum;
+
+    entry->nalType = info.nalType;
+    entry->bFirst = seg.bFirst;
+    entry->bDependent = seg.bDependent;
+    entry->address = seg.address;
+    entry->ctbCols = seg.sps->ctbCols;
+    entry->ctbRows = seg.sps->ctbRows;
+    entry->tileCols = seg.pps->tileCols;
+    entry->tileRows = seg.pps->tileRows;
+    entry->bWavefront = seg.pps->bWavefront;
+    entry->dataOff = raw;
+    h265bs_slice_unit(&seg, entry);
+    return 0;
+}
+
+int h265bs_slice_nal(h265bs_slice_t *s, const uint8_t *nal, int size, h265bs_slice_info_t *info)
+{
+    h265bs_slice_seg_t seg;
+    h265bs_bits_t b;
+    uint32_t type = 0;
+    int scLen = 0, ret = 0;
+
+    scLen = (nal[2] == 0x01) ? 3 : 4;
+    if (size < scLen + 3) {
+        return 0;
+    }
+    type = H265BS_NAL_TYPE(nal + scLen);
+    b.p = s->rbsp;
+    b.size = h265bs_bits_unescape(nal + scLen + 2, C_MIN(size - scLen - 2, H265BS_SLICE_PARSE_WINDOW), s->rbsp, sizeof(s->rbsp));
+    b.pos = 0;
+
+    switch (type) {
+    case I265E_NAL_SPS:
+        h265bs_slice_parse_sps(s, &b);
+        return 0;
+    case I265E_NAL_PPS:
+        h265bs_slice_parse_pps(s, &b);
+        return 0;
+    case I265E_NAL_EOS:
+        s->bFirst = 1;
+        return 0;
+    default:
+        if (!h265bs_nal_is_vcl(type) || !H265BS_NAL_FIRST_SLICE(nal + scLen)) {
+            return 0;
+        }
+        break;
+    }
+
+    info->nalType = type;
+    info->tid = H265BS_NAL_TID_PLUS1(nal + scLen) - 1;
+    info->sliceType = -1;
+    info->qp = 0;
+    info->poc = 0;
+    ret = h265bs_slice_parse_header(s, &b, info, &seg);
+    if (ret < 0) {
+        info->sliceType = -1;
+        return 1;
+    }
+    if (h265bs_nal_is_irap(type)) {
+        s->bFirst = 0;
+    }
+    if (h265bs_slice_is_tid0_ref(type, info->tid)) {
+        s->prevTid0Poc = info->poc;
+    }
+    return 1;
+}
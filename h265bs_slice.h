@@ -0,0 +1,73 @@
+#ifndef __H265BS_SLICE_H__
+#define __H265BS_SLICE_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* slice_type of the slice header */
+#define H265BS_SLICE_B          0
+#define H265BS_SLICE_P          1
+#define H265BS_SLICE_I          2
+
+/* What the first slice segment of a picture tells without decoding it */
+typedef struct {
+    uint32_t nalType;
+    int tid;                /* TemporalId */
+    int sliceType;          /* H265BS_SLICE_*, -1 when the header could not be parsed */
+    int qp;                 /* SliceQpY, 26 + init_qp_minus26 + slice_qp_delta */
+    int32_t poc;            /* PicOrderCntVal */
+} h265bs_slice_info_t;
+
+#define H265BS_SLICE_SUBSTREAM_MAX  1024
+
+/* How a slice segment is cut into substreams by its entry points, one per
+ * tile, per CTB row with wavefronts or per CTB row of a tile with both */
+typedef struct {
+    uint32_t nalType;
+    int bFirst;             /* first_slice_segment_in_pic_flag */
+    int bDependent;         /* dependent_slice_segment_flag */
+    int address;            /* slice_segment_address, CTBs in raster scan */
+    int ctbCols;            /* PicWidthInCtbsY */
+    int ctbRows;            /* PicHeightInCtbsY */
+    int tileCols;           /* 1 without tiles */
+    int tileRows;
+    int bWavefront;         /* entropy_coding_sync_enabled_flag */
+    int dataOff;            /* slice_segment_data() in the nal, start code included */
+    int unit;               /* index of the first substream among those of the picture, the others follow */
+    int unitNum;            /* substreams of the picture, 1 without tiles or wavefronts */
+    int substreamNum;       /* num_entry_point_offsets + 1 */
+    int substreamSize[H265BS_SLICE_SUBSTREAM_MAX];  /* bytes, emulation prevention bytes included */
+} h265bs_slice_entry_t;
+
+/* Parses just enough of the VPS/SPS/PPS and of the first slice segment
+ * header of every picture to reach slice_qp_delta, the parameter sets and
+ * the POC of the last TemporalId 0 picture are kept between nals */
+typedef struct h265bs_slice h265bs_slice_t;
+
+extern h265bs_slice_t *h265bs_slice_init(void);
+extern void h265bs_slice_deinit(h265bs_slice_t *s);
+/* The next IRAP starts the POC count like the first picture of a stream */
+extern void h265bs_slice_restart(h265bs_slice_t *s);
+/* POC of the picture in front, the prevTid0Pic of H.265 8.3.1 */
+extern void h265bs_slice_set_prev_poc(h265bs_slice_t *s, int32_t poc);
+/* One nal with its start code. 1 when it was the first slice segment of a
+ * picture and info is filled, sliceType -1 if its parameter sets are
+ * missing or the header is cut, 0 for any other nal */
+extern int h265bs_slice_nal(h265bs_slice_t *s, const uint8_t *nal, int size, h265bs_slice_info_t *info);
+/* Whole slice segment header of any vcl nal with its start code, the
+ * parameter sets are the ones h265bs_slice_nal has seen. 0 when entry is
+ * filled, -1 when they are missing, carry an extension the header parse
+ * does not know or the header is cut */
+extern int h265bs_slice_entry(h265bs_slice_t *s, const uint8_t *nal, int size, h265bs_slice_entry_t *entry);
+/* A picture of this nal type and TemporalId is the prevTid0Pic of the
+ * pictures behind it */
+extern int h265bs_slice_is_tid0_ref(uint32_t nalType, int tid);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __H265BS_SLICE_H__ */
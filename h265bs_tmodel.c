@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "h265bs_clock.h"
+#include "h265bs_tmodel.h"
+#include "h265bs_trace.h"
+
+#define H265BS_TMODEL_SLOT_MASK     (H265BS_TMODEL_WHEEL_SLOTS - 1)
+
+struct h265bs_tmodel {
+    h265bs_tmodel_profile_t profile;
+    uint64_t rs;
+    int64_t coreFree[H265BS_TMODEL_CORE_MAX];
+    int channels;
+
+    /* hashed wheel, slot heads are list sentinels, ticks up to curTick are done */
+    h265bs_timer_t slot[H265BS_TMODEL_WHEEL_SLOTS];
+    int64_t curTick;
+    int64_t nextWake;
+    int pendingCnt;
+
+    pthread_t tid;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int bStop;
+
+    h265bs_tmodel_stat_t stat;
+};
+
+static const h265bs_tmodel_profile_t h265bs_tmodel_profiles[C_SOC_MAX] = {
+    [C_M200] = { "m200", 12000, 30, 4000, H265BS_JITTER_UNIFORM, 1000, 1, 2 },
+    [C_T10]  = { "t10",  10000, 25, 3000, H265BS_JITTER_UNIFORM,  800, 1, 2 },
+    [C_T20]  = { "t20",   8000, 15, 2500, H265BS_JITTER_NORMAL,   600, 1, 3 },
+    [C_T30]  = { "t30",   6000, 10, 2000, H265BS_JITTER_NORMAL,   500, 1, 4 },
+};
+
+static double h265bs_tmodel_rand(h265bs_tmodel_t *tm)
+{
+    /* xorshift64*, 53 bits in [0, 1) */
+    tm->rs ^= tm->rs >> 12;
+    tm->rs ^= tm->rs << 25;
+    tm->rs ^= tm->rs >> 27;
+    return ((tm->rs * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int64_t h265bs_tmodel_jitter(h265bs_tmodel_t *tm)
+{
+    double u = 0.0;
+    int i = 0;
+
+    switch (tm->profile.jitterType) {
+    case H265BS_JITTER_UNIFORM:
+        return (int64_t)(h265bs_tmodel_rand(tm) * tm->profile.jitterUs);
+    case H265BS_JITTER_NORMAL:
+        /* Irwin-Hall, twelve uniforms are close enough to N(0, 1) */
+        for (i = 0; i < 12; i++) {
+            u += h265bs_tmodel_rand(tm);
+        }
+        return (int64_t)(fabs(u - 6.0) * tm->profile.jitterUs);
+    case H265BS_JITTER_EXP:
+        return (int64_t)(-log(1.0 - h265bs_tmodel_rand(tm)) * tm->profile.jitterUs);
+    default:
+        return 0;
+    }
+}
+
+const h265bs_tmodel_profile_t *h265bs_tmodel_soc_profile(c_soc_type_t socType)
+{
+    return (socType < C_SOC_MAX) ? &h265bs_tmodel_profiles[socType] : NULL;
+}
+
+c_soc_type_t h265bs_tmodel_soc_type(const char *name)
+{
+    int i = 0;
+
+    for (i = 0; i < C_SOC_MAX; i++) {
+        if (!strcmp(name, h265bs_tmodel_profiles[i].name)) {
+            return i;
+        }
+    }
+    return C_SOC_MAX;
+}
+
+/****************************************************************************
+ * timer wheel
+ ****************************************************************************/
+static void h265bs_tmodel_unlink(h265bs_tmodel_t *tm, h265bs_timer_t *timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = timer->next = NULL;
+    timer->bPending = 0;
+    tm->pendingCnt--;
+}
+
+static void h265bs_tmodel_fire(h265bs_tmodel_t *tm, h265bs_timer_t *timer)
+{
+    tm->stat.firedCnt++;
+    timer->fn(timer->arg);
+}
+
+/* Run every timer due by nowTick, a stalled thread sees each slot once */
+static void h265bs_tmodel_advance(h265bs_tmodel_t *tm, int64_t nowTick)
+{
+    h265bs_timer_t *head = NULL, *timer = NULL, *next = NULL;
+    int64_t n = C_MIN(nowTick - tm->curTick, H265BS_TMODEL_WHEEL_SLOTS);
+    int64_t i = 0;
+
+    for (i = 1; i <= n; i++) {
+        head = &tm->slot[(tm->curTick + i) & H265BS_TMODEL_SLOT_MASK];
+        for (timer = head->next; timer != head; timer = next) {
+            next = timer->next;
+            if (timer->expire / H265BS_TMODEL_TICK_US <= nowTick) {
+                h265bs_tmodel_unlink(tm, timer);
+                h265bs_tmodel_fire(tm, timer);
+            }
+        }
+    }
+    tm->curTick = C_MAX(tm->curTick, nowTick);
+}
+
+/* start of the first tick with a timer, a timer a turn ahead wakes us early */
+static int64_t h265bs_tmodel_next_wake(h265bs_tmodel_t *tm)
+{
+    h265bs_timer_t *head = NULL;
+    int64_t i = 0;
+
+    if (tm->pendingCnt == 0) {
+        return INT64_MAX;
+    }
+    for (i = 1; i <= H265BS_TMODEL_WHEEL_SLOTS; i++) {
+        head = &tm->slot[(tm->curTick + i) & H265BS_TMODEL_SLOT_MASK];
+        if (head->next != head) {
+            break;
+        }
+    }
+    return (tm->curTick + i) * H265BS_TMODEL_TICK_US;
+}
+
+static void *h265bs_tmodel_thread(void *arg)
+{
+    h265bs_tmodel_t *tm = arg;
+    struct timespec ts;
+
+    h265bs_trace_thread_name("tmodel");
+    pthread_mutex_lock(&tm->mutex);
+    while (!tm->bStop) {
+        h265bs_tmodel_advance(tm, h265bs_mdate() / H265BS_TMODEL_TICK_US);
+        tm->nextWake = h265bs_tmodel_next_wake(tm);
+        if (tm->nextWake == INT64_MAX) {
+            pthread_cond_wait(&tm->cond, &tm->mutex);
+        } else {
+            ts.tv_sec = tm->nextWake / 1000000;
+            ts.tv_nsec = (tm->nextWake % 1000000) * 1000;
+            pthread_cond_timedwait(&tm->cond, &tm->mutex, &ts);
+        }
+        tm->stat.wakeupCnt++;
+    }
+    pthread_mutex_unlock(&tm->mutex);
+
+    return NULL;
+}
+
+void h265bs_tmodel_add_timer(h265bs_tmodel_t *tm, h265bs_timer_t *timer)
+{
+    h265bs_timer_t *head = NULL;
+    int64_t tick = timer->expire / H265BS_TMODEL_TICK_US;
+
+    pthread_mutex_lock(&tm->mutex);
+    if (tick <= tm->curTick) {
+        h265bs_tmodel_fire(tm, timer);
+        pthread_mutex_unlock(&tm->mutex);
+        return;
+    }
+
+    head = &tm->slot[tick & H265BS_TMODEL_SLOT_MASK];
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+    timer->bPending = 1;
+    tm->pendingCnt++;
+    if (timer->expire < tm->nextWake) {
+        pthread_cond_signal(&tm->cond);
+    }
+    pthread_mutex_unlock(&tm->mutex);
+}
+
+int h265bs_tmodel_del_timer(h265bs_tmodel_t *tm, h265bs_timer_t *timer)
+{
+    int bPending = 0;
+
+    pthread_mutex_lock(&tm->mutex);
+    bPending = timer->bPending;
+    if (bPending) {
+        h265bs_tmodel_unlink(tm, timer);
+    }
+    pthread_mutex_unlock(&tm->mutex);
+
+    return bPending;
+}
+
+/****************************************************************************
+ * public interface
+ ****************************************************************************/
+h265bs_tmodel_t *h265bs_tmodel_init(const h265bs_tmodel_profile_t *profile, uint64_t seed)
+{
+    int i = 0, errnum = 0;
+    pthread_condattr_t attr;
+    h265bs_tmodel_t *tm = calloc(1, sizeof(h265bs_tmodel_t));
+    if (tm == NULL) {
+        printf("h265bs_tmodel:calloc h265bs_tmodel_t failed\n");
+        goto err_calloc_tm;
+    }
+
+    tm->profile = *profile;
+    tm->profile.coreNum = C_MIN(C_MAX(tm->profile.coreNum, 1), H265BS_TMODEL_CORE_MAX);
+    tm->rs = seed ? seed : 1;
+    for (i = 0; i < H265BS_TMODEL_WHEEL_SLOTS; i++) {
+        tm->slot[i].prev = tm->slot[i].next = &tm->slot[i];
+    }
+    tm->curTick = h265bs_mdate() / H265BS_TMODEL_TICK_US;
+    tm->nextWake = INT64_MAX;
+
+    /* the wheel sleeps on the same clock as the timers */
+    pthread_mutex_init(&tm->mutex, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&tm->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    if ((errnum = pthread_create(&tm->tid, NULL, h265bs_tmodel_thread, tm)) != 0) {
+        printf("h265bs_tmodel:pthread_create failed:%s\n", strerror(errnum));
+        goto err_pthread_create;
+    }
+
+    return tm;
+
+err_pthread_create:
+    pthread_cond_destroy(&tm->cond);
+    pthread_mutex_destroy(&tm->mutex);
+    free(tm);
+err_calloc_tm:
+    return NULL;
+}
+
+/* every channel is detached and its timers deleted by now */
+void h265bs_tmodel_deinit(h265bs_tmodel_t *tm)
+{
+    if (tm) {
+        pthread_mutex_lock(&tm->mutex);
+        tm->bStop = 1;
+        pthread_cond_signal(&tm->cond);
+        pthread_mutex_unlock(&tm->mutex);
+        pthread_join(tm->tid, NULL);
+        pthread_cond_destroy(&tm->cond);
+        pthread_mutex_destroy(&tm->mutex);
+        free(tm);
+    }
+}
+
+int h265bs_tmodel_attach(h265bs_tmodel_t *tm)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&tm->mutex);
+    if (tm->channels >= tm->profile.maxChannels) {
+        printf("h265bs_tmodel:%s takes %d channels at most\n", tm->profile.name, tm->profile.maxChannels);
+        ret = -1;
+    } else {
+        tm->channels++;
+    }
+    pthread_mutex_unlock(&tm->mutex);
+
+    return ret;
+}
+
+void h265bs_tmodel_detach(h265bs_tmodel_t *tm)
+{
+    pthread_mutex_lock(&tm->mutex);
+    tm->channels--;
+    pthread_mutex_unlock(&tm->mutex);
+}
+
+int64_t h265bs_tmodel_done_time(h265bs_tmodel_t *tm, int64_t arrival, int size, int bIrap)
+{
+    int64_t start = 0, service = 0, done = 0;
+    int i = 0, core = 0;
+
+    pthread_mutex_lock(&tm->mutex);
+    for (i = 1; i < tm->profile.coreNum; i++) {
+        if (tm->coreFree[i] < tm->coreFree[core]) {
+            core = i;
+        }
+    }
+    start = C_MAX(arrival, tm->coreFree[core]);
+    service = (int64_t)size * tm->profile.byteCostNs / 1000 + (bIrap ? tm->profile.idrPenaltyUs : 0);
+    tm->coreFree[core] = start + service;
+    done = start + service + tm->profile.latencyUs + h265bs_tmodel_jitter(tm);
+    tm->stat.auCnt++;
+    tm->stat.busyUs += service;
+    pthread_mutex_unlock(&tm->mutex);
+
+    return done;
+}
+
+void h265bs_tmodel_get_stat(h265bs_tmodel_t *tm, h265bs_tmodel_stat_t *stat)
+{
+    pthread_mutex_lock(&tm->mutex);
+    *stat = tm->stat;
+    stat->channels = tm->channels;
+    pthread_mutex_unlock(&tm->mutex);
+}
+
+void h265bs_tmodel_dump_stat(h265bs_tmodel_t *tm)
+{
+    h265bs_tmodel_stat_t stat;
+
+    h265bs_tmodel_get_stat(tm, &stat);
+    printf("h265bs_tmodel:%s, channels=%d, auCnt=%llu, firedCnt=%llu, wakeupCnt=%llu, busyUs=%lld\n",
+            tm->profile.name, stat.channels, (unsigned long long)stat.auCnt, (unsigned long long)stat.firedCnt,
+            (unsigned long long)stat.wakeupCnt, (long long)stat.busyUs);
+}
@@ -0,0 +1,81 @@
+#ifndef __H265BS_TMODEL_H__
+#define __H265BS_TMODEL_H__
+
+#include <stdint.h>
+
+#include "i265e.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define H265BS_TMODEL_TICK_US       100
+#define H265BS_TMODEL_WHEEL_SLOTS   1024    /* power of 2, one turn is about 100ms */
+#define H265BS_TMODEL_CORE_MAX      8
+
+typedef enum {
+    H265BS_JITTER_NONE      = 0,
+    H265BS_JITTER_UNIFORM   = 1,    /* [0, jitterUs) */
+    H265BS_JITTER_NORMAL    = 2,    /* |N(0, jitterUs)| */
+    H265BS_JITTER_EXP       = 3,    /* exponential, mean jitterUs */
+} h265bs_jitter_t;
+
+/* Timing of one hardware encoder: an access unit holds a core for its
+ * bytes and the IDR penalty, then shows up after the pipeline latency */
+typedef struct {
+    const char      *name;
+    int64_t         latencyUs;      /* fixed pipeline latency */
+    int             byteCostNs;     /* core time per output byte */
+    int64_t         idrPenaltyUs;   /* extra core time of an IRAP */
+    h265bs_jitter_t jitterType;
+    int64_t         jitterUs;
+    int             coreNum;        /* access units encoded at the same time */
+    int             maxChannels;    /* streams the soc accepts */
+} h265bs_tmodel_profile_t;
+
+typedef struct h265bs_timer {
+    int64_t expire;                 /* i265e_extern_bs_mdate() time */
+    void (*fn)(void *arg);          /* runs on the wheel thread */
+    void *arg;
+    struct h265bs_timer *prev;
+    struct h265bs_timer *next;
+    int bPending;
+} h265bs_timer_t;
+
+typedef struct {
+    uint64_t auCnt;
+    uint64_t firedCnt;
+    uint64_t wakeupCnt;             /* wheel thread wakeups */
+    int64_t busyUs;                 /* core time handed out */
+    int channels;
+} h265bs_tmodel_stat_t;
+
+typedef struct h265bs_tmodel h265bs_tmodel_t;
+
+/* Built in profiles, rough numbers to be replaced by measurements */
+extern const h265bs_tmodel_profile_t *h265bs_tmodel_soc_profile(c_soc_type_t socType);
+/* "m200", "t10", "t20" or "t30", C_SOC_MAX for anything else */
+extern c_soc_type_t h265bs_tmodel_soc_type(const char *name);
+
+/* One model per emulated soc, shared by all its channels */
+extern h265bs_tmodel_t *h265bs_tmodel_init(const h265bs_tmodel_profile_t *profile, uint64_t seed);
+extern void h265bs_tmodel_deinit(h265bs_tmodel_t *tm);
+/* -1 once maxChannels are attached */
+extern int h265bs_tmodel_attach(h265bs_tmodel_t *tm);
+extern void h265bs_tmodel_detach(h265bs_tmodel_t *tm);
+/* when an access unit captured at arrival is out of the encoder */
+extern int64_t h265bs_tmodel_done_time(h265bs_tmodel_t *tm, int64_t arrival, int size, int bIrap);
+
+/* timer wheel, fn runs with the wheel locked so del_timer waits for it */
+extern void h265bs_tmodel_add_timer(h265bs_tmodel_t *tm, h265bs_timer_t *timer);
+/* 1 when the timer was still pending */
+extern int h265bs_tmodel_del_timer(h265bs_tmodel_t *tm, h265bs_timer_t *timer);
+
+extern void h265bs_tmodel_get_stat(h265bs_tmodel_t *tm, h265bs_tmodel_stat_t *stat);
+extern void h265bs_tmodel_dump_stat(h265bs_tmodel_t *tm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __H265BS_TMODEL_H__ */
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "i265e.h"
+#include "h265bs_trace.h"
+
+typedef struct {
+    int64_t ns;
+    const char *name;
+    int64_t au;
+    int32_t chn;
+    char ph;
+} h265bs_trace_ev_t;
+
+/* Written by its thread only. cnt is published with release after the event,
+ * so a dump running meanwhile reads whole events */
+typedef struct h265bs_trace_buf {
+    struct h265bs_trace_buf *next;
+    const char *name;
+    int tid;
+    int cnt;
+    int dropCnt;
+    h265bs_trace_ev_t ev[];
+} h265bs_trace_buf_t;
+
+int h265bs_trace_on;
+
+static int h265bs_trace_event_num;
+static int64_t h265bs_trace_start;
+static h265bs_trace_buf_t *h265bs_trace_list;     /* pushed with a cas, freed at deinit */
+static int h265bs_trace_tid_next;
+static int h265bs_trace_chn_next;
+/* a buffer belongs to one init, a thread whose buffer is of an older one
+ * makes a new one instead of touching freed memory */
+static unsigned int h265bs_trace_gen;
+
+static __thread h265bs_trace_buf_t *h265bs_trace_buf;
+static __thread unsigned int h265bs_trace_buf_gen;
+static __thread const char *h265bs_trace_name;
+
+static int64_t h265bs_trace_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int h265bs_trace_init(int eventNum)
+{
+    if (h265bs_trace_on) {
+        printf("h265bs_trace:already on\n");
+        return -1;
+    }
+    h265bs_trace_event_num = eventNum > 0 ? eventNum : H265BS_TRACE_EVENT_NUM;
+    h265bs_trace_start = h265bs_trace_ns();
+    __atomic_add_fetch(&h265bs_trace_gen, 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&h265bs_trace_on, 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+void h265bs_trace_deinit(void)
+{
+    h265bs_trace_buf_t *buf = NULL, *next = NULL;
+
+    __atomic_store_n(&h265bs_trace_on, 0, __ATOMIC_RELEASE);
+    buf = __atomic_exchange_n(&h265bs_trace_list, NULL, __ATOMIC_ACQ_REL);
+    for (; buf; buf = next) {
+        next = buf->next;
+        free(buf);
+    }
+    __atomic_add_fetch(&h265bs_trace_gen, 1, __ATOMIC_RELEASE);
+    h265bs_trace_buf = NULL;
+}
+
+int h265bs_trace_channel(void)
+{
+    return __atomic_fetch_add(&h265bs_trace_chn_next, 1, __ATOMIC_RELAXED);
+}
+
+void h265bs_trace_thread_name(const char *name)
+{
+    h265bs_trace_name = name;
+    if (h265bs_trace_buf && h265bs_trace_buf_gen == __atomic_load_n(&h265bs_trace_gen, __ATOMIC_ACQUIRE)) {
+        h265bs_trace_buf->name = name;
+    }
+}
+
+/* First event of a thread under this init */
+static h265bs_trace_buf_t *h265bs_trace_buf_new(void)
+{
+    h265bs_trace_buf_t *buf = NULL;
+    unsigned int gen = __atomic_load_n(&h265bs_trace_gen, __ATOMIC_ACQUIRE);
+
+    buf = malloc(sizeof(h265bs_trace_buf_t) + h265bs_trace_event_num * sizeof(h265bs_trace_ev_t));
+    if (buf == NULL) {
+        return NULL;
+    }
+    buf->name = h265bs_trace_name;
+    buf->tid = __atomic_add_fetch(&h265bs_trace_tid_next, 1, __ATOMIC_RELAXED);
+    buf->cnt = 0;
+    buf->dropCnt = 0;
+    buf->next = __atomic_load_n(&h265bs_trace_list, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&h265bs_trace_list, &buf->next, buf, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    h265bs_trace_buf = buf;
+    h265bs_trace_buf_gen = gen;
+    return buf;
+}
+
+void h265bs_trace_event(char ph, const char *name, int chn, int64_t au)
+{
+    h265bs_trace_buf_t *buf = h265bs_trace_buf;
+    h265bs_trace_ev_t *ev = NULL;
+
+    if (buf == NULL || h265bs_trace_buf_gen != __atomic_load_n(&h265bs_trace_gen, __ATOMIC_ACQUIRE)) {
+        buf = h265bs_trace_buf_new();
+        if (buf == NULL) {
+            return;
+        }
+    }
+    if (buf->cnt == h265bs_trace_event_num) {
+        buf->dropCnt++;
+        return;
+    }
+
+    ev = &buf->ev[buf->cnt];
+    ev->ns = h265bs_trace_ns();
+    ev->name = name;
+    ev->au = au;
+    ev->chn = chn;
+    ev->ph = ph;
+    __atomic_store_n(&buf->cnt, buf->cnt + 1, __ATOMIC_RELEASE);
+}
+
+int h265bs_trace_dump(const char *fname)
+{
+    FILE *fp = NULL;
+    h265bs_trace_buf_t *buf = NULL;
+    h265bs_trace_ev_t *ev = NULL;
+    int64_t evCnt = 0, dropCnt = 0;
+    int i = 0, k = 0, cnt = 0, bufCnt = 0, chnMax = -1, namedCnt = 0;
+    int named[64];
+    const char *sep = "";
+
+    fp = fopen(fname, "w");
+    if (fp == NULL) {
+        printf("h265bs_trace:open %s failed:%s\n", fname, strerror(errno));
+        return -1;
+    }
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (buf = __atomic_load_n(&h265bs_trace_list, __ATOMIC_ACQUIRE); buf; buf = buf->next) {
+        cnt = __atomic_load_n(&buf->cnt, __ATOMIC_ACQUIRE);
+        namedCnt = 0;
+        for (i = 0; i < cnt; i++) {
+            ev = &buf->ev[i];
+            /* a thread may show under several channels, it is named in each */
+            for (k = 0; k < namedCnt && named[k] != ev->chn; k++);
+            if (k == namedCnt && namedCnt < (int)(sizeof(named) / sizeof(named[0]))) {
+                named[namedCnt++] = ev->chn;
+                fprintf(fp, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s-%d\"}}",
+                        sep, ev->chn, buf->tid, buf->name ? buf->name : "thread", buf->tid);
+                sep = ",";
+            }
+            fprintf(fp, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d", sep, ev->name, ev->ph,
+                    (ev->ns - h265bs_trace_start) / 1000.0, ev->chn, buf->tid);
+            if (ev->ph == 'i') {
+                fprintf(fp, ",\"s\":\"t\"");
+            }
+            if (ev->au >= 0) {
+                fprintf(fp, ",\"args\":{\"au\":%lld}", (long long)ev->au);
+            }
+            fprintf(fp, "}");
+            sep = ",";
+            chnMax = C_MAX(chnMax, ev->chn);
+        }
+        evCnt += cnt;
+        dropCnt += buf->dropCnt;
+        bufCnt++;
+    }
+    for (i = 0; i <= chnMax; i++) {
+        fprintf(fp, "%s\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"channel %d\"}}", sep, i, i);
+        sep = ",";
+    }
+    fprintf(fp, "\n]}\n");
+    if (fclose(fp) != 0) {
+        printf("h265bs_trace:write %s failed:%s\n", fname, strerror(errno));
+        return -1;
+    }
+
+    printf("h265bs_trace:%lld events of %d threads to %s, %lld dropped\n", (long long)evCnt, bufCnt, fname, (long long)dropCnt);
+    return 0;
+}
@@ -0,0 +1,53 @@
+#ifndef __H265BS_TRACE_H__
+#define __H265BS_TRACE_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define H265BS_TRACE_EVENT_NUM      (1 << 16)   /* default events per thread */
+
+/* Timestamped events of the replay pipeline, dumped in the Chrome trace event
+ * format for chrome://tracing or ui.perfetto.dev. Every thread appends to a
+ * buffer of its own without locks, a full buffer drops further events. While
+ * tracing is off a trace point costs one load and a not taken branch, built
+ * with H265BS_TRACE_DISABLE it costs nothing */
+
+extern int h265bs_trace_on;
+
+#ifdef H265BS_TRACE_DISABLE
+#define H265BS_TRACE(ph, name, chn, au)     do { } while (0)
+#else
+#define H265BS_TRACE(ph, name, chn, au) do { \
+    if (__builtin_expect(h265bs_trace_on, 0)) { \
+        h265bs_trace_event(ph, name, chn, au); \
+    } \
+} while (0)
+#endif
+
+/* name is kept, not copied: a string literal. chn shows as the process of the
+ * event, au is left out when negative. An end closes the last open begin of
+ * the same thread */
+#define H265BS_TRACE_BEGIN(name, chn, au)   H265BS_TRACE('B', name, chn, au)
+#define H265BS_TRACE_END(name, chn, au)     H265BS_TRACE('E', name, chn, au)
+#define H265BS_TRACE_INSTANT(name, chn, au) H265BS_TRACE('i', name, chn, au)
+
+/* Turns tracing on with eventNum events per thread, 0 for the default */
+extern int h265bs_trace_init(int eventNum);
+/* Off, and every buffer freed. No thread may be inside a trace point */
+extern void h265bs_trace_deinit(void);
+/* Channel number of the next replay engine, from 0 on */
+extern int h265bs_trace_channel(void);
+/* Name of the calling thread in the dump, kept like the event names */
+extern void h265bs_trace_thread_name(const char *name);
+extern void h265bs_trace_event(char ph, const char *name, int chn, int64_t au);
+/* The events so far as one json file, the threads may still be running */
+extern int h265bs_trace_dump(const char *fname);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __H265BS_TRACE_H__ */
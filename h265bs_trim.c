@@ -0,0 +1,355 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+
+#include "h265bs_clock.h"
+#include "h265bs_nal.h"
+#include "h265bs_ps.h"
+#include "h265bs_mem.h"
+#include "h265bs_trim.h"
+
+/* read ahead of the scan, and bytes handed to one copy call */
+#define H265BS_TRIM_CHUNK       (4 * 1024 * 1024)
+#define H265BS_TRIM_COPY_MAX    (1024 * 1024 * 1024)
+
+/* latest parameter set of each id, size 0 when there was none */
+typedef struct {
+    int64_t off;
+    int size;
+} h265bs_trim_ps_t;
+
+typedef struct {
+    h265bs_trim_ps_t vps[H265BS_PS_VPS_MAX];
+    h265bs_trim_ps_t sps[H265BS_PS_SPS_MAX];
+    h265bs_trim_ps_t pps[H265BS_PS_PPS_MAX];
+} h265bs_trim_ps_set_t;
+
+int h265bs_trim_parse_frame(const char *str, int fpsNum, int fpsDen, int64_t *frame)
+{
+    char *end = NULL;
+    double v = strtod(str, &end);
+
+    if (end == str || v < 0) {
+        return -1;
+    }
+    if (*end == '\0') {
+        *frame = (int64_t)v;
+        return 0;
+    }
+    if (strcmp(end, "s") != 0) {
+        return -1;
+    }
+    if (fpsNum <= 0 || fpsDen <= 0) {
+        printf("h265bs_trim:a time in seconds needs the frame rate\n");
+        return -1;
+    }
+    *frame = (int64_t)(v * fpsNum / fpsDen + 0.5);
+    return 0;
+}
+
+static void h265bs_trim_ps_add(h265bs_trim_ps_set_t *set, const uint8_t *base, int64_t off, int size)
+{
+    h265bs_ps_ids_t ids;
+    h265bs_trim_ps_t *ps = NULL;
+
+    if (h265bs_ps_parse_ids(base + off, size, &ids) < 0) {
+        return;
+    }
+    switch (ids.type) {
+    case I265E_NAL_VPS:
+        ps = (ids.id < H265BS_PS_VPS_MAX) ? &set->vps[ids.id] : NULL;
+        break;
+    case I265E_NAL_SPS:
+        ps = (ids.id < H265BS_PS_SPS_MAX) ? &set->sps[ids.id] : NULL;
+        break;
+    case I265E_NAL_PPS:
+        ps = (ids.id < H265BS_PS_PPS_MAX) ? &set->pps[ids.id] : NULL;
+        break;
+    }
+    if (ps) {
+        ps->off = off;
+        ps->size = size;
+    }
+}
+
+static int h265bs_trim_write(int fd, const uint8_t *buf, int64_t size)
+{
+    int64_t off = 0;
+    ssize_t n = 0;
+
+    while (off < size) {
+        n = write(fd, buf + off, C_MIN(size - off, H265BS_TRIM_COPY_MAX));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            return -1;
+        }
+        off += n;
+    }
+    return 0;
+}
+
+/* The parameter sets in front of keyOff, the ones the IRAP access unit
+ * sends again are newer and left out */
+static int h265bs_trim_put_ps(int fd, const uint8_t *base, h265bs_trim_ps_set_t *set, int64_t keyOff)
+{
+    h265bs_trim_ps_t *all[] = {set->vps, set->sps, set->pps};
+    int cnt[] = {H265BS_PS_VPS_MAX, H265BS_PS_SPS_MAX, H265BS_PS_PPS_MAX};
+    int i = 0, j = 0, size = 0;
+
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < cnt[i]; j++) {
+            if (all[i][j].size > 0 && all[i][j].off < keyOff) {
+                if (h265bs_trim_write(fd, base + all[i][j].off, all[i][j].size) < 0) {
+                    return -1;
+                }
+                size += all[i][j].size;
+            }
+        }
+    }
+    return size;
+}
+
+/* copy_file_range shares the blocks where the file system can, sendfile
+ * still stays in the kernel, write from the mapping is the last resort */
+static int h265bs_trim_copy(int inFd, int outFd, const uint8_t *base, int64_t off, int64_t size, const char **name)
+{
+    int64_t end = off + size;
+    loff_t inOff = off;
+    off_t sfOff = 0;
+    ssize_t n = 0;
+
+    *name = "copy_file_range";
+    while (inOff < end) {
+        n = copy_file_range(inFd, &inOff, outFd, NULL, C_MIN(end - inOff, H265BS_TRIM_COPY_MAX), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            break;
+        }
+    }
+    if (inOff == end) {
+        return 0;
+    }
+
+    *name = "sendfile";
+    sfOff = inOff;
+    while (sfOff < end) {
+        n = sendfile(outFd, inFd, &sfOff, C_MIN(end - sfOff, H265BS_TRIM_COPY_MAX));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            break;
+        }
+    }
+    if (sfOff == end) {
+        return 0;
+    }
+
+    *name = "write";
+    return h265bs_trim_write(outFd, base + sfOff, end - sfOff);
+}
+
+/* Every parameter set of the nals in [off, off + size) goes into set */
+static void h265bs_trim_ps_scan(h265bs_trim_ps_set_t *set, uint8_t *base, int64_t off, int64_t size)
+{
+    h265bs_nal_iter_t it;
+    uint32_t type = 0;
+
+    h265bs_nal_iter_init(&it, base + off, base + off + size);
+    while (h265bs_nal_iter_next(&it)) {
+        type = H265BS_NAL_TYPE(it.hdr);
+        if (type >= I265E_NAL_VPS && type <= I265E_NAL_PPS) {
+            h265bs_trim_ps_add(set, base, it.start - base, it.nalEnd - it.start);
+        }
+    }
+}
+
+/* The range from the keyframe index, no split at all. Only the access units
+ * up to the key which carry parameter sets are read */
+static int h265bs_trim_index_range(const char *inName, const h265bs_trim_cfg_t *cfg, uint8_t *base, int64_t fileSize,
+        h265bs_trim_ps_set_t *keySet, h265bs_trim_stat_t *stat, int64_t *keyOff, int64_t *endOff)
+{
+    h265bs_index_t *idx = cfg->index;
+    int64_t start = h265bs_mdate();
+    int k = 0, i = 0;
+
+    if (idx->fileSize != fileSize) {
+        printf("h265bs_trim:index of %lld bytes, %s has %lld\n", (long long)idx->fileSize, inName, (long long)fileSize);
+        return -1;
+    }
+    if (cfg->startFrame >= idx->auCnt) {
+        printf("h265bs_trim:%s has %d frames, %lld asked for\n", inName, idx->auCnt, (long long)cfg->startFrame);
+        return -1;
+    }
+    k = h265bs_index_key_before(idx, (int)cfg->startFrame);
+    if (k < 0) {
+        printf("h265bs_trim:no IRAP at or before frame %lld\n", (long long)cfg->startFrame);
+        return -1;
+    }
+    stat->keyFrame = idx->key[k];
+    *keyOff = idx->au[stat->keyFrame].off;
+    if (cfg->endFrame < 0 || cfg->endFrame >= idx->auCnt) {
+        *endOff = fileSize;
+        stat->frameCnt = idx->auCnt - stat->keyFrame;
+    } else {
+        *endOff = idx->au[cfg->endFrame].off;
+        stat->frameCnt = cfg->endFrame - stat->keyFrame;
+    }
+    /* the key access unit too, what it sends again replaces the older ones */
+    for (i = 0; i <= stat->keyFrame; i++) {
+        if (idx->au[i].flags & H265BS_AU_F_PARAM) {
+            h265bs_trim_ps_scan(keySet, base, idx->au[i].off, idx->au[i].size);
+            stat->scanBytes += idx->au[i].size;
+        }
+    }
+    stat->scanUs = h265bs_mdate() - start;
+    return 0;
+}
+
+/* The range by splitting access units like the scanner does from offset 0
+ * up to the end of the range */
+static int h265bs_trim_scan_range(const char *inName, const h265bs_trim_cfg_t *cfg, int inFd, uint8_t *base, int64_t fileSize,
+        h265bs_trim_ps_set_t *set, h265bs_trim_ps_set_t *keySet, h265bs_trim_stat_t *stat, int64_t *keyOff, int64_t *endOff)
+{
+    h265bs_mem_window_t window;
+    h265bs_nal_iter_t it;
+    int64_t nalOff = 0, auOff = 0, auIdx = -1, start = 0;
+    uint32_t type = 0;
+    int bAuVcl = 0, bFirst = 0, bEof = 1;
+
+    madvise(base, fileSize, MADV_SEQUENTIAL);
+    start = h265bs_mdate();
+    h265bs_mem_window_init(&window, 2 * H265BS_TRIM_CHUNK, H265BS_TRIM_CHUNK, fileSize);
+    h265bs_nal_iter_init(&it, base, base + fileSize);
+    while (h265bs_nal_iter_next(&it)) {
+        nalOff = it.start - base;
+        /* the copy reads from the key on, what lies in front can go */
+        h265bs_mem_window_advise(&window, inFd, base, 0, fileSize, nalOff, *keyOff < 0 ? nalOff : *keyOff);
+
+        type = H265BS_NAL_TYPE(it.hdr);
+        bFirst = h265bs_nal_iter_first_slice(&it);
+        if (auIdx < 0 || h265bs_nal_au_boundary(type, bFirst, bAuVcl)) {
+            auIdx++;
+            auOff = nalOff;
+            bAuVcl = 0;
+            if (auIdx > cfg->startFrame && (cfg->endFrame < 0 || auIdx == cfg->endFrame)) {
+                *endOff = cfg->endFrame < 0 ? fileSize : auOff;
+                bEof = 0;
+                break;
+            }
+        }
+        if (type >= I265E_NAL_VPS && type <= I265E_NAL_PPS) {
+            h265bs_trim_ps_add(set, base, nalOff, it.nalEnd - it.start);
+        }
+        if (h265bs_nal_is_vcl(type)) {
+            bAuVcl = 1;
+            if (bFirst && h265bs_nal_is_irap(type) && auIdx <= cfg->startFrame) {
+                stat->keyFrame = auIdx;
+                *keyOff = auOff;
+                *keySet = *set;
+            }
+        }
+    }
+    stat->scanBytes = bEof ? fileSize : it.sc - base;
+    stat->scanUs = h265bs_mdate() - start;
+    if (*endOff < 0 && auIdx >= cfg->startFrame) {
+        /* the range runs past the last frame */
+        *endOff = fileSize;
+        auIdx++;
+    }
+    if (*endOff < 0) {
+        printf("h265bs_trim:%s has %lld frames, %lld asked for\n", inName, (long long)auIdx + 1, (long long)cfg->startFrame);
+        return -1;
+    }
+    if (*keyOff < 0) {
+        printf("h265bs_trim:no IRAP at or before frame %lld\n", (long long)cfg->startFrame);
+        return -1;
+    }
+    /* an open end stops the scan behind startFrame, the rest is not counted */
+    stat->frameCnt = (bEof || cfg->endFrame >= 0) ? auIdx - stat->keyFrame : -1;
+    return 0;
+}
+
+int h265bs_trim(const char *inName, const char *outName, const h265bs_trim_cfg_t *cfg, h265bs_trim_stat_t *stat)
+{
+    struct stat stat_buf;
+    h265bs_trim_ps_set_t *set = NULL, *keySet = NULL;
+    uint8_t *base = MAP_FAILED;
+    int64_t keyOff = -1, endOff = -1, start = 0;
+    int inFd = -1, outFd = -1, ret = -1;
+
+    memset(stat, 0, sizeof(*stat));
+    stat->keyFrame = -1;
+    if (cfg->startFrame < 0 || (cfg->endFrame >= 0 && cfg->endFrame <= cfg->startFrame)) {
+        printf("h265bs_trim:empty range %lld to %lld\n", (long long)cfg->startFrame, (long long)cfg->endFrame);
+        goto err_range;
+    }
+    set = calloc(2, sizeof(h265bs_trim_ps_set_t));
+    if (set == NULL) {
+        printf("h265bs_trim:calloc parameter sets failed\n");
+        goto err_calloc_set;
+    }
+    keySet = set + 1;
+
+    inFd = open(inName, O_RDONLY);
+    if (inFd < 0 || fstat(inFd, &stat_buf) < 0) {
+        printf("h265bs_trim:open %s failed:%s\n", inName, strerror(errno));
+        goto err_open_in;
+    }
+    if (stat_buf.st_size == 0) {
+        printf("h265bs_trim:%s is empty\n", inName);
+        goto err_mmap;
+    }
+    base = mmap(NULL, stat_buf.st_size, PROT_READ, MAP_SHARED, inFd, 0);
+    if (base == MAP_FAILED) {
+        printf("h265bs_trim:mmap %s failed:%s\n", inName, strerror(errno));
+        goto err_mmap;
+    }
+
+    if (cfg->index) {
+        if (h265bs_trim_index_range(inName, cfg, base, stat_buf.st_size, keySet, stat, &keyOff, &endOff) < 0) {
+            goto err_range_scan;
+        }
+    } else if (h265bs_trim_scan_range(inName, cfg, inFd, base, stat_buf.st_size, set, keySet, stat, &keyOff, &endOff) < 0) {
+        goto err_range_scan;
+    }
+    stat->srcOff = keyOff;
+    stat->srcSize = endOff - keyOff;
+
+    outFd = open(outName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (outFd < 0) {
+        printf("h265bs_trim:open %s failed:%s\n", outName, strerror(errno));
+        goto err_open_out;
+    }
+    start = h265bs_mdate();
+    stat->psSize = h265bs_trim_put_ps(outFd, base, keySet, keyOff);
+    if (stat->psSize < 0 || h265bs_trim_copy(inFd, outFd, base, keyOff, endOff - keyOff, &stat->copyName) < 0) {
+        printf("h265bs_trim:write %s failed:%s\n", outName, strerror(errno));
+        goto err_copy;
+    }
+    stat->copyUs = h265bs_mdate() - start;
+    ret = 0;
+
+err_copy:
+    close(outFd);
+err_open_out:
+err_range_scan:
+    munmap(base, stat_buf.st_size);
+err_mmap:
+err_open_in:
+    if (inFd >= 0) close(inFd);
+    free(set);
+err_calloc_set:
+err_range:
+    return ret;
+}
@@ -0,0 +1,46 @@
+#ifndef __H265BS_TRIM_H__
+#define __H265BS_TRIM_H__
+
+#include <stdint.h>
+
+#include "h265bs_index.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Frames are access units counted from the start of the file */
+typedef struct {
+    int64_t startFrame;     /* first frame wanted, the cut starts at the IRAP at or before it */
+    int64_t endFrame;       /* first frame not wanted, -1 for the end of the file */
+    h265bs_index_t *index;  /* keyframe index of the input, NULL to scan for the range */
+} h265bs_trim_cfg_t;
+
+typedef struct {
+    int64_t keyFrame;       /* IRAP the output starts at */
+    int64_t frameCnt;       /* -1 when the end of the file was not scanned for */
+    int64_t srcOff;         /* byte range of the input copied */
+    int64_t srcSize;
+    int psSize;             /* parameter set bytes put in front of the IRAP */
+    int64_t scanBytes;      /* input looked at to find the range */
+    int64_t scanUs;
+    int64_t copyUs;
+    const char *copyName;   /* copy_file_range, sendfile or write */
+} h265bs_trim_stat_t;
+
+/* "N" is a frame and "Ns" a time in seconds at fpsNum/fpsDen, 0 when the
+ * value is understood */
+extern int h265bs_trim_parse_frame(const char *str, int fpsNum, int fpsDen, int64_t *frame);
+/* Copy frames [startFrame, endFrame) of inName to outName without decoding.
+ * Without an index the input is split from offset 0 up to the end of the
+ * range, with one the range comes from au[] and key[] and only the access
+ * units flagged with parameter sets up to the IRAP are read. The
+ * bytes go file to file. Parameter sets the IRAP refers to but does not
+ * carry are taken from in front of it. 0 on success */
+extern int h265bs_trim(const char *inName, const char *outName, const h265bs_trim_cfg_t *cfg, h265bs_trim_stat_t *stat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __H265BS_TRIM_H__ */
@@ -0,0 +1,2108 @@
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "i265e.h"
+#include "h265bs_clock.h"
+#include "h265bs_pool.h"
+#include "h265bs_mem.h"
+#include "h265bs_ingest.h"
+#include "h265bs_nal.h"
+#include "h265bs_index.h"
+#include "h265bs_ps.h"
+#include "h265bs_hash.h"
+#include "h265bs_cbr.h"
+#include "h265bs_trace.h"
+#include "h265bs_slice.h"
+#include "i265e_extern_bs.h"
+
+/* a 4 byte start code, the nal header and the first slice payload byte */
+#define I265E_EXT_SCAN_MIN          7
+
+/* last access unit of one slice type under the super frame threshold */
+typedef struct {
+    uint8_t *buf;
+    int size;
+    i265e_nal_t *nal;
+    int nalCnt;
+    int nalCap;
+    int vclCnt;
+} i265e_extern_superfrm_cache_t;
+
+/* one encode of the ladder, the playing one is bsFd and index */
+typedef struct {
+    int kbps;
+    int fd;
+    h265bs_index_t *index;
+} i265e_extern_rendition_t;
+
+/* source swap, a new file is indexed in the background and waits for an IRAP */
+typedef enum {
+    I265E_EXT_SWAP_IDLE     = 0,
+    I265E_EXT_SWAP_PREPARE  = 1,    /* swapTid opens and indexes swapName */
+    I265E_EXT_SWAP_READY    = 2,    /* taken at the next IRAP of the old file */
+} i265e_extern_swap_state_t;
+
+/* an access unit held back by the timing model until the emulated encoder
+ * is done with it, au is NULL for an end of stream without one */
+typedef struct {
+    h265bs_timer_t timer;
+    i265e_extern_bs_t *h;
+    i265e_extern_au_t *au;
+    int bEos;
+} i265e_extern_au_timer_t;
+
+struct i265e_extern_bs {
+    i265e_param_t param;
+    i265e_extern_bs_cfg_t cfg;
+
+    int bsBufSize;
+    uint8_t *bsBuf;
+    int bsFd;
+    int64_t bsFileSize;
+    h265bs_ingest_t *ingest;
+    uint8_t *startPtr;
+    uint8_t *endPtr;
+    int bsBufOccupy;
+    uint32_t nalType;       /* type of the nal opened at startPtr */
+    int bAuOversize;        /* the access unit scanned outgrew bsBufSize, the rest of it is skipped */
+    uint64_t oversizeCnt;
+    int bLoop;              /* rewind at end of file */
+    int bInputEof;          /* non-seekable input is exhausted */
+    int bEos;               /* last access unit produced */
+    int64_t frameNum;       /* source frame of the next streamed access unit */
+
+    /* keyframe table and trick play, trickPos is a frame of the file. index
+     * is the enc thread's, a swap or switch replaces it, bIndexed is fixed at
+     * init and all set_param may look at */
+    h265bs_index_t *index;
+    int bIndexed;
+    int trickSpeed;
+    int trickReq;           /* speed asked by set_param, taken by the enc thread */
+    int64_t trickPos;
+    int trickAu;            /* access unit emitted last in trick play */
+
+    /* playlist, the next file is opened and prefetched while this one plays */
+    int playIdx;
+    int nextFd;
+    h265bs_ps_t *ps;
+    uint8_t *spliceBuf;
+    int bSplicePending;     /* the access unit in progress is the last of a file */
+    int bSplice;            /* drop access units up to the first IRAP of the new file */
+    int bSkipRasl;          /* the splice landed on a CRA, its RASL pictures are gone */
+    uint64_t spliceCnt;
+    uint64_t spliceDropCnt;
+
+    /* nal buffers, auNum slots share the pool blocks */
+    h265bs_pool_t *pool;
+    uint8_t *userNalBuf;
+    i265e_extern_au_t *au;
+    int auNum;
+    i265e_extern_au_t **freeAu;
+    int freeAuCnt;
+    i265e_extern_au_t **readyAu;
+    int readyAuIdx;
+    int readyAuCnt;
+
+    /* timing model, auNum + 1 timers, the last one for an empty end of stream */
+    i265e_extern_au_timer_t *auTimer;
+    int64_t tmStart;        /* capture time of the first access unit with outFps */
+    int64_t tmFrame;
+    int64_t tmLastDone;     /* done times never go back, delivery keeps its order */
+
+    /* rc.rateControlMode I265E_RC_CBR, access units padded to rc.bitrate */
+    h265bs_cbr_t *cbr;
+
+    /* super frame policy, superReq is written by set_param and taken by
+     * the enc thread with the next access unit, a cache per I, P and B.
+     * superBits and superAuCnt are what passed the policy, the budget of
+     * I265E_EXT_SUPERFRM_PRIO_BITRATE */
+    c_superfrm_param_t superFrm;
+    c_superfrm_param_t superReq;
+    i265e_extern_superfrm_cache_t superCache[3];
+    int64_t superBits;
+    int64_t superAuCnt;
+    uint64_t superCnt;
+    uint64_t superDropCnt;
+    uint64_t superKeepCnt;  /* IRAPs DISCARD delivered flagged instead */
+    uint64_t superBudgetCnt;    /* over the threshold but inside the bitrate budget, passed */
+    uint64_t superSubstCnt;
+    uint64_t superMissCnt;  /* REENCODE with nothing cached yet, delivered flagged */
+
+    /* rendition ladder, rendReq is written by set_param and taken at the
+     * first IDR the enc thread reaches */
+    i265e_extern_rendition_t *rend;
+    int rendIdx;
+    int rendReq;
+    uint64_t rendSwitchCnt;
+
+    /* forced IDR, the next frame is an IDR of the file through the index or
+     * of the all intra companion, which plays up to the next IDR of the file */
+    int idrReq;
+    int intraFd;
+    h265bs_index_t *intraIndex;
+    int intraUntil;         /* IDR of the file it goes back at, -1 while the file plays */
+    int bIntraFirst;        /* the next companion frame gets its parameter sets in front */
+    int64_t ptsOffset;      /* keeps pts going on across a jump */
+    uint64_t idrReqCnt;
+    uint64_t idrJumpCnt;
+    uint64_t intraAuCnt;
+
+    /* source swap, the swap* fields are under enc_start_mutex until the enc
+     * thread takes them, srcName is the file playing */
+    char *srcName;
+    pthread_t swapTid;
+    int bSwapThread;        /* swapTid is still to be joined */
+    int swapState;          /* i265e_extern_swap_state_t */
+    char *swapName;
+    int swapFd;
+    h265bs_index_t *swapIndex;
+    h265bs_index_t *retiredIndex;   /* of the old file, freed once no access unit in flight points into it */
+    int bSwapIrap;          /* the next access unit scanned is the first of the new file */
+    uint64_t swapCnt;
+    uint64_t swapFailCnt;
+    uint64_t swapDropCnt;   /* RASL pictures of a CRA the new file started at */
+
+    /* control, bPause and seekReq are written by set_param */
+    int bPause;
+    int seekReq;            /* frame to go on at, -1 for none */
+    uint64_t seekCnt;
+    uint64_t auCnt;         /* access units produced */
+    int64_t lastPts;
+    i265e_extern_stat_t stat;   /* enc thread counters for get_param, under enc_start_mutex */
+
+    int traceChn;           /* pid of the trace events */
+
+    /* slice headers of a stream without index, an index keeps its own */
+    h265bs_slice_t *slice;
+
+    /* sync context */
+    pthread_cond_t enc_start_cond;
+    pthread_mutex_t enc_start_mutex;
+    pthread_cond_t enc_end_cond;
+    pthread_mutex_t enc_end_mutex;
+    int bStop;
+    int bEosReady;          /* no access unit will follow the ready ones */
+};
+
+int64_t i265e_extern_bs_mdate(void)
+{
+    return h265bs_mdate();
+}
+
+static int i265e_extern_bs_au_release(void *privData, void *releaseData);
+static int i265e_extern_bs_nal_reserve(i265e_nal_t **nal, int *cap, int cnt);
+static int i265e_extern_bs_seek_au(i265e_extern_bs_t *h, int auIdx);
+static void i265e_extern_bs_au_ready(void *arg);
+static int i265e_extern_bs_au_irap(i265e_extern_au_t *au);
+static void i265e_extern_bs_next_frame(i265e_extern_bs_t *h);
+
+/* Open the playlist entry after the current one, its first reads are
+ * handed to the page cache now so the splice does not wait for the disk */
+static int i265e_extern_bs_open_next(i265e_extern_bs_t *h)
+{
+    char *name = h->cfg.playlist[(h->playIdx + 1) % h->cfg.playlistCnt];
+
+    h->nextFd = open(name, O_RDONLY);
+    if (h->nextFd < 0) {
+        printf("i265ext:open %s failed:%s, the stream ends with this file\n", name, strerror(errno));
+        return -1;
+    }
+    posix_fadvise(h->nextFd, 0, h->bsBufSize + (off_t)h->cfg.ingestReadSize * h->cfg.ingestDepth, POSIX_FADV_WILLNEED);
+
+    return 0;
+}
+
+static int i265e_extern_bs_next_file(i265e_extern_bs_t *h)
+{
+    if (h->nextFd < 0) {
+        return -1;
+    }
+    h265bs_ingest_set_fd(h->ingest, h->nextFd);
+    close(h->bsFd);
+    h->bsFd = h->nextFd;
+    h->nextFd = -1;
+    h->playIdx = (h->playIdx + 1) % h->cfg.playlistCnt;
+    h->bSplicePending = 1;
+    h->spliceCnt++;
+    i265e_extern_bs_open_next(h);
+
+    return 0;
+}
+
+static int i265e_extern_bs_rend_closest(i265e_extern_bs_cfg_t *cfg, int kbps)
+{
+    int i = 0, best = 0;
+
+    for (i = 1; i < cfg->renditionCnt; i++) {
+        if (abs(cfg->renditionKbps[i] - kbps) < abs(cfg->renditionKbps[best] - kbps)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+/* Index every rendition and keep it open, they have to share the access
+ * unit count and the IDR positions so any IDR is a switch point */
+static int i265e_extern_bs_rend_init(i265e_extern_bs_t *h)
+{
+    i265e_extern_rendition_t *r = NULL;
+    h265bs_index_t *ref = NULL;
+    int i = 0, j = 0;
+
+    h->rend = calloc(h->cfg.renditionCnt, sizeof(i265e_extern_rendition_t));
+    if (h->rend == NULL) {
+        printf("i265ext:calloc h->rend failed\n");
+        return -1;
+    }
+    for (i = 0; i < h->cfg.renditionCnt; i++) {
+        h->rend[i].kbps = h->cfg.renditionKbps[i];
+        h->rend[i].fd = -1;
+    }
+
+    h->rend[h->rendIdx].fd = h->bsFd;
+    h->index = h->rend[h->rendIdx].index = h265bs_index_build(h->bsFd, h->cfg.hashType, h->bsBufSize);
+    if (h->index == NULL) {
+        printf("i265ext:index %s failed\n", h->cfg.rendition[h->rendIdx]);
+        return -1;
+    }
+    ref = h->index;
+    for (i = 0; i < h->cfg.renditionCnt; i++) {
+        r = &h->rend[i];
+        if (i == h->rendIdx) {
+            continue;
+        }
+        r->fd = open(h->cfg.rendition[i], O_RDONLY);
+        if (r->fd < 0) {
+            printf("i265ext:open %s failed:%s\n", h->cfg.rendition[i], strerror(errno));
+            return -1;
+        }
+        r->index = h265bs_index_build(r->fd, h->cfg.hashType, h->bsBufSize);
+        if (r->index == NULL) {
+            printf("i265ext:index %s failed\n", h->cfg.rendition[i]);
+            return -1;
+        }
+        if (r->index->auCnt != ref->auCnt) {
+            printf("i265ext:%s has %d access units, %d expected\n",
+                    h->cfg.rendition[i], r->index->auCnt, ref->auCnt);
+            return -1;
+        }
+        for (j = 0; j < ref->auCnt; j++) {
+            if ((r->index->au[j].flags ^ ref->au[j].flags) & H265BS_AU_F_IDR) {
+                printf("i265ext:%s is not aligned, IDR differs at access unit %d\n", h->cfg.rendition[i], j);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* the playing rendition is left to bsFd and index */
+static void i265e_extern_bs_rend_free(i265e_extern_bs_t *h)
+{
+    int i = 0;
+
+    if (h->rend) {
+        for (i = 0; i < h->cfg.renditionCnt; i++) {
+            if (i != h->rendIdx) {
+                h265bs_index_free(h->rend[i].index);
+                if (h->rend[i].fd >= 0) close(h->rend[i].fd);
+            }
+        }
+        free(h->rend);
+        h->rend = NULL;
+    }
+}
+
+/* Enc thread only, between two access units. The next frame is found in
+ * the index of the target, the scanner restarts there once it is an IDR */
+static void i265e_extern_bs_rend_switch(i265e_extern_bs_t *h, int to)
+{
+    i265e_extern_rendition_t *r = &h->rend[to];
+
+    if (!(r->index->au[h->frameNum].flags & H265BS_AU_F_IDR)) {
+        return;
+    }
+    if (h265bs_ingest_set_fd(h->ingest, r->fd) < 0) {
+        printf("i265ext:switch to %s failed\n", h->cfg.rendition[to]);
+        return;
+    }
+    h->bsFd = r->fd;
+    h->index = r->index;
+    pthread_mutex_lock(&h->enc_start_mutex);
+    h->rendIdx = to;
+    pthread_mutex_unlock(&h->enc_start_mutex);
+    i265e_extern_bs_seek_au(h, h->frameNum);
+    h->rendSwitchCnt++;
+}
+
+/* Every access unit of the companion is an IDR and frame n of it shows
+ * frame n of the file, a CRA would leave its leading pictures without
+ * references when the file goes on behind it */
+static int i265e_extern_bs_intra_init(i265e_extern_bs_t *h)
+{
+    int i = 0;
+
+    if (!h->bLoop || h->ps) {
+        printf("i265ext:an all intra companion needs one seekable file\n");
+        return -1;
+    }
+    h->intraFd = open(h->cfg.intraName, O_RDONLY);
+    if (h->intraFd < 0) {
+        printf("i265ext:open %s failed:%s\n", h->cfg.intraName, strerror(errno));
+        return -1;
+    }
+    h->intraIndex = h265bs_index_build(h->intraFd, h->cfg.hashType, h->bsBufSize);
+    if (h->intraIndex == NULL) {
+        printf("i265ext:index %s failed\n", h->cfg.intraName);
+        return -1;
+    }
+    for (i = 0; i < h->intraIndex->auCnt; i++) {
+        if (!(h->intraIndex->au[i].flags & H265BS_AU_F_IDR)) {
+            printf("i265ext:%s access unit %d of %d is not an IDR\n", h->cfg.intraName, i, h->intraIndex->auCnt);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Swap thread, the new file is opened and indexed while the old one plays */
+static void *i265e_extern_bs_swap_thread(void *arg)
+{
+    i265e_extern_bs_t *h = arg;
+    h265bs_index_t *idx = NULL;
+    int fd = -1;
+
+    h265bs_trace_thread_name("swap");
+    fd = open(h->swapName, O_RDONLY);
+    if (fd < 0) {
+        printf("i265ext:open %s failed:%s, no swap\n", h->swapName, strerror(errno));
+    } else if ((idx = h265bs_index_build(fd, h->cfg.hashType, h->bsBufSize)) == NULL || idx->keyCnt == 0) {
+        printf("i265ext:%s has no IRAP to start at, no swap\n", h->swapName);
+        h265bs_index_free(idx);
+        close(fd);
+        fd = -1;
+    }
+
+    pthread_mutex_lock(&h->enc_start_mutex);
+    if (fd < 0) {
+        free(h->swapName);
+        h->swapName = NULL;
+        h->swapFailCnt++;
+        h->swapState = I265E_EXT_SWAP_IDLE;
+    } else {
+        h->swapFd = fd;
+        h->swapIndex = idx;
+        h->swapState = I265E_EXT_SWAP_READY;
+    }
+    pthread_mutex_unlock(&h->enc_start_mutex);
+
+    return NULL;
+}
+
+i265e_extern_bs_t *i265e_extern_bs_init(i265e_param_t *param, i265e_extern_bs_cfg_t *cfg, char *bsname, uint8_t *nal_buf)
+{
+    int i = 0;
+    struct stat stat_buf;
+    h265bs_ingest_cfg_t ingestCfg;
+    i265e_extern_bs_t *h = calloc(1, sizeof(i265e_extern_bs_t));
+    if (h == NULL) {
+        printf("i265ext:calloc i265e_extern_bs_t failed\n");
+        goto err_calloc_i265e_extern_bs_t;
+    }
+
+    h->param = *param;
+    h->cfg = *cfg;
+    h->nextFd = -1;
+    h->intraFd = -1;
+    h->intraUntil = -1;
+    h->swapFd = -1;
+    h->seekReq = -1;
+    h->lastPts = h->stat.lastPts = -1;
+    h->traceChn = h265bs_trace_channel();
+    if (h->cfg.playlistCnt > 0 && h->cfg.renditionCnt > 0) {
+        printf("i265ext:a playlist can not be a rendition ladder\n");
+        goto err_malloc_bsBuf;
+    }
+    if (h->cfg.playlistCnt > 0) {
+        bsname = h->cfg.playlist[0];
+    }
+    if (h->cfg.renditionCnt > 0) {
+        h->rendIdx = h->rendReq = i265e_extern_bs_rend_closest(&h->cfg, h->param.rc.bitrate);
+        bsname = h->cfg.rendition[h->rendIdx];
+    }
+    h->srcName = strdup(bsname);
+    if (h->srcName == NULL) {
+        printf("i265ext:strdup %s failed\n", bsname);
+        goto err_malloc_bsBuf;
+    }
+    h->bsBufSize = cfg->bsBufSize;
+    h->bsBuf = h265bs_mem_alloc(h->bsBufSize, C_VB_ALIGN, h->cfg.memFlags, h->cfg.numaNode);
+    if (h->bsBuf == NULL) {
+        printf("i265ext:alloc bsBuf failed\n");
+        goto err_malloc_bsBuf;
+    }
+
+    /* "-" replays stdin, like a fifo it is played once instead of looped */
+    h->bLoop = strcmp(bsname, "-") != 0;
+    h->bsFd = h->bLoop ? open(bsname, O_RDONLY) : dup(STDIN_FILENO);
+    if (h->bsFd < 0) {
+        printf("i265ext:open %s failed:%s\n", bsname, strerror(errno));
+        goto err_open_bsname;
+    }
+
+    if (fstat(h->bsFd, &stat_buf) < 0) {
+        printf("i265ext:fstat %s failed:%s\n", bsname, strerror(errno));
+        goto err_fstat_bsFd;
+    }
+
+    h->bsFileSize = stat_buf.st_size;
+
+    ingestCfg.mode = h->cfg.ingestMode;
+    ingestCfg.queueDepth = h->cfg.ingestDepth;
+    ingestCfg.readSize = h->cfg.ingestReadSize;
+    ingestCfg.memFlags = h->cfg.memFlags;
+    ingestCfg.numaNode = h->cfg.numaNode;
+    ingestCfg.windowSize = h->cfg.ingestWindowSize;
+    h->ingest = h265bs_ingest_init(h->bsFd, &ingestCfg);
+    if (h->ingest == NULL) {
+        printf("i265ext:h265bs_ingest_init failed\n");
+        goto err_ingest_init;
+    }
+    h->startPtr = NULL;
+    h->endPtr = h->bsBuf;
+    h->bsBufOccupy = 0;
+
+    /* a playlist loops as a whole, the parameter sets of its files are
+     * renumbered where they collide */
+    if (h->cfg.playlistCnt > 0) {
+        h->ps = h265bs_ps_init(h->bsBufSize);
+        h->spliceBuf = malloc(h->bsBufSize);
+        if (h->ps == NULL || h->spliceBuf == NULL) {
+            printf("i265ext:alloc splice context failed\n");
+            goto err_splice_init;
+        }
+        i265e_extern_bs_open_next(h);
+        h->cfg.bIndex = 0;
+    }
+
+    /* every rendition is indexed, a switch only looks its frame up */
+    if (h->cfg.renditionCnt > 0) {
+        if (!h->bLoop || i265e_extern_bs_rend_init(h) < 0) {
+            printf("i265ext:rendition ladder init failed\n");
+            goto err_rend_init;
+        }
+        h->cfg.bIndex = 0;
+    }
+
+    /* the companion is only reached through the index of both */
+    if (h->cfg.intraName) {
+        if (i265e_extern_bs_intra_init(h) < 0) {
+            goto err_intra_init;
+        }
+        h->cfg.bIndex = h->rend == NULL;
+    }
+
+    /* the table needs a file it can scan now and pread later */
+    if (h->cfg.bIndex) {
+        h->index = h->bLoop ? h265bs_index_build(h->bsFd, h->cfg.hashType, h->bsBufSize) : NULL;
+        if (h->index == NULL) {
+            printf("i265ext:no access unit index for %s, trick play disabled\n", bsname);
+        }
+    }
+    if (h->intraIndex && (h->index == NULL || h->index->auCnt != h->intraIndex->auCnt)) {
+        printf("i265ext:%s is not aligned with %s\n", h->cfg.intraName, bsname);
+        goto err_user_nal_buf;
+    }
+    h->bIndexed = h->index != NULL;
+    h->trickSpeed = h->trickReq = 1;
+    h->superFrm = h->superReq = h->param.superFrm;
+
+    /* the user nal buffer can only carry one access unit at a time */
+    if (h->param.bUserNalbuf) {
+        if (nal_buf == NULL) {
+            printf("i265ext:bUserNalbuf set without nal_buf\n");
+            goto err_user_nal_buf;
+        }
+        h->userNalBuf = nal_buf;
+        h->auNum = 1;
+    } else {
+        /* without user hooks the pool follows the same placement as bsBuf */
+        h->pool = h265bs_pool_init(h->bsBufSize, h->cfg.nalBufNum, h->param.ckMalloc, h->param.ckFree,
+                h->cfg.memFlags, h->cfg.numaNode);
+        if (h->pool == NULL) {
+            printf("i265ext:h265bs_pool_init failed\n");
+            goto err_pool_init;
+        }
+        h->auNum = h->cfg.nalBufNum;
+    }
+
+    h->au = calloc(h->auNum, sizeof(i265e_extern_au_t));
+    h->freeAu = calloc(h->auNum, sizeof(i265e_extern_au_t *));
+    h->readyAu = calloc(h->auNum, sizeof(i265e_extern_au_t *));
+    if (h->au == NULL || h->freeAu == NULL || h->readyAu == NULL) {
+        printf("i265ext:calloc h->au failed:%s\n", strerror(errno));
+        goto err_calloc_au;
+    }
+    for (i = 0; i < h->auNum; i++) {
+        if (i265e_extern_bs_nal_reserve(&h->au[i].nal, &h->au[i].nalCap, I265E_EXT_NAL_CAP) < 0) {
+            goto err_calloc_au;
+        }
+        h->au[i].h = h;
+        h->au[i].pic.releaseFunc = i265e_extern_bs_au_release;
+        h->au[i].pic.privData = h;
+        h->au[i].pic.releaseData = &h->au[i];
+        h->freeAu[i] = &h->au[i];
+    }
+    h->freeAuCnt = h->auNum;
+    h->readyAuIdx = 0;
+    h->readyAuCnt = 0;
+
+    if (h->param.rc.rateControlMode == I265E_RC_CBR && h->param.rc.bitrate > 0) {
+        h->cbr = h265bs_cbr_init(&h->param, h->auNum);
+        if (h->cbr == NULL) {
+            printf("i265ext:h265bs_cbr_init failed\n");
+            goto err_cbr_init;
+        }
+    }
+
+    h->slice = h265bs_slice_init();
+    if (h->slice == NULL) {
+        goto err_slice_init;
+    }
+
+    if (h->cfg.tmodel) {
+        if (h265bs_tmodel_attach(h->cfg.tmodel) < 0) {
+            goto err_tmodel_attach;
+        }
+        h->auTimer = calloc(h->auNum + 1, sizeof(i265e_extern_au_timer_t));
+        if (h->auTimer == NULL) {
+            printf("i265ext:calloc h->auTimer failed:%s\n", strerror(errno));
+            goto err_calloc_auTimer;
+        }
+        for (i = 0; i <= h->auNum; i++) {
+            h->auTimer[i].timer.fn = i265e_extern_bs_au_ready;
+            h->auTimer[i].timer.arg = &h->auTimer[i];
+            h->auTimer[i].h = h;
+        }
+    }
+
+    /* sync context */
+    h->bStop = 0;
+    pthread_mutex_init(&h->enc_start_mutex, NULL);
+    pthread_cond_init(&h->enc_start_cond, NULL);
+    pthread_mutex_init(&h->enc_end_mutex, NULL);
+    pthread_cond_init(&h->enc_end_cond, NULL);
+
+    return h;
+
+err_calloc_auTimer:
+    h265bs_tmodel_detach(h->cfg.tmodel);
+err_tmodel_attach:
+    h265bs_slice_deinit(h->slice);
+err_slice_init:
+    h265bs_cbr_deinit(h->cbr);
+err_cbr_init:
+err_calloc_au:
+    for (i = 0; h->au && i < h->auNum; i++) {
+        free(h->au[i].nal);
+    }
+    free(h->readyAu);
+    free(h->freeAu);
+    free(h->au);
+    h265bs_pool_deinit(h->pool);
+err_pool_init:
+err_user_nal_buf:
+err_intra_init:
+    h265bs_index_free(h->intraIndex);
+    if (h->intraFd >= 0) close(h->intraFd);
+err_rend_init:
+    i265e_extern_bs_rend_free(h);
+    h265bs_index_free(h->index);
+    if (h->nextFd >= 0) close(h->nextFd);
+err_splice_init:
+    free(h->spliceBuf);
+    h265bs_ps_deinit(h->ps);
+    h265bs_ingest_deinit(h->ingest);
+err_ingest_init:
+err_fstat_bsFd:
+    close(h->bsFd);
+err_open_bsname:
+    h265bs_mem_free(h->bsBuf);
+err_malloc_bsBuf:
+    free(h->srcName);
+    free(h);
+err_calloc_i265e_extern_bs_t:
+    return NULL;
+}
+
+void i265e_extern_bs_deinit(i265e_extern_bs_t *h)
+{
+    int i = 0;
+
+    if (h) {
+        /* the ones still inside the emulated encoder, a timer firing now
+         * has queued its access unit once del_timer returns */
+        if (h->auTimer) {
+            for (i = 0; i < h->auNum; i++) {
+                if (h265bs_tmodel_del_timer(h->cfg.tmodel, &h->auTimer[i].timer)) {
+                    h->auTimer[i].au->pic.releaseFunc(h->auTimer[i].au->pic.privData, h->auTimer[i].au->pic.releaseData);
+                }
+            }
+            h265bs_tmodel_del_timer(h->cfg.tmodel, &h->auTimer[h->auNum].timer);
+            free(h->auTimer);
+            h265bs_tmodel_detach(h->cfg.tmodel);
+        }
+        /* access units produced but never fetched go back to the pool */
+        while (h->readyAuCnt > 0) {
+            i265e_extern_au_t *au = h->readyAu[h->readyAuIdx];
+            h->readyAuIdx = (h->readyAuIdx + 1) % h->auNum;
+            h->readyAuCnt--;
+            au->pic.releaseFunc(au->pic.privData, au->pic.releaseData);
+        }
+        pthread_mutex_destroy(&h->enc_start_mutex);
+        pthread_cond_destroy(&h->enc_start_cond);
+        pthread_mutex_destroy(&h->enc_end_mutex);
+        pthread_cond_destroy(&h->enc_end_cond);
+        for (i = 0; i < h->auNum; i++) {
+            free(h->au[i].nal);
+        }
+        free(h->readyAu);
+        free(h->freeAu);
+        free(h->au);
+        h265bs_cbr_deinit(h->cbr);
+        h265bs_slice_deinit(h->slice);
+        for (i = 0; i < 3; i++) {
+            free(h->superCache[i].buf);
+            free(h->superCache[i].nal);
+        }
+        if (h->pool) h265bs_pool_deinit(h->pool);
+        i265e_extern_bs_rend_free(h);
+        h265bs_index_free(h->index);
+        h265bs_index_free(h->intraIndex);
+        if (h->intraFd >= 0) close(h->intraFd);
+        if (h->bSwapThread) pthread_join(h->swapTid, NULL);
+        if (h->swapFd >= 0) close(h->swapFd);
+        h265bs_index_free(h->swapIndex);
+        h265bs_index_free(h->retiredIndex);
+        free(h->swapName);
+        free(h->srcName);
+        h265bs_ps_deinit(h->ps);
+        free(h->spliceBuf);
+        if (h->nextFd >= 0) close(h->nextFd);
+        if (h->ingest) h265bs_ingest_deinit(h->ingest);
+        if (h->bsFd >= 0) close(h->bsFd);
+        if (h->bsBuf) h265bs_mem_free(h->bsBuf);
+        free(h);
+    }
+}
+
+void i265e_extern_dump_nal(i265e_extern_au_t *au)
+{
+	if (au) {
+		int i = 0;
+
+		printf("-----------%s(%d) start, au->nalCnt=%d --------\n", __func__, __LINE__, au->nalCnt);
+		for (i = 0; i < au->nalCnt; i++) {
+			printf("[%d], i_type=%d, p_payload=%p, i_payload=%d\n", i, au->nal[i].i_type, au->nal[i].p_payload, au->nal[i].i_payload);
+		}
+		printf("-----------%s(%d) end,  au->nalCnt=%d --------\n", __func__, __LINE__, au->nalCnt);
+	}
+}
+
+/* Make room behind the scanned data and read more of the input. Everything
+ * in front of the pending nal is already copied out, so it is dropped here
+ * instead of moving the buffer after every access unit */
+static int i265e_extern_bs_fill(i265e_extern_bs_t *h, i265e_extern_au_t *au)
+{
+    uint8_t *keepPtr = h->startPtr ? h->startPtr : h->endPtr;
+    uint8_t *dataEnd = h->endPtr + h->bsBufOccupy;
+    int readCnt = 0;
+
+    if (keepPtr == h->bsBuf && dataEnd == h->bsBuf + h->bsBufSize) {
+        /* the pending nal fills the whole bsBuf, its access unit goes */
+        if (h265bs_nal_is_vcl(h->nalType)) {
+            au->vclCnt++;
+        }
+        h->bAuOversize = 1;
+        h->startPtr = NULL;
+        keepPtr = h->endPtr;
+    }
+    if ((keepPtr != h->bsBuf) && (h->bsBuf + h->bsBufSize - dataEnd < h->bsBufSize / 4)) {
+        memmove(h->bsBuf, keepPtr, dataEnd - keepPtr);
+        if (h->startPtr) {
+            h->startPtr = h->bsBuf;
+        }
+        h->endPtr = h->bsBuf + (h->endPtr - keepPtr);
+        dataEnd = h->endPtr + h->bsBufOccupy;
+    }
+
+    while (1) {
+        H265BS_TRACE_BEGIN("read", h->traceChn, -1);
+        readCnt = h265bs_ingest_read(h->ingest, dataEnd, h->bsBuf + h->bsBufSize - dataEnd);
+        H265BS_TRACE_END("read", h->traceChn, -1);
+        if (readCnt < 0 && errno == EINTR) {
+            continue;
+        } else if (readCnt < 0) {
+            printf("readCnt=%d, errno=%d:%s\n", readCnt, errno, strerror(errno));
+            abort();
+        } else if (readCnt == 0) {	//To the EndOfFile
+            /* a file or playlist loops forever, a pipe or stdin ends the stream */
+            if (h->ps ? (i265e_extern_bs_next_file(h) == 0)
+                    : (h->bLoop && h265bs_ingest_rewind(h->ingest) == 0)) {
+                continue;
+            }
+            h->bInputEof = 1;
+            return 0;
+        } else { /* readCnt > 0*/
+            h->bsBufOccupy += readCnt;
+            return readCnt;
+        }
+    }
+}
+
+/* Room for cnt nals in *nal, the slots keep what they had */
+static int i265e_extern_bs_nal_reserve(i265e_nal_t **nal, int *cap, int cnt)
+{
+    i265e_nal_t *p = NULL;
+    int newCap = C_MAX(*cap, I265E_EXT_NAL_CAP);
+
+    if (cnt <= *cap) {
+        return 0;
+    }
+    while (newCap < cnt) {
+        newCap *= 2;
+    }
+    p = realloc(*nal, newCap * sizeof(i265e_nal_t));
+    if (p == NULL) {
+        printf("i265ext:realloc %d nals failed\n", newCap);
+        return -1;
+    }
+    *nal = p;
+    *cap = newCap;
+    return 0;
+}
+
+/* Close the pending nal at endPtr into the access unit. The access unit is
+ * only ended by the nal which starts the next one, like in h265bs_index, so
+ * one which outgrows bsBufSize is scanned to its end and dropped */
+static void i265e_extern_bs_nal_end(i265e_extern_bs_t *h, i265e_extern_au_t *au)
+{
+    int len = h->endPtr - h->startPtr;
+    i265e_nal_t *nal = NULL;
+
+    if (h265bs_nal_is_vcl(h->nalType)) {
+        au->vclCnt++;
+    }
+    if (!h->bAuOversize && (au->nalBufOccupy + len > h->bsBufSize
+            || i265e_extern_bs_nal_reserve(&au->nal, &au->nalCap, au->nalCnt + 1) < 0)) {
+        h->bAuOversize = 1;
+    }
+    if (!h->bAuOversize) {
+        nal = &au->nal[au->nalCnt++];
+        nal->i_type = h->nalType;
+        nal->p_payload = au->nalBuf + au->nalBufOccupy;
+        nal->i_payload = len;
+        memcpy(nal->p_payload, h->startPtr, len);
+        au->nalBufOccupy += len;
+    }
+    h->startPtr = NULL;
+}
+
+/* Copy one access unit into au. A nal is closed by the next start code, the
+ * access unit by the next nal which opens a new one (H.265 7.4.2.4.4): a
+ * parameter set, AUD or prefix SEI, or a slice with
+ * first_slice_segment_in_pic_flag set, once a slice has been seen */
+int i265e_extern_bs_slice_write(i265e_extern_bs_t *h, i265e_extern_au_t *au)
+{
+    uint8_t *dataEnd = NULL, *scPtr = NULL;
+    uint32_t type = 0;
+    int scLen = 0, bFirstSlice = 0;
+
+    au->nalBufOccupy = 0;
+    au->nalCnt = 0;
+    au->vclCnt = 0;
+    h->bAuOversize = 0;
+
+	while (1) {
+        /*fill the h->bsBufSize, keep enough to read a start code and the slice flag */
+        if ((h->bsBufOccupy < I265E_EXT_SCAN_MIN) && !h->bInputEof) {
+            i265e_extern_bs_fill(h, au);
+            continue;
+        }
+
+        dataEnd = h->endPtr + h->bsBufOccupy;
+        scPtr = h265bs_nal_find_start_code(h->endPtr, dataEnd);
+        if (scPtr && (scPtr > h->endPtr) && (scPtr[-1] == 0x00)) {
+            scPtr--;
+        }
+        if (scPtr == NULL || (dataEnd - scPtr < I265E_EXT_SCAN_MIN)) {
+            if (!h->bInputEof) {
+                /* a start code may straddle the end of the data */
+                if (scPtr) {
+                    h->endPtr = scPtr;
+                } else if (dataEnd - h->endPtr > 4) {
+                    h->endPtr = dataEnd - 4;
+                }
+                h->bsBufOccupy = dataEnd - h->endPtr;
+                i265e_extern_bs_fill(h, au);
+                continue;
+            }
+        }
+        if (scPtr && (dataEnd - scPtr < ((scPtr[2] == 0x00) ? 4 : 3) + 2)) {
+            scPtr = NULL;   /* start code without a nal header at the end of input */
+        }
+        if (scPtr == NULL) {
+
+            /* the tail bytes can not hold another start code, they end the last nal */
+            h->endPtr = dataEnd;
+            h->bsBufOccupy = 0;
+            if (h->startPtr) {
+                i265e_extern_bs_nal_end(h, au);
+            }
+            h->bEos = 1;
+            if (au->nalCnt > 0 && h->param.logLevel >= C_LOG_DEBUG) {
+                i265e_extern_dump_nal(au);
+            }
+            return (au->nalCnt > 0 || h->bAuOversize) ? 0 : -1;
+        }
+
+        h->bsBufOccupy = dataEnd - scPtr;
+        h->endPtr = scPtr;
+
+        if (h->startPtr) { /* end nal */
+            i265e_extern_bs_nal_end(h, au);
+        }
+
+        /* start nal */
+        scLen = (h->endPtr[2] == 0x01) ? 3 : 4;
+        type = H265BS_NAL_TYPE(h->endPtr + scLen);
+        bFirstSlice = (h->bsBufOccupy > scLen + 2) ? H265BS_NAL_FIRST_SLICE(h->endPtr + scLen) : 1;
+        if (h265bs_nal_au_boundary(type, bFirstSlice, au->vclCnt > 0)) {
+            break;
+        }
+        h->startPtr = h->endPtr;
+        h->nalType = type;
+        h->endPtr += scLen + 2;
+        h->bsBufOccupy -= scLen + 2;
+	}
+
+    if (h->param.logLevel >= C_LOG_DEBUG) {
+        i265e_extern_dump_nal(au);
+    }
+    return 0;
+}
+
+/* Restart the scanner at access unit auIdx of the file */
+static int i265e_extern_bs_seek_au(i265e_extern_bs_t *h, int auIdx)
+{
+    if (h265bs_ingest_seek(h->ingest, h->index->au[auIdx].off) < 0) {
+        printf("i265ext:seek to au %d failed:%s\n", auIdx, strerror(errno));
+        return -1;
+    }
+    h->startPtr = NULL;
+    h->endPtr = h->bsBuf;
+    h->bsBufOccupy = 0;
+    h->bInputEof = 0;
+    h->frameNum = auIdx;
+
+    return 0;
+}
+
+/* Enc thread only, between two access units */
+static void i265e_extern_bs_trick_switch(i265e_extern_bs_t *h, int speed)
+{
+    h265bs_index_t *idx = h->index;
+
+    if (h->trickSpeed == 1) {
+        /* start at the frame which would have been streamed next */
+        h->trickPos = h->frameNum;
+        h->trickAu = -1;
+    } else if (speed == 1 && h->trickAu >= 0) {
+        /* the keyframe emitted last is the reference, go on right behind it
+         * with pts where trick play left it */
+        i265e_extern_bs_seek_au(h, (h->trickAu + 1) % idx->auCnt);
+        h->ptsOffset = h->lastPts + 1 - h->frameNum;
+    }
+    h->trickSpeed = speed;
+}
+
+/* The parameter sets in force at auIdx of the file behind idx go to the
+ * front of au->nalBuf, the ones of the last access unit which carries them.
+ * Returns their size, 0 when auIdx sends its own, -1 on a read error */
+static int i265e_extern_bs_read_ps(i265e_extern_bs_t *h, int fd, h265bs_index_t *idx, int auIdx, i265e_extern_au_t *au)
+{
+    h265bs_index_au_t *ia = NULL;
+    uint8_t *p = NULL, *end = NULL, *sc = NULL;
+    uint32_t type = 0;
+    int k = 0, n = 0, off = 0, scLen = 0, size = 0;
+
+    if (idx->au[auIdx].flags & H265BS_AU_F_PARAM) {
+        return 0;
+    }
+    for (k = auIdx - 1; k >= 0 && !(idx->au[k].flags & H265BS_AU_F_PARAM); k--);
+    if (k < 0) {
+        return 0;
+    }
+
+    ia = &idx->au[k];
+    while (off < ia->size) {
+        n = pread(fd, au->nalBuf + off, ia->size - off, ia->off + off);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            printf("i265ext:pread au at %lld failed:%s\n", (long long)ia->off, n < 0 ? strerror(errno) : "end of file");
+            return -1;
+        }
+        off += n;
+    }
+
+    /* keep the parameter set nals, in place and in order */
+    end = au->nalBuf + ia->size;
+    for (p = au->nalBuf; p < end; p = sc) {
+        scLen = (p[2] == 0x01) ? 3 : 4;
+        sc = h265bs_nal_find_start_code(p + scLen, end);
+        if (sc == NULL) {
+            sc = end;
+        } else if (sc[-1] == 0x00) {
+            sc--;
+        }
+        type = H265BS_NAL_TYPE(p + scLen);
+        if (type >= I265E_NAL_VPS && type <= I265E_NAL_PPS) {
+            memmove(au->nalBuf + size, p, sc - p);
+            size += sc - p;
+        }
+    }
+    return size;
+}
+
+/* One access unit read straight from fd at the place the index gives, behind
+ * the prefix bytes already at the front of au->nalBuf */
+static int i265e_extern_bs_read_au(i265e_extern_bs_t *h, int fd, h265bs_index_au_t *ia, int prefix, i265e_extern_au_t *au)
+{
+    i265e_nal_t *nal = NULL;
+    uint8_t *p = NULL, *end = NULL, *sc = NULL;
+    int n = 0, off = 0, scLen = 0;
+
+    if (prefix + ia->size > h->bsBufSize) {
+        printf("i265ext:access unit at %lld with %d bytes of parameter sets is over bsBufSize=%d\n",
+                (long long)ia->off, prefix, h->bsBufSize);
+        h->bEos = 1;
+        return -1;
+    }
+    H265BS_TRACE_BEGIN("read", h->traceChn, -1);
+    while (off < ia->size) {
+        n = pread(fd, au->nalBuf + prefix + off, ia->size - off, ia->off + off);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            printf("i265ext:pread au at %lld failed:%s\n", (long long)ia->off, n < 0 ? strerror(errno) : "end of file");
+            H265BS_TRACE_END("read", h->traceChn, -1);
+            h->bEos = 1;
+            return -1;
+        }
+        off += n;
+    }
+    H265BS_TRACE_END("read", h->traceChn, -1);
+
+    /* split at the start codes, every nal keeps its own like in the scanner */
+    au->nalBufOccupy = prefix + ia->size;
+    au->nalCnt = 0;
+    au->vclCnt = 0;
+    end = au->nalBuf + au->nalBufOccupy;
+    for (p = au->nalBuf; p < end; p = sc) {
+        scLen = (p[2] == 0x01) ? 3 : 4;
+        sc = h265bs_nal_find_start_code(p + scLen, end);
+        if (sc == NULL) {
+            sc = end;
+        } else if (sc[-1] == 0x00) {
+            sc--;
+        }
+        if (i265e_extern_bs_nal_reserve(&au->nal, &au->nalCap, au->nalCnt + 1) < 0) {
+            h->bEos = 1;
+            return -1;
+        }
+        nal = &au->nal[au->nalCnt++];
+        nal->i_type = H265BS_NAL_TYPE(p + scLen);
+        nal->p_payload = p;
+        nal->i_payload = sc - p;
+        if (h265bs_nal_is_vcl(nal->i_type)) {
+            au->vclCnt++;
+        }
+    }
+
+    if (h->param.logLevel >= C_LOG_DEBUG) {
+        i265e_extern_dump_nal(au);
+    }
+    return 0;
+}
+
+/* One IRAP access unit read straight from the file, the keyframe table
+ * replaces scanning the frames in between. A keyframe is emitted again
+ * while the position has not reached the next one, so the output keeps
+ * speed frames of the source per access unit */
+static int i265e_extern_bs_trick_write(i265e_extern_bs_t *h, i265e_extern_au_t *au)
+{
+    h265bs_index_t *idx = h->index;
+    int k = 0;
+
+    if (h->trickAu >= 0) {
+        h->trickPos = ((h->trickPos + h->trickSpeed) % idx->auCnt + idx->auCnt) % idx->auCnt;
+    }
+    /* nothing in front of the first keyframe, wrap like the looped file does */
+    k = h265bs_index_key_before(idx, h->trickPos);
+    h->trickAu = idx->key[k >= 0 ? k : idx->keyCnt - 1];
+
+    return i265e_extern_bs_read_au(h, h->bsFd, &idx->au[h->trickAu], 0, au);
+}
+
+/* Position in key[] of the first IDR at or after key position k going by
+ * step, wrapping around the file, -1 when the file has none */
+static int i265e_extern_bs_idr_key(h265bs_index_t *idx, int k, int step)
+{
+    int i = 0;
+
+    for (i = 0; i < idx->keyCnt; i++, k += step) {
+        k = (k + idx->keyCnt) % idx->keyCnt;
+        if (idx->au[idx->key[k]].flags & H265BS_AU_F_IDR) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+/* Enc thread only, between two access units. With the companion its frame
+ * stands in from now to the next IDR of the file. Without, the scanner
+ * jumps to the closest IDR of the file and pts carries on where it was */
+static void i265e_extern_bs_force_idr(i265e_extern_bs_t *h)
+{
+    h265bs_index_t *idx = h->index;
+    int k = 0, back = 0, fwd = 0, dBack = 0, dFwd = 0, to = 0;
+
+    h->idrReqCnt++;
+    if (h->intraUntil >= 0 || (idx->au[h->frameNum].flags & H265BS_AU_F_IDR)) {
+        return;
+    }
+
+    k = h265bs_index_key_before(idx, h->frameNum);
+    back = i265e_extern_bs_idr_key(idx, k >= 0 ? k : idx->keyCnt - 1, -1);
+    fwd = i265e_extern_bs_idr_key(idx, k + 1, 1);
+    if (back < 0) {
+        return;
+    }
+    if (h->intraIndex) {
+        h->intraUntil = idx->key[fwd];
+        h->bIntraFirst = 1;
+        return;
+    }
+
+    dBack = (h->frameNum - idx->key[back] + idx->auCnt) % idx->auCnt;
+    dFwd = (idx->key[fwd] - h->frameNum + idx->auCnt) % idx->auCnt;
+    to = idx->key[dFwd <= dBack ? fwd : back];
+    h->ptsOffset += h->frameNum - to;
+    i265e_extern_bs_seek_au(h, to);
+    h->idrJumpCnt++;
+}
+
+static void i265e_extern_bs_cra_to_bla(i265e_nal_t *nal)
+{
+    int scLen = (nal->p_payload[2] == 0x01) ? 3 : 4;
+
+    nal->p_payload[scLen] = (nal->p_payload[scLen] & 0x81) | (I265E_NAL_CODED_SLICE_BLA_W_LP << 1);
+    nal->i_type = I265E_NAL_CODED_SLICE_BLA_W_LP;
+}
+
+/* Enc thread only, between two access units. Playback goes on at the
+ * keyframe at or before frame with pts carrying on, trick play moves its
+ * position there */
+static void i265e_extern_bs_seek(i265e_extern_bs_t *h, int frame)
+{
+    h265bs_index_t *idx = h->index;
+    int k = 0, to = 0;
+    int64_t from = h->frameNum;
+
+    frame %= idx->auCnt;
+    if (h->trickSpeed != 1) {
+        h->trickPos = frame;
+        h->seekCnt++;
+        return;
+    }
+    k = h265bs_index_key_before(idx, frame);
+    to = (k >= 0) ? idx->key[k] : 0;
+    if (i265e_extern_bs_seek_au(h, to) == 0) {
+        h->ptsOffset += from - to;
+        h->seekCnt++;
+    }
+}
+
+/* Playlist only, 1 drops the access unit. The first one of a new file has
+ * to be an IRAP. A CRA there turns into BLA_W_LP and its RASL pictures,
+ * which reference the previous file, are dropped. The parameter sets pass
+ * h265bs_ps, which may drop or rewrite them and the slices behind them */
+static int i265e_extern_bs_splice(i265e_extern_bs_t *h, i265e_extern_au_t *au)
+{
+    i265e_nal_t *nal = NULL;
+    uint32_t type = 0;
+    int i = 0, j = 0, ret = 0, len = 0, occupy = 0;
+    int bSpliceAu = 0, bRebuild = 0, bDrop = 0;
+
+    for (i = 0; i < au->nalCnt && !h265bs_nal_is_vcl(au->nal[i].i_type); i++);
+    type = (i < au->nalCnt) ? au->nal[i].i_type : I265E_NAL_INVALID;
+
+    if (h->bSplice) {
+        bDrop = !h265bs_nal_is_irap(type);
+        bSpliceAu = !bDrop;
+        h->bSplice = bDrop;
+        h->bSkipRasl = (type == I265E_NAL_CODED_SLICE_CRA);
+    } else if (h265bs_nal_is_irap(type)) {
+        h->bSkipRasl = 0;
+    } else if (h->bSkipRasl) {
+        bDrop = (type == I265E_NAL_CODED_SLICE_RASL_N) || (type == I265E_NAL_CODED_SLICE_RASL_R);
+    }
+    if (bDrop) {
+        h->spliceDropCnt++;
+        goto splice_next;
+    }
+
+    for (i = 0, j = 0; i < au->nalCnt; i++) {
+        nal = &au->nal[i];
+        if (bSpliceAu && nal->i_type == I265E_NAL_CODED_SLICE_CRA) {
+            i265e_extern_bs_cra_to_bla(nal);
+        }
+        ret = h265bs_ps_filter(h->ps, nal->p_payload, nal->i_payload, bSpliceAu,
+                h->spliceBuf + occupy, h->bsBufSize - occupy, &len);
+        if (ret < 0) {
+            printf("i265ext:splice rewrite of nal type %d failed, kept as it is\n", nal->i_type);
+            ret = 1;
+        }
+        if (ret != 1 && !bRebuild) {
+            /* the nals in front are unchanged, they move along */
+            memcpy(h->spliceBuf, au->nalBuf, occupy);
+            bRebuild = 1;
+        }
+        if (ret == 0) {
+            continue;
+        }
+        if (ret == 1) {
+            len = nal->i_payload;
+            if (bRebuild) {
+                memcpy(h->spliceBuf + occupy, nal->p_payload, len);
+            }
+        }
+        au->nal[j].i_type = nal->i_type;
+        au->nal[j].i_payload = len;
+        j++;
+        occupy += len;
+    }
+
+    if (bRebuild) {
+        memcpy(au->nalBuf, h->spliceBuf, occupy);
+        au->nalCnt = j;
+        au->nalBufOccupy = occupy;
+        for (i = 0, occupy = 0; i < au->nalCnt; i++) {
+            au->nal[i].p_payload = au->nalBuf + occupy;
+            occupy += au->nal[i].i_payload;
+        }
+    }
+
+splice_next:
+    /* the access unit in progress at the end of a file is still its own */
+    if (h->bSplicePending) {
+        h->bSplicePending = 0;
+        h->bSplice = 1;
+        h265bs_ps_new_source(h->ps);
+    }
+    return bDrop;
+}
+
+/* An index can go once no access unit out of the free slots points into it */
+static int i265e_extern_bs_index_busy(i265e_extern_bs_t *h, h265bs_index_t *idx)
+{
+    const h265bs_index_au_t *ia = NULL;
+    int i = 0, j = 0, bBusy = 0;
+
+    pthread_mutex_lock(&h->enc_start_mutex);
+    for (i = 0; i < h->auNum && !bBusy; i++) {
+        for (j = 0; j < h->freeAuCnt && h->freeAu[j] != &h->au[i]; j++);
+        ia = h->au[i].indexAu;
+        bBusy = j == h->freeAuCnt && ia >= idx->au && ia < idx->au + idx->auCnt;
+    }
+    pthread_mutex_unlock(&h->enc_start_mutex);
+
+    return bBusy;
+}
+
+/* Enc thread only, the scanner goes on at the first IRAP of the new file.
+ * The index of the old one stays until the access units using it are back */
+static int i265e_extern_bs_swap_source(i265e_extern_bs_t *h)
+{
+    h265bs_index_t *idx = NULL;
+    char *name = NULL;
+    int fd = -1, start = 0;
+
+    if (h->retiredIndex) {
+        return -1;
+    }
+    pthread_mutex_lock(&h->enc_start_mutex);
+    fd = h->swapFd;
+    idx = h->swapIndex;
+    name = h->swapName;
+    h->swapFd = -1;
+    h->swapIndex = NULL;
+    h->swapName = NULL;
+    h->swapState = I265E_EXT_SWAP_IDLE;
+    pthread_mutex_unlock(&h->enc_start_mutex);
+
+    /* set_fd always takes the fd, it reads from the start if the seek fails */
+    start = idx->key[0];
+    h265bs_ingest_set_fd(h->ingest, fd);
+    if (start > 0 && h265bs_ingest_seek(h->ingest, idx->au[start].off) < 0) {
+        printf("i265ext:seek %s to au %d failed:%s, it plays from its start\n", name, start, strerror(errno));
+        start = 0;
+    }
+    H265BS_TRACE_INSTANT("swap", h->traceChn, h->frameNum + h->ptsOffset);
+    close(h->bsFd);
+    h->bsFd = fd;
+    h->bsFileSize = idx->fileSize;
+    h->retiredIndex = h->index;
+    if (h->index == NULL) {
+        h265bs_index_free(idx);
+        idx = NULL;
+    }
+    h->index = idx;
+    h->ptsOffset += h->frameNum - start;
+    h->frameNum = start;
+    h->startPtr = NULL;
+    h->endPtr = h->bsBuf;
+    h->bsBufOccupy = 0;
+    h->bInputEof = 0;
+    h->bSwapIrap = 1;
+    h265bs_slice_restart(h->slice);
+    h->swapCnt++;
+
+    pthread_mutex_lock(&h->enc_start_mutex);
+    free(h->srcName);
+    h->srcName = name;
+    pthread_mutex_unlock(&h->enc_start_mutex);
+
+    return 0;
+}
+
+/* Source swap only, 1 drops the access unit. The old file plays up to its
+ * next IRAP, which is dropped for the first IRAP of the new one. A CRA
+ * there turns into BLA_W_LP and its RASL pictures are dropped, like at a
+ * playlist splice */
+static int i265e_extern_bs_swap(i265e_extern_bs_t *h, i265e_extern_au_t *au, int *bSwap)
+{
+    uint32_t type = 0;
+    int i = 0;
+
+    for (i = 0; i < au->nalCnt && !h265bs_nal_is_vcl(au->nal[i].i_type); i++);
+    type = (i < au->nalCnt) ? au->nal[i].i_type : I265E_NAL_INVALID;
+
+    if (h->bSwapIrap) {
+        h->bSwapIrap = 0;
+        h->bSkipRasl = (type == I265E_NAL_CODED_SLICE_CRA);
+        au->flags |= I265E_EXT_AU_F_SWAP;
+        for (i = 0; i < au->nalCnt; i++) {
+            if (au->nal[i].i_type == I265E_NAL_CODED_SLICE_CRA) {
+                i265e_extern_bs_cra_to_bla(&au->nal[i]);
+            }
+        }
+        return 0;
+    }
+    if (h->bSkipRasl) {
+        if ((type == I265E_NAL_CODED_SLICE_RASL_N) || (type == I265E_NAL_CODED_SLICE_RASL_R)) {
+            /* the frame of the file is gone, pts goes on without a gap */
+            i265e_extern_bs_next_frame(h);
+            h->ptsOffset--;
+            h->swapDropCnt++;
+            return 1;
+        }
+        h->bSkipRasl = !h265bs_nal_is_irap(type);
+    }
+    if (*bSwap && h265bs_nal_is_irap(type) && i265e_extern_bs_swap_source(h) == 0) {
+        *bSwap = 0;
+        return 1;
+    }
+    return 0;
+}
+
+/* Slice type and POC of the first slice segment into au, its QP into pic. With an index
+ * they are parsed once per access unit of the file and kept in its entry.
+ * It runs before the super frame policy, a cached payload standing in for
+ * the one of pts keeps what pts had */
+static void i265e_extern_bs_pic_info(i265e_extern_bs_t *h, i265e_extern_au_t *au, h265bs_index_t *idx, int fd, int auIdx)
+{
+    h265bs_slice_info_t info, next;
+    h265bs_index_au_t *ia = NULL;
+    int i = 0;
+
+    memset(&info, 0, sizeof(info));
+    info.sliceType = -1;
+    if (idx) {
+        if (h265bs_index_slice(idx, fd, auIdx, au->nalBuf, au->nalBufOccupy) == 0) {
+            ia = &idx->au[auIdx];
+            info.nalType = ia->type;
+            info.sliceType = ia->sliceType;
+            info.qp = ia->qp;
+            info.poc = ia->poc;
+        }
+    } else {
+        /* every nal goes through, parameter sets and end of sequence count */
+        for (i = 0; i < au->nalCnt; i++) {
+            if (h265bs_slice_nal(h->slice, au->nal[i].p_payload, au->nal[i].i_payload, &next) == 1 && info.sliceType < 0) {
+                info = next;
+            }
+        }
+    }
+
+    switch (info.sliceType) {
+    case H265BS_SLICE_I:
+        au->sliceType = h265bs_nal_is_idr(info.nalType) ? I265E_TYPE_IDR : I265E_TYPE_I;
+        break;
+    case H265BS_SLICE_P:
+        au->sliceType = I265E_TYPE_P;
+        break;
+    case H265BS_SLICE_B:
+        /* the _R nal types of the sub-layer reference pictures are odd */
+        au->sliceType = (info.nalType & 0x01) ? I265E_TYPE_BREF : I265E_TYPE_B;
+        break;
+    default:
+        au->sliceType = I265E_TYPE_AUTO;
+        au->pic.qp = -1;
+        au->poc = 0;
+        return;
+    }
+    au->pic.qp = info.qp;
+    au->poc = info.poc;
+}
+
+static void i265e_extern_bs_next_frame(i265e_extern_bs_t *h)
+{
+    h->frameNum++;
+    if (h->index && h->frameNum == h->index->auCnt) {
+        h->frameNum = 0;
+    }
+}
+
+/* Enc thread only, one frame while the companion stands in. Its frames are
+ * read with pread and not cached: it plays a whole GOP up to the next IDR of
+ * the file, not one picture, and the page cache already keeps what a forced
+ * IDR asks for again. The first one gets the parameter sets of the companion
+ * in front, the IDR of the file the ones of the file on the way back */
+static int i265e_extern_bs_intra_write(i265e_extern_bs_t *h, i265e_extern_au_t *au)
+{
+    h265bs_index_t *idx = h->intraIndex;
+    int fd = h->intraFd, auIdx = h->frameNum, prefix = 0, ret = 0;
+
+    if (auIdx == h->intraUntil) {
+        idx = h->index;
+        fd = h->bsFd;
+    }
+    if (idx != h->intraIndex || h->bIntraFirst) {
+        prefix = i265e_extern_bs_read_ps(h, fd, idx, auIdx, au);
+        if (prefix < 0) {
+            h->bEos = 1;
+            return -1;
+        }
+    }
+    h->bIntraFirst = 0;
+
+    ret = i265e_extern_bs_read_au(h, fd, &idx->au[auIdx], prefix, au);
+    au->pic.pts = auIdx + h->ptsOffset;
+    au->indexAu = &idx->au[auIdx];
+    if (ret == 0) {
+        i265e_extern_bs_pic_info(h, au, idx, fd, auIdx);
+    }
+    i265e_extern_bs_next_frame(h);
+    if (idx == h->intraIndex) {
+        h->intraAuCnt++;
+    } else {
+        /* the scanner goes on behind the IDR */
+        i265e_extern_bs_seek_au(h, h->frameNum);
+        h->intraUntil = -1;
+    }
+    return ret;
+}
+
+static int i265e_extern_bs_au_copy(uint8_t *dstBuf, i265e_nal_t **dst, int *dstCap, const i265e_nal_t *src, int nalCnt)
+{
+    int i = 0, occupy = 0;
+
+    if (i265e_extern_bs_nal_reserve(dst, dstCap, nalCnt) < 0) {
+        return -1;
+    }
+    for (i = 0; i < nalCnt; i++) {
+        (*dst)[i].i_type = src[i].i_type;
+        (*dst)[i].i_payload = src[i].i_payload;
+        (*dst)[i].p_payload = dstBuf + occupy;
+        memcpy((*dst)[i].p_payload, src[i].p_payload, src[i].i_payload);
+        occupy += src[i].i_payload;
+    }
+    return 0;
+}
+
+/* An access unit the scanner could not carry whole, 1 when it is dropped.
+ * pts leaves a gap like for a discarded super frame */
+static int i265e_extern_bs_oversize(i265e_extern_bs_t *h)
+{
+    if (!h->bAuOversize) {
+        return 0;
+    }
+    printf("i265ext:access unit of frame %lld over bsBufSize=%d dropped\n", (long long)h->frameNum, h->bsBufSize);
+    h->oversizeCnt++;
+    i265e_extern_bs_next_frame(h);
+    return 1;
+}
+
+/* 1 when bits more keep the access units which passed the policy under
+ * rc.bitrate at outFps, always without both */
+static int i265e_extern_bs_super_budget(i265e_extern_bs_t *h, int64_t bits)
+{
+    if (h->param.rc.bitrate <= 0 || h->param.outFpsNum <= 0 || h->param.outFpsDen <= 0) {
+        return 0;
+    }
+    return (h->superBits + bits) * h->param.outFpsNum
+        <= (h->superAuCnt + 1) * h->param.rc.bitrate * 1000LL * h->param.outFpsDen;
+}
+
+/* Slice header info of a fresh access unit of the scanner into au, then the
+ * super frame policy, 1 when it is dropped. The threshold and the cache
+ * follow the slice type, the IRAP flag when it could not be parsed. Every
+ * access unit under its threshold refreshes the cache the REENCODE mode
+ * draws from. An IRAP is never dropped, what follows refers to it */
+static int i265e_extern_bs_superfrm(i265e_extern_bs_t *h, i265e_extern_au_t *au)
+{
+    i265e_extern_superfrm_cache_t *cache = NULL;
+    int bIrap = 0, type = 0, thresd = 0, mode = h->superFrm.mode;
+
+    i265e_extern_bs_pic_info(h, au, h->index, h->bsFd, h->frameNum);
+    if (mode == I265E_EXT_SUPERFRM_NONE) {
+        return 0;
+    }
+    bIrap = i265e_extern_bs_au_irap(au);
+    if (au->sliceType == I265E_TYPE_AUTO) {
+        type = bIrap ? 0 : 1;
+    } else {
+        type = IS_I265E_TYPE_I(au->sliceType) ? 0 : IS_I265E_TYPE_B(au->sliceType) ? 2 : 1;
+    }
+    thresd = type == 0 ? h->superFrm.iframe_bits_thresd
+        : type == 1 ? h->superFrm.pframe_bits_thresd : h->superFrm.bframe_bits_thresd;
+    cache = &h->superCache[type];
+
+    if (thresd > 0 && (int64_t)au->nalBufOccupy * 8 > thresd && h->superFrm.priority == I265E_EXT_SUPERFRM_PRIO_BITRATE
+            && i265e_extern_bs_super_budget(h, (int64_t)au->nalBufOccupy * 8)) {
+        h->superBudgetCnt++;
+        thresd = 0;
+    }
+    if (thresd <= 0 || (int64_t)au->nalBufOccupy * 8 <= thresd) {
+        h->superBits += (int64_t)au->nalBufOccupy * 8;
+        h->superAuCnt++;
+        if (h->superFrm.mode == I265E_EXT_SUPERFRM_REENCODE) {
+            if (cache->buf == NULL && (cache->buf = malloc(h->bsBufSize)) == NULL) {
+                printf("i265ext:malloc super frame cache failed\n");
+                return 0;
+            }
+            if (i265e_extern_bs_au_copy(cache->buf, &cache->nal, &cache->nalCap, au->nal, au->nalCnt) < 0) {
+                cache->size = 0;
+                return 0;
+            }
+            cache->nalCnt = au->nalCnt;
+            cache->vclCnt = au->vclCnt;
+            cache->size = au->nalBufOccupy;
+        }
+        return 0;
+    }
+
+    h->superCnt++;
+    if (mode == I265E_EXT_SUPERFRM_DISCARD && bIrap) {
+        h->superKeepCnt++;
+        mode = I265E_EXT_SUPERFRM_FLAG;
+    }
+    switch (mode) {
+    case I265E_EXT_SUPERFRM_DISCARD:
+        h->superDropCnt++;
+        h->superAuCnt++;
+        i265e_extern_bs_next_frame(h);
+        return 1;
+    case I265E_EXT_SUPERFRM_REENCODE:
+        if (cache->size > 0 && i265e_extern_bs_au_copy(au->nalBuf, &au->nal, &au->nalCap, cache->nal, cache->nalCnt) == 0) {
+            au->nalCnt = cache->nalCnt;
+            au->vclCnt = cache->vclCnt;
+            au->nalBufOccupy = cache->size;
+            au->flags |= I265E_EXT_AU_F_SUPERFRM | I265E_EXT_AU_F_SUBST;
+            h->superSubstCnt++;
+            break;
+        }
+        h->superMissCnt++;
+        au->flags |= I265E_EXT_AU_F_SUPERFRM;
+        break;
+    default:
+        au->flags |= I265E_EXT_AU_F_SUPERFRM;
+        break;
+    }
+    h->superBits += (int64_t)au->nalBufOccupy * 8;
+    h->superAuCnt++;
+    return 0;
+}
+
+static int i265e_extern_bs_au_release(void *privData, void *releaseData)
+{
+    i265e_extern_bs_t *h = privData;
+    i265e_extern_au_t *au = releaseData;
+
+    if (h->pool) {
+        h265bs_pool_release(h->pool, au->nalBuf);
+    }
+    au->nalBuf = NULL;
+
+    pthread_mutex_lock(&h->enc_start_mutex);
+    h->freeAu[h->freeAuCnt++] = au;
+    pthread_cond_signal(&h->enc_start_cond);
+    pthread_mutex_unlock(&h->enc_start_mutex);
+
+    return 0;
+}
+
+/* Hand an access unit to get_bitstream, bEos also tells it nothing follows */
+static void i265e_extern_bs_queue(i265e_extern_bs_t *h, i265e_extern_au_t *au, int bEos)
+{
+    pthread_mutex_lock(&h->enc_end_mutex);
+    if (au) {
+        H265BS_TRACE_INSTANT("enqueue", h->traceChn, au->pic.pts);
+        au->readyTime = i265e_extern_bs_mdate();
+        h->readyAu[(h->readyAuIdx + h->readyAuCnt) % h->auNum] = au;
+        h->readyAuCnt++;
+    }
+    if (bEos) {
+        h->bEosReady = 1;
+        pthread_cond_broadcast(&h->enc_end_cond);
+    } else {
+        pthread_cond_signal(&h->enc_end_cond);
+    }
+    pthread_mutex_unlock(&h->enc_end_mutex);
+}
+
+static void i265e_extern_bs_au_ready(void *arg)
+{
+    i265e_extern_au_timer_t *t = arg;
+
+    i265e_extern_bs_queue(t->h, t->au, t->bEos);
+}
+
+/* nuh_temporal_id_plus1 of the first vcl nal, behind its start code */
+static int i265e_extern_bs_au_tid_plus1(i265e_extern_au_t *au)
+{
+    uint8_t *p = NULL;
+    int i = 0;
+
+    for (i = 0; i < au->nalCnt; i++) {
+        if (h265bs_nal_is_vcl(au->nal[i].i_type)) {
+            p = au->nal[i].p_payload;
+            return H265BS_NAL_TID_PLUS1(p + (p[2] == 1 ? 3 : 4));
+        }
+    }
+    return 1;
+}
+
+static int i265e_extern_bs_au_irap(i265e_extern_au_t *au)
+{
+    int i = 0;
+
+    for (i = 0; i < au->nalCnt; i++) {
+        if (h265bs_nal_is_irap(au->nal[i].i_type)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Without a timing model the access unit is ready at once. With one it is
+ * captured at its frame time under outFps, or now, and queued when the
+ * emulated encoder would have it out */
+static void i265e_extern_bs_deliver(i265e_extern_bs_t *h, i265e_extern_au_t *au, int bEos)
+{
+    i265e_extern_au_timer_t *t = NULL;
+    int64_t arrival = 0, done = 0;
+
+    if (h->cfg.tmodel == NULL) {
+        i265e_extern_bs_queue(h, au, bEos);
+        return;
+    }
+
+    if (au) {
+        if (h->param.outFpsNum > 0 && h->param.outFpsDen > 0) {
+            if (h->tmFrame == 0) {
+                h->tmStart = i265e_extern_bs_mdate();
+            }
+            arrival = h->tmStart + h->tmFrame * 1000000 * h->param.outFpsDen / h->param.outFpsNum;
+        } else {
+            arrival = i265e_extern_bs_mdate();
+        }
+        h->tmFrame++;
+        done = h265bs_tmodel_done_time(h->cfg.tmodel, arrival, au->nalBufOccupy, i265e_extern_bs_au_irap(au));
+        h->tmLastDone = C_MAX(h->tmLastDone, done);
+    }
+    t = au ? &h->auTimer[au - h->au] : &h->auTimer[h->auNum];
+    t->au = au;
+    t->bEos = bEos;
+    t->timer.expire = h->tmLastDone;
+    h265bs_tmodel_add_timer(h->cfg.tmodel, &t->timer);
+}
+
+/* Enc thread only, its counters as get_param gives them to other threads */
+static void i265e_extern_bs_pub_stat(i265e_extern_bs_t *h)
+{
+    pthread_mutex_lock(&h->enc_start_mutex);
+    h->stat.frameNum = h->frameNum;
+    h->stat.lastPts = h->lastPts;
+    h->stat.auCnt = h->auCnt;
+    h->stat.idrReqCnt = h->idrReqCnt;
+    h->stat.seekCnt = h->seekCnt;
+    h->stat.swapCnt = h->swapCnt;
+    h->stat.spliceCnt = h->spliceCnt;
+    h->stat.superCnt = h->superCnt;
+    h->stat.rendSwitchCnt = h->rendSwitchCnt;
+    pthread_mutex_unlock(&h->enc_start_mutex);
+}
+
+int i265e_extern_bs_enc(i265e_extern_bs_t *h)
+{
+    i265e_extern_au_t *au = NULL;
+    int ret = 0, speed = 0, rend = 0, idr = 0, swap = 0, seek = -1;
+    int64_t pts = -1, pauseStart = 0;
+
+    pthread_mutex_lock(&h->enc_start_mutex);
+    while ((h->freeAuCnt == 0 || h->bPause) && !h->bStop) {
+        if (h->bPause && pauseStart == 0) {
+            pauseStart = i265e_extern_bs_mdate();
+        }
+        pthread_cond_wait(&h->enc_start_cond, &h->enc_start_mutex);
+    }
+    if (h->bStop) {
+        pthread_mutex_unlock(&h->enc_start_mutex);
+        return -1;
+    }
+    au = h->freeAu[--h->freeAuCnt];
+    /* set_param only stores the requests, what they need of the index is
+     * checked here where it can not change underneath */
+    if (h->trickReq != h->trickSpeed && h->trickReq != 1 && h->index->keyCnt == 0) {
+        printf("i265ext:trick speed %d needs keyframes in the index, ignored\n", h->trickReq);
+        h->trickReq = h->trickSpeed;
+    }
+    speed = h->trickReq;
+    h->superFrm = h->superReq;
+    rend = h->rendReq;
+    idr = h->idrReq;
+    h->idrReq = 0;
+    swap = h->swapState == I265E_EXT_SWAP_READY;
+    seek = h->seekReq;
+    h->seekReq = -1;
+    au->indexAu = NULL;
+    pthread_mutex_unlock(&h->enc_start_mutex);
+    H265BS_TRACE_BEGIN("enc", h->traceChn, -1);
+
+    /* capture times go on after the pause instead of catching up */
+    if (pauseStart) {
+        h->tmStart += i265e_extern_bs_mdate() - pauseStart;
+    }
+
+    if (speed != h->trickSpeed) {
+        i265e_extern_bs_trick_switch(h, speed);
+    }
+    if (rend != h->rendIdx && h->trickSpeed == 1 && h->intraUntil < 0) {
+        i265e_extern_bs_rend_switch(h, rend);
+    }
+    if (idr && h->trickSpeed == 1 && h->index) {
+        i265e_extern_bs_force_idr(h);
+    }
+    if (seek >= 0 && h->index && h->intraUntil < 0) {
+        i265e_extern_bs_seek(h, seek);
+    }
+    if (h->retiredIndex && !i265e_extern_bs_index_busy(h, h->retiredIndex)) {
+        h265bs_index_free(h->retiredIndex);
+        h->retiredIndex = NULL;
+    }
+
+    /* a free au slot guarantees a free pool block, this never waits */
+    au->nalBuf = h->pool ? h265bs_pool_get(h->pool, 1) : h->userNalBuf;
+    au->flags = 0;
+    if (h->trickSpeed != 1) {
+        ret = i265e_extern_bs_trick_write(h, au);
+        /* output clock, a keyframe emitted again gets a pts of its own */
+        au->pic.pts = h->lastPts + 1;
+        au->indexAu = &h->index->au[h->trickAu];
+        if (ret == 0) {
+            i265e_extern_bs_pic_info(h, au, h->index, h->bsFd, h->trickAu);
+        }
+    } else if (h->intraUntil >= 0) {
+        ret = i265e_extern_bs_intra_write(h, au);
+    } else {
+        H265BS_TRACE_BEGIN("scan", h->traceChn, -1);
+        while ((ret = i265e_extern_bs_slice_write(h, au)) == 0
+                && (i265e_extern_bs_oversize(h)
+                    || (h->ps == NULL && (swap || h->bSwapIrap || h->bSkipRasl) && i265e_extern_bs_swap(h, au, &swap))
+                    || (h->ps && i265e_extern_bs_splice(h, au))
+                    || i265e_extern_bs_superfrm(h, au)));
+        H265BS_TRACE_END("scan", h->traceChn, -1);
+        au->pic.pts = h->frameNum + h->ptsOffset;
+        au->indexAu = h->index ? &h->index->au[h->frameNum] : NULL;
+        i265e_extern_bs_next_frame(h);
+    }
+    if (ret == 0 && h->cfg.hashType != H265BS_HASH_NONE) {
+        au->checksum = h265bs_hash(h->cfg.hashType, au->nalBuf, au->nalBufOccupy);
+    }
+    /* filler nals point outside nalBuf, nalBufOccupy stays the source bytes */
+    if (ret == 0 && h->cbr) {
+        i265e_extern_bs_nal_reserve(&au->nal, &au->nalCap, au->nalCnt + 1);
+        au->nalCnt += h265bs_cbr_pad(h->cbr, au - h->au, au->nalBufOccupy, i265e_extern_bs_au_tid_plus1(au),
+                au->nal + au->nalCnt, au->nalCap - au->nalCnt);
+    }
+    if (ret < 0) {
+        au->pic.releaseFunc(au->pic.privData, au->pic.releaseData);
+    }
+    /* the consumer may have the access unit back before deliver returns */
+    pts = ret == 0 ? au->pic.pts : -1;
+    if (ret == 0) {
+        h->auCnt++;
+        h->lastPts = pts;
+    }
+    i265e_extern_bs_pub_stat(h);
+    if (h->bEos || ret == 0) {
+        i265e_extern_bs_deliver(h, ret == 0 ? au : NULL, h->bEos);
+    }
+    H265BS_TRACE_END("enc", h->traceChn, pts);
+    return h->bEos ? -1 : 0;
+}
+
+int i265e_extern_bs_get_bitstream(i265e_extern_bs_t *h, i265e_nal_t **pp_nal, int *pi_nal, i265e_pic_t **pic_out, void **bshandler)
+{
+    i265e_extern_au_t *au = NULL;
+
+    H265BS_TRACE_BEGIN("get_bitstream", h->traceChn, -1);
+    pthread_mutex_lock(&h->enc_end_mutex);
+    while (h->readyAuCnt == 0 && !h->bStop && !h->bEosReady) {
+        pthread_cond_wait(&h->enc_end_cond, &h->enc_end_mutex);
+    }
+    if (h->readyAuCnt == 0) {
+        pthread_mutex_unlock(&h->enc_end_mutex);
+        H265BS_TRACE_END("get_bitstream", h->traceChn, -1);
+        return -1;
+    }
+    au = h->readyAu[h->readyAuIdx];
+    h->readyAuIdx = (h->readyAuIdx + 1) % h->auNum;
+    h->readyAuCnt--;
+    pthread_mutex_unlock(&h->enc_end_mutex);
+
+    *pp_nal = au->nal;
+    *pi_nal = au->nalCnt;
+    *pic_out = &au->pic;
+    *bshandler = au;
+    H265BS_TRACE_END("get_bitstream", h->traceChn, au->pic.pts);
+
+    return 0;
+}
+
+int i265e_extern_bs_release_bitstream(i265e_extern_bs_t *h, void *bshandler)
+{
+    i265e_extern_au_t *au = bshandler;
+    int64_t pts = au->pic.pts;
+    int ret = 0;
+
+    H265BS_TRACE_BEGIN("release_bitstream", h->traceChn, pts);
+    /* what the consumer would set on the next pic_in of an encoder */
+    if (au->pic.bForceIDR) {
+        au->pic.bForceIDR = 0;
+        pthread_mutex_lock(&h->enc_start_mutex);
+        h->idrReq = 1;
+        pthread_mutex_unlock(&h->enc_start_mutex);
+    }
+
+    ret = au->pic.releaseFunc(au->pic.privData, au->pic.releaseData);
+    H265BS_TRACE_END("release_bitstream", h->traceChn, pts);
+    return ret;
+}
+
+void i265e_extern_bs_stop(i265e_extern_bs_t *h)
+{
+    pthread_mutex_lock(&h->enc_start_mutex);
+    h->bStop = 1;
+    pthread_cond_broadcast(&h->enc_start_cond);
+    pthread_mutex_unlock(&h->enc_start_mutex);
+
+    pthread_mutex_lock(&h->enc_end_mutex);
+    pthread_cond_broadcast(&h->enc_end_cond);
+    pthread_mutex_unlock(&h->enc_end_mutex);
+}
+
+int i265e_extern_bs_channel(i265e_extern_bs_t *h)
+{
+    return h->traceChn;
+}
+
+const h265bs_index_t *i265e_extern_bs_get_index(i265e_extern_bs_t *h)
+{
+    return h->index;
+}
+
+int i265e_extern_bs_get_param(i265e_extern_bs_t *h, int param_id, void *param)
+{
+    i265e_extern_rcfg_trick_param_t *trick = NULL;
+    i265e_extern_rcfg_source_param_t *src = NULL;
+    i265e_extern_stat_t *stat = NULL;
+    i265e_rcfg_rc_param_t *rc = NULL;
+
+    switch (param_id) {
+    case I265E_EXT_RCFG_TRICK_ID:
+        trick = param;
+        pthread_mutex_lock(&h->enc_start_mutex);
+        trick->speed = h->trickReq;
+        pthread_mutex_unlock(&h->enc_start_mutex);
+        return 0;
+    case I265E_EXT_RCFG_SOURCE_ID:
+        src = param;
+        pthread_mutex_lock(&h->enc_start_mutex);
+        snprintf(src->name, sizeof(src->name), "%s", h->ps ? h->cfg.playlist[h->playIdx]
+                : h->rend ? h->cfg.rendition[h->rendIdx] : h->srcName);
+        src->bPending = h->swapState != I265E_EXT_SWAP_IDLE;
+        pthread_mutex_unlock(&h->enc_start_mutex);
+        return 0;
+    case I265E_EXT_RCFG_PAUSE_ID:
+        pthread_mutex_lock(&h->enc_start_mutex);
+        *(int *)param = h->bPause;
+        pthread_mutex_unlock(&h->enc_start_mutex);
+        return 0;
+    case I265E_EXT_RCFG_SEEK_ID:
+        pthread_mutex_lock(&h->enc_start_mutex);
+        *(int *)param = h->seekReq;
+        pthread_mutex_unlock(&h->enc_start_mutex);
+        return 0;
+    case I265E_EXT_RCFG_STAT_ID:
+        /* the enc thread counters as of its last access unit */
+        stat = param;
+        pthread_mutex_lock(&h->enc_start_mutex);
+        *stat = h->stat;
+        stat->freeCnt = h->freeAuCnt;
+        stat->speed = h->trickReq;
+        stat->bPaused = h->bPause;
+        pthread_mutex_unlock(&h->enc_start_mutex);
+        pthread_mutex_lock(&h->enc_end_mutex);
+        stat->readyCnt = h->readyAuCnt;
+        pthread_mutex_unlock(&h->enc_end_mutex);
+        return 0;
+    case I265E_RCFG_SUPER_ID:
+        pthread_mutex_lock(&h->enc_start_mutex);
+        *(c_superfrm_param_t *)param = h->superReq;
+        pthread_mutex_unlock(&h->enc_start_mutex);
+        return 0;
+    case I265E_RCFG_ENIDR_ID:
+        pthread_mutex_lock(&h->enc_start_mutex);
+        *(int *)param = h->idrReq;
+        pthread_mutex_unlock(&h->enc_start_mutex);
+        return 0;
+    case I265E_RCFG_RC_ID:
+        /* the bitrate being delivered, a requested switch shows after its IDR */
+        rc = param;
+        memset(rc, 0, sizeof(*rc));
+        rc->rcMethod = h->param.rc.rateControlMode;
+        rc->qp = h->param.rc.qp;
+        pthread_mutex_lock(&h->enc_start_mutex);
+        rc->bitrate = h->rend ? h->rend[h->rendIdx].kbps : h->param.rc.bitrate;
+        pthread_mutex_unlock(&h->enc_start_mutex);
+        return 0;
+    default:
+        printf("i265ext:get_param id %d is not supported\n", param_id);
+        return -1;
+    }
+}
+
+/* Takes effect at the next access unit the enc thread produces, the ones
+ * already queued for get_bitstream are still delivered. Any thread may call
+ * it, only what is fixed at init is checked here and the request is stored
+ * under enc_start_mutex, the enc thread checks it against the index in use */
+int i265e_extern_bs_set_param(i265e_extern_bs_t *h, int param_id, const void *param)
+{
+    const i265e_extern_rcfg_trick_param_t *trick = NULL;
+    const i265e_extern_rcfg_source_param_t *src = NULL;
+    const c_superfrm_param_t *superFrm = NULL;
+    const i265e_rcfg_rc_param_t *rc = NULL;
+    pthread_t tid;
+    int errnum = 0, bJoin = 0;
+
+    switch (param_id) {
+    case I265E_EXT_RCFG_TRICK_ID:
+        trick = param;
+        if (trick->speed == 0) {
+            printf("i265ext:trick speed 0 is not supported\n");
+            return -1;
+        }
+        if (trick->speed != 1 && !h->bIndexed) {
+            printf("i265ext:trick play needs an access unit index\n");
+            return -1;
+        }
+        pthread_mutex_lock(&h->enc_start_mutex);
+        h->trickReq = trick->speed;
+        pthread_mutex_unlock(&h->enc_start_mutex);
+        return 0;
+    case I265E_EXT_RCFG_SOURCE_ID:
+        src = param;
+        if (!h->bLoop || h->ps || h->rend || h->intraIndex) {
+            printf("i265ext:a source swap needs one seekable file, no playlist, ladder or all intra companion\n");
+            return -1;
+        }
+        pthread_mutex_lock(&h->enc_start_mutex);
+        if (h->swapState != I265E_EXT_SWAP_IDLE) {
+            pthread_mutex_unlock(&h->enc_start_mutex);
+            printf("i265ext:swap to %s is still pending\n", h->swapName);
+            return -1;
+        }
+        /* a swap thread which gave up is joined before the next one */
+        bJoin = h->bSwapThread;
+        tid = h->swapTid;
+        h->bSwapThread = 0;
+        pthread_mutex_unlock(&h->enc_start_mutex);
+        if (bJoin) {
+            pthread_join(tid, NULL);
+        }
+
+        pthread_mutex_lock(&h->enc_start_mutex);
+        h->swapName = strdup(src->name);
+        if (h->swapName == NULL) {
+            pthread_mutex_unlock(&h->enc_start_mutex);
+            printf("i265ext:strdup %s failed\n", src->name);
+            return -1;
+        }
+        h->swapState = I265E_EXT_SWAP_PREPARE;
+        if ((errnum = pthread_create(&h->swapTid, NULL, i265e_extern_bs_swap_thread, h)) != 0) {
+            printf("i265ext:pthread_create swap thread failed:%s\n", strerror(errnum));
+            free(h->swapName);
+            h->swapName = NULL;
+            h->swapState = I265E_EXT_SWAP_IDLE;
+            pthread_mutex_unlock(&h->enc_start_mutex);
+            return -1;
+        }
+        h->bSwapThread = 1;
+        pthread_mutex_unlock(&h->enc_start_mutex);
+        return 0;
+    case I265E_EXT_RCFG_PAUSE_ID:
+        pthread_mutex_lock(&h->enc_start_mutex);
+        h->bPause = !!*(const int *)param;
+        pthread_cond_broadcast(&h->enc_start_cond);
+        pthread_mutex_unlock(&h->enc_start_mutex);
+        return 0;
+    case I265E_EXT_RCFG_SEEK_ID:
+        if (!h->bIndexed || *(const int *)param < 0) {
+            printf("i265ext:seek to frame %d needs an access unit index\n", *(const int *)param);
+            return -1;
+        }
+        pthread_mutex_lock(&h->enc_start_mutex);
+        h->seekReq = *(const int *)param;
+        pthread_mutex_unlock(&h->enc_start_mutex);
+        return 0;
+    case I265E_RCFG_SUPER_ID:
+        superFrm = param;
+        if (superFrm->mode < I265E_EXT_SUPERFRM_NONE || superFrm->mode > I265E_EXT_SUPERFRM_FLAG
+                || superFrm->priority < I265E_EXT_SUPERFRM_PRIO_FRAMEBITS || superFrm->priority > I265E_EXT_SUPERFRM_PRIO_BITRATE) {
+            printf("i265ext:super frame mode %d, priority %d is not supported\n", superFrm->mode, superFrm->priority);
+            return -1;
+        }
+        pthread_mutex_lock(&h->enc_start_mutex);
+        h->superReq = *superFrm;
+        pthread_mutex_unlock(&h->enc_start_mutex);
+        return 0;
+    case I265E_RCFG_ENIDR_ID:
+        if (!h->bIndexed) {
+            printf("i265ext:forced IDR needs an access unit index\n");
+            return -1;
+        }
+        pthread_mutex_lock(&h->enc_start_mutex);
+        h->idrReq = h->idrReq || *(const int *)param;
+        pthread_mutex_unlock(&h->enc_start_mutex);
+        return 0;
+    case I265E_RCFG_RC_ID:
+        rc = param;
+        if (h->rend == NULL || rc->bitrate <= 0) {
+            printf("i265ext:bitrate %d needs a rendition ladder\n", rc->bitrate);
+            return -1;
+        }
+        pthread_mutex_lock(&h->enc_start_mutex);
+        h->rendReq = i265e_extern_bs_rend_closest(&h->cfg, rc->bitrate);
+        pthread_mutex_unlock(&h->enc_start_mutex);
+        return 0;
+    default:
+        printf("i265ext:set_param id %d is not supported\n", param_id);
+        return -1;
+    }
+}
+
+void i265e_extern_bs_dump_stat(i265e_extern_bs_t *h)
+{
+    h265bs_mem_info_t info;
+
+    h265bs_mem_get_info(h->bsBuf, &info);
+    printf("i265ext:bsBuf %s pages on node %d, mapSize=%zu\n", h265bs_mem_page_name(info.pageType), info.node, info.mapSize);
+    h265bs_ingest_dump_stat(h->ingest);
+    h265bs_index_dump(h->index);
+    if (h->cfg.tmodel) {
+        h265bs_tmodel_dump_stat(h->cfg.tmodel);
+    }
+    if (h->cbr) {
+        h265bs_cbr_dump_stat(h->cbr);
+    }
+    if (h->idrReqCnt > 0) {
+        printf("i265ext:forced IDR idrReqCnt=%llu, idrJumpCnt=%llu, intraAuCnt=%llu\n", (unsigned long long)h->idrReqCnt,
+                (unsigned long long)h->idrJumpCnt, (unsigned long long)h->intraAuCnt);
+    }
+    if (h->seekCnt > 0) {
+        printf("i265ext:seekCnt=%llu\n", (unsigned long long)h->seekCnt);
+    }
+    if (h->oversizeCnt > 0) {
+        printf("i265ext:access units over bsBufSize=%d dropped, oversizeCnt=%llu\n", h->bsBufSize, (unsigned long long)h->oversizeCnt);
+    }
+    if (h->rend) {
+        printf("i265ext:rendition %d of %d at %d kbps, rendSwitchCnt=%llu\n", h->rendIdx, h->cfg.renditionCnt,
+                h->rend[h->rendIdx].kbps, (unsigned long long)h->rendSwitchCnt);
+    }
+    if (h->superCnt > 0 || h->superFrm.mode != I265E_EXT_SUPERFRM_NONE) {
+        printf("i265ext:super frame mode=%d, priority=%d, superCnt=%llu, superDropCnt=%llu, superSubstCnt=%llu, superMissCnt=%llu, "
+                "superKeepCnt=%llu, superBudgetCnt=%llu\n",
+                h->superFrm.mode, h->superFrm.priority, (unsigned long long)h->superCnt, (unsigned long long)h->superDropCnt,
+                (unsigned long long)h->superSubstCnt, (unsigned long long)h->superMissCnt,
+                (unsigned long long)h->superKeepCnt, (unsigned long long)h->superBudgetCnt);
+    }
+    if (h->swapCnt > 0 || h->swapFailCnt > 0) {
+        printf("i265ext:source %s, swapCnt=%llu, swapFailCnt=%llu, swapDropCnt=%llu\n", h->srcName,
+                (unsigned long long)h->swapCnt, (unsigned long long)h->swapFailCnt, (unsigned long long)h->swapDropCnt);
+    }
+    if (h->ps) {
+        printf("i265ext:playlist of %d, spliceCnt=%llu, spliceDropCnt=%llu\n", h->cfg.playlistCnt,
+                (unsigned long long)h->spliceCnt, (unsigned long long)h->spliceDropCnt);
+        h265bs_ps_dump_stat(h->ps);
+    }
+    if (h->pool) {
+        h265bs_pool_dump_stat(h->pool);
+    }
+}
+
+void *i265e_extern_bs_enc_thread(void *arg)
+{
+    i265e_extern_bs_t *h = arg;
+
+    h265bs_trace_thread_name("enc");
+    if (h->cfg.numaNode != H265BS_MEM_NODE_ANY) {
+        h265bs_mem_bind_thread(h->cfg.numaNode);
+    }
+    while (i265e_extern_bs_enc(h) == 0);
+    return NULL;
+}
@@ -0,0 +1,159 @@
+#ifndef __I265E_EXTERN_BS_H__
+#define __I265E_EXTERN_BS_H__
+
+#include <stdint.h>
+
+#include "i265e.h"
+#include "h265bs_index.h"
+#include "h265bs_tmodel.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define I265E_EXT_NAL_CAP           32      /* nal slots of an access unit at init, they grow with it */
+#define I265E_EXT_NALBUF_NUM        4
+#define I265E_EXT_NAME_MAX          4096
+
+typedef struct i265e_extern_bs i265e_extern_bs_t;
+
+/* replay side settings which have no home in i265e_param_t */
+typedef struct {
+    int bsBufSize;          /* also the largest access unit, a bigger one is dropped and fails the index */
+    int nalBufNum;
+    int memFlags;           /* H265BS_MEM_F_* for bsBuf and the nal pool */
+    int numaNode;           /* H265BS_MEM_NODE_ANY or node of buffers, enc and read-ahead threads */
+    int ingestMode;         /* h265bs_ingest_mode_t */
+    int ingestDepth;        /* reads kept in flight */
+    int ingestReadSize;     /* bytes of one read-ahead */
+    int64_t ingestWindowSize;   /* bytes mapped at once by the mmap ingest, 0 for the default */
+    int bIndex;             /* scan the file at init for the access unit and keyframe table */
+    char **playlist;        /* files spliced into one looped stream instead of bsname, kept by the caller */
+    int playlistCnt;
+    int hashType;           /* h265bs_hash_type_t of au->checksum and the index */
+    h265bs_tmodel_t *tmodel;    /* hardware timing emulation shared by channels, NULL delivers at once */
+    char **rendition;       /* aligned encodes of one content played instead of bsname, kept by the caller */
+    int *renditionKbps;     /* bitrate of each rendition, I265E_RCFG_RC_ID picks the closest */
+    int renditionCnt;
+    char *intraName;        /* all IDR encode aligned with bsname, a forced IDR is taken from it */
+} i265e_extern_bs_cfg_t;
+
+/* set_param/get_param ids of the replay engine, kept clear of i265e_rcfg_type_t */
+typedef enum {
+    I265E_EXT_RCFG_TRICK_ID     = 0x100,    /* i265e_extern_rcfg_trick_param_t */
+    I265E_EXT_RCFG_SOURCE_ID    = 0x101,    /* i265e_extern_rcfg_source_param_t */
+    I265E_EXT_RCFG_PAUSE_ID     = 0x102,    /* int, non zero holds the enc thread before its next access unit */
+    I265E_EXT_RCFG_SEEK_ID      = 0x103,    /* int, frame of the file, the keyframe at or before it plays next */
+    I265E_EXT_RCFG_STAT_ID      = 0x104,    /* i265e_extern_stat_t, get_param only */
+} i265e_extern_rcfg_type_t;
+
+/* speed 1 is normal playback. Any other speed emits IRAP access units only,
+ * the keyframe at or before a position which moves speed frames per emitted
+ * access unit, backwards when negative. Needs cfg.bIndex. pts is the output
+ * clock, one up per access unit emitted in trick play and going on from
+ * there back at speed 1, like across a seek, a forced IDR or a swap.
+ * indexAu gives the source position */
+typedef struct {
+    int speed;
+} i265e_extern_rcfg_trick_param_t;
+
+/* A new file in place of the one playing. It is opened and indexed in the
+ * background while the old one goes on, which plays up to its next IRAP,
+ * and the new one starts at its first IRAP with pts carrying on. One
+ * seekable file only, not a playlist, ladder or all intra companion.
+ * get_param gives the file playing and whether a swap is pending */
+typedef struct {
+    char name[I265E_EXT_NAME_MAX];
+    int bPending;
+} i265e_extern_rcfg_source_param_t;
+
+/* Snapshot of a channel, the counters run from init and are the ones of
+ * the last access unit the enc thread produced */
+typedef struct {
+    int64_t frameNum;       /* frame of the file the next streamed access unit is read from */
+    int64_t lastPts;        /* pts of the access unit produced last, -1 before the first */
+    uint64_t auCnt;         /* access units produced */
+    int readyCnt;           /* waiting for get_bitstream */
+    int freeCnt;            /* au slots the enc thread can fill */
+    int speed;
+    int bPaused;
+    uint64_t idrReqCnt;
+    uint64_t seekCnt;
+    uint64_t swapCnt;
+    uint64_t spliceCnt;
+    uint64_t superCnt;
+    uint64_t rendSwitchCnt;
+} i265e_extern_stat_t;
+
+/* c_superfrm_param_t.mode of the replay, an access unit over the bits
+ * threshold of its slice type (iframe_, pframe_ or bframe_bits_thresd, 0
+ * for none) is handled as the encoder would. The IRAP flag stands in for a
+ * slice type which could not be parsed. An IRAP is never dropped, the
+ * pictures behind it refer to it and its parameter sets, DISCARD delivers
+ * it flagged instead */
+typedef enum {
+    I265E_EXT_SUPERFRM_NONE     = 0,
+    I265E_EXT_SUPERFRM_DISCARD  = 1,    /* dropped, pts leaves a gap */
+    I265E_EXT_SUPERFRM_REENCODE = 2,    /* replaced by the last access unit of the same slice type under the threshold */
+    I265E_EXT_SUPERFRM_FLAG     = 3,    /* delivered as it is with I265E_EXT_AU_F_SUPERFRM */
+} i265e_extern_superfrm_mode_t;
+
+/* c_superfrm_param_t.priority of the replay */
+typedef enum {
+    I265E_EXT_SUPERFRM_PRIO_FRAMEBITS   = 0,    /* every access unit over its threshold is handled */
+    I265E_EXT_SUPERFRM_PRIO_BITRATE     = 1,    /* one which still keeps the stream under rc.bitrate at outFps passes */
+} i265e_extern_superfrm_priority_t;
+
+#define I265E_EXT_AU_F_SUPERFRM     0x01    /* over the super frame threshold */
+#define I265E_EXT_AU_F_SUBST        0x02    /* payload is a cached access unit, not the one of pts */
+#define I265E_EXT_AU_F_SWAP         0x04    /* first of a swapped in source, a CRA there became BLA_W_LP */
+
+/* One access unit on its way from the enc thread to the bitstream consumer,
+ * nalBuf is a pool block unless param.bUserNalbuf is set */
+typedef struct i265e_extern_au {
+    i265e_extern_bs_t *h;
+    uint8_t *nalBuf;
+    unsigned int nalBufOccupy;
+    i265e_nal_t *nal;
+    int nalCnt;
+    int nalCap;
+    int vclCnt;
+    int64_t readyTime;      /* i265e_extern_bs_mdate() when queued for get_bitstream */
+    uint64_t checksum;      /* h265bs_hash() of nalBuf, the nals back to back */
+    uint32_t flags;         /* I265E_EXT_AU_F_* */
+    const h265bs_index_au_t *indexAu;  /* entry of pts in the index it was read with, NULL without one */
+    /* of the first slice segment, pic.qp has its slice QP, i265e_pic_t stays
+     * the one of the encoder library */
+    int sliceType;          /* i265e_frame_type_t, I265E_TYPE_AUTO when it could not be parsed */
+    int poc;
+    i265e_pic_t pic;
+} i265e_extern_au_t;
+
+extern int64_t i265e_extern_bs_mdate(void);
+extern i265e_extern_bs_t *i265e_extern_bs_init(i265e_param_t *param, i265e_extern_bs_cfg_t *cfg, char *bsname, uint8_t *nal_buf);
+extern void i265e_extern_bs_deinit(i265e_extern_bs_t *h);
+extern void *i265e_extern_bs_enc_thread(void *arg);
+extern int i265e_extern_bs_get_bitstream(i265e_extern_bs_t *h, i265e_nal_t **pp_nal, int *pi_nal, i265e_pic_t **pic_out, void **bshandler);
+extern int i265e_extern_bs_release_bitstream(i265e_extern_bs_t *h, void *bshandler);
+extern void i265e_extern_bs_stop(i265e_extern_bs_t *h);
+/* NULL without cfg.bIndex. The index at init, a source swap retires it once
+ * no access unit out of get_bitstream points into it, so a thread other
+ * than the consumer goes through au->indexAu of an access unit it holds */
+extern const h265bs_index_t *i265e_extern_bs_get_index(i265e_extern_bs_t *h);
+/* h265bs_trace channel of the engine, for the trace points of its consumer */
+extern int i265e_extern_bs_channel(i265e_extern_bs_t *h);
+/* I265E_EXT_RCFG_* above, I265E_RCFG_SUPER_ID with a c_superfrm_param_t
+ * whose mode is an i265e_extern_superfrm_mode_t and thresholds are in bits,
+ * I265E_RCFG_RC_ID whose bitrate moves to the closest rendition at the
+ * next IDR, or I265E_RCFG_ENIDR_ID with an int, non zero makes the next
+ * access unit produced an IDR. pic_out->bForceIDR set before
+ * release_bitstream asks for the same */
+extern int i265e_extern_bs_get_param(i265e_extern_bs_t *h, int param_id, void *param);
+extern int i265e_extern_bs_set_param(i265e_extern_bs_t *h, int param_id, const void *param);
+extern void i265e_extern_bs_dump_stat(i265e_extern_bs_t *h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __I265E_EXTERN_BS_H__ */